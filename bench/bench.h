@@ -0,0 +1,47 @@
+/*
+=========================================================================================
+Name    | bench                                                                         |
+Purpose | Shared helpers and the workloads of the ehfbench executable                   |
+=========================================================================================
+*/
+#ifndef _EhFbEnCh__
+#define _EhFbEnCh__
+
+#include <vector>
+
+// Format the key and record used by the benchmarks for record number n.
+// key must hold IDSIZE+1 chars, record must hold RECORDSIZE+1 chars.
+// Hash() folds a key down to a few tens of thousands of values, so the keys are chosen
+// to hash to n itself. Numbers from 0 up to MAXBENCHKEYS are supported.
+const int MAXBENCHKEYS = 28300;
+void MakeKey(int n, char* key);
+void MakeRecord(int n, char* record);
+
+// Seconds elapsed on a monotonic clock
+double Now();
+
+// Print " p50_us=... p90_us=... p99_us=... p999_us=... max_us=..." for the times of
+// single operations, in seconds, which are sorted in place
+void PrintPercentiles(std::vector<double>& seconds);
+
+// Double the index of the container until it reaches depth
+bool DeepenIndex(char* containerFileName, int depth);
+
+// Workloads. Each is given the arguments following its name, and returns an exit code.
+int BenchReaders(int argc, char** argv);
+int BenchPartitions(int argc, char** argv);
+int BenchIndex(int argc, char** argv);
+int BenchOpen(int argc, char** argv);
+int BenchRebuild(int argc, char** argv);
+int BenchDurability(int argc, char** argv);
+int BenchDirect(int argc, char** argv);
+int BenchGet(int argc, char** argv);
+int BenchInserts(int argc, char** argv);
+int BenchMemory(int argc, char** argv);
+int BenchBatch(int argc, char** argv);
+int BenchAsync(int argc, char** argv);
+int BenchSuite(int argc, char** argv);
+int BenchYCSB(int argc, char** argv);
+int BenchScan(int argc, char** argv);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+=========================================================================================
+Name    | BenchAsync
+Purpose | Compare the synchronous calls with EHFOperations run by one EHFScheduler on
+        | one thread, at several numbers of operations in flight:
+        |   lookups  on tables kept in memory, spread over enough tables to be too large
+        |            for the caches, as in BenchBatch, where the gain is from misses
+        |            overlapping
+        |   inserts  with EHF_DURABILITY_COMMIT on a container, where the gain is from
+        |            the inserts in flight sharing a sync
+        | In flight 0 is the synchronous call in a loop. The lookups are worth timing
+        | with optimisation on (make bench CXXFLAGS="-std=c++14 -O2"): without it the
+        | calls between the stages cost more than the overlapped misses save.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <functional>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfasync.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+// Operations kept in flight, at most
+const int MAXINFLIGHT = 256;
+
+// Run count operations, keeping inFlight of them going. start(operation, slot, i) sets
+// up operation number i in the given slot, and those returning success are counted.
+static void
+RunInFlight(int count,
+	    int inFlight,
+	    std::function<void(EHFOperation*, int, int)> start,
+	    int success,
+	    long& succeeded
+	    )
+{
+  std::vector<EHFOperation> operations(inFlight);
+  EHFScheduler scheduler;
+  int next = 0;
+  std::function<void(EHFOperation*)> whenDone = [&](EHFOperation* done){
+    succeeded += (done->Result() == success) ? 1 : 0;
+    if (next < count){
+      start(done, done - operations.data(), next++);
+    }
+  };
+  for (int slot = 0; (slot < inFlight) && (next < count); slot++){
+    start(&operations[slot], slot, next++);
+    scheduler.Submit(&operations[slot], whenDone);
+  }
+  scheduler.Run();
+}
+
+int
+BenchAsync(int argc, char** argv)
+{
+  int tables = (argc > 0) ? atoi(argv[0]) : 32;
+  int lookups = (argc > 1) ? atoi(argv[1]) : 2000000;
+  int inserts = (argc > 2) ? atoi(argv[2]) : 2000;
+  if (tables < 1){
+    tables = 1;
+  }
+  if (inserts > MAXBENCHKEYS){
+    inserts = MAXBENCHKEYS;
+  }
+  int inFlights[] = { 0, 1, 4, 16, 64, MAXINFLIGHT };
+
+  EHFOptions options;
+  options.inMemory = true;
+  std::vector<ExtendibleHashFile*> ehfs;
+  char memoryName[] = "unused";
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int t = 0; t < tables; t++){
+    ExtendibleHashFile* ehf = new ExtendibleHashFile(options);
+    ehf->Open(memoryName, false);
+    for (int i = 0; i < MAXBENCHKEYS; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      ehf->InsertRecord(key, record);
+    }
+    ehfs.push_back(ehf);
+  }
+  // The same keys, and tables, for every run
+  std::vector<char> keys(static_cast<size_t>(lookups) * (IDSIZE + 1));
+  std::vector<int> keyTables(lookups);
+  unsigned seed = 1;
+  for (int i = 0; i < lookups; i++){
+    keyTables[i] = rand_r(&seed) % tables;
+    MakeKey(rand_r(&seed) % MAXBENCHKEYS, &keys[static_cast<size_t>(i) * (IDSIZE + 1)]);
+  }
+  std::vector<char> records(static_cast<size_t>(MAXINFLIGHT) * (RECORDSIZE + 1));
+
+  for (int inFlight : inFlights){
+    long found = 0;
+    double start = Now();
+    if (inFlight == 0){
+      for (int i = 0; i < lookups; i++){
+	found += (ehfs[keyTables[i]]->RetrieveRecord(&keys[static_cast<size_t>(i) *
+							   (IDSIZE + 1)], record)
+		  == EHF_RETRIEVED) ? 1 : 0;
+      }
+    } else {
+      RunInFlight(lookups, inFlight,
+		  [&](EHFOperation* operation, int slot, int i){
+		    operation->Retrieve(ehfs[keyTables[i]],
+					&keys[static_cast<size_t>(i) * (IDSIZE + 1)],
+					&records[slot * (RECORDSIZE + 1)]);
+		  }, EHF_RETRIEVED, found);
+    }
+    double seconds = Now() - start;
+    printf("async op=lookup tables=%d in_flight=%d lookups=%d seconds=%.6f"
+	   " lookups_per_second=%.0f found=%ld\n",
+	   tables, inFlight, lookups, seconds, lookups / seconds, found);
+  }
+  for (ExtendibleHashFile* ehf : ehfs){
+    ehf->Close();
+    delete ehf;
+  }
+
+  char fileName[] = "ehfbench-async";
+  char containerName[] = "ehfbench-async.eh";
+  EHFOptions durable;
+  durable.durability = EHF_DURABILITY_COMMIT;
+  std::vector<char> insertRecords(static_cast<size_t>(inserts) * (RECORDSIZE + 1));
+  std::vector<char> insertKeys(static_cast<size_t>(inserts) * (IDSIZE + 1));
+  for (int i = 0; i < inserts; i++){
+    MakeKey(i, &insertKeys[static_cast<size_t>(i) * (IDSIZE + 1)]);
+    MakeRecord(i, &insertRecords[static_cast<size_t>(i) * (RECORDSIZE + 1)]);
+  }
+  for (int inFlight : inFlights){
+    ExtendibleHashFile ehf(durable);
+    if (!ehf.Open(fileName, false)){
+      fprintf(stderr, "async: could not create %s\n", fileName);
+      return 1;
+    }
+    long inserted = 0;
+    double start = Now();
+    if (inFlight == 0){
+      for (int i = 0; i < inserts; i++){
+	inserted += (ehf.InsertRecord(&insertKeys[static_cast<size_t>(i) * (IDSIZE + 1)],
+				      &insertRecords[static_cast<size_t>(i) *
+						     (RECORDSIZE + 1)])
+		     == EHF_INSERTED) ? 1 : 0;
+      }
+    } else {
+      RunInFlight(inserts, inFlight,
+		  [&](EHFOperation* operation, int slot, int i){
+		    (void) slot;
+		    operation->Insert(&ehf, &insertKeys[static_cast<size_t>(i) * (IDSIZE + 1)],
+				      &insertRecords[static_cast<size_t>(i) * (RECORDSIZE + 1)]);
+		  }, EHF_INSERTED, inserted);
+    }
+    double seconds = Now() - start;
+    ehf.Close();
+    printf("async op=insert durability=commit in_flight=%d inserts=%d seconds=%.6f"
+	   " inserts_per_second=%.0f inserted=%ld\n",
+	   inFlight, inserts, seconds, inserts / seconds, inserted);
+  }
+  unlink(containerName);
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+=========================================================================================
+Name    | BenchBatch
+Purpose | Compare RetrieveRecord called in a loop with RetrieveBatch at several group
+        | sizes, on tables kept in memory. Hash() limits a table to MAXBENCHKEYS keys,
+        | a few megabytes, so the lookups are spread over a number of tables, together
+        | too large for the caches: each batch of keys goes to a table chosen at random.
+        | Group size 1 is RetrieveBatch with nothing in flight but the lookup at hand,
+        | so the gain from overlapping misses shows against it.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+// Keys given to each RetrieveBatch call
+const int BENCHBATCH = 64;
+
+int
+BenchBatch(int argc, char** argv)
+{
+  int tables = (argc > 0) ? atoi(argv[0]) : 32;
+  int lookups = (argc > 1) ? atoi(argv[1]) : 2000000;
+  if (tables < 1){
+    tables = 1;
+  }
+  int batches = lookups / BENCHBATCH;
+
+  EHFOptions options;
+  options.inMemory = true;
+  std::vector<ExtendibleHashFile*> ehfs;
+  char fileName[] = "unused";
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int t = 0; t < tables; t++){
+    ExtendibleHashFile* ehf = new ExtendibleHashFile(options);
+    ehf->Open(fileName, false);
+    for (int i = 0; i < MAXBENCHKEYS; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      ehf->InsertRecord(key, record);
+    }
+    ehfs.push_back(ehf);
+  }
+
+  // The same batches of keys, and tables, for every run
+  std::vector<char> keys(static_cast<size_t>(batches) * BENCHBATCH * (IDSIZE + 1));
+  std::vector<int> batchTables(batches);
+  unsigned seed = 1;
+  for (int b = 0; b < batches; b++){
+    batchTables[b] = rand_r(&seed) % tables;
+    for (int k = 0; k < BENCHBATCH; k++){
+      MakeKey(rand_r(&seed) % MAXBENCHKEYS,
+	      &keys[(static_cast<size_t>(b) * BENCHBATCH + k) * (IDSIZE + 1)]);
+    }
+  }
+  std::vector<char> records(BENCHBATCH * (RECORDSIZE + 1));
+  char* keyPointers[BENCHBATCH];
+  char* recordPointers[BENCHBATCH];
+  int results[BENCHBATCH];
+  for (int k = 0; k < BENCHBATCH; k++){
+    recordPointers[k] = &records[k * (RECORDSIZE + 1)];
+  }
+
+  int groupSizes[] = { 0, 1, 4, 8, 16, 32, 64 };       // 0 for RetrieveRecord
+  for (int groupSize : groupSizes){
+    long found = 0;
+    double start = Now();
+    for (int b = 0; b < batches; b++){
+      ExtendibleHashFile* ehf = ehfs[batchTables[b]];
+      for (int k = 0; k < BENCHBATCH; k++){
+	keyPointers[k] = &keys[(static_cast<size_t>(b) * BENCHBATCH + k) * (IDSIZE + 1)];
+      }
+      if (groupSize == 0){
+	for (int k = 0; k < BENCHBATCH; k++){
+	  found += (ehf->RetrieveRecord(keyPointers[k], recordPointers[k])
+		    == EHF_RETRIEVED) ? 1 : 0;
+	}
+      } else {
+	found += ehf->RetrieveBatch(BENCHBATCH, keyPointers, recordPointers, results,
+				    groupSize);
+      }
+    }
+    double seconds = Now() - start;
+    long done = static_cast<long>(batches) * BENCHBATCH;
+    printf("batch tables=%d call=%s group=%d lookups=%ld seconds=%.6f"
+	   " lookups_per_second=%.0f found=%ld\n",
+	   tables, groupSize ? "RetrieveBatch" : "RetrieveRecord", groupSize, done,
+	   seconds, done / seconds, found);
+  }
+
+  for (ExtendibleHashFile* ehf : ehfs){
+    ehf->Close();
+    delete ehf;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+/*
+=========================================================================================
+Name    | BenchDirect
+Purpose | Compare lookups through the page cache with lookups through BucketFile's own
+        | cache, with O_DIRECT. Each table is built, closed and dropped from the page
+        | cache, then reopened, so both start cold. With direct I/O the memory the
+        | buckets take is cache_pages pages, however large the table is.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bucketfile.h"
+#include "bench.h"
+
+int
+BenchDirect(int argc, char** argv)
+{
+  int records = (argc > 0) ? atoi(argv[0]) : 20000;
+  int cachePages = (argc > 1) ? atoi(argv[1]) : 4096;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 200000;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  char fileName[] = "ehfbench-direct";
+  char containerFileName[] = "ehfbench-direct.eh";
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int direct = 0; direct < 2; direct++){
+    EHFOptions options;
+    options.directIO = (direct == 1);
+    options.cachePages = cachePages;
+    ExtendibleHashFile created(options);
+    if (!created.Open(fileName, false)){
+      fprintf(stderr, "direct: could not create %s\n", fileName);
+      return 1;
+    }
+    for (int i = 0; i < records; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      created.InsertRecord(key, record);
+    }
+    created.Close();
+    int fd = open(containerFileName, O_RDONLY);
+    if (fd >= 0){
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+
+    ExtendibleHashFile ehf(options);
+    if (!ehf.Open(fileName)){
+      fprintf(stderr, "direct: could not open %s\n", fileName);
+      return 1;
+    }
+    unsigned seed = 1;
+    int found = 0;
+    double start = Now();
+    for (int i = 0; i < lookups; i++){
+      MakeKey(rand_r(&seed) % records, key);
+      found += (ehf.RetrieveRecord(key, record) == EHF_RETRIEVED) ? 1 : 0;
+    }
+    double seconds = Now() - start;
+    ehf.Close();
+    printf("direct io=%s records=%d cache_pages=%d cache_bytes=%ld lookups=%d"
+	   " seconds=%.6f lookups_per_second=%.0f found=%d\n",
+	   direct ? "direct" : "buffered", records, cachePages,
+	   direct ? static_cast<long>(cachePages) * DIRECTALIGN : 0L, lookups, seconds,
+	   lookups / seconds, found);
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+=========================================================================================
+Name    | BenchDurability
+Purpose | Measure insert throughput at each durability option, with a number of writer
+        | threads. With EHF_DURABILITY_COMMIT, concurrent writers share their syncs, so
+        | throughput should grow with the writers where EHF_DURABILITY_PEROP does not.
+        | The time includes the final Close, which makes every option durable.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+int
+BenchDurability(int argc, char** argv)
+{
+  int records = (argc > 0) ? atoi(argv[0]) : 2000;
+  int writers = (argc > 1) ? atoi(argv[1]) : 4;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+  if (writers < 1){
+    writers = 1;
+  }
+
+  struct { const char* name; int durability; } modes[] = {
+    { "none", EHF_DURABILITY_NONE },
+    { "periodic", EHF_DURABILITY_PERIODIC },
+    { "commit", EHF_DURABILITY_COMMIT },
+    { "perop", EHF_DURABILITY_PEROP },
+  };
+  char fileName[] = "ehfbench-durability";
+  for (auto& mode : modes){
+    EHFOptions options;
+    options.durability = mode.durability;
+    ExtendibleHashFile ehf(options);
+    if (!ehf.Open(fileName, false)){
+      fprintf(stderr, "durability: could not create %s\n", fileName);
+      return 1;
+    }
+    std::atomic<int> failures(0);
+    std::vector<std::thread> workers;
+    double start = Now();
+    for (int w = 0; w < writers; w++){
+      workers.emplace_back([&ehf, &failures, records, writers, w]() {
+	char key[IDSIZE+1];
+	char record[RECORDSIZE+1];
+	for (int i = w; i < records; i += writers){
+	  MakeKey(i, key);
+	  MakeRecord(i, record);
+	  if (ehf.InsertRecord(key, record) != EHF_INSERTED){
+	    failures++;
+	  }
+	}
+      });
+    }
+    for (std::thread& worker : workers){
+      worker.join();
+    }
+    ehf.Close();
+    double seconds = Now() - start;
+    printf("durability mode=%s writers=%d records=%d seconds=%.6f inserts_per_second=%.0f"
+	   " failures=%d\n",
+	   mode.name, writers, records, seconds, records / seconds, failures.load());
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+=========================================================================================
+Name    | BenchGet
+Purpose | Compare RetrieveRecord, which copies each record out and null terminates it,
+        | with Get, which leaves it in its bucket for a view. Both are timed over the
+        | same keys, buffered and with direct I/O, where Get pins the cached page. Each
+        | lookup reads one field of the record, as a caller of Get would.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "ehfrecordview.h"
+#include "bench.h"
+
+int
+BenchGet(int argc, char** argv)
+{
+  int records = (argc > 0) ? atoi(argv[0]) : 20000;
+  int lookups = (argc > 1) ? atoi(argv[1]) : 500000;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  char fileName[] = "ehfbench-get";
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int direct = 0; direct < 2; direct++){
+    EHFOptions options;
+    options.directIO = (direct == 1);
+    ExtendibleHashFile ehf(options);
+    if (!ehf.Open(fileName, false)){
+      fprintf(stderr, "get: could not create %s\n", fileName);
+      return 1;
+    }
+    for (int i = 0; i < records; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      ehf.InsertRecord(key, record);
+    }
+
+    for (int view = 0; view < 2; view++){
+      unsigned seed = 1;
+      long checksum = 0;
+      EHFRecordView recordView;
+      double start = Now();
+      for (int i = 0; i < lookups; i++){
+	MakeKey(rand_r(&seed) % records, key);
+	if (view == 0){
+	  if (ehf.RetrieveRecord(key, record) == EHF_RETRIEVED){
+	    checksum += record[TITLEPOSITION];
+	  }
+	} else if (ehf.Get(key, recordView) == EHF_RETRIEVED){
+	  checksum += recordView.Data()[TITLEPOSITION];
+	}
+      }
+      double seconds = Now() - start;
+      recordView.Release();
+      printf("get io=%s call=%s records=%d lookups=%d seconds=%.6f"
+	     " lookups_per_second=%.0f checksum=%ld\n",
+	     direct ? "direct" : "buffered", view ? "Get" : "RetrieveRecord", records,
+	     lookups, seconds, lookups / seconds, checksum);
+    }
+    ehf.Close();
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+/*
+=========================================================================================
+Name    | BenchIndex
+Purpose | Compare the memory and lookup speed of the two index representations, for an
+        | index made deep by a hot spot in the hash values. Most buckets are shallow,
+        | while the buckets along the hot spot reach the full depth.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "indexholder.h"
+#include "compactindexholder.h"
+#include "bench.h"
+
+// Split buckets until there are buckets of them, then split the bucket holding slot 0
+// until the index reaches depth. Returns the number of buckets.
+static int
+SkewedSplits(ExtendibleIndex& index, int buckets, int depth)
+{
+  std::vector<int> bucketDepths(1, 0);
+  unsigned seed = 1;
+  for (;;){
+    int slot = 0;
+    if (static_cast<int>(bucketDepths.size()) < buckets){
+      slot = rand_r(&seed) % index.GetNumberOfAddresses();
+    }
+    int address = index.GetAddress(slot);
+    int bucketDepth = bucketDepths[address];
+    if (bucketDepth == index.GetDepth()){
+      if (index.GetDepth() >= depth){
+	break;
+      }
+      index.IncreaseDepth();
+    }
+    index.SplitAddress(slot & ((1 << bucketDepth) - 1), bucketDepth, bucketDepths.size());
+    bucketDepths[address] = bucketDepth + 1;
+    bucketDepths.push_back(bucketDepth + 1);
+    // Keep up with the copying a file would spread over its inserts
+    index.CopyMirrors(64);
+  }
+  while (index.CopyMirrors(1 << 16) > 0){
+  }
+  return bucketDepths.size();
+}
+
+static void
+Measure(const char* name, ExtendibleIndex& index, int buckets, int depth, int lookups)
+{
+  int made = SkewedSplits(index, buckets, depth);
+  unsigned seed = 2;
+  int mask = index.GetNumberOfAddresses() - 1;
+  long checksum = 0;
+  double start = Now();
+  for (int i = 0; i < lookups; i++){
+    checksum += index.GetAddress(rand_r(&seed) & mask);
+  }
+  double seconds = Now() - start;
+  printf("index type=%s depth=%d buckets=%d bytes=%ld lookups=%d seconds=%.3f"
+	 " ns_per_lookup=%.1f checksum=%ld\n",
+	 name, index.GetDepth(), made, index.MemoryUsage(), lookups, seconds,
+	 (seconds * 1e9) / lookups, checksum);
+}
+
+int
+BenchIndex(int argc, char** argv)
+{
+  int depth = (argc > 0) ? atoi(argv[0]) : 22;
+  int buckets = (argc > 1) ? atoi(argv[1]) : 4096;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 10000000;
+  if (depth < 1 || depth > 28){
+    fprintf(stderr, "index: depth must be from 1 to 28\n");
+    return 1;
+  }
+
+  IndexHolder array(1);
+  Measure("array", array, buckets, depth, lookups);
+  CompactIndexHolder compact(1);
+  Measure("compact", compact, buckets, depth, lookups);
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+=========================================================================================
+Name    | ehfbench                                                                      |
+Purpose | Run one of the extendible hash file benchmarks, chosen by name                |
+=========================================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "records.h"
+#include "bench.h"
+
+struct Workload{
+  const char* name;
+  int (*run)(int argc, char** argv);
+  const char* usage;
+};
+
+static const Workload workloads[] = {
+  { "readers", BenchReaders, "readers [threads] [records] [lookups per thread]" },
+  { "partitions", BenchPartitions,
+    "partitions [partitions] [records] [lookups per partition]" },
+  { "index", BenchIndex, "index [depth] [buckets before the hot spot] [lookups]" },
+  { "open", BenchOpen, "open [index depth] [records]" },
+  { "rebuild", BenchRebuild, "rebuild [bucket depth] [threads, 0 for one per core]" },
+  { "durability", BenchDurability, "durability [records] [writer threads]" },
+  { "direct", BenchDirect, "direct [records] [cache pages] [lookups]" },
+  { "get", BenchGet, "get [records] [lookups]" },
+  { "inserts", BenchInserts, "inserts [records]" },
+  { "memory", BenchMemory, "memory [records] [lookups]" },
+  { "batch", BenchBatch, "batch [tables] [lookups]" },
+  { "async", BenchAsync, "async [tables] [lookups] [inserts]" },
+  { "suite", BenchSuite,
+    "suite [container|twofiles|direct|memory] [records] [lookups] [repeats]" },
+  { "ycsb", BenchYCSB,
+    "ycsb [a-f] [uniform|zipfian|latest|default] [threads] [operations] [records]"
+    " [record bytes] [container|direct|memory]" },
+  { "scan", BenchScan, "scan [container|twofiles|memory] [records] [threads] [scans]" },
+};
+
+// Hash() sums 100 * the even chars and the odd chars of a key. The even chars carry
+// n / 100 and the odd chars n % 100, each spread over three printable chars.
+static void
+SpreadOverChars(int value, char* chars)
+{
+  for (int i = 0; i < 3; i++){
+    int part = (value > 94) ? 94 : value;
+    chars[2 * i] = static_cast<char>(' ' + part);
+    value -= part;
+  }
+}
+
+void
+MakeKey(int n, char* key)
+{
+  SpreadOverChars(n / 100, key);
+  SpreadOverChars(n % 100, key + 1);
+  key[IDSIZE] = '\0';
+}
+
+void
+MakeRecord(int n, char* record)
+{
+  char key[IDSIZE+1];
+  MakeKey(n, key);
+  memset(record, '\0', RECORDSIZE+1);
+  snprintf(record, RECORDSIZE+1, "%sRecord %d", key, n);
+}
+
+double
+Now()
+{
+  return std::chrono::duration<double>(
+	   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+PrintPercentiles(std::vector<double>& seconds)
+{
+  std::sort(seconds.begin(), seconds.end());
+  struct { const char* name; double fraction; } percentiles[] = {
+    { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 }, { "max", 1.0 },
+  };
+  for (auto& percentile : percentiles){
+    double value = 0;
+    if (!seconds.empty()){
+      size_t rank = static_cast<size_t>(percentile.fraction * (seconds.size() - 1) + 0.5);
+      value = seconds[rank];
+    }
+    printf(" %s_us=%.3f", percentile.name, value * 1e6);
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc >= 2){
+    for (const Workload& workload : workloads){
+      if (strcmp(argv[1], workload.name) == 0){
+	return workload.run(argc - 2, argv + 2);
+      }
+    }
+  }
+  fprintf(stderr, "usage: %s <workload> [args]\n", argv[0]);
+  for (const Workload& workload : workloads){
+    fprintf(stderr, "  %s\n", workload.usage);
+  }
+  return 1;
+}
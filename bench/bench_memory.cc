@@ -0,0 +1,71 @@
+/*
+=========================================================================================
+Name    | BenchMemory
+Purpose | Compare a table kept in memory with one in a container, for inserts and for
+        | lookups, and time Persist writing the in memory table out as a container.
+        | The container is left in the page cache, so the difference is the cost of
+        | the system calls rather than of the disc.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+int
+BenchMemory(int argc, char** argv)
+{
+  int records = (argc > 0) ? atoi(argv[0]) : MAXBENCHKEYS;
+  int lookups = (argc > 1) ? atoi(argv[1]) : 500000;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  char fileName[] = "ehfbench-memory";
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int inMemory = 0; inMemory < 2; inMemory++){
+    EHFOptions options;
+    options.inMemory = (inMemory == 1);
+    ExtendibleHashFile ehf(options);
+    if (!ehf.Open(fileName, false)){
+      fprintf(stderr, "memory: could not create %s\n", fileName);
+      return 1;
+    }
+    double start = Now();
+    for (int i = 0; i < records; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      ehf.InsertRecord(key, record);
+    }
+    double insertSeconds = Now() - start;
+
+    unsigned seed = 1;
+    int found = 0;
+    start = Now();
+    for (int i = 0; i < lookups; i++){
+      MakeKey(rand_r(&seed) % records, key);
+      found += (ehf.RetrieveRecord(key, record) == EHF_RETRIEVED) ? 1 : 0;
+    }
+    double lookupSeconds = Now() - start;
+
+    double persistSeconds = 0;
+    if (inMemory){
+      start = Now();
+      if (!ehf.Persist(fileName)){
+	fprintf(stderr, "memory: could not persist %s\n", fileName);
+	return 1;
+      }
+      persistSeconds = Now() - start;
+    }
+    ehf.Close();
+    printf("memory table=%s records=%d inserts_per_second=%.0f lookups=%d"
+	   " lookups_per_second=%.0f found=%d persist_seconds=%.6f\n",
+	   inMemory ? "memory" : "container", records, records / insertSeconds, lookups,
+	   lookups / lookupSeconds, found, persistSeconds);
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+=========================================================================================
+Name    | BenchOpen
+Purpose | Measure the time from Open to the first lookup answered, for a table whose
+        | index has been made deep, with each way of getting hold of the index. The
+        | file is dropped from the page cache first, where the system allows it, so
+        | the index has to come from disc.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "indexholder.h"
+#include "ehfcontainer.h"
+#include "bench.h"
+
+static void
+DropFromPageCache(const char* fileName)
+{
+  int fd = open(fileName, O_RDONLY);
+  if (fd >= 0){
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+bool
+DeepenIndex(char* containerFileName, int depth)
+{
+  EHFContainer container;
+  IndexHolder index;
+  if (!container.Open(containerFileName) ||
+      !container.LoadIndex(&index, EHF_OPEN_READINDEX)){
+    return false;
+  }
+  while (index.GetDepth() < depth){
+    index.IncreaseDepth();
+  }
+  while (index.CopyMirrors(1 << 20) > 0){
+  }
+  return container.Commit(&index, container.BucketCount());
+}
+
+int
+BenchOpen(int argc, char** argv)
+{
+  int depth = (argc > 0) ? atoi(argv[0]) : 22;
+  int records = (argc > 1) ? atoi(argv[1]) : 2000;
+  if (depth < 1 || depth > 28){
+    fprintf(stderr, "open: depth must be from 1 to 28\n");
+    return 1;
+  }
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  char fileName[] = "ehfbench-open";
+  char containerFileName[] = "ehfbench-open.eh";
+  ExtendibleHashFile ehf;
+  if (!ehf.Open(fileName, false)){
+    fprintf(stderr, "open: could not create %s\n", fileName);
+    return 1;
+  }
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int i = 0; i < records; i++){
+    MakeKey(i, key);
+    MakeRecord(i, record);
+    ehf.InsertRecord(key, record);
+  }
+  ehf.Close();
+  if (!DeepenIndex(containerFileName, depth)){
+    fprintf(stderr, "open: could not deepen the index of %s\n", containerFileName);
+    return 1;
+  }
+
+  struct { const char* name; int indexOpen; } modes[] = {
+    { "read", EHF_OPEN_READINDEX },
+    { "map", EHF_OPEN_MAPINDEX },
+    { "prefetch", EHF_OPEN_PREFETCHINDEX },
+  };
+  for (auto& mode : modes){
+    EHFOptions options;
+    options.indexOpen = mode.indexOpen;
+    ExtendibleHashFile table(options);
+    DropFromPageCache(containerFileName);
+    double start = Now();
+    if (!table.Open(fileName)){
+      fprintf(stderr, "open: could not open %s\n", fileName);
+      return 1;
+    }
+    double opened = Now();
+    MakeKey(0, key);
+    int result = table.RetrieveRecord(key, record);
+    double answered = Now();
+    // Lookups spread over the whole table, as a service would see after a restart
+    unsigned seed = 1;
+    int found = 0;
+    for (int i = 0; i < records; i++){
+      MakeKey(rand_r(&seed) % records, key);
+      found += (table.RetrieveRecord(key, record) == EHF_RETRIEVED) ? 1 : 0;
+    }
+    double warmed = Now();
+    printf("open mode=%s depth=%d open_seconds=%.6f first_query_seconds=%.6f"
+	   " lookups=%d lookup_seconds=%.6f found=%d\n",
+	   mode.name, depth, opened - start, answered - start, records,
+	   warmed - answered, found + ((result == EHF_RETRIEVED) ? 1 : 0));
+    table.Close();
+  }
+  return 0;
+}
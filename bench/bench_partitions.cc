@@ -0,0 +1,105 @@
+/*
+=========================================================================================
+Name    | BenchPartitions
+Purpose | Measure lookup throughput of a PartitionedHashFile as the number of partitions
+        | (cores) grows. There is one client thread per partition, each keeping a window
+        | of requests in flight, so the partitions and not the clients are the limit.
+        | Partitions share nothing, so throughput should scale with the number of cores.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "partitionedhashfile.h"
+#include "bench.h"
+
+// Requests each client keeps in flight
+const int CLIENTWINDOW = 32;
+
+static void
+Client(PartitionedHashFile* phf, int client, int records, int lookups)
+{
+  PartitionRequest requests[CLIENTWINDOW];
+  char keys[CLIENTWINDOW][IDSIZE+1];
+  char results[CLIENTWINDOW][RECORDSIZE+1];
+  bool inFlight[CLIENTWINDOW];
+  unsigned seed = client + 1;
+  int submitted = 0;
+  int completed = 0;
+
+  for (int slot = 0; slot < CLIENTWINDOW; slot++){
+    requests[slot].op = PARTITION_RETRIEVE;
+    requests[slot].key = keys[slot];
+    requests[slot].record = results[slot];
+    inFlight[slot] = false;
+  }
+  while (completed < lookups){
+    for (int slot = 0; slot < CLIENTWINDOW; slot++){
+      if (inFlight[slot]){
+	if (!requests[slot].done.load(std::memory_order_acquire)){
+	  continue;
+	}
+	inFlight[slot] = false;
+	completed++;
+      }
+      if (submitted < lookups){
+	MakeKey(rand_r(&seed) % records, keys[slot]);
+	if (phf->Submit(client, &requests[slot])){
+	  inFlight[slot] = true;
+	  submitted++;
+	}
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+int
+BenchPartitions(int argc, char** argv)
+{
+  int maxPartitions = (argc > 0) ? atoi(argv[0]) : 4;
+  int records = (argc > 1) ? atoi(argv[1]) : 10000;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 100000;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  for (int partitions = 1; partitions <= maxPartitions; partitions *= 2){
+    PartitionedHashFile phf(partitions, partitions);
+    char fileName[] = "ehfbench-partitions";
+    if (!phf.Open(fileName, false)){
+      fprintf(stderr, "partitions: could not create %s\n", fileName);
+      return 1;
+    }
+    char key[IDSIZE+1];
+    char record[RECORDSIZE+1];
+    for (int i = 0; i < records; i++){
+      MakeKey(i, key);
+      MakeRecord(i, record);
+      if (phf.InsertRecord(0, key, record) != EHF_INSERTED){
+	fprintf(stderr, "partitions: insert of record %d failed\n", i);
+	return 1;
+      }
+    }
+
+    std::vector<std::thread> clients;
+    double start = Now();
+    for (int c = 0; c < partitions; c++){
+      clients.emplace_back(Client, &phf, c, records, lookups);
+    }
+    for (std::thread& client : clients){
+      client.join();
+    }
+    double seconds = Now() - start;
+    printf("partitions partitions=%d records=%d lookups=%d seconds=%.3f ops_per_sec=%.0f\n",
+	   partitions, records, partitions * lookups, seconds,
+	   (partitions * lookups) / seconds);
+    phf.Close();
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+=========================================================================================
+Name    | BenchReaders
+Purpose | Measure lookup throughput as the number of reader threads grows. The readers
+        | take no locks, so throughput should scale with the number of cores.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+int
+BenchReaders(int argc, char** argv)
+{
+  int threads = (argc > 0) ? atoi(argv[0]) : 4;
+  int records = (argc > 1) ? atoi(argv[1]) : 10000;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 100000;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  ExtendibleHashFile ehf;
+  char fileName[] = "ehfbench-readers";
+  if (!ehf.Open(fileName, false)){
+    fprintf(stderr, "readers: could not create %s\n", fileName);
+    return 1;
+  }
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int i = 0; i < records; i++){
+    MakeKey(i, key);
+    MakeRecord(i, record);
+    if (ehf.InsertRecord(key, record) != EHF_INSERTED){
+      fprintf(stderr, "readers: insert of %s failed\n", key);
+      return 1;
+    }
+  }
+
+  for (int t = 1; t <= threads; t *= 2){
+    std::vector<std::thread> workers;
+    double start = Now();
+    for (int w = 0; w < t; w++){
+      workers.emplace_back([&ehf, records, lookups, w]() {
+	char readerKey[IDSIZE+1];
+	char readerRecord[RECORDSIZE+1];
+	unsigned seed = w + 1;
+	for (int i = 0; i < lookups; i++){
+	  MakeKey(rand_r(&seed) % records, readerKey);
+	  ehf.RetrieveRecord(readerKey, readerRecord);
+	}
+      });
+    }
+    for (std::thread& worker : workers){
+      worker.join();
+    }
+    double seconds = Now() - start;
+    printf("readers threads=%d records=%d lookups=%d seconds=%.3f ops_per_sec=%.0f\n",
+	   t, records, t * lookups, seconds, (t * lookups) / seconds);
+  }
+  ehf.Close();
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+=========================================================================================
+Name    | BenchRebuild
+Purpose | Measure RebuildIndex on a two file table of 2^depth buckets, with one thread
+        | and with several. The buckets are written directly rather than by inserting,
+        | so that the table can be far larger than the bench keys would make it, and the
+        | file is dropped from the page cache before each run, where the system allows.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfbucket.h"
+#include "ehfrecovery.h"
+#include "bench.h"
+
+static void
+DropFromPageCache(const char* fileName)
+{
+  int fd = open(fileName, O_RDONLY);
+  if (fd >= 0){
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+int
+BenchRebuild(int argc, char** argv)
+{
+  int depth = (argc > 0) ? atoi(argv[0]) : 16;
+  int threads = (argc > 1) ? atoi(argv[1]) : 0;
+  if (depth < 1 || depth > 24){
+    fprintf(stderr, "rebuild: depth must be from 1 to 24\n");
+    return 1;
+  }
+
+  char fileName[] = "ehfbench-rebuild";
+  char bucketFileName[] = "ehfbench-rebuild.ehf";
+  int fd = open(bucketFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0){
+    fprintf(stderr, "rebuild: could not create %s\n", bucketFileName);
+    return 1;
+  }
+  int buckets = 1 << depth;
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int b = 0; b < buckets; b++){
+    EHFBucket bucket(fd, b, depth);
+    bucket.ChangePattern(b);
+    MakeKey(b % MAXBENCHKEYS, key);
+    MakeRecord(b % MAXBENCHKEYS, record);
+    bucket.Add(key, record);
+    if (bucket.Write() != EHF_WROTEOK){
+      fprintf(stderr, "rebuild: could not write %s\n", bucketFileName);
+      close(fd);
+      return 1;
+    }
+  }
+  pwrite(fd, &buckets, sizeof(buckets), 0);
+  close(fd);
+
+  double megabytes = static_cast<double>(buckets) * BUCKETSIZE / (1024 * 1024);
+  int runs[] = { 1, threads };
+  for (int run : runs){
+    DropFromPageCache(bucketFileName);
+    double start = Now();
+    bool rebuilt = RebuildIndex(fileName, run);
+    double seconds = Now() - start;
+    printf("rebuild depth=%d buckets=%d megabytes=%.1f threads=%d seconds=%.6f"
+	   " megabytes_per_second=%.1f rebuilt=%d\n",
+	   depth, buckets, megabytes, run, seconds, megabytes / seconds, rebuilt ? 1 : 0);
+  }
+  unlink(bucketFileName);
+  unlink("ehfbench-rebuild.ehd");
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+=========================================================================================
+Name    | BenchScan
+Purpose | Measure full-table scan throughput of ScanPartitions as the number of threads
+        | grows, each partition taking the CRC-32 of every record it is given, and the
+        | sink combining the partitions' checksums and adding up their record counts. The
+        | checksum printed, that of the last scan, is the same whatever the threads.
+        | Each partition sums into its own cache line, so the threads share none as
+        | they count.
+        | The table is left in the page cache (apart from memory, in the process), so
+        | the rate is that of reading the cache and of the visitor, not of the disc.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "ehfcursor.h"
+#include "checksum.h"
+#include "spscqueue.h"
+#include "bench.h"
+
+// One partition's sums, a cache line clear of its neighbours' in a vector
+struct PartitionSum{
+  char padding[CACHELINESIZE];
+  uint32_t checksum;
+  long count;
+};
+
+int
+BenchScan(int argc, char** argv)
+{
+  const char* mode = (argc > 0) ? argv[0] : "container";
+  int records = (argc > 1) ? atoi(argv[1]) : MAXBENCHKEYS;
+  int maxThreads = (argc > 2) ? atoi(argv[2]) :
+    std::max(1u, std::thread::hardware_concurrency());
+  int repeats = (argc > 3) ? atoi(argv[3]) : 20;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+
+  EHFOptions options;
+  if (strcmp(mode, "twofiles") == 0){
+    options.fileFormat = EHF_FORMAT_TWOFILES;
+  } else if (strcmp(mode, "memory") == 0){
+    options.inMemory = true;
+  } else if (strcmp(mode, "container") != 0){
+    fprintf(stderr, "scan: unknown mode %s\n", mode);
+    return 1;
+  }
+  char fileName[] = "ehfbench-scan";
+  ExtendibleHashFile ehf(options);
+  if (!ehf.Open(fileName, false)){
+    fprintf(stderr, "scan: could not create %s\n", fileName);
+    return 1;
+  }
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int i = 0; i < records; i++){
+    MakeKey(i, key);
+    MakeRecord(i, record);
+    ehf.InsertRecord(key, record);
+  }
+  EHFOccupancy occupancy = ehf.Analyse();
+  double bytes = static_cast<double>(occupancy.buckets) * occupancy.pageSize;
+
+  for (int threads = 1; threads <= maxThreads; threads *= 2){
+    std::vector<PartitionSum> sums(threads);
+    uint32_t checksum = 0;
+    long scanned = 0;
+    double start = Now();
+    for (int r = 0; r < repeats; r++){
+      for (PartitionSum& sum : sums){
+	sum.checksum = 0;
+	sum.count = 0;
+      }
+      checksum = 0;
+      ScanPartitions(&ehf, threads,
+		     [&sums](int partition, const char*, const char* record){
+		       sums[partition].checksum ^= Crc32(record, RECORDSIZE);
+		       sums[partition].count++;
+		     },
+		     [&sums, &checksum, &scanned](int partition){
+		       checksum ^= sums[partition].checksum;
+		       scanned += sums[partition].count;
+		     });
+    }
+    double seconds = Now() - start;
+    if (scanned != static_cast<long>(records) * repeats){
+      fprintf(stderr, "scan: found %ld records of %ld\n", scanned,
+	      static_cast<long>(records) * repeats);
+      return 1;
+    }
+    printf("scan mode=%s threads=%d records=%d buckets=%ld scans=%d seconds=%.4f"
+	   " records_per_second=%.0f mb_per_second=%.1f checksum=%08x\n",
+	   mode, threads, records, occupancy.buckets, repeats, seconds,
+	   scanned / seconds, bytes * repeats / seconds / (1024 * 1024), checksum);
+  }
+  ehf.Close();
+  const char* extensions[] = { ".eh", ".ehd", ".ehf" };
+  for (const char* extension : extensions){
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s", fileName, extension);
+    unlink(name);
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+/*
+=========================================================================================
+Name    | BenchSuite
+Purpose | Time the everyday operations of a table, one line per phase, each with its
+        | rate and the percentiles of the time taken by single operations:
+        |   insert_sequential  keys in order, into a new table
+        |   insert_random      the same keys shuffled, into another new table
+        |   lookup_hit         keys of that table, at random
+        |   lookup_miss        keys not in it, at random (none if records is the most
+        |                      MakeKey supports)
+        |   split_growth       every SPLITSTRIDE-th key into a new table: the keys share
+        |                      their low bits, so the index doubles while most buckets
+        |                      it points to stay empty, and splits come often
+        |   summary_scan       FileSummary, its output thrown away, repeats times
+        |   cursor_scan        every record through an EHFCursor, repeats times
+        |   analyse            Analyse, repeats times, then a line of what it found
+        |   open_close         Open and Close, repeats times, at the depth the table
+        |                      grew to and deepened twice by OPENDEPTHSTEP (containers
+        |                      only, whose index DeepenIndex can rewrite)
+        | Every line is "suite" then name=value pairs, for scripts to pick up and compare
+        | from one release to the next.
+=========================================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "ehfcursor.h"
+#include "ehfcontainer.h"
+#include "indexholder.h"
+#include "bench.h"
+
+// Keys apart in split_growth
+const int SPLITSTRIDE = 8;
+
+// Levels the index is deepened by between open_close phases
+const int OPENDEPTHSTEP = 3;
+
+static void
+PrintPhase(const char* mode,
+	   const char* phase,
+	   std::vector<double>& latencies,
+	   double seconds,
+	   int depth
+	   )
+{
+  printf("suite mode=%s phase=%s ops=%zu seconds=%.6f ops_per_second=%.0f",
+	 mode, phase, latencies.size(), seconds,
+	 (seconds > 0) ? latencies.size() / seconds : 0.0);
+  if (depth > 0){
+    printf(" depth=%d", depth);
+  }
+  PrintPercentiles(latencies);
+  printf("\n");
+}
+
+static void
+RemoveTable(const char* fileName)
+{
+  char name[64];
+  const char* extensions[] = { ".eh", ".ehd", ".ehf" };
+  for (const char* extension : extensions){
+    snprintf(name, sizeof(name), "%s%s", fileName, extension);
+    unlink(name);
+  }
+}
+
+// Insert the records numbered in keys into a new table, timing each insert
+static bool
+InsertPhase(const char* mode,
+	    const char* phase,
+	    char* fileName,
+	    const std::vector<int>& keys,
+	    ExtendibleHashFile& ehf
+	    )
+{
+  RemoveTable(fileName);
+  if (!ehf.Open(fileName, false)){
+    fprintf(stderr, "suite: could not create %s\n", fileName);
+    return false;
+  }
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  std::vector<double> latencies;
+  latencies.reserve(keys.size());
+  double start = Now();
+  for (int n : keys){
+    MakeKey(n, key);
+    MakeRecord(n, record);
+    double before = Now();
+    int result = ehf.InsertRecord(key, record);
+    latencies.push_back(Now() - before);
+    if (result != EHF_INSERTED){
+      fprintf(stderr, "suite: %s could not insert record %d, return code %d\n",
+	      phase, n, result);
+      return false;
+    }
+  }
+  PrintPhase(mode, phase, latencies, Now() - start, 0);
+  return true;
+}
+
+// Look up lookups keys numbered from first up to end, at random
+static void
+LookupPhase(const char* mode,
+	    const char* phase,
+	    ExtendibleHashFile& ehf,
+	    int first,
+	    int end,
+	    int lookups
+	    )
+{
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  std::vector<double> latencies;
+  latencies.reserve(lookups);
+  unsigned seed = 1;
+  double start = Now();
+  for (int i = 0; i < lookups; i++){
+    MakeKey(first + rand_r(&seed) % (end - first), key);
+    double before = Now();
+    ehf.RetrieveRecord(key, record);
+    latencies.push_back(Now() - before);
+  }
+  PrintPhase(mode, phase, latencies, Now() - start, 0);
+}
+
+int
+BenchSuite(int argc, char** argv)
+{
+  const char* mode = (argc > 0) ? argv[0] : "container";
+  int records = (argc > 1) ? atoi(argv[1]) : MAXBENCHKEYS / 2;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 500000;
+  int repeats = (argc > 3) ? atoi(argv[3]) : 20;
+  if (records > MAXBENCHKEYS){
+    records = MAXBENCHKEYS;
+  }
+  if ( (records < 1) || (lookups < 1) || (repeats < 1) ){
+    fprintf(stderr, "suite: records, lookups and repeats must be positive\n");
+    return 1;
+  }
+  EHFOptions options;
+  if (strcmp(mode, "twofiles") == 0){
+    options.fileFormat = EHF_FORMAT_TWOFILES;
+  } else if (strcmp(mode, "direct") == 0){
+    options.directIO = true;
+  } else if (strcmp(mode, "memory") == 0){
+    options.inMemory = true;
+  } else if (strcmp(mode, "container") != 0){
+    fprintf(stderr, "suite: no mode %s\n", mode);
+    return 1;
+  }
+  bool inContainer = (options.fileFormat == EHF_FORMAT_CONTAINER) && !options.inMemory;
+
+  char fileName[] = "ehfbench-suite";
+  char containerFileName[] = "ehfbench-suite.eh";
+  std::vector<int> keys(records);
+  for (int i = 0; i < records; i++){
+    keys[i] = i;
+  }
+  {
+    ExtendibleHashFile ehf(options);
+    if (!InsertPhase(mode, "insert_sequential", fileName, keys, ehf)){
+      return 1;
+    }
+    ehf.Close();
+  }
+
+  unsigned seed = 1;
+  for (int i = records - 1; i > 0; i--){
+    std::swap(keys[i], keys[rand_r(&seed) % (i + 1)]);
+  }
+  ExtendibleHashFile ehf(options);
+  if (!InsertPhase(mode, "insert_random", fileName, keys, ehf)){
+    return 1;
+  }
+  LookupPhase(mode, "lookup_hit", ehf, 0, records, lookups);
+  if (records < MAXBENCHKEYS){
+    LookupPhase(mode, "lookup_miss", ehf, records, MAXBENCHKEYS, lookups);
+  }
+
+  // FileSummary writes to std::cout, which is pointed elsewhere meanwhile
+  std::ofstream nowhere("/dev/null");
+  std::streambuf* output = std::cout.rdbuf(nowhere.rdbuf());
+  std::vector<double> latencies;
+  double start = Now();
+  for (int i = 0; i < repeats; i++){
+    double before = Now();
+    ehf.FileSummary();
+    latencies.push_back(Now() - before);
+  }
+  double seconds = Now() - start;
+  std::cout.rdbuf(output);
+  PrintPhase(mode, "summary_scan", latencies, seconds, 0);
+
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  long scanned = 0;
+  latencies.clear();
+  start = Now();
+  for (int i = 0; i < repeats; i++){
+    double before = Now();
+    EHFCursor cursor;
+    cursor.Open(&ehf);
+    while (cursor.Next(key, record)){
+      scanned++;
+    }
+    latencies.push_back(Now() - before);
+  }
+  PrintPhase(mode, "cursor_scan", latencies, Now() - start, 0);
+  if (scanned != static_cast<long>(records) * repeats){
+    fprintf(stderr, "suite: cursor_scan found %ld records of %ld\n", scanned,
+	    static_cast<long>(records) * repeats);
+  }
+
+  EHFOccupancy occupancy;
+  latencies.clear();
+  start = Now();
+  for (int i = 0; i < repeats; i++){
+    double before = Now();
+    occupancy = ehf.Analyse();
+    latencies.push_back(Now() - before);
+  }
+  PrintPhase(mode, "analyse", latencies, Now() - start, 0);
+  printf("suite mode=%s phase=occupancy buckets=%ld records=%ld index_depth=%d"
+	 " load_factor=%.4f slots_per_bucket=%.4f wasted_bytes=%ld\n",
+	 mode, occupancy.buckets, occupancy.records, occupancy.indexDepth,
+	 occupancy.loadFactor, occupancy.slotsPerBucket, occupancy.wastedBytes);
+  ehf.Close();
+
+  if (inContainer){
+    EHFContainer container;
+    IndexHolder index;
+    if (!container.Open(containerFileName) ||
+	!container.LoadIndex(&index, EHF_OPEN_READINDEX)){
+      fprintf(stderr, "suite: could not read the index of %s\n", containerFileName);
+      return 1;
+    }
+    int depth = index.GetDepth();
+    container.Close();
+    for (int step = 0; step < 3; step++, depth += OPENDEPTHSTEP){
+      if ( (step > 0) && !DeepenIndex(containerFileName, depth) ){
+	fprintf(stderr, "suite: could not deepen the index of %s\n", containerFileName);
+	return 1;
+      }
+      latencies.clear();
+      start = Now();
+      for (int i = 0; i < repeats; i++){
+	double before = Now();
+	bool opened = ehf.Open(fileName);
+	ehf.Close();
+	latencies.push_back(Now() - before);
+	if (!opened){
+	  fprintf(stderr, "suite: could not open %s\n", fileName);
+	  return 1;
+	}
+      }
+      PrintPhase(mode, "open_close", latencies, Now() - start, depth);
+    }
+  }
+
+  std::vector<int> spread;
+  for (int n = 0; n < MAXBENCHKEYS; n += SPLITSTRIDE){
+    spread.push_back(n);
+  }
+  {
+    ExtendibleHashFile grown(options);
+    if (!InsertPhase(mode, "split_growth", fileName, spread, grown)){
+      return 1;
+    }
+    grown.Close();
+  }
+  RemoveTable(fileName);
+  return 0;
+}
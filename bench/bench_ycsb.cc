@@ -0,0 +1,361 @@
+/*
+=========================================================================================
+Name    | BenchYCSB
+Purpose | Drive a table with the mixes of the YCSB core workloads, from several threads,
+        | with keys chosen uniformly, by a Zipfian distribution, or by one favouring the
+        | latest inserted, and report the rate and latency of each type of operation.
+----------------------------------------------------------------------------------------|
+Notes   | The workloads, and the distribution each uses unless told otherwise:         |
+        |   a  50% read, 50% update                                  zipfian            |
+        |   b  95% read, 5% update                                   zipfian            |
+        |   c  100% read                                             zipfian            |
+        |   d  95% read, 5% insert                                   latest             |
+        |   e  95% scan, 5% insert                                   zipfian            |
+        |   f  50% read, 50% read-modify-write                       zipfian            |
+        | Keys are MakeKey's, IDSIZE chars, so a table holds at most MAXBENCHKEYS of   |
+        | them; inserts past that are done as reads. A hash table keeps no key order,  |
+        | so a scan is a run of lookups of consecutive key numbers, up to MAXSCAN of   |
+        | them. Records are RECORDSIZE chars in the table, of which the first record   |
+        | bytes are filled. An update is an UpdateRecord of a fresh record, written in  |
+        | place, and a read-modify-write a Modify, which reads the record and writes   |
+        | its successor atomically.                                                     |
+        | The Zipfian keys are scrambled, as YCSB's are, so that the hot keys are spread |
+        | over the table rather than being the first ones loaded.                       |
+=========================================================================================
+*/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+#include "bench.h"
+
+// Skew of the Zipfian distribution, as YCSB has it
+const double ZIPFIANCONSTANT = 0.99;
+
+// Longest scan
+const int MAXSCAN = 100;
+
+// Histogram buckets: [0, 1) microseconds, then doubling, the last open ended
+const int LATENCYBUCKETS = 24;
+
+enum Operation{ READ, UPDATE, INSERT, SCAN, RMW, OPERATIONS };
+static const char* operationNames[OPERATIONS] = { "read", "update", "insert", "scan",
+						   "rmw" };
+
+/*
+=========================================================================================
+Name    | Zipfian
+Purpose | Ranks from 0 to n-1, rank r drawn in proportion to 1 / (r+1)^theta
+Notes   | As YCSB's ZipfianGenerator (Gray et al., Quickly Generating Billion-Record
+        | Synthetic Databases): zeta(n) is summed once, then each draw takes one uniform
+        | number and a pow.
+=========================================================================================
+*/
+class Zipfian{
+ public:
+  Zipfian(long n, double theta)
+  {
+    _n = n;
+    _theta = theta;
+    double zeta2 = Zeta(2, theta);
+    _zetan = Zeta(n, theta);
+    _alpha = 1.0 / (1.0 - theta);
+    _eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / _zetan);
+  }
+
+  long
+  Next(double u) const
+  {
+    double uz = u * _zetan;
+    if (uz < 1.0){
+      return 0;
+    }
+    if (uz < 1.0 + pow(0.5, _theta)){
+      return 1;
+    }
+    long rank = static_cast<long>(_n * pow(_eta * u - _eta + 1.0, _alpha));
+    return (rank < _n) ? rank : _n - 1;
+  }
+
+ private:
+  static double
+  Zeta(long n, double theta)
+  {
+    double sum = 0;
+    for (long i = 1; i <= n; i++){
+      sum += 1.0 / pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  long _n;
+  double _theta;
+  double _zetan;
+  double _alpha;
+  double _eta;
+};
+
+// FNV-1a of a rank, to scramble Zipfian ranks over the key numbers
+static uint64_t
+ScrambleRank(uint64_t rank)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < 8; i++){
+    hash = (hash ^ (rank & 0xff)) * 1099511628211ULL;
+    rank >>= 8;
+  }
+  return hash;
+}
+
+struct Mix{
+  char name;
+  int percent[OPERATIONS];                           // Of each operation, adding to 100
+  const char* distribution;
+};
+
+static const Mix mixes[] = {
+  { 'a', { 50, 50, 0, 0, 0 }, "zipfian" },
+  { 'b', { 95, 5, 0, 0, 0 }, "zipfian" },
+  { 'c', { 100, 0, 0, 0, 0 }, "zipfian" },
+  { 'd', { 95, 0, 5, 0, 0 }, "latest" },
+  { 'e', { 0, 0, 5, 95, 0 }, "zipfian" },
+  { 'f', { 50, 0, 0, 0, 50 }, "zipfian" },
+};
+
+// What each thread times, by operation
+struct Timings{
+  std::vector<double> latencies[OPERATIONS];
+  long histogram[OPERATIONS][LATENCYBUCKETS];
+};
+
+static int
+HistogramBucket(double seconds)
+{
+  double microseconds = seconds * 1e6;
+  int bucket = 0;
+  for (double bound = 1.0; (microseconds >= bound) && (bucket < LATENCYBUCKETS - 1);
+       bound *= 2){
+    bucket++;
+  }
+  return bucket;
+}
+
+static void
+FillRecord(int n, int recordBytes, int version, char* record)
+{
+  MakeRecord(n, record);
+  int used = strlen(record);
+  for (int i = used; i < recordBytes; i++){
+    record[i] = 'a' + (i + version) % 26;
+  }
+  memset(record + recordBytes, '\0', RECORDSIZE + 1 - recordBytes);
+}
+
+int
+BenchYCSB(int argc, char** argv)
+{
+  char workload = (argc > 0) ? argv[0][0] : 'a';
+  const char* distribution = (argc > 1) ? argv[1] : "default";
+  int threads = (argc > 2) ? atoi(argv[2]) : 4;
+  int operations = (argc > 3) ? atoi(argv[3]) : 1000000;
+  int records = (argc > 4) ? atoi(argv[4]) : 20000;
+  int recordBytes = (argc > 5) ? atoi(argv[5]) : RECORDSIZE;
+  const char* mode = (argc > 6) ? argv[6] : "container";
+  const Mix* mix = nullptr;
+  for (const Mix& candidate : mixes){
+    if (candidate.name == workload){
+      mix = &candidate;
+    }
+  }
+  if (mix == nullptr){
+    fprintf(stderr, "ycsb: no workload %c, only a to f\n", workload);
+    return 1;
+  }
+  if (strcmp(distribution, "default") == 0){
+    distribution = mix->distribution;
+  }
+  bool zipfian = (strcmp(distribution, "zipfian") == 0);
+  bool latest = (strcmp(distribution, "latest") == 0);
+  if (!zipfian && !latest && (strcmp(distribution, "uniform") != 0)){
+    fprintf(stderr, "ycsb: no distribution %s, only uniform, zipfian or latest\n",
+	    distribution);
+    return 1;
+  }
+  if ( (threads < 1) || (operations < 1) || (records < 1) ){
+    fprintf(stderr, "ycsb: threads, operations and records must be positive\n");
+    return 1;
+  }
+  records = std::min(records, MAXBENCHKEYS);
+  recordBytes = std::max(IDSIZE, std::min(recordBytes, RECORDSIZE));
+  EHFOptions options;
+  if (strcmp(mode, "direct") == 0){
+    options.directIO = true;
+  } else if (strcmp(mode, "memory") == 0){
+    options.inMemory = true;
+  } else if (strcmp(mode, "container") != 0){
+    fprintf(stderr, "ycsb: no mode %s, only container, direct or memory\n", mode);
+    return 1;
+  }
+
+  // Load
+  char fileName[] = "ehfbench-ycsb";
+  char containerFileName[] = "ehfbench-ycsb.eh";
+  unlink(containerFileName);
+  ExtendibleHashFile ehf(options);
+  if (!ehf.Open(fileName, false)){
+    fprintf(stderr, "ycsb: could not create %s\n", fileName);
+    return 1;
+  }
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int i = 0; i < records; i++){
+    MakeKey(i, key);
+    FillRecord(i, recordBytes, 0, record);
+    if (ehf.InsertRecord(key, record) != EHF_INSERTED){
+      fprintf(stderr, "ycsb: could not load record %d\n", i);
+      return 1;
+    }
+  }
+
+  // Run
+  Zipfian ranks(latest ? MAXBENCHKEYS : records, ZIPFIANCONSTANT);
+  std::atomic<int> inserted(records);                // Key numbers in the table
+  std::atomic<int> nextInsert(records);              // Key number for the next insert
+  std::vector<Timings> timings(threads);
+  std::vector<std::thread> workers;
+  double start = Now();
+  for (int t = 0; t < threads; t++){
+    int share = operations / threads + ((t < operations % threads) ? 1 : 0);
+    workers.emplace_back([&, t, share](){
+      Timings& mine = timings[t];
+      memset(mine.histogram, 0, sizeof(mine.histogram));
+      unsigned seed = t + 1;
+      char workerKey[IDSIZE+1];
+      char workerRecord[RECORDSIZE+1];
+      // A key number already inserted, as the distribution has it
+      auto chooseKey = [&]() -> int {
+	int count = inserted.load(std::memory_order_relaxed);
+	double u = rand_r(&seed) / (RAND_MAX + 1.0);
+	if (latest){
+	  return count - 1 - ranks.Next(u) % count;
+	}
+	if (zipfian){
+	  return ScrambleRank(ranks.Next(u)) % count;
+	}
+	return static_cast<int>(u * count);
+      };
+      for (int i = 0; i < share; i++){
+	int roll = rand_r(&seed) % 100;
+	int operation = 0;
+	while (roll >= mix->percent[operation]){
+	  roll -= mix->percent[operation++];
+	}
+	int n = -1;
+	if (operation == INSERT){
+	  n = nextInsert.fetch_add(1);
+	  if (n >= MAXBENCHKEYS){
+	    n = -1;
+	    operation = READ;
+	  }
+	}
+	if (n < 0){
+	  n = chooseKey();
+	}
+	MakeKey(n, workerKey);
+	double before = Now();
+	switch (operation){
+	case READ:
+	  ehf.RetrieveRecord(workerKey, workerRecord);
+	  break;
+	case UPDATE:
+	  FillRecord(n, recordBytes, i + 1, workerRecord);
+	  ehf.UpdateRecord(workerKey, workerRecord);
+	  break;
+	case INSERT:
+	  FillRecord(n, recordBytes, 0, workerRecord);
+	  if (ehf.InsertRecord(workerKey, workerRecord) == EHF_INSERTED){
+	    // Inserts may finish out of order, so only ever move the count up
+	    int count = inserted.load();
+	    while ( (count < n + 1) && !inserted.compare_exchange_weak(count, n + 1) ){
+	    }
+	  }
+	  break;
+	case SCAN:
+	  {
+	    int length = 1 + rand_r(&seed) % MAXSCAN;
+	    int count = inserted.load(std::memory_order_relaxed);
+	    for (int s = n; (s < n + length) && (s < count); s++){
+	      MakeKey(s, workerKey);
+	      ehf.RetrieveRecord(workerKey, workerRecord);
+	    }
+	  }
+	  break;
+	case RMW:
+	  ehf.Modify(workerKey, [&](char* record){
+	      memcpy(workerRecord, record, RECORDSIZE + 1);
+	      FillRecord(n, recordBytes, i + 1, record);
+	      return true;
+	    });
+	  break;
+	}
+	double took = Now() - before;
+	mine.latencies[operation].push_back(took);
+	mine.histogram[operation][HistogramBucket(took)]++;
+      }
+    });
+  }
+  for (std::thread& worker : workers){
+    worker.join();
+  }
+  double seconds = Now() - start;
+
+  printf("ycsb workload=%c distribution=%s mode=%s threads=%d records=%d record_bytes=%d"
+	 " op=all ops=%d seconds=%.6f ops_per_second=%.0f\n",
+	 workload, distribution, mode, threads, records, recordBytes, operations, seconds,
+	 operations / seconds);
+  for (int operation = 0; operation < OPERATIONS; operation++){
+    std::vector<double> latencies;
+    long histogram[LATENCYBUCKETS] = { 0 };
+    for (Timings& thread : timings){
+      latencies.insert(latencies.end(), thread.latencies[operation].begin(),
+		       thread.latencies[operation].end());
+      for (int b = 0; b < LATENCYBUCKETS; b++){
+	histogram[b] += thread.histogram[operation][b];
+      }
+    }
+    if (latencies.empty()){
+      continue;
+    }
+    printf("ycsb workload=%c op=%s ops=%zu ops_per_second=%.0f",
+	   workload, operationNames[operation], latencies.size(), latencies.size() / seconds);
+    PrintPercentiles(latencies);
+    // Each bucket as upper bound in microseconds:count, the last one open ended
+    printf(" histogram_us=");
+    bool first = true;
+    for (int b = 0; b < LATENCYBUCKETS; b++){
+      if (histogram[b] == 0){
+	continue;
+      }
+      if (b < LATENCYBUCKETS - 1){
+	printf("%s%ld:%ld", first ? "" : ",", 1L << b, histogram[b]);
+      } else {
+	printf("%sinf:%ld", first ? "" : ",", histogram[b]);
+      }
+      first = false;
+    }
+    printf("\n");
+  }
+  ehf.Close();
+  unlink(containerFileName);
+  return 0;
+}
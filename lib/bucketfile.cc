@@ -0,0 +1,391 @@
+/*
+=========================================================================================
+Name	 | BucketFile
+Purpose	 | Direct I/O of bucket pages through a cache of our own, see bucketfile.h
+=========================================================================================
+*/
+
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+// For file system methods and constants
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "bucketfile.h"
+#include "ehfconsts.h"
+#include "ehftrace.h"
+
+/*
+=========================================================================================
+Name	 | BucketFile constructor / destructor
+=========================================================================================
+*/
+BucketFile::
+BucketFile()
+{
+  _fileDescriptor = -1;
+  _direct = false;
+  _firstPosition = 0;
+  _pageSize = 0;
+  _framesPerShard = 0;
+  _tracer = nullptr;
+  for (Shard& shard : _shards){
+    shard.hand = 0;
+    shard.frames = nullptr;
+    shard.hits = 0;
+    shard.misses = 0;
+  }
+}
+
+BucketFile::
+~BucketFile()
+{
+  Close();
+}
+
+/*
+=========================================================================================
+Name	 | Open
+Purpose	 | Open the file for direct I/O if the file system allows it, and set up the cache
+Returns	 | False if the file cannot be opened, or the geometry is not aligned
+=========================================================================================
+*/
+bool
+BucketFile::
+Open(char* fileName,
+     long firstPosition,
+     int pageSize,
+     int cachePages
+     )
+{
+  Close();
+  if ( (pageSize <= 0) || (pageSize % DIRECTALIGN != 0) ||
+       (firstPosition % DIRECTALIGN != 0) ){
+    return false;
+  }
+  _fileDescriptor = open(fileName, O_RDWR | O_DIRECT);
+  _direct = (_fileDescriptor >= 0);
+  if (!_direct){
+    _fileDescriptor = open(fileName, O_RDWR);
+    if (_fileDescriptor < 0){
+      return false;
+    }
+  }
+  _firstPosition = firstPosition;
+  _pageSize = pageSize;
+  _framesPerShard = (cachePages + CACHESHARDS - 1) / CACHESHARDS;
+  if (_framesPerShard < 1){
+    _framesPerShard = 1;
+  }
+  for (Shard& shard : _shards){
+    void* frames = nullptr;
+    if (posix_memalign(&frames, DIRECTALIGN,
+		       static_cast<size_t>(_framesPerShard) * _pageSize) != 0){
+      throw std::bad_alloc();
+    }
+    shard.frames = static_cast<char*>(frames);
+    shard.pageOf.assign(_framesPerShard, -1);
+    shard.referenced.assign(_framesPerShard, false);
+    shard.pins.assign(_framesPerShard, 0);
+    shard.frameOf.clear();
+    shard.hand = 0;
+    shard.hits = 0;
+    shard.misses = 0;
+  }
+  return true;
+}
+
+void
+BucketFile::
+Close()
+{
+  if (_fileDescriptor >= 0){
+    close(_fileDescriptor);
+  }
+  _fileDescriptor = -1;
+  for (Shard& shard : _shards){
+    free(shard.frames);
+    shard.frames = nullptr;
+    shard.frameOf.clear();
+    shard.pageOf.clear();
+    shard.referenced.clear();
+    shard.pins.clear();
+  }
+}
+
+/*
+=========================================================================================
+Name	 | Read
+Purpose	 | Copy the start of a page out of the cache, reading the page in on a miss
+=========================================================================================
+*/
+int
+BucketFile::
+Read(int page,
+     void* bucket,
+     int bytes
+     )
+{
+  if (_fileDescriptor < 0){
+    return EHF_FILENOTOPEN;
+  }
+  Shard& shard = _shards[static_cast<unsigned>(page) % CACHESHARDS];
+  std::lock_guard<std::mutex> latch(shard.latch);
+  bool cached;
+  int frame = FrameFor(shard, page, cached);
+  if (frame < 0){
+    shard.misses++;
+    return Uncached(page, static_cast<char*>(bucket), bytes, false);
+  }
+  char* memory = FrameMemory(shard, frame);
+  if (cached){
+    shard.hits++;
+  } else {
+    shard.misses++;
+    ssize_t dataRead = pread(_fileDescriptor, memory, _pageSize,
+			     _firstPosition + static_cast<long>(_pageSize) * page);
+    if (dataRead != _pageSize){
+      shard.frameOf.erase(page);
+      shard.pageOf[frame] = -1;
+      return EHF_READERROR;
+    }
+  }
+  memcpy(bucket, memory, bytes);
+  return EHF_READOK;
+}
+
+/*
+=========================================================================================
+Name	 | Write
+Purpose	 | Put a bucket in its page's frame and write the frame to the file
+Notes	 | A frame whose write failed may not match the file, so it is dropped. A pinned
+	 | frame of the page is left as it is, and no longer caches the page.
+=========================================================================================
+*/
+int
+BucketFile::
+Write(int page,
+      const void* bucket,
+      int bytes
+      )
+{
+  if (_fileDescriptor < 0){
+    return EHF_FILENOTOPEN;
+  }
+  Shard& shard = _shards[static_cast<unsigned>(page) % CACHESHARDS];
+  std::lock_guard<std::mutex> latch(shard.latch);
+  std::unordered_map<int, int>::iterator found = shard.frameOf.find(page);
+  if ( (found != shard.frameOf.end()) && (shard.pins[found->second] > 0) ){
+    shard.pageOf[found->second] = -1;
+    shard.frameOf.erase(found);
+  }
+  bool cached;
+  int frame = FrameFor(shard, page, cached);
+  if (frame < 0){
+    return Uncached(page, static_cast<char*>(const_cast<void*>(bucket)), bytes, true);
+  }
+  char* memory = FrameMemory(shard, frame);
+  memcpy(memory, bucket, bytes);
+  memset(memory + bytes, 0, _pageSize - bytes);
+  ssize_t wrote = pwrite(_fileDescriptor, memory, _pageSize,
+			 _firstPosition + static_cast<long>(_pageSize) * page);
+  if (wrote != _pageSize){
+    shard.frameOf.erase(page);
+    shard.pageOf[frame] = -1;
+    return EHF_WRITEERROR;
+  }
+  return EHF_WROTEOK;
+}
+
+/*
+=========================================================================================
+Name	 | Pin
+Purpose	 | Read page into the cache if need be, and keep its frame for the caller
+Notes	 | The pin is the shard and the frame in one number, for Unpin to find them by
+=========================================================================================
+*/
+const char*
+BucketFile::
+Pin(int page,
+    int& pin,
+    int& result
+    )
+{
+  result = EHF_FILENOTOPEN;
+  if (_fileDescriptor < 0){
+    return nullptr;
+  }
+  int shardNumber = static_cast<unsigned>(page) % CACHESHARDS;
+  Shard& shard = _shards[shardNumber];
+  std::lock_guard<std::mutex> latch(shard.latch);
+  bool cached;
+  int frame = FrameFor(shard, page, cached);
+  result = EHF_READOK;
+  if (frame < 0){
+    return nullptr;
+  }
+  char* memory = FrameMemory(shard, frame);
+  if (cached){
+    shard.hits++;
+  } else {
+    shard.misses++;
+    ssize_t dataRead = pread(_fileDescriptor, memory, _pageSize,
+			     _firstPosition + static_cast<long>(_pageSize) * page);
+    if (dataRead != _pageSize){
+      shard.frameOf.erase(page);
+      shard.pageOf[frame] = -1;
+      result = EHF_READERROR;
+      return nullptr;
+    }
+  }
+  shard.pins[frame]++;
+  pin = shardNumber * _framesPerShard + frame;
+  return memory;
+}
+
+void
+BucketFile::
+Unpin(int pin
+      )
+{
+  Shard& shard = _shards[pin / _framesPerShard];
+  std::lock_guard<std::mutex> latch(shard.latch);
+  shard.pins[pin % _framesPerShard]--;
+}
+
+void
+BucketFile::
+SetTracer(EHFTracer* tracer
+	  )
+{
+  _tracer = tracer;
+}
+
+bool
+BucketFile::
+Direct()
+{
+  return _direct;
+}
+
+long
+BucketFile::
+CacheHits()
+{
+  long hits = 0;
+  for (Shard& shard : _shards){
+    std::lock_guard<std::mutex> latch(shard.latch);
+    hits += shard.hits;
+  }
+  return hits;
+}
+
+long
+BucketFile::
+CacheMisses()
+{
+  long misses = 0;
+  for (Shard& shard : _shards){
+    std::lock_guard<std::mutex> latch(shard.latch);
+    misses += shard.misses;
+  }
+  return misses;
+}
+
+/*
+  Private member functions
+*/
+
+/*
+=========================================================================================
+Name	 | FrameFor
+Purpose	 | Find the frame caching page, or give page a frame
+Notes	 | The clock hand passes over frames used since it last came by, clearing their
+	 | mark, and takes the first one not used since nor pinned. After two rounds
+	 | every frame has been looked at unmarked, so all of them are pinned. The shard
+	 | latch must be held.
+=========================================================================================
+*/
+int
+BucketFile::
+FrameFor(Shard& shard,
+	 int page,
+	 bool& cached
+	 )
+{
+  std::unordered_map<int, int>::iterator found = shard.frameOf.find(page);
+  if (found != shard.frameOf.end()){
+    cached = true;
+    shard.referenced[found->second] = true;
+    return found->second;
+  }
+  cached = false;
+  int looked = 0;
+  while (shard.referenced[shard.hand] || (shard.pins[shard.hand] > 0)){
+    if (++looked > 2 * _framesPerShard){
+      return -1;
+    }
+    shard.referenced[shard.hand] = false;
+    shard.hand = (shard.hand + 1) % _framesPerShard;
+  }
+  int frame = shard.hand;
+  shard.hand = (shard.hand + 1) % _framesPerShard;
+  if (shard.pageOf[frame] >= 0){
+    shard.frameOf.erase(shard.pageOf[frame]);
+    if (_tracer != nullptr){
+      _tracer->Record(EHF_TRACE_CACHEEVICT, shard.pageOf[frame], page);
+    }
+  }
+  shard.pageOf[frame] = page;
+  shard.frameOf[page] = frame;
+  shard.referenced[frame] = true;
+  return frame;
+}
+
+/*
+=========================================================================================
+Name	 | Uncached
+Purpose	 | Read or write a page through memory of its own, aligned for direct I/O
+=========================================================================================
+*/
+int
+BucketFile::
+Uncached(int page,
+	 char* bucket,
+	 int bytes,
+	 bool write
+	 )
+{
+  void* memory = nullptr;
+  if (posix_memalign(&memory, DIRECTALIGN, _pageSize) != 0){
+    throw std::bad_alloc();
+  }
+  char* aligned = static_cast<char*>(memory);
+  long position = _firstPosition + static_cast<long>(_pageSize) * page;
+  int result;
+  if (write){
+    memcpy(aligned, bucket, bytes);
+    memset(aligned + bytes, 0, _pageSize - bytes);
+    result = (pwrite(_fileDescriptor, aligned, _pageSize, position) == _pageSize) ?
+      EHF_WROTEOK : EHF_WRITEERROR;
+  } else {
+    result = (pread(_fileDescriptor, aligned, _pageSize, position) == _pageSize) ?
+      EHF_READOK : EHF_READERROR;
+    if (result == EHF_READOK){
+      memcpy(bucket, aligned, bytes);
+    }
+  }
+  free(aligned);
+  return result;
+}
+
+char*
+BucketFile::
+FrameMemory(Shard& shard,
+	    int frame
+	    )
+{
+  return shard.frames + static_cast<size_t>(frame) * _pageSize;
+}
@@ -0,0 +1,153 @@
+/*
+=========================================================================================
+Name    | BucketFile                                                                    |
+Purpose | Read and write bucket pages with O_DIRECT, through a cache of our own         |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Open                | Open a file of pages for direct I/O                     |
+        | Close               | Close it, and free the cache                            |
+        | Read                | Copy a bucket out of its cached page, reading it if need|
+        | Write               | Write a bucket's page through the cache to the file     |
+        | Pin                 | Hold a page in the cache, unchanged, until Unpin        |
+        | Unpin               | Let a pinned page go                                    |
+        | SetTracer           | Note each page evicted from the cache on a tracer       |
+----------------------------------------------------------------------------------------|
+Notes   | Direct I/O wants the file position, the length and the memory of every read   |
+        | and write aligned, so pages must be a multiple of DIRECTALIGN and start on   |
+        | such a boundary, as in a container created with a page size of DIRECTALIGN.   |
+        | Each page is cached in a frame of its own, and the cache is then the only copy |
+        | kept in memory: its size is fixed at Open, whatever the size of the file.     |
+        | Writes go straight through to the file, so no frame is ever dirty and frames   |
+        | are given up for reuse in clock order, passing over pinned ones. A pinned     |
+        | frame is never written to: a Write of its page takes another frame, and the   |
+        | pinned one is left to whoever pinned it, to be reused once unpinned. The      |
+        | frames are split into shards by page, each with a latch of its own, so that   |
+        | concurrent readers of different pages seldom wait on each other. Should the   |
+        | file system refuse O_DIRECT, the file is opened as usual and only the cache   |
+        | works as described.                                                          |
+=========================================================================================
+*/
+#ifndef _BuCkEtFiLe__
+#define _BuCkEtFiLe__
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "bucketstore.h"
+
+class EHFTracer;
+
+// Alignment that direct I/O asks for, and so the page size for direct I/O
+const int DIRECTALIGN = 4096;
+
+// Shards of the cache
+const int CACHESHARDS = 16;
+
+class BucketFile : public BucketStore{
+ public:
+  BucketFile();
+  ~BucketFile();
+
+  // Open fileName, whose page n starts at firstPosition + n * pageSize, with room in
+  // the cache for cachePages pages
+  bool
+  Open(char* fileName,
+       long firstPosition,
+       int pageSize,
+       int cachePages
+       );
+
+  void
+  Close();
+
+  // Copy bytes from the start of page into bucket. EHF_READOK or EHF_READERROR.
+  int
+  Read(int page,
+       void* bucket,
+       int bytes
+       ) override;
+
+  // Make bytes from bucket the start of page, the rest of it zeroes, and write the page.
+  // EHF_WROTEOK or EHF_WRITEERROR.
+  int
+  Write(int page,
+	const void* bucket,
+	int bytes
+	) override;
+
+  // Pin page in the cache and return its memory, which stays as it is until Unpin
+  // is given pin. nullptr, with result EHF_READOK, if every frame the page could use
+  // is pinned already; with result EHF_READERROR if the page could not be read.
+  const char*
+  Pin(int page,
+      int& pin,
+      int& result
+      );
+
+  void
+  Unpin(int pin
+	);
+
+  // Record an EHF_TRACE_CACHEEVICT on tracer whenever a frame is given to another page,
+  // nullptr for none
+  void
+  SetTracer(EHFTracer* tracer
+	    );
+
+  // True if the file was opened with O_DIRECT
+  bool
+  Direct();
+
+  // Reads answered from the cache, and reads that went to the file
+  long
+  CacheHits();
+
+  long
+  CacheMisses();
+
+ private:
+  struct Shard{
+    std::mutex latch;                               // Guards the rest of the shard
+    std::unordered_map<int, int> frameOf;           // Page to frame
+    std::vector<int> pageOf;                        // Frame to page, -1 if unused
+    std::vector<bool> referenced;                   // Used since the hand last passed
+    std::vector<int> pins;                          // Pins held on each frame
+    int hand;                                       // Next frame the clock looks at
+    char* frames;                                   // The frames, DIRECTALIGN aligned
+    long hits;
+    long misses;
+  };
+
+  // A frame of shard for page, the least recently used by the clock if page has none,
+  // or -1 if every frame is pinned
+  int
+  FrameFor(Shard& shard,
+	   int page,
+	   bool& cached
+	   );
+
+  // Read or write a page without the cache, for when FrameFor has no frame to give
+  int
+  Uncached(int page,
+	   char* bucket,
+	   int bytes,
+	   bool write
+	   );
+
+  char*
+  FrameMemory(Shard& shard,
+	      int frame
+	      );
+
+  int _fileDescriptor;                              // The file, maybe opened O_DIRECT
+  bool _direct;                                     // Whether it was
+  long _firstPosition;                              // Position of page 0
+  int _pageSize;                                    // Bytes per page
+  int _framesPerShard;
+  EHFTracer* _tracer;                               // For evictions, or nullptr
+  Shard _shards[CACHESHARDS];
+};
+
+#endif
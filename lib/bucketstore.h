@@ -0,0 +1,44 @@
+/*
+=========================================================================================
+Name    | BucketStore                                                                   |
+Purpose | Somewhere other than a file descriptor for EHFBucket to read and write pages  |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Read                | Copy a bucket out of its page                           |
+        | Write               | Make a bucket the contents of its page                  |
+----------------------------------------------------------------------------------------|
+Notes   | Pages are numbered as buckets are, so a bucket's page is its bucket number.   |
+        | An EHFBucket given a store (ChangeStore) goes through it in place of pread    |
+        | and pwrite on its file descriptor. See BucketFile, for direct I/O, and        |
+        | MemoryBucketStore, for a table with no file at all.                           |
+        | Writes are serialised by the caller, but reads may come at any time, from any |
+        | thread, alongside them: a read torn by a write is fine, as readers validate   |
+        | what they read (see ExtendibleHashFile::RetrieveRecord), so long as it reads  |
+        | memory the store still owns.                                                  |
+=========================================================================================
+*/
+#ifndef _BuCkEtStOrE__
+#define _BuCkEtStOrE__
+
+class BucketStore{
+ public:
+  virtual ~BucketStore() {}
+
+  // Copy bytes from the start of page into bucket. EHF_READOK or EHF_READERROR.
+  virtual int
+  Read(int page,
+       void* bucket,
+       int bytes
+       ) = 0;
+
+  // Make bytes from bucket the start of page, the rest of it zeroes.
+  // EHF_WROTEOK or EHF_WRITEERROR.
+  virtual int
+  Write(int page,
+	const void* bucket,
+	int bytes
+	) = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+=========================================================================================
+Name	 | Checksum
+Purpose	 | CRC-32, one byte at a time from a table
+=========================================================================================
+*/
+#include "checksum.h"
+
+// The reflected IEEE polynomial
+const uint32_t CRC32POLYNOMIAL = 0xEDB88320u;
+
+/*
+=========================================================================================
+Name	 | Crc32Table
+Purpose	 | Return the table of the CRCs of every byte value, made on first use
+=========================================================================================
+*/
+static const uint32_t*
+Crc32Table()
+{
+  struct Table{
+    uint32_t entries[256];
+    Table(){
+      for (uint32_t byte = 0; byte < 256; byte++){
+	uint32_t crc = byte;
+	for (int bit = 0; bit < 8; bit++){
+	  crc = (crc & 1) ? ((crc >> 1) ^ CRC32POLYNOMIAL) : (crc >> 1);
+	}
+	entries[byte] = crc;
+      }
+    }
+  };
+  static const Table table;
+  return table.entries;
+}
+
+uint32_t
+Crc32(const void* data,
+      size_t length,
+      uint32_t crc
+      )
+{
+  const uint32_t* table = Crc32Table();
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++){
+    crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
@@ -0,0 +1,21 @@
+/*
+=========================================================================================
+Name    | Checksum                                                                      |
+Purpose | CRC-32 of a block of bytes, for checking what is read back from disc          |
+=========================================================================================
+*/
+#ifndef _ChEcKsUm__
+#define _ChEcKsUm__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The CRC-32 (IEEE, as used by zlib) of length bytes of data. To checksum data held in
+// pieces, pass the result for the pieces so far as crc, starting from 0.
+uint32_t
+Crc32(const void* data,
+      size_t length,
+      uint32_t crc = 0
+      );
+
+#endif
@@ -0,0 +1,400 @@
+/*
+=========================================================================================
+Name     | CompactIndexHolder                                                           |
+Purpose  | Hold an extendible index as a binary trie, one leaf per bucket               |
+=========================================================================================
+*/
+#include <new>
+#include <cstdlib>
+#include <vector>
+
+// For file system methods and constants
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "compactindexholder.h"
+
+// Nodes in the first block, see the class notes. Must be a power of two.
+const int FIRSTBLOCKNODES = 64;
+const int FIRSTBLOCKBIT = 6;
+
+// Number of slots gathered up before Write writes them out
+const int TRIEWRITECHUNK = 1024;
+
+/*
+=========================================================================================
+Name     | Constructors
+=========================================================================================
+*/
+CompactIndexHolder::CompactIndexHolder()
+{
+  _indexDepth = 1;
+  _root = -1;                                           // Not loaded, see GetAddress
+  for (int block = 0; block < NUMBITS; block++){
+    _blocks[block] = nullptr;
+  }
+  _nodeCount = 0;
+}
+
+CompactIndexHolder::CompactIndexHolder(int initialDepth)
+{
+  if ( !( (initialDepth >= 1) && (initialDepth <= 32) ) ){
+    initialDepth = 1;
+  }
+  _indexDepth = initialDepth;
+  _root = -(0 + 1);                                     // One leaf, for address 0
+  for (int block = 0; block < NUMBITS; block++){
+    _blocks[block] = nullptr;
+  }
+  _nodeCount = 0;
+}
+
+/*
+=========================================================================================
+Name     | Destructor
+=========================================================================================
+*/
+CompactIndexHolder::
+~CompactIndexHolder()
+{
+  FreeNodes();
+}
+
+/*
+=========================================================================================
+Name     | Load
+Purpose  | Read an index written in the .ehd layout, and rebuild the trie from it
+=========================================================================================
+*/
+bool
+CompactIndexHolder::
+Load(int fileDescriptor,
+     long position
+     )
+{
+  if (fileDescriptor < 0){
+    return false;
+  }
+  FreeNodes();
+  _root = -1;
+
+  // Seek to the start of the index
+  lseek(fileDescriptor, position, SEEK_SET);
+
+  // Read the index depth
+  int depth;
+  int dataRead = read(fileDescriptor, &depth, sizeof(depth));
+  if ( (dataRead != sizeof(depth)) || (depth < 1) || (depth > NUMBITS - 2) ){
+    return false;
+  }
+
+  // Read the index, every address becoming a leaf
+  size_t numOfAddresses = static_cast<size_t>(1) << depth;
+  std::vector<int> links(numOfAddresses);
+  dataRead = read(fileDescriptor, links.data(), sizeof(int) * numOfAddresses);
+  if ( static_cast<size_t>(dataRead) != (sizeof(int) * numOfAddresses) ){
+    return false;
+  }
+  for (size_t i = 0; i < numOfAddresses; i++){
+    links[i] = -(links[i] + 1);
+  }
+  BuildFromLeaves(links, depth);
+  return true;
+}
+
+/*
+=========================================================================================
+Name     | Attach
+Purpose  | Build the trie from an array of slots. The trie never uses them in place.
+=========================================================================================
+*/
+bool
+CompactIndexHolder::
+Attach(int* slots,
+       int depth,
+       bool inPlace
+       )
+{
+  (void) inPlace;
+  if ( (slots == nullptr) || (depth < 1) || (depth > NUMBITS - 2) ){
+    return false;
+  }
+  FreeNodes();
+  size_t numOfAddresses = static_cast<size_t>(1) << depth;
+  // A slot holds its address plus one, so its leaf is just its negation
+  std::vector<int> links(numOfAddresses);
+  for (size_t i = 0; i < numOfAddresses; i++){
+    links[i] = -slots[i];
+  }
+  BuildFromLeaves(links, depth);
+  return true;
+}
+
+bool
+CompactIndexHolder::
+Write(int fileDescriptor,
+      long position
+      )
+{
+  if (fileDescriptor < 0){
+    return false;
+  }
+  // Seek to the start of the index
+  lseek(fileDescriptor, position, SEEK_SET);
+
+  // Write the index depth
+  int depth = _indexDepth;
+  int dataWrote = write(fileDescriptor, &depth, sizeof(depth));
+  if ( dataWrote != sizeof(depth) ){
+    return false;
+  }
+
+  // Write every index value's address
+  int chunk[TRIEWRITECHUNK];
+  int numOfAddresses = GetNumberOfAddresses();
+  for (int start = 0; start < numOfAddresses; start += TRIEWRITECHUNK){
+    int count = numOfAddresses - start;
+    if (count > TRIEWRITECHUNK){
+      count = TRIEWRITECHUNK;
+    }
+    for (int i = 0; i < count; i++){
+      chunk[i] = GetAddress(start + i);
+    }
+    dataWrote = write(fileDescriptor, chunk, (sizeof(int) * count));
+    if ( static_cast<size_t>(dataWrote) != (sizeof(int) * count) ){
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+CompactIndexHolder::
+IncreaseDepth()
+{
+  _indexDepth = _indexDepth + 1;
+}
+
+int
+CompactIndexHolder::
+GetDepth()
+{
+  return _indexDepth;
+}
+
+int
+CompactIndexHolder::
+GetNumberOfAddresses()
+{
+  return 1 << _indexDepth;
+}
+
+/*
+=========================================================================================
+Name     | GetAddress
+Purpose  | Return the address for a given index
+Returns  | The address for the given index, or -1 if the index value is out of range
+Notes    | Starting at the root, each node is left by the link picked by the next bit of
+         | the index, lowest bit first, until a leaf is reached.
+=========================================================================================
+*/
+int
+CompactIndexHolder::
+GetAddress(int index
+	   )
+{
+  if ( (index < 0) || (index >= GetNumberOfAddresses()) ){
+    return -1;
+  }
+  int link = _root.load(std::memory_order_acquire);
+  while (link >= 0){
+    link = Children(link)[index & 1];
+    index >>= 1;
+  }
+  return -link - 1;
+}
+
+/*
+=========================================================================================
+Name     | SplitAddress
+Purpose  | Replace the leaf of a split bucket by a node over the old and new buckets
+Notes    | The walk down follows the bucketDepth bits of bucketValue. Should it meet a
+         | leaf early (a bucket shallower than bucketDepth), that leaf is pushed down a
+         | level at a time, so that only the index values of the split bucket move.
+=========================================================================================
+*/
+void
+CompactIndexHolder::
+SplitAddress(int bucketValue,                           // Bit pattern held by the bucket
+	     int bucketDepth,                           // Depth of the bucket before split
+	     int newAddress                             // Address of the new bucket
+	     )
+{
+  std::atomic<int>* rootLink = &_root;
+  int* link = nullptr;                                  // Link into the current leaf
+  for (int bit = 0; bit <= bucketDepth; bit++){
+    int current = (link == nullptr) ? rootLink->load() : *link;
+    int replacement = current;
+    if (bit == bucketDepth){
+      replacement = NewNode(current, -(newAddress + 1));
+    } else if (current < 0){
+      replacement = NewNode(current, current);
+    }
+    if (replacement != current){
+      // The new node is complete before it is linked in
+      std::atomic_thread_fence(std::memory_order_release);
+      if (link == nullptr){
+	rootLink->store(replacement, std::memory_order_release);
+      } else {
+	*link = replacement;
+      }
+    }
+    if (bit < bucketDepth){
+      link = &Children(replacement)[(bucketValue >> bit) & 1];
+    }
+  }
+}
+
+/*
+=========================================================================================
+Name     | MoveAddress
+Purpose  | Replace the leaf of a moved bucket
+Notes    | As in SplitAddress, a shallower leaf met on the way down is pushed down.
+=========================================================================================
+*/
+void
+CompactIndexHolder::
+MoveAddress(int bucketValue,                            // Bit pattern held by the bucket
+	    int bucketDepth,                            // Depth of the bucket
+	    int newAddress                              // Where the bucket is now
+	    )
+{
+  int* link = nullptr;                                  // Link into the current leaf
+  for (int bit = 0; bit < bucketDepth; bit++){
+    int current = (link == nullptr) ? _root.load() : *link;
+    if (current < 0){
+      current = NewNode(current, current);
+      std::atomic_thread_fence(std::memory_order_release);
+      if (link == nullptr){
+	_root.store(current, std::memory_order_release);
+      } else {
+	*link = current;
+      }
+    }
+    link = &Children(current)[(bucketValue >> bit) & 1];
+  }
+  if (link == nullptr){
+    _root.store(-(newAddress + 1), std::memory_order_release);
+  } else {
+    *link = -(newAddress + 1);
+  }
+}
+
+long
+CompactIndexHolder::
+MemoryUsage()
+{
+  long bytes = sizeof(*this);
+  for (int block = 0; block < NUMBITS; block++){
+    if (_blocks[block] != nullptr){
+      bytes += 2 * sizeof(int) * (static_cast<long>(FIRSTBLOCKNODES) << block);
+    }
+  }
+  return bytes;
+}
+
+int
+CompactIndexHolder::
+GetNumberOfNodes()
+{
+  return _nodeCount;
+}
+
+/*
+  Private member functions
+*/
+
+/*
+=========================================================================================
+Name     | BuildFromLeaves
+Purpose  | Build the trie for an index of depth, given a leaf per index value
+Notes    | The trie is built from the bottom up. Each pass pairs up the index values
+         | differing only in their top bit, as the top bit is the last one the trie
+         | looks at. A pair of leaves for the same address becomes one leaf, anything
+         | else becomes a node. links is used up in the process.
+=========================================================================================
+*/
+void
+CompactIndexHolder::
+BuildFromLeaves(std::vector<int>& links,
+		int depth
+		)
+{
+  for (size_t half = links.size() / 2; half >= 1; half /= 2){
+    for (size_t i = 0; i < half; i++){
+      int child0 = links[i];
+      int child1 = links[i + half];
+      if ( (child0 < 0) && (child0 == child1) ){
+	links[i] = child0;
+      } else {
+	links[i] = NewNode(child0, child1);
+      }
+    }
+  }
+  _root = links[0];
+  _indexDepth = depth;
+}
+
+/*
+=========================================================================================
+Name     | NewNode
+Purpose  | Add a node with the given links, a new block being allocated if need be
+Returns  | The number of the new node
+=========================================================================================
+*/
+int
+CompactIndexHolder::
+NewNode(int child0,
+	int child1
+	)
+{
+  int node = _nodeCount;
+  int position = node + FIRSTBLOCKNODES;
+  int highBit = (NUMBITS - 1) - __builtin_clz(static_cast<unsigned>(position));
+  int block = highBit - FIRSTBLOCKBIT;
+  if (_blocks[block] == nullptr){
+    size_t links = 2 * (static_cast<size_t>(FIRSTBLOCKNODES) << block);
+    int* newBlock = static_cast<int*>( malloc(links * sizeof(int)) );
+    if (newBlock == nullptr){
+      throw std::bad_alloc();
+    }
+    _blocks[block] = newBlock;
+  }
+  int* children = Children(node);
+  children[0] = child0;
+  children[1] = child1;
+  _nodeCount++;
+  return node;
+}
+
+int*
+CompactIndexHolder::
+Children(int node
+	 )
+{
+  int position = node + FIRSTBLOCKNODES;
+  int highBit = (NUMBITS - 1) - __builtin_clz(static_cast<unsigned>(position));
+  int* block = _blocks[highBit - FIRSTBLOCKBIT].load(std::memory_order_relaxed);
+  return &block[2 * (position - (1 << highBit))];
+}
+
+void
+CompactIndexHolder::
+FreeNodes()
+{
+  for (int block = 0; block < NUMBITS; block++){
+    free(_blocks[block]);
+    _blocks[block] = nullptr;
+  }
+  _nodeCount = 0;
+}
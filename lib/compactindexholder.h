@@ -0,0 +1,85 @@
+/*
+=========================================================================================
+Name     | CompactIndexHolder                                                           |
+Purpose  | Hold an extendible index as a binary trie, one leaf per bucket               |
+----------------------------------------------------------------------------------------|
+Notes    | IndexHolder keeps a slot for every index value, so a bucket of local depth d |
+         | in an index of depth D takes up 2^(D-d) identical slots. With skewed hash    |
+         | values a few deep buckets push D up, and most of the index is made up of     |
+         | such copies. Here each bucket is a single leaf instead, reached from the     |
+         | root by following the bits of its pattern from the lowest up, so the size of |
+         | the index follows the number of buckets rather than 2^D.                     |
+         | The trie is flattened into the usual .ehd layout by Write, and rebuilt from  |
+         | it by Load, so files do not depend on which index was used.                  |
+=========================================================================================
+*/
+#ifndef _CoMpAcTiNdExHoLdEr__
+#define _CoMpAcTiNdExHoLdEr__
+
+#include <atomic>
+#include <vector>
+
+#include "bit_op_lib.h"
+#include "extendibleindex.h"
+
+class CompactIndexHolder : public ExtendibleIndex
+{
+public:
+/*
+The default constructor is for an index about to be Loaded. The other sets up an index
+of initialDepth with every index value pointing at address 0.
+*/
+CompactIndexHolder();
+CompactIndexHolder(int initialDepth);
+~CompactIndexHolder() override;
+
+bool Load(int fileDescriptor, long position = 0) override;
+bool Write(int fileDescriptor, long position = 0) override;
+bool Attach(int* slots, int depth, bool inPlace) override;
+
+/*
+Index values are told apart by as many bits as their bucket needs and no more, so
+adding a bit to the depth changes nothing but the depth.
+*/
+void IncreaseDepth() override;
+
+int GetDepth() override;
+
+int GetNumberOfAddresses() override;
+
+int GetAddress(int index) override;
+
+/*
+Turn the leaf of the split bucket into a node, with the old bucket as its 0 child and
+the new one as its 1 child.
+*/
+void SplitAddress(int bucketValue, int bucketDepth, int newAddress) override;
+
+void MoveAddress(int bucketValue, int bucketDepth, int newAddress) override;
+
+long MemoryUsage() override;
+
+// The number of nodes (not leaves) in the trie
+int GetNumberOfNodes();
+
+private:
+
+void BuildFromLeaves(std::vector<int>& links, int depth);
+int NewNode(int child0, int child1);
+int* Children(int node);
+void FreeNodes();
+
+// data members
+// A link is either a node number (zero or more) or a leaf, -(address + 1).
+// Node n's two links are kept in block b = (highest bit of n + FIRSTBLOCKNODES) - the
+// bit of FIRSTBLOCKNODES, so each block is twice the size of the one before and
+// blocks never move. A node's links are written before the link to the node itself,
+// and the depth is atomic, as for IndexHolder, for the sake of lock-free readers.
+std::atomic<int>  _indexDepth;
+std::atomic<int>  _root;
+std::atomic<int*> _blocks[NUMBITS];
+int _nodeCount;
+
+};
+
+#endif
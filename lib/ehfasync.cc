@@ -0,0 +1,215 @@
+/*
+=========================================================================================
+Name	 | EHFOperation, EHFScheduler
+Purpose	 | Operations run a stage at a time, see ehfasync.h
+=========================================================================================
+*/
+
+#include <string.h>
+#include <utility>
+
+#include "ehfasync.h"
+#include "ehfconsts.h"
+
+/*
+=========================================================================================
+Name	 | EHFOperation constructor
+=========================================================================================
+*/
+EHFOperation::
+EHFOperation()
+{
+  _file = nullptr;
+  _insert = false;
+  _stage = DONE;
+  _result = EHF_FILENOTOPEN;
+  _returnRecord = nullptr;
+  _writeNumber = 0;
+}
+
+/*
+=========================================================================================
+Name	 | Retrieve / Insert
+Purpose	 | Set the operation up to run from its first stage
+=========================================================================================
+*/
+void
+EHFOperation::
+Retrieve(ExtendibleHashFile* file,
+	 char* keyToFind,
+	 char* returnRecord
+	 )
+{
+  _file = file;
+  _insert = false;
+  _stage = BEGIN;
+  _result = EHF_PENDING;
+  _returnRecord = returnRecord;
+  _file->StartLookup(keyToFind, _lookup);
+}
+
+void
+EHFOperation::
+Insert(ExtendibleHashFile* file,
+       char* keyToAdd,
+       char* recordToAdd
+       )
+{
+  _file = file;
+  _insert = true;
+  _stage = BEGIN;
+  _result = EHF_PENDING;
+  *((char *) mempcpy(_record, recordToAdd, RECORDSIZE)) = '\0';
+  _file->StartLookup(keyToAdd, _lookup);
+}
+
+/*
+=========================================================================================
+Name	 | Resume
+Purpose	 | Run stages until one has to wait on something
+Notes	 | A retrieve runs BEGIN, RESOLVE and FINISH, back to BEGIN should a writer get
+	 | in the way. An insert runs BEGIN and RESOLVE only to get the index slot and the
+	 | bucket on their way, then inserts as InsertRecord does once it has the latch.
+=========================================================================================
+*/
+int
+EHFOperation::
+Resume()
+{
+  switch (_stage){
+  case BEGIN:
+    if (!_file->_fileOpen){
+      return Finish(EHF_FILENOTOPEN);
+    }
+    _file->BeginLookup(_lookup);
+    _stage = RESOLVE;
+    return EHF_PENDING;
+  case RESOLVE:
+    _file->ResolveLookup(_lookup, true);
+    _stage = _insert ? LATCH : FINISH;
+    return EHF_PENDING;
+  case FINISH:
+    {
+      int result;
+      if (!_file->FinishLookup(_lookup, _returnRecord, result)){
+	_file->_stats.Count(EHF_STAT_LOOKUPRETRIES);
+	_stage = BEGIN;
+	return EHF_PENDING;
+      }
+      _file->_stats.Count(EHF_STAT_RETRIEVES);
+      return Finish(result);
+    }
+  case LATCH:
+    {
+      if (!_file->_writeLatch.try_lock()){
+	return EHF_PENDING;
+      }
+      int result = _file->InsertLocked(_lookup.key, _record, _lookup.hashValue,
+				       _writeNumber);
+      _file->_writeLatch.unlock();
+      if ( (result != EHF_INSERTED) ||
+	   (_file->_options.durability != EHF_DURABILITY_COMMIT) ){
+	return Finish(result);
+      }
+      // Give way, so that the inserts of others still in flight share the sync
+      _stage = DURABLE;
+      return EHF_PENDING;
+    }
+  case DURABLE:
+    {
+      bool durable;
+      if (!_file->PollDurable(_writeNumber, durable)){
+	return EHF_PENDING;
+      }
+      return Finish(durable ? EHF_INSERTED : EHF_WRITEERROR);
+    }
+  case DONE:
+    break;
+  }
+  return _result;
+}
+
+bool
+EHFOperation::
+Done() const
+{
+  return (_stage == DONE);
+}
+
+int
+EHFOperation::
+Result() const
+{
+  return _result;
+}
+
+int
+EHFOperation::
+Finish(int result
+       )
+{
+  _stage = DONE;
+  _result = result;
+  return result;
+}
+
+/*
+=========================================================================================
+Name	 | Submit / Poll / Run
+Purpose	 | Keep operations going, round robin, until they finish
+Notes	 | An operation whenDone sets up again stays where it is, to be resumed by the
+	 | next Poll, as do operations submitted by a whenDone, which go on the end.
+	 | whenDone is taken out of its entry while it runs, as a Submit from within it
+	 | may move every entry, and is put back if the operation is set up again.
+=========================================================================================
+*/
+void
+EHFScheduler::
+Submit(EHFOperation* operation,
+       std::function<void(EHFOperation*)> whenDone
+       )
+{
+  _active.push_back( Entry{operation, std::move(whenDone)} );
+}
+
+int
+EHFScheduler::
+Poll()
+{
+  size_t count = _active.size();
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++){
+    EHFOperation* operation = _active[i].operation;
+    if (operation->Resume() != EHF_PENDING){
+      std::function<void(EHFOperation*)> whenDone = std::move(_active[i].whenDone);
+      if (whenDone){
+	whenDone(operation);
+      }
+      if (operation->Done()){
+	continue;
+      }
+      _active[i].whenDone = std::move(whenDone);
+    }
+    if (kept != i){
+      _active[kept] = std::move(_active[i]);
+    }
+    kept++;
+  }
+  _active.erase(_active.begin() + kept, _active.begin() + count);
+  return _active.size();
+}
+
+void
+EHFScheduler::
+Run()
+{
+  while (Poll() > 0){
+  }
+}
+
+int
+EHFScheduler::
+Pending() const
+{
+  return _active.size();
+}
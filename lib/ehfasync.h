@@ -0,0 +1,123 @@
+/*
+=========================================================================================
+Name    | EHFOperation, EHFScheduler                                                    |
+Purpose | Lookups and inserts run a stage at a time, many at once on one thread         |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Retrieve            | Set up an operation to retrieve a record                |
+        | Insert              | Set up an operation to insert a record                  |
+        | Resume              | Run the next stage, EHF_PENDING until the last is done  |
+        | Done / Result       | Whether it has finished, and its return code            |
+        | Submit              | Give the scheduler an operation to run                  |
+        | Poll                | Resume every operation once, in the order submitted     |
+        | Run                 | Poll until every operation has finished                 |
+----------------------------------------------------------------------------------------|
+Notes   | An operation gives way wherever a call would wait: on a load likely to miss   |
+        | the cache, after prefetching it; on a bucket read from disc, after asking for |
+        | it to be read ahead; on the writer latch, if it is held; and on a sync that   |
+        | someone else is running, with EHF_DURABILITY_COMMIT. While one operation      |
+        | waits the scheduler resumes the others, so that thousands of them on a single |
+        | thread keep the memory system, or the disc, busy. Each operation is a small   |
+        | state machine, running the same stages as RetrieveRecord and InsertRecord,   |
+        | which run them back to back, so both give the same results.                   |
+        | A stage that cannot give way still blocks: a bucket read that was not read    |
+        | ahead in time, or a sync this operation runs itself. An insert gives way      |
+        | between inserting and syncing, so that a sync covers every insert the         |
+        | scheduler has in flight, and inserts made together share one.                 |
+        | Neither class is safe to share between threads, but any number of threads may |
+        | each run a scheduler of their own over the same file.                         |
+=========================================================================================
+*/
+#ifndef _EhFaSyNc__
+#define _EhFaSyNc__
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "records.h"
+#include "extendiblehashfile.h"
+
+class EHFOperation{
+ public:
+  EHFOperation();
+
+  // Look for keyToFind in file, returning the record found in returnRecord, which
+  // must hold RECORDSIZE+1 chars and outlive the operation
+  void
+  Retrieve(ExtendibleHashFile* file,
+	   char* keyToFind,
+	   char* returnRecord
+	   );
+
+  // Insert recordToAdd under keyToAdd in file. Both are copied.
+  void
+  Insert(ExtendibleHashFile* file,
+	 char* keyToAdd,
+	 char* recordToAdd
+	 );
+
+  // Run the operation until it next has to wait
+  int                                                // EHF_PENDING, or the result
+  Resume();
+
+  bool
+  Done() const;
+
+  // The return code RetrieveRecord or InsertRecord would have given, once Done
+  int
+  Result() const;
+
+ private:
+  enum Stage{
+    BEGIN,                                           // Prefetch the index slot
+    RESOLVE,                                         // Read it, and get the bucket coming
+    FINISH,                                          // Look in the bucket
+    LATCH,                                           // Insert, once the latch is free
+    DURABLE,                                         // Wait for a sync
+    DONE
+  };
+
+  int
+  Finish(int result
+	 );
+
+  ExtendibleHashFile* _file;
+  bool _insert;                                      // Inserting, rather than retrieving
+  Stage _stage;
+  int _result;
+  EHFLookup _lookup;
+  char* _returnRecord;                               // Where a retrieve returns the record
+  char _record[RECORDSIZE+1];                        // The record an insert adds
+  uint64_t _writeNumber;                             // The insert, for PollDurable
+};
+
+class EHFScheduler{
+ public:
+  // Resume operation on each Poll until it finishes, then call whenDone, if given.
+  // whenDone may set the operation up again, to be kept going, or submit others.
+  void
+  Submit(EHFOperation* operation,
+	 std::function<void(EHFOperation*)> whenDone = nullptr
+	 );
+
+  int                                                // Operations yet to finish
+  Poll();
+
+  void
+  Run();
+
+  int
+  Pending() const;
+
+ private:
+  struct Entry{
+    EHFOperation* operation;
+    std::function<void(EHFOperation*)> whenDone;
+  };
+
+  std::vector<Entry> _active;                        // In the order submitted
+};
+
+#endif
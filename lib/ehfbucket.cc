@@ -6,7 +6,9 @@ Purpose | Bucket behaviour for an extendibile hash file
 */
 
 #include "ehfbucket.h"
+#include "bucketstore.h"
 #include "ehfconsts.h"
+#include "bit_op_lib.h"
 
 #include <iostream>
 #include <cstring>
@@ -21,7 +23,9 @@ Name    | EHFBucket constructor
 Purpose | Construct an EHFBucket
 Notes   | The first constructor should be called for buckets that will be read from the 
         | file. The second constructor should be called for brand new buckets whose
-        | depth needs to be assigned
+        | depth needs to be assigned. The third is the first without clearing the
+        | records, for a bucket whose Read follows straight away and overwrites them:
+        | until then, only its count of records (none) may be relied on.
 =========================================================================================
 */
 // Constructor for existing bucket contained in the file.
@@ -32,10 +36,15 @@ EHFBucket(int fd,                                          // fd of open bucket
 {
   _fileDescriptor = fd;
   _bucketAddress = address;
+  _fileHeaderSize = FILEHEADERSIZE;
+  _pageSize = BUCKETSIZE;
+  _store = nullptr;
   // Initialise bucket buffer
   _bucketBuffer.numOfRecs = 0;  
   _bucketBuffer.depth = 1;                                 // dummy only
-  std::memset(_bucketBuffer.records, '\0', RECSBUFFSIZE);
+  std::memset(_bucketBuffer.records, '\0', sizeof(_bucketBuffer.records));
+  _bucketBuffer.patternMark = 0;                           // Pattern not known
+  _bucketBuffer.pattern = 0;
 }
 
 // Constructor for a bucket which has not yet been written to the file
@@ -47,10 +56,33 @@ EHFBucket(int fd,                                          // fd of open bucket
 {
   _fileDescriptor = fd;
   _bucketAddress = address;
+  _fileHeaderSize = FILEHEADERSIZE;
+  _pageSize = BUCKETSIZE;
+  _store = nullptr;
   // Initialise bucket buffer
   _bucketBuffer.numOfRecs = 0;  
   _bucketBuffer.depth = bitDepth;                          
-  std::memset(_bucketBuffer.records, '\0', RECSBUFFSIZE);
+  std::memset(_bucketBuffer.records, '\0', sizeof(_bucketBuffer.records));
+  _bucketBuffer.patternMark = 0;                           // Pattern not known
+  _bucketBuffer.pattern = 0;
+}
+
+// Constructor for an existing bucket, to be read straight away
+EHFBucket::
+EHFBucket(int fd,                                          // fd of open bucket file
+	  int address,                                     // Bucket number in the file
+	  EHFToBeRead                                      // EHF_TOBEREAD
+	  )
+{
+  _fileDescriptor = fd;
+  _bucketAddress = address;
+  _fileHeaderSize = FILEHEADERSIZE;
+  _pageSize = BUCKETSIZE;
+  _store = nullptr;
+  _bucketBuffer.numOfRecs = 0;
+  _bucketBuffer.depth = 1;                                 // dummy only
+  _bucketBuffer.patternMark = 0;                           // Pattern not known
+  _bucketBuffer.pattern = 0;
 }
 
 /*
@@ -74,24 +106,29 @@ Purpose | Read in the EHFBucket from the file
 Returns | EHF_READOK - if the bucket is read from the file as expected
         | EHF_FILENOTOPEN - if the file descriptor was invalid
         | EHF_READERROR - if there is an error reading the bucket from the file
+Notes   | A bucket that was not read holds no records afterwards
 =========================================================================================
 */
 int 
 EHFBucket::
 Read()
 {
-  if (_fileDescriptor < 0){
-    return EHF_FILENOTOPEN;
-  }
-  // Set the file position to the position of the bucket
-  lseek(_fileDescriptor, BucketPosition(), SEEK_SET);
-  // Attempt to read the bucket
-  int dataRead = read(_fileDescriptor, &_bucketBuffer, sizeof(_bucketBuffer));
-  if (dataRead == sizeof(_bucketBuffer)){
-    return EHF_READOK;
+  int result;
+  if (_store != nullptr){
+    result = _store->Read(_bucketAddress, &_bucketBuffer, sizeof(_bucketBuffer));
+  } else if (_fileDescriptor < 0){
+    result = EHF_FILENOTOPEN;
   } else {
-    return EHF_READERROR;
+    // Attempt to read the bucket. A positional read leaves the shared file offset
+    // alone, so concurrent readers of the same file cannot disturb each other
+    int dataRead = pread(_fileDescriptor, &_bucketBuffer, sizeof(_bucketBuffer),
+			 BucketPosition());
+    result = (dataRead == sizeof(_bucketBuffer)) ? EHF_READOK : EHF_READERROR;
+  }
+  if (result != EHF_READOK){
+    _bucketBuffer.numOfRecs = 0;
   }
+  return result;
 }
 
 /*
@@ -107,14 +144,15 @@ int
 EHFBucket::
 Write()
 {
+  if (_store != nullptr){
+    return _store->Write(_bucketAddress, &_bucketBuffer, sizeof(_bucketBuffer));
+  }
   if (_fileDescriptor < 0){
     return EHF_FILENOTOPEN;
   }
-  // Set the file position to the position of the bucket
-  lseek(_fileDescriptor, BucketPosition(), SEEK_SET);
- 
-  // Attempt to write the bucket
-  int wrote = write(_fileDescriptor, &_bucketBuffer, sizeof(_bucketBuffer));
+  // Attempt to write the bucket at its position in the file
+  int wrote = pwrite(_fileDescriptor, &_bucketBuffer, sizeof(_bucketBuffer),
+		     BucketPosition());
   if (wrote == sizeof(_bucketBuffer)){
     return EHF_WROTEOK;
   } else {
@@ -127,13 +165,13 @@ Write()
 Name    | BucketPosition
 Purpose | Return the start position of this bucket in relation to the start of the file
 Returns | The position in number of bytes from the start of the file, plus the size of
-        | the file header
+        | the file header. Buckets are BUCKETSIZE apart unless given larger pages.
 =========================================================================================
 */
 int 
 EHFBucket::
 BucketPosition(){
-  return ( (BUCKETSIZE * _bucketAddress) + FILEHEADERSIZE );
+  return ( (_pageSize * _bucketAddress) + _fileHeaderSize );
 }
 
 /*
@@ -162,6 +200,116 @@ Depth(){
   return _bucketBuffer.depth;
 }
 
+/*
+=========================================================================================
+Name    | Pattern
+Purpose | Return the bit pattern shared by the keys of this bucket, in its Depth() lowest
+        | bits
+Returns | The pattern, or -1 if the bucket was written without one
+=========================================================================================
+*/
+int
+EHFBucket::
+Pattern(){
+  if (_bucketBuffer.patternMark != EHF_PATTERNMARK){
+    return -1;
+  }
+  return _bucketBuffer.pattern;
+}
+
+/*
+=========================================================================================
+Name    | ChangePattern
+Purpose | Record the bit pattern of this bucket, so that the index can be rebuilt from the
+        | buckets alone (see ehfrecovery.h)
+=========================================================================================
+*/
+void
+EHFBucket::
+ChangePattern(int newPattern
+	      )
+{
+  _bucketBuffer.patternMark = EHF_PATTERNMARK;
+  _bucketBuffer.pattern = newPattern;
+}
+
+/*
+=========================================================================================
+Name    | ReadFromBuffer
+Purpose | Take the bucket from BUCKETSIZE bytes already read from the file, as when many
+        | buckets are read at a time
+Returns | EHF_READOK - if the image holds a plausible bucket
+        | EHF_READERROR - if its record count or depth are out of range
+=========================================================================================
+*/
+int
+EHFBucket::
+ReadFromBuffer(const char* image
+	       )
+{
+  std::memcpy(&_bucketBuffer, image, sizeof(_bucketBuffer));
+  if ( (_bucketBuffer.numOfRecs < 0) || (_bucketBuffer.numOfRecs > FULLBUCKET) ||
+       (_bucketBuffer.depth < 0) || (_bucketBuffer.depth > NUMBITS - 2) ){
+    return EHF_READERROR;
+  }
+  return EHF_READOK;
+}
+
+/*
+=========================================================================================
+Name    | ReadImage
+Purpose | Read the bucket as it is in the file into image, BUCKETSIZE bytes, leaving this
+        | EHFBucket as it was
+Returns | As Read
+=========================================================================================
+*/
+int
+EHFBucket::
+ReadImage(char* image
+	  )
+{
+  if (_store != nullptr){
+    return _store->Read(_bucketAddress, image, sizeof(_bucketBuffer));
+  }
+  if (_fileDescriptor < 0){
+    return EHF_FILENOTOPEN;
+  }
+  int dataRead = pread(_fileDescriptor, image, sizeof(_bucketBuffer), BucketPosition());
+  if (dataRead == sizeof(_bucketBuffer)){
+    return EHF_READOK;
+  } else {
+    return EHF_READERROR;
+  }
+}
+
+/*
+=========================================================================================
+Name    | FindInImage
+Purpose | Find the record for key in a bucket image, as read by ReadImage or held in a
+        | BucketFile page, without copying it
+Returns | The RECORDSIZE bytes of the record within image, or nullptr if not present
+=========================================================================================
+*/
+const char*
+EHFBucket::
+FindInImage(const char* image,
+	    char* key
+	    )
+{
+  const BucketImage* bucket = reinterpret_cast<const BucketImage*>(image);
+  int numOfRecs = bucket->numOfRecs;
+  if ( (numOfRecs < 0) || (numOfRecs > FULLBUCKET) ){
+    return nullptr;
+  }
+  for (int index = 0; index < numOfRecs; ++index){
+    const char* record = &bucket->records[index * RECORDSIZE];
+    if (strncmp(record + IDPOSITION, key, IDSIZE) == 0){
+      return record;
+    }
+  }
+  return nullptr;
+}
+
 /*
 =========================================================================================
 Name    | RecordPosition
@@ -313,6 +461,34 @@ Delete(char* keyToDelete
   }
 }
 
+/*
+=========================================================================================
+Name    | Replace
+Purpose | Overwrite part of the record matching keyToUpdate, where it lies in the bucket
+Params  | position, length - the bytes of the record to overwrite, such as
+        | CALLCODEPOSITION and CALLCODESIZE
+        | value - length bytes to overwrite them with
+Returns | EHF_UPDATED - the record was found and overwritten
+        | EHF_NOT_PRESENT - no records matching keyToUpdate were found
+Notes   | The caller keeps position and length inside the record
+=========================================================================================
+*/
+int
+EHFBucket::
+Replace(char* keyToUpdate,
+	int position,
+	int length,
+	const char* value
+	)
+{
+  int recordNumber = RecordPosition(keyToUpdate);
+  if (recordNumber == -1){
+    return EHF_NOT_PRESENT;
+  }
+  memmove(&_bucketBuffer.records[recordNumber * RECORDSIZE + position], value, length);
+  return EHF_UPDATED;
+}
+
 /*
 =========================================================================================
 Name    | ChangeAddress
@@ -327,3 +503,49 @@ ChangeAddress(int newAddress
 {
   _bucketAddress = newAddress;
 }
+
+/*
+=========================================================================================
+Name    | ChangeFileHeaderSize
+Purpose | Change the size of the header coming before the first bucket in the file
+Params  | newHeaderSize - bytes before bucket 0. FILEHEADERSIZE unless changed.
+=========================================================================================
+*/
+void
+EHFBucket::
+ChangeFileHeaderSize(int newHeaderSize
+		     )
+{
+  _fileHeaderSize = newHeaderSize;
+}
+
+/*
+=========================================================================================
+Name    | ChangePageSize
+Purpose | Change the distance between buckets in the file
+Params  | newPageSize - bytes from the start of one bucket to the next. BUCKETSIZE unless
+        | changed.
+=========================================================================================
+*/
+void
+EHFBucket::
+ChangePageSize(int newPageSize
+	       )
+{
+  _pageSize = newPageSize;
+}
+
+/*
+=========================================================================================
+Name    | ChangeStore
+Purpose | Have Read and Write go through newStore, by bucket number, rather than to the
+        | file descriptor. nullptr to go back to the file descriptor.
+=========================================================================================
+*/
+void
+EHFBucket::
+ChangeStore(BucketStore* newStore
+	    )
+{
+  _store = newStore;
+}
@@ -3,10 +3,22 @@
 
 #include "records.h"
 
+// Marks the last word of the padding after the records as holding the bucket's bit
+// pattern. Buckets written before the pattern was kept have zeroes there.
+const int EHF_PATTERNMARK = 0x50464845;                   // "EHFP"
+
+class BucketStore;
+
+// Given to the constructor of a bucket that is about to be Read, whose records then
+// need not be cleared first
+struct EHFToBeRead{};
+const EHFToBeRead EHF_TOBEREAD = EHFToBeRead();
+
 class EHFBucket{
  public:
   EHFBucket(int fd, int address);
   EHFBucket(int fd, int address, int bitDepth);
+  EHFBucket(int fd, int address, EHFToBeRead);
   ~EHFBucket();
   int Read();
   int Write();
@@ -14,9 +26,18 @@ class EHFBucket{
   int Add(char* keyToAdd, char* recordToAdd);
   int Retrieve(char* keyToFind, char* returnRecord);
   int Delete(char* keyToDelete);
+  int Replace(char* keyToUpdate, int position, int length, const char* value);
   int NumOfRecs();
   int Depth();
+  int Pattern();
+  void ChangePattern(int newPattern);
+  int ReadFromBuffer(const char* image);
+  int ReadImage(char* image);
+  static const char* FindInImage(const char* image, char* key);
   void ChangeAddress(int newAddress);
+  void ChangeFileHeaderSize(int newHeaderSize);
+  void ChangePageSize(int newPageSize);
+  void ChangeStore(BucketStore* newStore);
   void RetrieveRecAtIndex(int index, char* returnKey, char* returnRecord);
 
  private:
@@ -27,12 +48,17 @@ class EHFBucket{
   int _bucketAddress;                                      // Main bucket address
   int _fileDescriptor;                                     // File descriptor
   int _fileHeaderSize;                                     // Size of main file header
+  int _pageSize;                                           // Bytes from bucket to bucket
+  BucketStore* _store;                                     // Reads and writes, if set
 
-  struct {
+  struct BucketImage{
     int numOfRecs;                                         // Number of records in bucket
     int depth;                                             // Depth of the bucket in bits
-    char records[RECSBUFFSIZE];                            // The records
-  } _bucketBuffer;
+    char records[RECORDSIZE*FULLBUCKET];                   // The records
+    int patternMark;                                       // EHF_PATTERNMARK, if pattern set
+    int pattern;                                           // Bit pattern of the bucket's keys
+  };                                                       // Padded out to BUCKETSIZE
+  BucketImage _bucketBuffer;
 };
 
 #endif
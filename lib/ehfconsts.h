@@ -7,6 +7,7 @@ const int EHF_WROTEOK = 1;                    // Write was successful
 const int EHF_INSERTED = 1;                   // Record was inserted successfully
 const int EHF_DELETED = 1;                    // Record was deleted successfully
 const int EHF_RETRIEVED = 1;                  // Record was retrieved successfully
+const int EHF_UPDATED = 1;                    // Record was updated successfully
 // Logical error returns
 const int EHF_ALREADY_PRESENT = 2;            // The record was already present
 const int EHF_NOT_PRESENT = 3;                // The record was not present
@@ -19,4 +20,15 @@ const int EHF_WRITEERROR = 7;
 const int EHF_READERROR = 8;
 const int EHF_POORHASHFUNCTION = 9;
 
+// Asynchronous operation returns
+const int EHF_PENDING = 10;                   // The operation has yet to finish
+
+// Argument error returns
+const int EHF_BADFIELD = 11;                  // The bytes given are not all in the record,
+                                              // or include its key
+
+// Conditional update returns
+const int EHF_MISMATCH = 12;                  // The record was not the one expected
+const int EHF_UNCHANGED = 13;                 // The record was left as it was
+
 #endif
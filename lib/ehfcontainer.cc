@@ -0,0 +1,645 @@
+/*
+=========================================================================================
+Name	 | EHFContainer
+Purpose	 | Single file layout for an extendible hash file, see ehfcontainer.h
+=========================================================================================
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+// For file system methods and constants
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "ehfcontainer.h"
+#include "records.h"
+#include "checksum.h"
+#include "indexholder.h"
+#include "ehfoptions.h"
+
+// Marks the start of a superblock
+const char EHF_MAGIC[8] = { 'E', 'H', 'F', 'T', 'A', 'B', 'L', 'E' };
+
+// Buckets copied at a time by ConvertToContainer
+const int CONVERTCHUNK = 256;
+
+// Largest page size Open accepts
+const int MAXPAGESIZE = 65536;
+
+// Index slots written at a time by Commit
+const int SLOTCHUNK = 1024;
+
+/*
+=========================================================================================
+Name	 | EHFContainer constructor / destructor
+=========================================================================================
+*/
+EHFContainer::
+EHFContainer()
+{
+  _fileDescriptor = -1;
+  _pageCount = 0;
+  _mapping = nullptr;
+  _mappingLength = 0;
+  _mappedPage = -1;
+  _holds = 0;
+  memset(&_superblock, 0, sizeof(_superblock));
+}
+
+EHFContainer::
+~EHFContainer()
+{
+  Close();
+}
+
+/*
+=========================================================================================
+Name	 | Create
+Purpose	 | Create an empty container. Nothing is on disc until the first Commit.
+=========================================================================================
+*/
+bool
+EHFContainer::
+Create(char* fileName,
+       int pageSize
+       )
+{
+  Close();
+  if ( (pageSize < BUCKETSIZE) || (pageSize % BUCKETSIZE != 0) ){
+    return false;
+  }
+  _fileDescriptor = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (_fileDescriptor < 0){
+    return false;
+  }
+  memset(&_superblock, 0, sizeof(_superblock));
+  memcpy(_superblock.magic, EHF_MAGIC, sizeof(EHF_MAGIC));
+  _superblock.version = EHF_FORMAT_VERSION;
+  _superblock.pageSize = pageSize;
+  _superblock.bucketSize = BUCKETSIZE;
+  _superblock.hashId = EHF_HASH_SUMOFPAIRS;
+  _pageCount = 0;
+  _freePages.clear();
+  return true;
+}
+
+/*
+=========================================================================================
+Name	 | Open
+Purpose	 | Open a container, and pick the superblock copy to go by
+Returns	 | False if the file cannot be opened, or has no usable superblock
+Notes	 | Only the superblock is read here, the index is read by LoadIndex
+=========================================================================================
+*/
+bool
+EHFContainer::
+Open(char* fileName
+     )
+{
+  Close();
+  _fileDescriptor = open(fileName, O_RDWR);
+  if (_fileDescriptor < 0){
+    return false;
+  }
+
+  EHFSuperblock copies[2];
+  bool valid[2];
+  for (int slot = 0; slot < 2; slot++){
+    valid[slot] = ReadSuperblock(slot, copies[slot]);
+  }
+  int newest;
+  if (valid[0] && valid[1]){
+    newest = (copies[1].generation > copies[0].generation) ? 1 : 0;
+  } else if (valid[0] || valid[1]){
+    newest = valid[0] ? 0 : 1;
+  } else {
+    Close();
+    return false;
+  }
+  _superblock = copies[newest];
+  _pageCount = _superblock.pageCount;
+  _freePages.clear();
+  return true;
+}
+
+/*
+=========================================================================================
+Name	 | LoadIndex
+Purpose	 | Read the index and the free page list written by the last Commit
+Returns	 | False if they do not match the checksum in the superblock
+Notes	 | A mapped index is not checked against its checksum, as that would mean
+	 | reading all of it. The free list, at the end of the run, is read in full.
+=========================================================================================
+*/
+bool
+EHFContainer::
+LoadIndex(ExtendibleIndex* index,
+	  int indexOpen
+	  )
+{
+  if (_fileDescriptor < 0){
+    return false;
+  }
+  long position = PagePosition(_superblock.metaPage);
+  size_t freeBytes = sizeof(int) * _superblock.freeCount;
+  size_t indexBytes = _superblock.metaBytes - freeBytes;
+  int depth = _superblock.indexDepth;
+  if ( (depth < 1) || (depth > NUMBITS - 2) ||
+       (indexBytes != sizeof(int) * (1 + (static_cast<size_t>(1) << depth))) ){
+    return false;
+  }
+
+  if ( (_superblock.version >= 2) && (indexOpen != EHF_OPEN_READINDEX) ){
+    _freePages.resize(_superblock.freeCount);
+    if (pread(_fileDescriptor, _freePages.data(), freeBytes, position + indexBytes)
+	!= static_cast<ssize_t>(freeBytes)){
+      return false;
+    }
+    return MapIndex(index, (indexOpen == EHF_OPEN_PREFETCHINDEX));
+  }
+
+  std::vector<char> meta(_superblock.metaBytes);
+  ssize_t dataRead = pread(_fileDescriptor, meta.data(), meta.size(), position);
+  if ( (dataRead != static_cast<ssize_t>(meta.size())) ||
+       (Crc32(meta.data(), meta.size()) != _superblock.metaChecksum) ){
+    return false;
+  }
+  bool loaded;
+  if (_superblock.version >= 2){
+    // Skip the depth, which the superblock has too
+    loaded = index->Attach(reinterpret_cast<int*>(meta.data()) + 1, depth, false);
+  } else {
+    loaded = index->Load(_fileDescriptor, position);
+  }
+  if ( !loaded || (index->GetDepth() != depth) ){
+    return false;
+  }
+  // The free pages follow the index
+  _freePages.resize(_superblock.freeCount);
+  memcpy(_freePages.data(), meta.data() + indexBytes, freeBytes);
+  return true;
+}
+
+/*
+=========================================================================================
+Name	 | Commit
+Purpose	 | Write the index and free list to a fresh run of pages, then the superblock
+Notes	 | The run holding the previous index is released, as by FreePage, so it cannot
+	 | be reused until the new superblock is on disc.
+	 | The run is sized for every page that may end up on the free list, before the
+	 | run itself is taken from it. What the run does not use is zeroed, so that
+	 | recovery never takes a bucket once held there for a live one.
+=========================================================================================
+*/
+bool
+EHFContainer::
+Commit(ExtendibleIndex* index,
+       int bucketCount
+       )
+{
+  if (_fileDescriptor < 0){
+    return false;
+  }
+  int pageSize = _superblock.pageSize;
+  int oldMetaPages = (_superblock.metaBytes + pageSize - 1) / pageSize;
+  long indexBytes = sizeof(int) * (1L + index->GetNumberOfAddresses());
+  long mostBytes = indexBytes + sizeof(int) *
+    (_freePages.size() + _pinnedPages.size() + _releasedPages.size() + _heldPages.size() +
+     oldMetaPages);
+  int metaPages = (mostBytes + pageSize - 1) / pageSize;
+  int metaPage = AllocateRun(metaPages);
+  bool oldMetaMapped = (static_cast<int>(_superblock.metaPage) == _mappedPage);
+  for (int i = 0; i < oldMetaPages; i++){
+    if (oldMetaMapped){
+      _pinnedPages.push_back(_superblock.metaPage + i);
+    } else {
+      _releasedPages.push_back(_superblock.metaPage + i);
+    }
+  }
+
+  // Index, then free list, pinned and released pages included. The new superblock no
+  // longer refers to released pages, and the old one never listed them as free.
+  long position = PagePosition(metaPage);
+  uint32_t checksum;
+  if (!WriteIndex(index, position, checksum)){
+    return false;
+  }
+  std::vector<int> freeList(_freePages);
+  freeList.insert(freeList.end(), _pinnedPages.begin(), _pinnedPages.end());
+  freeList.insert(freeList.end(), _releasedPages.begin(), _releasedPages.end());
+  freeList.insert(freeList.end(), _heldPages.begin(), _heldPages.end());
+  long freeBytes = sizeof(int) * freeList.size();
+  if (pwrite(_fileDescriptor, freeList.data(), freeBytes, position + indexBytes)
+      != freeBytes){
+    return false;
+  }
+  long unusedBytes = static_cast<long>(metaPages) * pageSize - indexBytes - freeBytes;
+  std::vector<char> zeroes(unusedBytes, 0);
+  if (pwrite(_fileDescriptor, zeroes.data(), unusedBytes,
+	     position + indexBytes + freeBytes) != unusedBytes){
+    return false;
+  }
+  if (fdatasync(_fileDescriptor) != 0){
+    return false;
+  }
+
+  _superblock.generation++;
+  _superblock.pageCount = _pageCount;
+  _superblock.bucketCount = bucketCount;
+  _superblock.indexDepth = index->GetDepth();
+  _superblock.metaPage = metaPage;
+  _superblock.metaBytes = indexBytes + freeBytes;
+  _superblock.metaChecksum = Crc32(freeList.data(), freeBytes, checksum);
+  _superblock.freeCount = freeList.size();
+  if ( !WriteSuperblock() || (fdatasync(_fileDescriptor) != 0) ){
+    return false;
+  }
+  std::vector<int>& nowFree = (_holds > 0) ? _heldPages : _freePages;
+  nowFree.insert(nowFree.end(), _releasedPages.begin(), _releasedPages.end());
+  _releasedPages.clear();
+  return true;
+}
+
+void
+EHFContainer::
+Close()
+{
+  if (_mapping != nullptr){
+    munmap(_mapping, _mappingLength);
+  }
+  _mapping = nullptr;
+  _mappingLength = 0;
+  _mappedPage = -1;
+  if (_fileDescriptor >= 0){
+    close(_fileDescriptor);
+  }
+  _fileDescriptor = -1;
+  _pageCount = 0;
+  _freePages.clear();
+  _pinnedPages.clear();
+  _releasedPages.clear();
+  _heldPages.clear();
+  _holds = 0;
+}
+
+int
+EHFContainer::
+AllocatePage()
+{
+  if (!_freePages.empty()){
+    int page = _freePages.back();
+    _freePages.pop_back();
+    return page;
+  }
+  return _pageCount++;
+}
+
+void
+EHFContainer::
+FreePage(int page
+	 )
+{
+  _releasedPages.push_back(page);
+}
+
+/*
+=========================================================================================
+Name	 | RebuildFreePages
+Purpose	 | Work out the free list from an index, rather than read it
+Notes	 | The run of the last committed index is left off, as the next Commit releases
+	 | it. Nothing may be mapped, as after Open without LoadIndex.
+=========================================================================================
+*/
+void
+EHFContainer::
+RebuildFreePages(ExtendibleIndex* index
+		 )
+{
+  std::vector<bool> inUse(_pageCount, false);
+  int numOfAddresses = index->GetNumberOfAddresses();
+  for (int i = 0; i < numOfAddresses; i++){
+    int page = index->GetAddress(i);
+    if ( (page >= 0) && (page < _pageCount) ){
+      inUse[page] = true;
+    }
+  }
+  int pageSize = _superblock.pageSize;
+  int metaPages = (_superblock.metaBytes + pageSize - 1) / pageSize;
+  for (int i = 0; i < metaPages; i++){
+    int page = _superblock.metaPage + i;
+    if (page < _pageCount){
+      inUse[page] = true;
+    }
+  }
+  _freePages.clear();
+  _pinnedPages.clear();
+  _releasedPages.clear();
+  _heldPages.clear();
+  for (int page = 0; page < _pageCount; page++){
+    if (!inUse[page]){
+      _freePages.push_back(page);
+    }
+  }
+}
+
+/*
+=========================================================================================
+Name	 | HoldFreedPages / EndHold
+Purpose	 | Keep pages that become free out of reuse while a snapshot may still read them
+Notes	 | Held pages are listed as free by every Commit, as pinned ones are, so nothing
+	 | is lost should the container be closed or the process die with a hold on.
+=========================================================================================
+*/
+void
+EHFContainer::
+HoldFreedPages()
+{
+  _holds++;
+}
+
+void
+EHFContainer::
+EndHold()
+{
+  if ( (_holds > 0) && (--_holds == 0) ){
+    _freePages.insert(_freePages.end(), _heldPages.begin(), _heldPages.end());
+    _heldPages.clear();
+  }
+}
+
+int
+EHFContainer::
+FileDescriptor()
+{
+  return _fileDescriptor;
+}
+
+int
+EHFContainer::
+BucketCount()
+{
+  return _superblock.bucketCount;
+}
+
+int
+EHFContainer::
+PageCount()
+{
+  return _pageCount;
+}
+
+int
+EHFContainer::
+FreePageCount()
+{
+  return _freePages.size() + _pinnedPages.size() + _releasedPages.size() +
+    _heldPages.size();
+}
+
+int
+EHFContainer::
+PageSize()
+{
+  return _superblock.pageSize;
+}
+
+long
+EHFContainer::
+PagePosition(int page
+	     )
+{
+  return SUPERBLOCKAREA + static_cast<long>(_superblock.pageSize) * page;
+}
+
+/*
+  Private member functions
+*/
+
+/*
+=========================================================================================
+Name	 | ReadSuperblock
+Purpose	 | Read one superblock copy
+Returns	 | True if the copy checks out and describes a file this code can read
+=========================================================================================
+*/
+bool
+EHFContainer::
+ReadSuperblock(int slot,
+	       EHFSuperblock& superblock
+	       )
+{
+  ssize_t dataRead = pread(_fileDescriptor, &superblock, sizeof(superblock),
+			   slot * SUPERBLOCKSLOT);
+  if (dataRead != sizeof(superblock)){
+    return false;
+  }
+  if ( (memcmp(superblock.magic, EHF_MAGIC, sizeof(EHF_MAGIC)) != 0) ||
+       (Crc32(&superblock, offsetof(EHFSuperblock, checksum)) != superblock.checksum) ){
+    return false;
+  }
+  // Buckets of other sizes are not supported, but they may sit in larger pages
+  return ( (superblock.version <= EHF_FORMAT_VERSION) &&
+	   (superblock.pageSize >= static_cast<uint32_t>(BUCKETSIZE)) &&
+	   (superblock.pageSize <= static_cast<uint32_t>(MAXPAGESIZE)) &&
+	   (superblock.pageSize % BUCKETSIZE == 0) &&
+	   (superblock.bucketSize == static_cast<uint32_t>(BUCKETSIZE)) &&
+	   (superblock.hashId == EHF_HASH_SUMOFPAIRS) );
+}
+
+/*
+=========================================================================================
+Name	 | WriteSuperblock
+Purpose	 | Write the superblock over the copy older than it
+=========================================================================================
+*/
+bool
+EHFContainer::
+WriteSuperblock()
+{
+  _superblock.version = EHF_FORMAT_VERSION;
+  _superblock.checksum = Crc32(&_superblock, offsetof(EHFSuperblock, checksum));
+  char slotBuffer[SUPERBLOCKSLOT];
+  memset(slotBuffer, 0, sizeof(slotBuffer));
+  memcpy(slotBuffer, &_superblock, sizeof(_superblock));
+  int slot = _superblock.generation % 2;
+  return (pwrite(_fileDescriptor, slotBuffer, sizeof(slotBuffer), slot * SUPERBLOCKSLOT)
+	  == sizeof(slotBuffer));
+}
+
+/*
+=========================================================================================
+Name	 | AllocateRun
+Purpose	 | Take pages consecutive pages, from the free list if it has such a run, else
+	 | from the end of the file
+Returns	 | The first page of the run
+=========================================================================================
+*/
+int
+EHFContainer::
+AllocateRun(int pages
+	    )
+{
+  std::sort(_freePages.begin(), _freePages.end());
+  size_t runStart = 0;
+  for (size_t i = 0; i < _freePages.size(); i++){
+    if ( (i > runStart) && (_freePages[i] != _freePages[i - 1] + 1) ){
+      runStart = i;
+    }
+    if (static_cast<int>(i - runStart + 1) == pages){
+      int first = _freePages[runStart];
+      _freePages.erase(_freePages.begin() + runStart, _freePages.begin() + i + 1);
+      return first;
+    }
+  }
+  int first = _pageCount;
+  _pageCount += pages;
+  return first;
+}
+
+/*
+=========================================================================================
+Name	 | MapIndex
+Purpose	 | Map the index run privately, and have index use the slots where they lie
+Notes	 | A mapping must start on a system page boundary, which a container page need
+	 | not be on, so the mapping starts a little early when it has to.
+=========================================================================================
+*/
+bool
+EHFContainer::
+MapIndex(ExtendibleIndex* index,
+	 bool prefetch
+	 )
+{
+  long position = PagePosition(_superblock.metaPage);
+  long systemPage = sysconf(_SC_PAGESIZE);
+  long start = position - (position % systemPage);
+  size_t length = (position - start) + _superblock.metaBytes;
+  void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		       _fileDescriptor, start);
+  if (mapping == MAP_FAILED){
+    return false;
+  }
+  if (prefetch){
+    // Only a hint, so a failure does not matter
+    madvise(mapping, length, MADV_WILLNEED);
+  }
+  _mapping = mapping;
+  _mappingLength = length;
+  _mappedPage = _superblock.metaPage;
+  // Skip the depth, which the superblock has too
+  int* slots = reinterpret_cast<int*>(static_cast<char*>(mapping) + (position - start)) + 1;
+  return index->Attach(slots, _superblock.indexDepth, true) &&
+    (index->GetDepth() == static_cast<int>(_superblock.indexDepth));
+}
+
+/*
+=========================================================================================
+Name	 | WriteIndex
+Purpose	 | Write the depth, then every index value's address plus one, at position
+Params	 | checksum - returns the CRC-32 of what was written
+=========================================================================================
+*/
+bool
+EHFContainer::
+WriteIndex(ExtendibleIndex* index,
+	   long position,
+	   uint32_t& checksum
+	   )
+{
+  int depth = index->GetDepth();
+  if (pwrite(_fileDescriptor, &depth, sizeof(depth), position) != sizeof(depth)){
+    return false;
+  }
+  checksum = Crc32(&depth, sizeof(depth));
+  position += sizeof(depth);
+  int chunk[SLOTCHUNK];
+  int numOfAddresses = index->GetNumberOfAddresses();
+  for (int start = 0; start < numOfAddresses; start += SLOTCHUNK){
+    int count = std::min(SLOTCHUNK, numOfAddresses - start);
+    for (int i = 0; i < count; i++){
+      chunk[i] = index->GetAddress(start + i) + 1;
+    }
+    ssize_t bytes = sizeof(int) * count;
+    if (pwrite(_fileDescriptor, chunk, bytes, position) != bytes){
+      return false;
+    }
+    checksum = Crc32(chunk, bytes, checksum);
+    position += bytes;
+  }
+  return true;
+}
+
+/*
+=========================================================================================
+Name	 | ConvertToContainer
+Purpose	 | Copy a two file table into a container, see ehfcontainer.h
+Notes	 | The container is written under a temporary name and renamed into place, so
+	 | fileName.eh only ever appears whole. The old files are removed last.
+=========================================================================================
+*/
+bool
+ConvertToContainer(char* fileName
+		   )
+{
+  int strLength = strlen(fileName) + 8;
+  char indexFileName[strLength];
+  char bucketFileName[strLength];
+  char containerFileName[strLength];
+  char tempFileName[strLength];
+  snprintf(indexFileName, strLength, "%s.ehd", fileName);
+  snprintf(bucketFileName, strLength, "%s.ehf", fileName);
+  snprintf(containerFileName, strLength, "%s.eh", fileName);
+  snprintf(tempFileName, strLength, "%s.eh~", fileName);
+
+  int indexFD = open(indexFileName, O_RDONLY);
+  int bucketFD = open(bucketFileName, O_RDONLY);
+  bool converted = false;
+  int bucketCount = 0;
+  IndexHolder index;
+  EHFContainer container;
+  if ( (indexFD >= 0) && (bucketFD >= 0) &&
+       (pread(bucketFD, &bucketCount, sizeof(bucketCount), 0) == sizeof(bucketCount)) &&
+       (bucketCount > 0) && index.Load(indexFD) && container.Create(tempFileName) ){
+    converted = true;
+    // Every slot must point at a bucket in the file
+    for (int i = 0; i < index.GetNumberOfAddresses() && converted; i++){
+      int address = index.GetAddress(i);
+      converted = (address >= 0) && (address < bucketCount);
+    }
+    // Bucket n stays bucket n, so they are copied across in large sequential chunks
+    std::vector<char> chunk(static_cast<size_t>(CONVERTCHUNK) * BUCKETSIZE);
+    for (int first = 0; first < bucketCount && converted; first += CONVERTCHUNK){
+      int count = std::min(CONVERTCHUNK, bucketCount - first);
+      ssize_t bytes = static_cast<ssize_t>(count) * BUCKETSIZE;
+      for (int i = 0; i < count; i++){
+	container.AllocatePage();
+      }
+      converted =
+	(pread(bucketFD, chunk.data(), bytes,
+	       FILEHEADERSIZE + static_cast<long>(first) * BUCKETSIZE) == bytes) &&
+	(pwrite(container.FileDescriptor(), chunk.data(), bytes,
+		container.PagePosition(first)) == bytes);
+    }
+    converted = converted && container.Commit(&index, bucketCount);
+    container.Close();
+    converted = converted && (rename(tempFileName, containerFileName) == 0);
+    if (!converted){
+      unlink(tempFileName);
+    }
+  }
+  if (indexFD >= 0){
+    close(indexFD);
+  }
+  if (bucketFD >= 0){
+    close(bucketFD);
+  }
+  if (converted){
+    unlink(indexFileName);
+    unlink(bucketFileName);
+  }
+  return converted;
+}
@@ -0,0 +1,211 @@
+/*
+=========================================================================================
+Name    | EHF Container                                                                 |
+Purpose | Keep a whole extendible hash file (buckets, index and free space) in one file |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Create              | Create an empty container file                          |
+        | Open                | Open a container file and check its superblock          |
+        | LoadIndex           | Read the index and the free page list                   |
+        | Commit              | Write the index and free pages, then a new superblock   |
+        | Close               | Close the container file                                |
+        | AllocatePage        | Hand out a page for a new bucket                        |
+        | FreePage            | Give a page back, for reuse after the next Commit       |
+        | RebuildFreePages    | Free every page an index does not refer to              |
+        | HoldFreedPages      | Keep pages freed from now on from reuse, until EndHold  |
+        | EndHold             | Let held pages be reused, once no hold is left          |
+----------------------------------------------------------------------------------------|
+Notes   | The file starts with a SUPERBLOCKAREA byte header, followed by pages of       |
+        | pageSize bytes, numbered from 0. Each bucket takes one page, and its number   |
+        | is the bucket number held in the index, so an EHFBucket finds it just as it   |
+        | would in a .ehf file, with SUPERBLOCKAREA as the size of the file header.     |
+        | Pages are BUCKETSIZE unless Create is given a larger multiple of it, as direct|
+        | I/O needs (see BucketFile); a bucket then only uses the start of its page.    |
+        | The header has room for two copies of the superblock. Each Commit writes the  |
+        | index and the list of free pages to a run of pages not in use, syncs, and     |
+        | only then writes the superblock pointing at them over the older of the two    |
+        | copies, and syncs again. Open takes the copy with the highest generation whose|
+        | checksum holds, so a crash part way through a Commit leaves the last one.     |
+        | Pages are given back to the free list rather than to the end of the file, and |
+        | the run holding the previous index becomes free once a new one is committed.  |
+        | The index is stored the way IndexHolder holds it, so LoadIndex may map it     |
+        | and let the index use it where it lies. Opening then costs the same at any    |
+        | depth: only the superblock is checked, and index pages are read as lookups    |
+        | touch them, or ahead of them in the background. The mapping is private, so   |
+        | changes to the index never reach the file that way, and the run mapped is not |
+        | reused until the container is closed, even once a later Commit frees it.      |
+        | A scan reading a snapshot of the buckets holds freed pages the same way, so  |
+        | that no Commit writes an index over a bucket the scan has yet to read.        |
+=========================================================================================
+*/
+#ifndef _EhFcOnTaInEr__
+#define _EhFcOnTaInEr__
+
+#include <stdint.h>
+#include <vector>
+
+#include "records.h"
+
+#include "extendibleindex.h"
+
+// Format of the container, bumped whenever the layout changes. Older versions are read,
+// newer ones are refused.
+// 1 - The index is stored as its depth, then the address of every index value
+// 2 - Every index value's address plus one, as IndexHolder keeps it in memory
+const uint32_t EHF_FORMAT_VERSION = 2;
+
+// Hash functions, recorded so a file is never read with the wrong one
+const uint32_t EHF_HASH_SUMOFPAIRS = 1;             // Hash() in hash.h
+
+// Bytes at the start of the file set aside for the superblock copies
+const int SUPERBLOCKAREA = 4096;
+// Bytes set aside for each superblock copy
+const int SUPERBLOCKSLOT = 2048;
+
+// The superblock, as stored on disc. Fields are only ever added at the end, before
+// checksum, and older readers go by version to tell what is there.
+struct EHFSuperblock{
+  char     magic[8];                                // EHF_MAGIC
+  uint32_t version;                                 // EHF_FORMAT_VERSION when written
+  uint32_t pageSize;                                // Bytes per page
+  uint32_t bucketSize;                              // Bytes used in each bucket page
+  uint32_t hashId;                                  // Hash function of the keys
+  uint64_t generation;                              // Bumped by every Commit
+  uint32_t pageCount;                               // Pages in the file
+  uint32_t bucketCount;                             // Pages holding buckets
+  uint32_t indexDepth;                              // Depth of the index
+  uint32_t metaPage;                                // First page of index and free list
+  uint32_t metaBytes;                               // Bytes of index and free list
+  uint32_t metaChecksum;                            // CRC-32 of those bytes
+  uint32_t freeCount;                               // Free pages listed after the index
+  uint32_t checksum;                                // CRC-32 of the fields above
+};
+
+class EHFContainer{
+ public:
+  EHFContainer();
+  ~EHFContainer();
+
+  // Create an empty container, truncating any file of the same name. pageSize must be
+  // a multiple of BUCKETSIZE.
+  bool
+  Create(char* fileName,
+	 int pageSize = BUCKETSIZE
+	 );
+
+  // Open an existing container, using the newest superblock copy that checks out
+  bool
+  Open(char* fileName
+       );
+
+  // Fill index in from the last Commit, and pick up the free page list. indexOpen is
+  // one of the EHF_OPEN_...INDEX values in ehfoptions.h
+  bool
+  LoadIndex(ExtendibleIndex* index,
+	    int indexOpen
+	    );
+
+  // Make everything written so far durable, along with index and bucketCount
+  bool
+  Commit(ExtendibleIndex* index,
+	 int bucketCount
+	 );
+
+  void
+  Close();
+
+  // A page not in use, from the free list if there is one, else from the end
+  int
+  AllocatePage();
+
+  // Give page back. It is not reused until the next Commit has made sure that no
+  // superblock on disc still refers to it.
+  void
+  FreePage(int page
+	   );
+
+  // In place of the free list of the last Commit, take as free every page that is
+  // neither referred to by index nor holding the last committed index. For an index
+  // rebuilt from the buckets, when the committed one cannot be trusted.
+  void
+  RebuildFreePages(ExtendibleIndex* index
+		   );
+
+  // Until as many EndHold calls as HoldFreedPages calls, keep every page freed from now
+  // on out of reuse, though listed as free on disc
+  void
+  HoldFreedPages();
+
+  void
+  EndHold();
+
+  int
+  FileDescriptor();
+
+  // The number of buckets at the last Commit
+  int
+  BucketCount();
+
+  // Pages in the file, whether in use or not
+  int
+  PageCount();
+
+  // Pages on the free list
+  int
+  FreePageCount();
+
+  // Bytes per page
+  int
+  PageSize();
+
+  // Byte position of a page in the file
+  long
+  PagePosition(int page
+	       );
+
+ private:
+  bool
+  ReadSuperblock(int slot,
+		 EHFSuperblock& superblock
+		 );
+
+  bool
+  WriteSuperblock();
+
+  int
+  AllocateRun(int pages
+	      );
+
+  bool
+  MapIndex(ExtendibleIndex* index,
+	   bool prefetch
+	   );
+
+  bool
+  WriteIndex(ExtendibleIndex* index,
+	     long position,
+	     uint32_t& checksum
+	     );
+
+  int _fileDescriptor;                              // The container file
+  EHFSuperblock _superblock;                        // As last read or written
+  int _pageCount;                                   // Pages in the file
+  std::vector<int> _freePages;                      // Pages not in use
+  std::vector<int> _pinnedPages;                    // Free, but mapped until Close
+  std::vector<int> _releasedPages;                  // Free from the next Commit on
+  std::vector<int> _heldPages;                      // Free, but held for a snapshot
+  int _holds;                                       // HoldFreedPages not yet ended
+  void* _mapping;                                   // The mapped index, if mapped
+  size_t _mappingLength;                            // Bytes mapped
+  int _mappedPage;                                  // First page of the mapped index
+};
+
+// Turn the two file table fileName.ehd / fileName.ehf into the container fileName.eh,
+// removing the two files once the container is safely written. Bucket numbers are kept,
+// so the buckets are copied across as they are.
+bool
+ConvertToContainer(char* fileName
+		   );
+
+#endif
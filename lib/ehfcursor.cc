@@ -0,0 +1,280 @@
+/*
+=========================================================================================
+Name	 | EHFCursor
+Purpose	 | A scan of every record, a span of buckets at a time, see ehfcursor.h
+=========================================================================================
+*/
+
+#include <limits.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "ehfcursor.h"
+#include "ehfconsts.h"
+
+/*
+=========================================================================================
+Name	 | EHFCursor constructor / destructor
+=========================================================================================
+*/
+EHFCursor::
+EHFCursor()
+  : _bucket(-1, 0, EHF_TOBEREAD)
+{
+  _file = nullptr;
+  _snapshot = nullptr;
+  Reset();
+}
+
+EHFCursor::
+~EHFCursor()
+{
+  Close();
+}
+
+/*
+=========================================================================================
+Name	 | Open
+Purpose	 | Take a snapshot of the buckets to visit, and start reading the first span
+=========================================================================================
+*/
+bool
+EHFCursor::
+Open(ExtendibleHashFile* file
+     )
+{
+  return Open(file, 0, INT_MAX);
+}
+
+bool
+EHFCursor::
+Open(ExtendibleHashFile* file,
+     int firstPage,
+     int endPage
+     )
+{
+  Close();
+  if ( (file == nullptr) || !file->_fileOpen ){
+    return false;
+  }
+  file->BeginSnapshot(&_ownSnapshot, firstPage, endPage);
+  Start(file, &_ownSnapshot, 0, _ownSnapshot.buckets.size());
+  return true;
+}
+
+/*
+=========================================================================================
+Name	 | Next
+Purpose	 | Give the next record of the bucket being gone through, moving on to the next
+	 | bucket, and the next span, as each runs out
+=========================================================================================
+*/
+bool
+EHFCursor::
+Next(char* key,
+     char* record
+     )
+{
+  if (_result != EHF_READOK){
+    return false;
+  }
+  while (_nextRecord >= _bucketRecords){
+    if ( (_nextImage >= _images.size()) && !ReadSpan() ){
+      return false;
+    }
+    if (_bucket.ReadFromBuffer(_images[_nextImage++]) != EHF_READOK){
+      _result = EHF_READERROR;
+      return false;
+    }
+    _nextRecord = 0;
+    _bucketRecords = _bucket.NumOfRecs();
+  }
+  _bucket.RetrieveRecAtIndex(_nextRecord++, key, record);
+  return true;
+}
+
+int
+EHFCursor::
+Result() const
+{
+  return _result;
+}
+
+/*
+=========================================================================================
+Name	 | Close
+Purpose	 | End the snapshot, if it is the cursor's own, and free the buffers
+=========================================================================================
+*/
+void
+EHFCursor::
+Close()
+{
+  if ( (_file != nullptr) && (_snapshot == &_ownSnapshot) ){
+    _file->EndSnapshot(&_ownSnapshot);
+    _ownSnapshot.buckets.clear();
+    _ownSnapshot.buckets.shrink_to_fit();
+    _ownSnapshot.read.clear();
+    _ownSnapshot.read.shrink_to_fit();
+  }
+  _span.clear();
+  _span.shrink_to_fit();
+  Reset();
+}
+
+/*
+  Private member functions
+*/
+
+void
+EHFCursor::
+Start(ExtendibleHashFile* file,
+      EHFSnapshot* snapshot,
+      size_t first,
+      size_t end
+      )
+{
+  _file = file;
+  _snapshot = snapshot;
+  _nextBucket = first;
+  _endBucket = end;
+  _result = EHF_READOK;
+  _file->ReadAhead(_snapshot->buckets.data() + first, SpanEnd(first) - first);
+}
+
+void
+EHFCursor::
+Reset()
+{
+  _file = nullptr;
+  _snapshot = nullptr;
+  _nextBucket = 0;
+  _endBucket = 0;
+  _kept.clear();
+  _images.clear();
+  _nextImage = 0;
+  _nextRecord = 0;
+  _bucketRecords = 0;
+  _result = EHF_FILENOTOPEN;
+}
+
+/*
+=========================================================================================
+Name	 | ReadSpan
+Purpose	 | Read the next span of buckets, then mark them read in the snapshot, taking any
+	 | a writer kept before changing them in place of what was read
+=========================================================================================
+*/
+bool
+EHFCursor::
+ReadSpan()
+{
+  if (_nextBucket >= _endBucket){
+    return false;
+  }
+  size_t end = SpanEnd(_nextBucket);
+  const int* buckets = _snapshot->buckets.data();
+  _kept.clear();
+  _nextImage = 0;
+  _result = _file->ReadBuckets(buckets + _nextBucket, end - _nextBucket, _span, _images);
+  if (_result != EHF_READOK){
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> latch(_snapshot->latch);
+    for (size_t b = _nextBucket; b < end; b++){
+      _snapshot->read[b] = true;
+      std::unordered_map<int, std::vector<char> >::iterator kept =
+	_snapshot->kept.find(buckets[b]);
+      if (kept != _snapshot->kept.end()){
+	_kept.push_back(std::move(kept->second));
+	_snapshot->kept.erase(kept);
+	_images[b - _nextBucket] = _kept.back().data();
+      }
+    }
+  }
+  _nextBucket = end;
+  _file->ReadAhead(buckets + _nextBucket, SpanEnd(_nextBucket) - _nextBucket);
+  return true;
+}
+
+size_t
+EHFCursor::
+SpanEnd(size_t first
+	) const
+{
+  const std::vector<int>& buckets = _snapshot->buckets;
+  size_t end = first;
+  while ( (end < _endBucket) && (buckets[end] - buckets[first] < SCANPAGES) ){
+    end++;
+  }
+  return end;
+}
+
+/*
+=========================================================================================
+Name	 | ScanPartitions
+Purpose	 | Scan a file with a cursor for each of a number of contiguous ranges of pages,
+	 | each on a thread of its own
+Notes	 | The cursors share one snapshot, and the pages are split up by the number of
+	 | pages in the file when it was taken, so that the ranges neither overlap nor
+	 | leave gaps. A range holding no bucket still has its gather called.
+=========================================================================================
+*/
+int
+ScanPartitions(ExtendibleHashFile* file,
+	       int partitions,
+	       std::function<void(int partition, const char* key, const char* record)> visit,
+	       std::function<void(int partition)> gather
+	       )
+{
+  if ( (file == nullptr) || !file->_fileOpen ){
+    return EHF_FILENOTOPEN;
+  }
+  if (partitions <= 0){
+    partitions = std::max(1u, std::thread::hardware_concurrency());
+  }
+  EHFSnapshot snapshot;
+  file->BeginSnapshot(&snapshot, 0, INT_MAX);
+  std::vector<int>& buckets = snapshot.buckets;
+
+  std::vector<int> results(partitions, EHF_READOK);
+  std::mutex sinkLatch;
+  std::vector<std::thread> scanners;
+  for (int p = 0; p < partitions; p++){
+    int firstPage = snapshot.pages * p / partitions;
+    int endPage = (p == partitions - 1) ? INT_MAX : snapshot.pages * (p + 1) / partitions;
+    size_t first = std::lower_bound(buckets.begin(), buckets.end(), firstPage) -
+      buckets.begin();
+    size_t end = std::lower_bound(buckets.begin() + first, buckets.end(), endPage) -
+      buckets.begin();
+    scanners.emplace_back([file, p, first, end, &snapshot, &results, &sinkLatch, &visit,
+			   &gather](){
+	EHFCursor cursor;
+	cursor.Start(file, &snapshot, first, end);
+	char key[IDSIZE+1];
+	char record[RECORDSIZE+1];
+	while (cursor.Next(key, record)){
+	  visit(p, key, record);
+	}
+	results[p] = cursor.Result();
+	cursor.Reset();
+	if (gather){
+	  std::lock_guard<std::mutex> latch(sinkLatch);
+	  gather(p);
+	}
+      });
+  }
+  for (std::thread& scanner : scanners){
+    scanner.join();
+  }
+  file->EndSnapshot(&snapshot);
+  for (int result : results){
+    if (result != EHF_READOK){
+      return result;
+    }
+  }
+  return EHF_READOK;
+}
@@ -0,0 +1,133 @@
+/*
+=========================================================================================
+Name    | EHFCursor, ScanPartitions                                                     |
+Purpose | Every record of an extendible hash file, each bucket read once, in file order |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Open                | Start a scan of a file, or of a range of its pages      |
+        | Next                | The next key and record, false once there are no more   |
+        | Result              | EHF_READOK, or the error that ended the scan early      |
+        | Close               | End the scan, freeing its buffers                       |
+        | ScanPartitions      | Scan a file with a thread for each range of its pages   |
+----------------------------------------------------------------------------------------|
+Notes   | The buckets to visit are taken from the index as Open is called, each once     |
+        | however many index values share it, and sorted into the order they lie in the |
+        | file. They are then read SCANPAGES pages at a time, in one read from the file |
+        | for each such span, the span after it being read ahead meanwhile, so that a   |
+        | scan runs at the rate the disc reads sequentially. Pages between buckets in a |
+        | span (free pages of a container) are read and passed over.                   |
+        | Records come out in no particular order of key, and are those in the table   |
+        | at the moment Open was called, whatever is inserted and split meanwhile. The  |
+        | buckets are read without the writer latch, but a writer about to change a     |
+        | bucket the scan has yet to read copies it first (see EHFSnapshot), and the    |
+        | scan takes that copy in place of what it read. Writers carry on, paying one   |
+        | bucket read the first time they change each bucket the scan is still to      |
+        | reach. A cursor must be closed, or run to the end, before its file is closed. |
+        | A cursor is not safe to share between threads. ScanPartitions splits the pages |
+        | of the file into as many contiguous ranges as there are threads, each read by |
+        | a cursor on a thread of its own, which passes each record to a visitor. What  |
+        | each partition finds is kept apart, and gathered up into a sink as each one   |
+        | ends, so the visitor needs no latch of its own. The partitions share one      |
+        | snapshot, and so see the table as it was at one moment.                       |
+=========================================================================================
+*/
+#ifndef _EhFcUrSoR__
+#define _EhFcUrSoR__
+
+#include <functional>
+#include <vector>
+
+#include "records.h"
+#include "ehfbucket.h"
+#include "extendiblehashfile.h"
+
+// Most pages read from the file at a time
+const int SCANPAGES = 256;
+
+class EHFCursor{
+ public:
+  EHFCursor();
+  ~EHFCursor();
+
+  EHFCursor(const EHFCursor&) = delete;
+  EHFCursor& operator=(const EHFCursor&) = delete;
+
+  bool                                               // False if file is not open
+  Open(ExtendibleHashFile* file
+       );
+
+  // Only the buckets on pages [firstPage, endPage)
+  bool
+  Open(ExtendibleHashFile* file,
+       int firstPage,
+       int endPage
+       );
+
+  // Copy the next record into key, which must hold IDSIZE+1 chars, and record, which
+  // must hold RECORDSIZE+1
+  bool                                               // False at the end, or on an error
+  Next(char* key,
+       char* record
+       );
+
+  int
+  Result() const;
+
+  void
+  Close();
+
+ private:
+  friend int ScanPartitions(ExtendibleHashFile*, int,
+			    std::function<void(int, const char*, const char*)>,
+			    std::function<void(int)>);
+
+  // Scan the buckets [first, end) of snapshot, which another keeps up to date
+  void
+  Start(ExtendibleHashFile* file,
+	EHFSnapshot* snapshot,
+	size_t first,
+	size_t end
+	);
+
+  // Forget the scan, without ending the snapshot
+  void
+  Reset();
+
+  // Read the span of buckets starting at _nextBucket, and ask for the one after it.
+  // Buckets changed since the snapshot are taken from it instead.
+  bool
+  ReadSpan();
+
+  // The buckets from first up to where a span of SCANPAGES pages ends
+  size_t
+  SpanEnd(size_t first
+	  ) const;
+
+  ExtendibleHashFile* _file;
+  EHFSnapshot _ownSnapshot;                          // Unless ScanPartitions gives one
+  EHFSnapshot* _snapshot;                            // The buckets to scan, in file order
+  size_t _nextBucket;                                // First bucket not yet read
+  size_t _endBucket;                                 // And the bucket after the last
+  std::vector<char> _span;                           // The pages last read
+  std::vector< std::vector<char> > _kept;            // Buckets of the span kept for us
+  std::vector<const char*> _images;                  // The buckets in those two
+  size_t _nextImage;                                 // First of them not yet in _bucket
+  EHFBucket _bucket;                                 // The bucket being gone through
+  int _nextRecord;                                   // Its next record
+  int _bucketRecords;                                // And how many it holds
+  int _result;
+};
+
+// Scan file with partitions threads, 0 for one per core, each going through the buckets
+// on a contiguous range of pages of its own. visit is called for each record, on the
+// thread of the partition it is in; gather is called on that thread as each partition
+// ends, one partition at a time, to add what it found into a sink.
+int                                                  // EHF_READOK, or the first error met
+ScanPartitions(ExtendibleHashFile* file,
+	       int partitions,
+	       std::function<void(int partition, const char* key, const char* record)> visit,
+	       std::function<void(int partition)> gather = nullptr
+	       );
+
+#endif
@@ -0,0 +1,119 @@
+/*
+=========================================================================================
+Name	 | EHFOccupancy
+Purpose	 | Occupancy of an extendible hash file, see ehfoccupancy.h
+=========================================================================================
+*/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "ehfoccupancy.h"
+#include "records.h"
+
+EHFOccupancy::
+EHFOccupancy()
+  : depthHistogram(1, 0), fillHistogram(FULLBUCKET + 1, 0),
+    patternRecords(1 << HOTPATTERNBITS, 0)
+{
+  indexDepth = 0;
+  indexSlots = 0;
+  buckets = 0;
+  records = 0;
+  pageSize = BUCKETSIZE;
+  loadFactor = 0;
+  slotsPerBucket = 0;
+  wastedBytes = 0;
+  unreadable = 0;
+}
+
+/*
+=========================================================================================
+Name	 | Add
+Purpose	 | Add the counts of buckets and records other found to those of this one
+=========================================================================================
+*/
+void
+EHFOccupancy::
+Add(const EHFOccupancy& other
+    )
+{
+  buckets += other.buckets;
+  records += other.records;
+  unreadable += other.unreadable;
+  if (other.depthHistogram.size() > depthHistogram.size()){
+    depthHistogram.resize(other.depthHistogram.size(), 0);
+  }
+  for (size_t d = 0; d < other.depthHistogram.size(); d++){
+    depthHistogram[d] += other.depthHistogram[d];
+  }
+  for (size_t n = 0; n < fillHistogram.size(); n++){
+    fillHistogram[n] += other.fillHistogram[n];
+  }
+  for (size_t p = 0; p < patternRecords.size(); p++){
+    patternRecords[p] += other.patternRecords[p];
+  }
+}
+
+void
+EHFOccupancy::
+Summarise()
+{
+  loadFactor = (buckets > 0) ? static_cast<double>(records) / (buckets * FULLBUCKET) : 0;
+  slotsPerBucket = (buckets > 0) ? static_cast<double>(indexSlots) / buckets : 0;
+  wastedBytes = buckets * pageSize - records * RECORDSIZE;
+  if (depthHistogram.size() < static_cast<size_t>(indexDepth) + 1){
+    depthHistogram.resize(indexDepth + 1, 0);
+  }
+  hottest.clear();
+  for (size_t p = 0; p < patternRecords.size(); p++){
+    hottest.push_back( EHFPatternCount{static_cast<int>(p), patternRecords[p]} );
+  }
+  int kept = std::min(HOTPATTERNS, static_cast<int>(hottest.size()));
+  std::partial_sort(hottest.begin(), hottest.begin() + kept, hottest.end(),
+		    [](const EHFPatternCount& a, const EHFPatternCount& b){
+		      return (a.records > b.records) ||
+			((a.records == b.records) && (a.pattern < b.pattern));
+		    });
+  hottest.resize(kept);
+}
+
+static void
+AppendList(std::string& json,
+	   const char* name,
+	   const std::vector<long>& counts
+	   )
+{
+  json += ",\"";
+  json += name;
+  json += "\":[";
+  for (size_t i = 0; i < counts.size(); i++){
+    json += (i > 0) ? "," : "";
+    json += std::to_string(counts[i]);
+  }
+  json += "]";
+}
+
+std::string
+EHFOccupancy::
+ToJSON() const
+{
+  char text[512];
+  snprintf(text, sizeof(text),
+	   "{\"indexDepth\":%d,\"indexSlots\":%ld,\"buckets\":%ld,\"records\":%ld,"
+	   "\"pageSize\":%d,\"loadFactor\":%.4f,\"slotsPerBucket\":%.4f,\"wastedBytes\":%ld,"
+	   "\"unreadable\":%ld",
+	   indexDepth, indexSlots, buckets, records, pageSize, loadFactor, slotsPerBucket,
+	   wastedBytes, unreadable);
+  std::string json(text);
+  AppendList(json, "depthHistogram", depthHistogram);
+  AppendList(json, "fillHistogram", fillHistogram);
+  json += ",\"hottestPatterns\":[";
+  for (size_t i = 0; i < hottest.size(); i++){
+    snprintf(text, sizeof(text), "%s{\"pattern\":%d,\"records\":%ld}",
+	     (i > 0) ? "," : "", hottest[i].pattern, hottest[i].records);
+    json += text;
+  }
+  json += "]}";
+  return json;
+}
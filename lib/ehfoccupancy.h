@@ -0,0 +1,65 @@
+/*
+=========================================================================================
+Name    | EHFOccupancy                                                                  |
+Purpose | How full an extendible hash file is, and how evenly its keys are spread       |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Add                 | Add in the counts of another part of the same file      |
+        | Summarise           | Work out the ratios and the hottest patterns            |
+        | ToJSON              | The whole of it as a JSON object                        |
+----------------------------------------------------------------------------------------|
+Notes   | Made by ExtendibleHashFile::Analyse, which reads each bucket once. The load   |
+        | factor is records over the room for them in the buckets there are; wasted     |
+        | bytes are those of the buckets' pages not holding a record: empty record      |
+        | slots, bucket headers, and the slack of pages larger than a bucket. The      |
+        | patterns count records by the low HOTPATTERNBITS bits of their hash, those    |
+        | the index goes by first, so a hash spreading keys evenly gives patterns of    |
+        | much the same count, and a skewed one hot patterns, and deep buckets.         |
+=========================================================================================
+*/
+#ifndef _EhFoCcUpAnCy__
+#define _EhFoCcUpAnCy__
+
+#include <string>
+#include <vector>
+
+// Low bits of the hash the patterns are counted by, and how many of the hottest to keep
+const int HOTPATTERNBITS = 8;
+const int HOTPATTERNS = 8;
+
+struct EHFPatternCount{
+  int pattern;                                      // Low HOTPATTERNBITS bits of the hash
+  long records;                                     // Records whose hash ends in them
+};
+
+struct EHFOccupancy{
+  int indexDepth;                                   // Depth of the index
+  long indexSlots;                                  // Index values, 2 to the depth
+  long buckets;                                     // Distinct buckets
+  long records;
+  int pageSize;                                     // Bytes each bucket takes up
+  double loadFactor;                                // records / (buckets * FULLBUCKET)
+  double slotsPerBucket;                            // indexSlots / buckets
+  long wastedBytes;
+  long unreadable;                                  // Buckets not read, or out of range
+  std::vector<long> depthHistogram;                 // Buckets by depth, 0 to indexDepth
+  std::vector<long> fillHistogram;                  // Buckets by records, 0 to FULLBUCKET
+  std::vector<long> patternRecords;                 // Records by pattern
+  std::vector<EHFPatternCount> hottest;             // Most records first
+
+  EHFOccupancy();
+
+  void
+  Add(const EHFOccupancy& other
+      );
+
+  // Work out loadFactor, slotsPerBucket, wastedBytes and hottest from the counts
+  void
+  Summarise();
+
+  std::string
+  ToJSON() const;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+=========================================================================================
+Name    | EHFOptions                                                                    |
+Purpose | Choices made when an extendible hash file is constructed                      |
+----------------------------------------------------------------------------------------|
+Notes   | The file format only applies to new files, Open finds the format of an        |
+        | existing file for itself. Nothing else changes what is written to disc, so a |
+        | file may be opened with different options from those it was created with.     |
+        | inMemory is the exception: such a table has no file until it is Persisted.    |
+=========================================================================================
+*/
+#ifndef _EhFoPtIoNs__
+#define _EhFoPtIoNs__
+
+// Index (directory) representations
+const int EHF_INDEX_ARRAY = 0;                // One slot per index value, see IndexHolder
+const int EHF_INDEX_COMPACT = 1;              // One leaf per bucket, see CompactIndexHolder
+
+// File formats
+const int EHF_FORMAT_CONTAINER = 0;           // One file, name.eh, see EHFContainer
+const int EHF_FORMAT_TWOFILES = 1;            // Index in name.ehd, buckets in name.ehf
+
+// How Open gets hold of the index of a container
+const int EHF_OPEN_READINDEX = 0;             // Read it all, and check its checksum
+const int EHF_OPEN_MAPINDEX = 1;              // Map it, reading pages as lookups need them
+const int EHF_OPEN_PREFETCHINDEX = 2;         // Map it, and have it read in the background
+
+// How soon InsertRecord's changes are made durable. Close and Sync always do so.
+const int EHF_DURABILITY_NONE = 0;            // Only at Close or Sync
+const int EHF_DURABILITY_PERIODIC = 1;        // By a background thread, every syncInterval
+const int EHF_DURABILITY_COMMIT = 2;          // Before returning, sharing syncs between
+                                              // concurrent writers
+const int EHF_DURABILITY_PEROP = 3;           // Before returning, syncing for each insert
+
+struct EHFOptions{
+  int indexType;                              // EHF_INDEX_ARRAY or EHF_INDEX_COMPACT
+  int fileFormat;                             // Format of new files, EHF_FORMAT_...
+  int indexOpen;                              // EHF_OPEN_...INDEX
+  // Containers only. Split buckets into pages not in use, leaving the old bucket as it
+  // was, and commit the index after every split. See ExtendibleHashFile::AccomodateRecord
+  bool shadowSplits;
+  int durability;                             // EHF_DURABILITY_...
+  int syncInterval;                           // Milliseconds, for EHF_DURABILITY_PERIODIC
+  // Containers only. Read and write buckets with O_DIRECT, cached in cachePages pages
+  // of our own rather than in the page cache (see BucketFile). New containers get
+  // pages of DIRECTALIGN bytes for it; one with smaller pages is opened as usual.
+  bool directIO;
+  int cachePages;
+  // Keep the table in memory alone (see MemoryBucketStore). Open starts a new, empty
+  // table whatever it is given, no file is ever touched, and durability does not
+  // apply; ExtendibleHashFile::Persist writes the table out as a container.
+  bool inMemory;
+  // Time each InsertRecord, RetrieveRecord and split for the latency histograms of
+  // ExtendibleHashFile::GetStats, at the cost of reading the clock twice for each.
+  // The counters are always kept.
+  bool timeOperations;
+
+  EHFOptions()
+    : indexType(EHF_INDEX_ARRAY), fileFormat(EHF_FORMAT_CONTAINER),
+      indexOpen(EHF_OPEN_PREFETCHINDEX), shadowSplits(false),
+      durability(EHF_DURABILITY_NONE), syncInterval(100),
+      directIO(false), cachePages(4096), inMemory(false),
+      timeOperations(false) {}
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+=========================================================================================
+Name	 | EHFRecordView
+Purpose	 | A record left in its bucket, see ehfrecordview.h
+=========================================================================================
+*/
+
+#include <string.h>
+
+#include "ehfrecordview.h"
+#include "bucketfile.h"
+
+/*
+=========================================================================================
+Name	 | EHFRecordView constructors / destructor
+=========================================================================================
+*/
+EHFRecordView::
+EHFRecordView()
+{
+  _record = nullptr;
+  _file = nullptr;
+  _pin = -1;
+  _copy = nullptr;
+}
+
+EHFRecordView::
+~EHFRecordView()
+{
+  Release();
+  delete[] _copy;
+}
+
+EHFRecordView::
+EHFRecordView(EHFRecordView&& other)
+{
+  _record = nullptr;
+  _file = nullptr;
+  _pin = -1;
+  _copy = nullptr;
+  TakeFrom(other);
+}
+
+EHFRecordView&
+EHFRecordView::
+operator=(EHFRecordView&& other)
+{
+  if (this != &other){
+    Release();
+    TakeFrom(other);
+  }
+  return *this;
+}
+
+const char*
+EHFRecordView::
+Data() const
+{
+  return _record;
+}
+
+int
+EHFRecordView::
+Size() const
+{
+  return (_record != nullptr) ? RECORDSIZE : 0;
+}
+
+void
+EHFRecordView::
+Release()
+{
+  if (_file != nullptr){
+    _file->Unpin(_pin);
+  }
+  _record = nullptr;
+  _file = nullptr;
+  _pin = -1;
+}
+
+/*
+=========================================================================================
+Name	 | TakeFrom
+Purpose	 | Move the record of other into this view, leaving other empty
+Notes	 | The buffers are swapped rather than copied, so other keeps one to reuse
+=========================================================================================
+*/
+void
+EHFRecordView::
+TakeFrom(EHFRecordView& other
+	 )
+{
+  _file = other._file;
+  _pin = other._pin;
+  _record = other._record;
+  char* copy = _copy;
+  _copy = other._copy;
+  other._copy = copy;
+  other._record = nullptr;
+  other._file = nullptr;
+  other._pin = -1;
+}
+
+void
+EHFRecordView::
+Keep(const char* record
+     )
+{
+  if (_copy == nullptr){
+    _copy = new char[RECORDSIZE];
+  }
+  memcpy(_copy, record, RECORDSIZE);
+  _record = _copy;
+}
@@ -0,0 +1,73 @@
+/*
+=========================================================================================
+Name    | EHFRecordView                                                                 |
+Purpose | A record found by ExtendibleHashFile::Get, left where it was found            |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Data                | The bytes of the record, nullptr if there is none       |
+        | Size                | The number of bytes, RECORDSIZE or 0                    |
+        | Release             | Let go of the record, and of any page pinned for it     |
+----------------------------------------------------------------------------------------|
+Notes   | Only with the directIO option is the record left in its bucket: it is read    |
+        | in place from the cached page, which stays pinned until the view is released  |
+        | or destroyed; a writer changing the bucket meanwhile writes a fresh page, so  |
+        | the view goes on showing the record as it was found. Otherwise, or should    |
+        | every frame be pinned, the bucket is read as RetrieveRecord reads it and the  |
+        | record alone is copied out, into a buffer the view allocates the first time   |
+        | it needs one and keeps for the next Get. A view itself is a few words. The    |
+        | bytes are not null terminated: fields are found at the positions in records.h.|
+        | A view can be moved but not copied, and must be released before the file it  |
+        | came from is closed.                                                          |
+=========================================================================================
+*/
+#ifndef _EhFrEcOrDvIeW__
+#define _EhFrEcOrDvIeW__
+
+#include "records.h"
+
+class BucketFile;
+
+class EHFRecordView{
+ public:
+  EHFRecordView();
+  ~EHFRecordView();
+
+  EHFRecordView(EHFRecordView&& other);
+
+  EHFRecordView&
+  operator=(EHFRecordView&& other);
+
+  EHFRecordView(const EHFRecordView&) = delete;
+  EHFRecordView& operator=(const EHFRecordView&) = delete;
+
+  // The RECORDSIZE bytes of the record, not null terminated, or nullptr
+  const char*
+  Data() const;
+
+  int
+  Size() const;
+
+  void
+  Release();
+
+ private:
+  friend class ExtendibleHashFile;
+
+  // Take over the record, and the pin if file is set, from other
+  void
+  TakeFrom(EHFRecordView& other
+	   );
+
+  // Copy the RECORDSIZE bytes of record into the view's own buffer, and show them
+  void
+  Keep(const char* record
+       );
+
+  const char* _record;                              // The record, nullptr if none
+  BucketFile* _file;                                // Holder of the pin, if any
+  int _pin;                                         // As given by BucketFile::Pin
+  char* _copy;                                      // RECORDSIZE bytes, when not pinned
+};
+
+#endif
@@ -0,0 +1,293 @@
+/*
+=========================================================================================
+Name	 | EHF Recovery
+Purpose	 | Rebuild the index of an extendible hash file from its buckets, see ehfrecovery.h
+=========================================================================================
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// For file system methods and constants
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "ehfrecovery.h"
+#include "ehfcontainer.h"
+#include "ehfbucket.h"
+#include "ehfconsts.h"
+#include "indexholder.h"
+#include "bit_op_lib.h"
+#include "hash.h"
+#include "records.h"
+
+// Buckets read at a time by each scanning thread
+const int SCANCHUNK = 1024;
+
+// A bucket found by ScanBuckets
+struct FoundBucket{
+  int page;                                         // Bucket number
+  int depth;                                        // Depth of the bucket
+  int pattern;                                      // Its bit pattern, -1 if not known
+};
+
+/*
+=========================================================================================
+Name	 | ScanBuckets
+Purpose	 | Read the pages [firstPage, endPage) and note down those holding a bucket
+Notes	 | Without trustUnmarked, a page only counts if it has the pattern kept in it.
+	 | Otherwise the pattern of a bucket without one is taken from its keys, which
+	 | must all agree on it, and an empty one is noted with a pattern of -1.
+=========================================================================================
+*/
+static void
+ScanBuckets(int fileDescriptor,
+	    int fileHeaderSize,
+	    int pageSize,
+	    int firstPage,
+	    int endPage,
+	    bool trustUnmarked,
+	    std::vector<FoundBucket>* found
+	    )
+{
+  std::vector<char> chunk(static_cast<size_t>(SCANCHUNK) * pageSize);
+  EHFBucket bucket(fileDescriptor, 0, EHF_TOBEREAD);
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int first = firstPage; first < endPage; first += SCANCHUNK){
+    int count = std::min(SCANCHUNK, endPage - first);
+    ssize_t dataRead = pread(fileDescriptor, chunk.data(),
+			     static_cast<size_t>(count) * pageSize,
+			     fileHeaderSize + static_cast<long>(first) * pageSize);
+    if (dataRead < 0){
+      return;
+    }
+    count = dataRead / pageSize;                    // The file may end short
+    for (int i = 0; i < count; i++){
+      if (bucket.ReadFromBuffer(&chunk[static_cast<size_t>(i) * pageSize])
+	  != EHF_READOK){
+	continue;
+      }
+      int depth = bucket.Depth();
+      int pattern = bucket.Pattern();
+      if (depth < 1){
+	continue;
+      }
+      if (pattern >= 0){
+	if ( (pattern >> depth) != 0 ){
+	  continue;
+	}
+      } else if (!trustUnmarked){
+	continue;
+      } else {
+	for (int r = 0; r < bucket.NumOfRecs(); r++){
+	  bucket.RetrieveRecAtIndex(r, key, record);
+	  int keyPattern = GetLowestBits(Hash(key), depth);
+	  if (r == 0){
+	    pattern = keyPattern;
+	  } else if (keyPattern != pattern){
+	    pattern = -2;
+	    break;
+	  }
+	}
+	if (pattern == -2){
+	  continue;
+	}
+      }
+      found->push_back( FoundBucket{first + i, depth, pattern} );
+    }
+  }
+}
+
+/*
+=========================================================================================
+Name	 | ScanInParallel
+Purpose	 | Split the pages [0, pageCount) between threads, and gather up what they find
+=========================================================================================
+*/
+static std::vector<FoundBucket>
+ScanInParallel(int fileDescriptor,
+	       int fileHeaderSize,
+	       int pageSize,
+	       int pageCount,
+	       bool trustUnmarked,
+	       int threads
+	       )
+{
+  if (threads <= 0){
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Every thread reads at least a whole chunk
+  int chunks = (pageCount + SCANCHUNK - 1) / SCANCHUNK;
+  threads = std::max(1, std::min(threads, chunks));
+  int chunksEach = (chunks + threads - 1) / threads;
+
+  std::vector< std::vector<FoundBucket> > found(threads);
+  std::vector<std::thread> scanners;
+  for (int t = 0; t < threads; t++){
+    int firstPage = std::min(pageCount, t * chunksEach * SCANCHUNK);
+    int endPage = std::min(pageCount, (t + 1) * chunksEach * SCANCHUNK);
+    scanners.push_back(std::thread(ScanBuckets, fileDescriptor, fileHeaderSize, pageSize,
+				   firstPage, endPage, trustUnmarked, &found[t]));
+  }
+  for (std::thread& scanner : scanners){
+    scanner.join();
+  }
+  std::vector<FoundBucket> all;
+  for (std::vector<FoundBucket>& some : found){
+    all.insert(all.end(), some.begin(), some.end());
+  }
+  return all;
+}
+
+/*
+=========================================================================================
+Name	 | RebuildIndex
+Purpose	 | Rebuild the index of a table from its buckets, and write it out
+Returns	 | False if the table cannot be read, or the new index cannot be written
+=========================================================================================
+*/
+bool
+RebuildIndex(char* fileName,
+	     int threads
+	     )
+{
+  int strLength = strlen(fileName) + 8;
+  char indexFileName[strLength];
+  char bucketFileName[strLength];
+  char containerFileName[strLength];
+  snprintf(indexFileName, strLength, "%s.ehd", fileName);
+  snprintf(bucketFileName, strLength, "%s.ehf", fileName);
+  snprintf(containerFileName, strLength, "%s.eh", fileName);
+
+  // As in ExtendibleHashFile::Open, a container is used whenever there is one
+  EHFContainer container;
+  bool inContainer = (access(containerFileName, F_OK) == 0);
+  int fileDescriptor;
+  int fileHeaderSize;
+  int pageSize = BUCKETSIZE;
+  int pageCount;
+  if (inContainer){
+    if (!container.Open(containerFileName)){
+      return false;
+    }
+    fileDescriptor = container.FileDescriptor();
+    fileHeaderSize = SUPERBLOCKAREA;
+    pageSize = container.PageSize();
+    pageCount = container.PageCount();
+  } else {
+    fileDescriptor = open(bucketFileName, O_RDWR);
+    struct stat status;
+    if ( (fileDescriptor < 0) || (fstat(fileDescriptor, &status) != 0) ){
+      if (fileDescriptor >= 0){
+	close(fileDescriptor);
+      }
+      return false;
+    }
+    // Go by the size of the file rather than its header, which is written on Close
+    fileHeaderSize = FILEHEADERSIZE;
+    pageCount = std::max(0L, static_cast<long>(status.st_size) - FILEHEADERSIZE) /
+      BUCKETSIZE;
+  }
+
+  std::vector<FoundBucket> found =
+    ScanInParallel(fileDescriptor, fileHeaderSize, pageSize, pageCount, !inContainer,
+		   threads);
+
+  // Place the buckets shallowest first, so that deeper ones take over from them
+  std::stable_sort(found.begin(), found.end(),
+		   [](const FoundBucket& a, const FoundBucket& b){
+		     return a.depth < b.depth;
+		   });
+  int depth = 1;
+  std::vector<int> spares;                          // Empty buckets without a pattern
+  for (FoundBucket& bucket : found){
+    if (bucket.pattern >= 0){
+      depth = std::max(depth, bucket.depth);
+    } else {
+      spares.push_back(bucket.page);
+    }
+  }
+  // Slots hold address plus one, as IndexHolder::Attach takes them, 0 for none yet
+  size_t numOfAddresses = static_cast<size_t>(1) << depth;
+  std::vector<int> slots(numOfAddresses, 0);
+  for (FoundBucket& bucket : found){
+    if (bucket.pattern >= 0){
+      size_t stride = static_cast<size_t>(1) << bucket.depth;
+      for (size_t i = bucket.pattern; i < numOfAddresses; i += stride){
+	slots[i] = bucket.page + 1;
+      }
+    }
+  }
+
+  // Give index values no bucket claims an empty bucket, as shallow as the gap allows
+  bool rebuilt = true;
+  int newBuckets = 0;
+  for (size_t i = 0; i < numOfAddresses && rebuilt; i++){
+    if (slots[i] != 0){
+      continue;
+    }
+    int bucketDepth = 1;
+    for ( ; bucketDepth < depth; bucketDepth++){
+      size_t stride = static_cast<size_t>(1) << bucketDepth;
+      size_t j = i & (stride - 1);
+      while ( (j < numOfAddresses) && (slots[j] == 0) ){
+	j += stride;
+      }
+      if (j >= numOfAddresses){
+	break;
+      }
+    }
+    int page;
+    if (!spares.empty()){
+      page = spares.back();
+      spares.pop_back();
+    } else if (inContainer){
+      page = container.AllocatePage();
+    } else {
+      page = pageCount + newBuckets++;
+    }
+    size_t stride = static_cast<size_t>(1) << bucketDepth;
+    int pattern = i & (stride - 1);
+    EHFBucket bucket(fileDescriptor, page, bucketDepth);
+    bucket.ChangeFileHeaderSize(fileHeaderSize);
+    bucket.ChangePageSize(pageSize);
+    bucket.ChangePattern(pattern);
+    rebuilt = (bucket.Write() == EHF_WROTEOK);
+    for (size_t j = pattern; j < numOfAddresses; j += stride){
+      slots[j] = page + 1;
+    }
+  }
+
+  IndexHolder index;
+  rebuilt = rebuilt && index.Attach(slots.data(), depth, false);
+  if (inContainer){
+    if (rebuilt){
+      std::vector<int> buckets(slots);
+      std::sort(buckets.begin(), buckets.end());
+      int bucketCount = std::unique(buckets.begin(), buckets.end()) - buckets.begin();
+      container.RebuildFreePages(&index);
+      rebuilt = container.Commit(&index, bucketCount);
+    }
+    container.Close();
+  } else {
+    // The file header holds the number of buckets, counting any added above
+    int bucketCount = pageCount + newBuckets;
+    rebuilt = rebuilt &&
+      (pwrite(fileDescriptor, &bucketCount, sizeof(bucketCount), 0)
+       == sizeof(bucketCount));
+    close(fileDescriptor);
+    if (rebuilt){
+      int indexFD = open(indexFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+      rebuilt = (indexFD >= 0) && index.Write(indexFD);
+      if (indexFD >= 0){
+	close(indexFD);
+      }
+    }
+  }
+  return rebuilt;
+}
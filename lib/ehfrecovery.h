@@ -0,0 +1,35 @@
+/*
+=========================================================================================
+Name    | EHF Recovery                                                                  |
+Purpose | Rebuild the index of an extendible hash file from its buckets                 |
+----------------------------------------------------------------------------------------|
+Notes   | Every bucket holds its depth, and the bit pattern its keys share in that many |
+        | low bits: kept in the bucket since the pattern was added, otherwise worked    |
+        | out from the hash of its first key. A bucket of depth d and pattern p is the  |
+        | one for every index value whose low d bits are p, so the index follows from   |
+        | the buckets alone, and is rebuilt at the depth of the deepest bucket.         |
+        | The buckets are read by several threads, each through its own share of the    |
+        | file in large sequential reads, so that the time taken is that of reading the |
+        | file.                                                                         |
+        | A container may hold pages that are no longer buckets: free pages, some with |
+        | an old bucket still on them, and the pages of older indexes. Only pages with  |
+        | a kept pattern count there, and as a bucket is only ever replaced by deeper   |
+        | ones, the deeper bucket wins wherever two claim an index value. Empty buckets |
+        | without a pattern cannot be placed; index values no bucket claims are given   |
+        | such a bucket, or failing that a new one, at the least depth that fits.       |
+=========================================================================================
+*/
+#ifndef _EhFrEcOvErY__
+#define _EhFrEcOvErY__
+
+// Rebuild the index of the table fileName (as given to ExtendibleHashFile::Open) from
+// its buckets, and write it in place of the one there: fileName.ehd for a table in two
+// files, a new Commit for a container, whose free list is rebuilt along with it.
+// threads is the number of threads reading buckets, 0 for one per core. The table must
+// not be open.
+bool
+RebuildIndex(char* fileName,
+	     int threads = 0
+	     );
+
+#endif
@@ -0,0 +1,401 @@
+/*
+=========================================================================================
+Name	 | EHFStats, EHFHistogram, EHFStatsCollector
+Purpose	 | Counts of what a file has done, see ehfstats.h
+=========================================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ehfstats.h"
+
+// Add to a count only its own thread changes
+static inline void
+Bump(std::atomic<uint64_t>& count,
+     uint64_t by
+     )
+{
+  count.store(count.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+/*
+=========================================================================================
+Name	 | EHFHistogram
+=========================================================================================
+*/
+EHFHistogram::
+EHFHistogram()
+{
+  memset(counts, 0, sizeof(counts));
+  count = 0;
+  total = 0;
+  max = 0;
+}
+
+void
+EHFHistogram::
+Record(uint64_t value
+       )
+{
+  counts[BucketOf(value)]++;
+  count++;
+  total += value;
+  if (value > max){
+    max = value;
+  }
+}
+
+void
+EHFHistogram::
+Add(const EHFHistogram& other
+    )
+{
+  for (int b = 0; b < HISTOGRAMBUCKETS; b++){
+    counts[b] += other.counts[b];
+  }
+  count += other.count;
+  total += other.total;
+  if (other.max > max){
+    max = other.max;
+  }
+}
+
+uint64_t
+EHFHistogram::
+Percentile(double fraction
+	   ) const
+{
+  if (count == 0){
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(fraction * (count - 1) + 0.5) + 1;
+  uint64_t seen = 0;
+  for (int b = 0; b < HISTOGRAMBUCKETS; b++){
+    seen += counts[b];
+    if (seen >= rank){
+      uint64_t highest = HighestIn(b);
+      return (highest < max) ? highest : max;
+    }
+  }
+  return max;
+}
+
+double
+EHFHistogram::
+Mean() const
+{
+  return (count > 0) ? static_cast<double>(total) / count : 0.0;
+}
+
+/*
+=========================================================================================
+Name	 | BucketOf / HighestIn
+Notes	 | A value of b bits, b > HISTOGRAMSUBBITS, goes by its top HISTOGRAMSUBBITS + 1
+	 | bits: the leading one gives the power of two, the bits after it the bucket
+	 | within it.
+=========================================================================================
+*/
+int
+EHFHistogram::
+BucketOf(uint64_t value
+	 )
+{
+  if (value < static_cast<uint64_t>(HISTOGRAMSUBBUCKETS)){
+    return value;
+  }
+  int bits = 64 - __builtin_clzll(value);
+  int shift = bits - 1 - HISTOGRAMSUBBITS;
+  int within = (value >> shift) & (HISTOGRAMSUBBUCKETS - 1);
+  return (shift + 1) * HISTOGRAMSUBBUCKETS + within;
+}
+
+uint64_t
+EHFHistogram::
+HighestIn(int bucket
+	  )
+{
+  if (bucket < HISTOGRAMSUBBUCKETS){
+    return bucket;
+  }
+  int shift = bucket / HISTOGRAMSUBBUCKETS - 1;
+  uint64_t lowest = static_cast<uint64_t>(HISTOGRAMSUBBUCKETS + bucket % HISTOGRAMSUBBUCKETS)
+    << shift;
+  return lowest + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+/*
+=========================================================================================
+Name	 | EHFStats
+=========================================================================================
+*/
+EHFStats::
+EHFStats()
+{
+  inserts = 0;
+  retrieves = 0;
+  lookupRetries = 0;
+  splits = 0;
+  directoryDoublings = 0;
+  bucketReads = 0;
+  bucketWrites = 0;
+  poorHashFunction = 0;
+  updates = 0;
+  syncs = 0;
+}
+
+static void
+AppendHistogram(std::string& json,
+		const char* name,
+		const EHFHistogram& histogram
+		)
+{
+  char text[512];
+  snprintf(text, sizeof(text),
+	   ",\"%s\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,"
+	   "\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+	   name, (unsigned long long) histogram.count, histogram.Mean(),
+	   (unsigned long long) histogram.Percentile(0.5),
+	   (unsigned long long) histogram.Percentile(0.9),
+	   (unsigned long long) histogram.Percentile(0.99),
+	   (unsigned long long) histogram.Percentile(0.999),
+	   (unsigned long long) histogram.max);
+  json += text;
+}
+
+std::string
+EHFStats::
+ToJSON() const
+{
+  char text[512];
+  snprintf(text, sizeof(text),
+	   "{\"inserts\":%llu,\"retrieves\":%llu,\"lookupRetries\":%llu,\"splits\":%llu,"
+	   "\"directoryDoublings\":%llu,\"bucketReads\":%llu,\"bucketWrites\":%llu,"
+	   "\"poorHashFunction\":%llu,\"updates\":%llu,\"syncs\":%llu",
+	   (unsigned long long) inserts, (unsigned long long) retrieves,
+	   (unsigned long long) lookupRetries, (unsigned long long) splits,
+	   (unsigned long long) directoryDoublings, (unsigned long long) bucketReads,
+	   (unsigned long long) bucketWrites, (unsigned long long) poorHashFunction,
+	   (unsigned long long) updates, (unsigned long long) syncs);
+  std::string json(text);
+  AppendHistogram(json, "insertLatencyNs", insertLatency);
+  AppendHistogram(json, "retrieveLatencyNs", retrieveLatency);
+  AppendHistogram(json, "splitLatencyNs", splitLatency);
+  json += "}";
+  return json;
+}
+
+/*
+=========================================================================================
+Name	 | EHFStatsCollector
+=========================================================================================
+*/
+static std::atomic<uint64_t> collectorsMade(0);
+
+// Each thread's cache is guarded by its own latch, which only a collector going away
+// ever takes from another thread
+struct EHFStatsCollector::ThreadShards{
+  std::mutex latch;
+  std::unordered_map<uint64_t, Shard*> shards;
+
+  // The caches of every live thread
+  struct Registry{
+    std::mutex latch;
+    std::unordered_set<ThreadShards*> threads;
+  };
+
+  ThreadShards();
+  ~ThreadShards();
+
+  // Never destroyed, so that threads and collectors outliving static destruction can
+  // still find it
+  static Registry&
+  Every();
+};
+
+EHFStatsCollector::ThreadShards::Registry&
+EHFStatsCollector::ThreadShards::
+Every()
+{
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+EHFStatsCollector::ThreadShards::
+ThreadShards()
+{
+  Registry& registry = Every();
+  std::lock_guard<std::mutex> latch(registry.latch);
+  registry.threads.insert(this);
+}
+
+EHFStatsCollector::ThreadShards::
+~ThreadShards()
+{
+  Registry& registry = Every();
+  std::lock_guard<std::mutex> latch(registry.latch);
+  registry.threads.erase(this);
+}
+
+EHFStatsCollector::Shard::
+Shard()
+{
+  for (std::atomic<uint64_t>& counter : counters){
+    counter.store(0, std::memory_order_relaxed);
+  }
+  for (int l = 0; l < EHF_LATENCIES; l++){
+    for (std::atomic<uint64_t>& count : counts[l]){
+      count.store(0, std::memory_order_relaxed);
+    }
+    totals[l].store(0, std::memory_order_relaxed);
+    maxima[l].store(0, std::memory_order_relaxed);
+  }
+}
+
+EHFStatsCollector::
+EHFStatsCollector()
+{
+  _id = ++collectorsMade;
+}
+
+/*
+=========================================================================================
+Name	 | ~EHFStatsCollector
+Notes	 | A thread's last shard is left as it is: it is only used again for the same
+	 | number, which no other collector is given.
+=========================================================================================
+*/
+EHFStatsCollector::
+~EHFStatsCollector()
+{
+  ThreadShards::Registry& registry = ThreadShards::Every();
+  std::lock_guard<std::mutex> latch(registry.latch);
+  for (ThreadShards* thread : registry.threads){
+    std::lock_guard<std::mutex> threadLatch(thread->latch);
+    thread->shards.erase(_id);
+  }
+}
+
+void
+EHFStatsCollector::
+Count(int counter,
+      uint64_t by
+      )
+{
+  Bump(Mine().counters[counter], by);
+}
+
+void
+EHFStatsCollector::
+Time(int latency,
+     uint64_t nanoseconds
+     )
+{
+  Shard& shard = Mine();
+  Bump(shard.counts[latency][EHFHistogram::BucketOf(nanoseconds)], 1);
+  Bump(shard.totals[latency], nanoseconds);
+  if (nanoseconds > shard.maxima[latency].load(std::memory_order_relaxed)){
+    shard.maxima[latency].store(nanoseconds, std::memory_order_relaxed);
+  }
+}
+
+EHFStats
+EHFStatsCollector::
+Gather()
+{
+  uint64_t counters[EHF_STATCOUNTERS] = { 0 };
+  EHFHistogram histograms[EHF_LATENCIES];
+  {
+    std::lock_guard<std::mutex> latch(_latch);
+    for (std::unique_ptr<Shard>& shard : _shards){
+      for (int c = 0; c < EHF_STATCOUNTERS; c++){
+	counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+      }
+      for (int l = 0; l < EHF_LATENCIES; l++){
+	EHFHistogram& histogram = histograms[l];
+	for (int b = 0; b < HISTOGRAMBUCKETS; b++){
+	  uint64_t count = shard->counts[l][b].load(std::memory_order_relaxed);
+	  histogram.counts[b] += count;
+	  histogram.count += count;
+	}
+	histogram.total += shard->totals[l].load(std::memory_order_relaxed);
+	uint64_t max = shard->maxima[l].load(std::memory_order_relaxed);
+	if (max > histogram.max){
+	  histogram.max = max;
+	}
+      }
+    }
+  }
+  EHFStats stats;
+  stats.inserts = counters[EHF_STAT_INSERTS];
+  stats.retrieves = counters[EHF_STAT_RETRIEVES];
+  stats.lookupRetries = counters[EHF_STAT_LOOKUPRETRIES];
+  stats.splits = counters[EHF_STAT_SPLITS];
+  stats.directoryDoublings = counters[EHF_STAT_DOUBLINGS];
+  stats.bucketReads = counters[EHF_STAT_BUCKETREADS];
+  stats.bucketWrites = counters[EHF_STAT_BUCKETWRITES];
+  stats.poorHashFunction = counters[EHF_STAT_POORHASHFUNCTION];
+  stats.updates = counters[EHF_STAT_UPDATES];
+  stats.syncs = counters[EHF_STAT_SYNCS];
+  stats.insertLatency = histograms[EHF_LATENCY_INSERT];
+  stats.retrieveLatency = histograms[EHF_LATENCY_RETRIEVE];
+  stats.splitLatency = histograms[EHF_LATENCY_SPLIT];
+  return stats;
+}
+
+uint64_t
+EHFStatsCollector::
+Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+=========================================================================================
+Name	 | Mine
+Notes	 | The last shard used is kept apart from the rest, as a thread mostly counts
+	 | for one file at a time, and is found without a latch.
+=========================================================================================
+*/
+EHFStatsCollector::Shard&
+EHFStatsCollector::
+Mine()
+{
+  thread_local uint64_t lastId = 0;
+  thread_local Shard* lastShard = nullptr;
+  if (lastId == _id){
+    return *lastShard;
+  }
+  ThreadShards& here = Here();
+  std::lock_guard<std::mutex> threadLatch(here.latch);
+  Shard*& shard = here.shards[_id];
+  if (shard == nullptr){
+    std::lock_guard<std::mutex> latch(_latch);
+    _shards.emplace_back(new Shard());
+    shard = _shards.back().get();
+  }
+  lastId = _id;
+  lastShard = shard;
+  return *shard;
+}
+
+EHFStatsCollector::ThreadShards&
+EHFStatsCollector::
+Here()
+{
+  thread_local ThreadShards here;
+  return here;
+}
+
+size_t
+EHFStatsCollector::
+CachedShards()
+{
+  ThreadShards& here = Here();
+  std::lock_guard<std::mutex> threadLatch(here.latch);
+  return here.shards.size();
+}
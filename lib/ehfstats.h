@@ -0,0 +1,175 @@
+/*
+=========================================================================================
+Name    | EHFStats, EHFHistogram, EHFStatsCollector                                     |
+Purpose | What an extendible hash file has done, counted as it goes                     |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Record              | Add a value to a histogram                              |
+        | Percentile          | The value below which a fraction of those recorded lie  |
+        | ToJSON              | The stats as a JSON object                              |
+        | Count               | Add to a counter, for the calling thread                |
+        | Time                | Add a latency to a histogram, for the calling thread    |
+        | Gather              | Sum up every thread's counts                            |
+        | CachedShards        | How many shards the calling thread can find its way to  |
+----------------------------------------------------------------------------------------|
+Notes   | A histogram keeps values below HISTOGRAMSUBBUCKETS exactly, and every larger  |
+        | one in one of HISTOGRAMSUBBUCKETS buckets per power of two, so that any value |
+        | is known to within about 6%, as an HDR histogram does, whatever its size.     |
+        | The collector keeps a shard of counters and histograms for each thread that   |
+        | counts anything. A thread only ever adds to its own shard, with plain loads  |
+        | and stores rather than atomic additions, so counting takes no lock and shares |
+        | no cache line between threads; Gather reads every shard, and may see a count |
+        | a moment out of date. Each thread finds its shard through a thread local      |
+        | cache, keyed by a number no other collector is ever given. A collector takes  |
+        | its keys out of every thread's cache as it goes, so a thread that touches    |
+        | many files over its life holds only those still open.                        |
+=========================================================================================
+*/
+#ifndef _EhFsTaTs__
+#define _EhFsTaTs__
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Histogram geometry: 16 buckets per power of two
+const int HISTOGRAMSUBBITS = 4;
+const int HISTOGRAMSUBBUCKETS = 1 << HISTOGRAMSUBBITS;
+const int HISTOGRAMBUCKETS = (64 - HISTOGRAMSUBBITS + 1) * HISTOGRAMSUBBUCKETS;
+
+// Counters
+const int EHF_STAT_INSERTS = 0;               // Insert calls
+const int EHF_STAT_RETRIEVES = 1;             // Lookups, by any call
+const int EHF_STAT_LOOKUPRETRIES = 2;         // Lookups begun again, a writer in the way
+const int EHF_STAT_SPLITS = 3;                // Buckets split
+const int EHF_STAT_DOUBLINGS = 4;             // Times the index doubled
+const int EHF_STAT_BUCKETREADS = 5;           // Buckets read by inserts, lookups, splits
+const int EHF_STAT_BUCKETWRITES = 6;          // Buckets written by inserts and splits
+const int EHF_STAT_POORHASHFUNCTION = 7;      // Inserts returning EHF_POORHASHFUNCTION
+const int EHF_STAT_UPDATES = 8;               // Records updated in place
+const int EHF_STAT_SYNCS = 9;                 // Syncs that made writes durable
+const int EHF_STATCOUNTERS = 10;
+
+// Latency histograms
+const int EHF_LATENCY_INSERT = 0;             // InsertRecord
+const int EHF_LATENCY_RETRIEVE = 1;           // RetrieveRecord
+const int EHF_LATENCY_SPLIT = 2;              // Splitting a bucket, index changes and all
+const int EHF_LATENCIES = 3;
+
+struct EHFHistogram{
+  uint64_t counts[HISTOGRAMBUCKETS];
+  uint64_t count;                             // Values recorded
+  uint64_t total;                             // Their sum
+  uint64_t max;
+
+  EHFHistogram();
+
+  void
+  Record(uint64_t value
+	 );
+
+  void
+  Add(const EHFHistogram& other
+      );
+
+  // The highest value of the bucket holding the value fraction of the way up, 0 if
+  // nothing was recorded
+  uint64_t
+  Percentile(double fraction
+	     ) const;
+
+  double
+  Mean() const;
+
+  static int
+  BucketOf(uint64_t value
+	   );
+
+  // The highest value bucket holds
+  static uint64_t
+  HighestIn(int bucket
+	    );
+};
+
+struct EHFStats{
+  uint64_t inserts;
+  uint64_t retrieves;
+  uint64_t lookupRetries;
+  uint64_t splits;
+  uint64_t directoryDoublings;
+  uint64_t bucketReads;
+  uint64_t bucketWrites;
+  uint64_t poorHashFunction;
+  uint64_t updates;
+  uint64_t syncs;
+  // Nanoseconds, recorded only with the timeOperations option
+  EHFHistogram insertLatency;
+  EHFHistogram retrieveLatency;
+  EHFHistogram splitLatency;
+
+  EHFStats();
+
+  // One object: the counters, then each histogram as its count, mean, percentiles
+  // and max, in nanoseconds
+  std::string
+  ToJSON() const;
+};
+
+class EHFStatsCollector{
+ public:
+  EHFStatsCollector();
+
+  ~EHFStatsCollector();
+
+  void
+  Count(int counter,
+	uint64_t by = 1
+	);
+
+  void
+  Time(int latency,
+       uint64_t nanoseconds
+       );
+
+  EHFStats
+  Gather();
+
+  // Nanoseconds on a monotonic clock, to time with
+  static uint64_t
+  Now();
+
+  // Collectors the calling thread has a shard of, in its cache
+  static size_t
+  CachedShards();
+
+ private:
+  struct Shard{
+    std::atomic<uint64_t> counters[EHF_STATCOUNTERS];
+    std::atomic<uint64_t> counts[EHF_LATENCIES][HISTOGRAMBUCKETS];
+    std::atomic<uint64_t> totals[EHF_LATENCIES];
+    std::atomic<uint64_t> maxima[EHF_LATENCIES];
+
+    Shard();
+  };
+
+  // A thread's cache of its shards, by collector
+  struct ThreadShards;
+
+  // The calling thread's cache
+  static ThreadShards&
+  Here();
+
+  // The calling thread's shard, made on its first call
+  Shard&
+  Mine();
+
+  uint64_t _id;                               // Key to each thread's cache
+  std::mutex _latch;                          // Guards _shards
+  std::vector< std::unique_ptr<Shard> > _shards;
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+=========================================================================================
+Name	 | EHFTracer
+Purpose	 | A ring of timestamped events, see ehftrace.h
+=========================================================================================
+*/
+
+#include <stdio.h>
+#include <utility>
+
+#include "ehftrace.h"
+#include "ehfstats.h"
+
+// Small numbers for threads, in the order they first record an event
+static std::atomic<int> threadsSeen(0);
+
+static int
+ThisThread()
+{
+  thread_local int thread = ++threadsSeen;
+  return thread;
+}
+
+/*
+=========================================================================================
+Name	 | EHFTracer constructor / destructor
+=========================================================================================
+*/
+EHFTracer::
+EHFTracer(int capacity
+	  )
+{
+  uint64_t slots = 1;
+  while (slots < static_cast<uint64_t>(capacity)){
+    slots *= 2;
+  }
+  _slots = new Slot[slots];
+  for (uint64_t s = 0; s < slots; s++){
+    _slots[s].sequence.store(0, std::memory_order_relaxed);
+  }
+  _mask = slots - 1;
+  _next = 0;
+}
+
+EHFTracer::
+~EHFTracer()
+{
+  delete[] _slots;
+}
+
+/*
+=========================================================================================
+Name	 | Record
+Purpose	 | Stamp an event with the time and thread, and put it in the next slot
+=========================================================================================
+*/
+void
+EHFTracer::
+Record(int type,
+       long first,
+       long second
+       )
+{
+  EHFTraceEvent event;
+  event.nanoseconds = EHFStatsCollector::Now();
+  event.type = type;
+  event.thread = ThisThread();
+  event.first = first;
+  event.second = second;
+  uint64_t number = _next.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = _slots[number & _mask];
+  slot.sequence.store(2 * number + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = event;
+  slot.sequence.store(2 * number + 2, std::memory_order_release);
+  if (_callback){
+    _callback(event);
+  }
+}
+
+void
+EHFTracer::
+SetCallback(std::function<void(const EHFTraceEvent&)> callback
+	    )
+{
+  _callback = std::move(callback);
+}
+
+/*
+=========================================================================================
+Name	 | Events
+Purpose	 | Copy out the events still in the ring, oldest first
+Notes	 | A slot whose sequence number is not that of the event looked for, before and
+	 | after it is copied, is being written, and is left out.
+=========================================================================================
+*/
+std::vector<EHFTraceEvent>
+EHFTracer::
+Events() const
+{
+  uint64_t next = _next.load(std::memory_order_acquire);
+  uint64_t first = (next > _mask + 1) ? next - (_mask + 1) : 0;
+  std::vector<EHFTraceEvent> events;
+  events.reserve(next - first);
+  for (uint64_t number = first; number < next; number++){
+    const Slot& slot = _slots[number & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != 2 * number + 2){
+      continue;
+    }
+    EHFTraceEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == 2 * number + 2){
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+uint64_t
+EHFTracer::
+Recorded() const
+{
+  return _next.load(std::memory_order_relaxed);
+}
+
+/*
+=========================================================================================
+Name	 | ToChromeTrace
+Purpose	 | The events as a Chrome trace: splits as begin and end events, bucket I/O as
+	 | complete events with their duration, the rest as instants
+Notes	 | Times are in microseconds from the first event.
+=========================================================================================
+*/
+std::string
+EHFTracer::
+ToChromeTrace() const
+{
+  std::vector<EHFTraceEvent> events = Events();
+  uint64_t origin = events.empty() ? 0 : events.front().nanoseconds;
+  for (const EHFTraceEvent& event : events){
+    if ( (event.type == EHF_TRACE_BUCKETREAD) || (event.type == EHF_TRACE_BUCKETWRITE) ){
+      uint64_t start = event.nanoseconds - event.second;
+      origin = (start < origin) ? start : origin;
+    }
+  }
+  std::string json("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  char text[256];
+  bool first = true;
+  for (const EHFTraceEvent& event : events){
+    double at = (event.nanoseconds - origin) / 1000.0;
+    switch (event.type){
+    case EHF_TRACE_SPLITBEGIN:
+      snprintf(text, sizeof(text),
+	       "{\"name\":\"split\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+	       "\"args\":{\"bucket\":%ld,\"depth\":%ld}}",
+	       at, event.thread, event.first, event.second);
+      break;
+    case EHF_TRACE_SPLITEND:
+      snprintf(text, sizeof(text),
+	       "{\"name\":\"split\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+	       "\"args\":{\"newBucket\":%ld,\"depth\":%ld}}",
+	       at, event.thread, event.first, event.second);
+      break;
+    case EHF_TRACE_INDEXGROW:
+    case EHF_TRACE_INDEXSHRINK:
+      snprintf(text, sizeof(text),
+	       "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+	       "\"args\":{\"oldSlots\":%ld,\"newSlots\":%ld}}",
+	       (event.type == EHF_TRACE_INDEXGROW) ? "index doubled" : "index halved",
+	       at, event.thread, event.first, event.second);
+      break;
+    case EHF_TRACE_BUCKETREAD:
+    case EHF_TRACE_BUCKETWRITE:
+      snprintf(text, sizeof(text),
+	       "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+	       "\"args\":{\"bucket\":%ld}}",
+	       (event.type == EHF_TRACE_BUCKETREAD) ? "bucket read" : "bucket write",
+	       at - event.second / 1000.0, event.second / 1000.0, event.thread,
+	       event.first);
+      break;
+    case EHF_TRACE_CACHEEVICT:
+      snprintf(text, sizeof(text),
+	       "{\"name\":\"cache eviction\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+	       "\"pid\":1,\"tid\":%d,\"args\":{\"evicted\":%ld,\"for\":%ld}}",
+	       at, event.thread, event.first, event.second);
+      break;
+    default:
+      continue;
+    }
+    json += first ? "" : ",";
+    json += text;
+    first = false;
+  }
+  json += "]}";
+  return json;
+}
+
+bool
+EHFTracer::
+WriteChromeTrace(char* fileName
+		 ) const
+{
+  FILE* file = fopen(fileName, "w");
+  if (file == nullptr){
+    return false;
+  }
+  std::string json = ToChromeTrace();
+  bool written = (fwrite(json.data(), 1, json.size(), file) == json.size());
+  return (fclose(file) == 0) && written;
+}
@@ -0,0 +1,100 @@
+/*
+=========================================================================================
+Name    | EHFTracer                                                                     |
+Purpose | Timestamped events of what an extendible hash file does, for a timeline       |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Record              | Note an event, from any thread                          |
+        | SetCallback         | Have every event passed to a function as it happens     |
+        | Events              | The events still held, oldest first                     |
+        | Recorded            | Events recorded, counting those since overwritten       |
+        | ToChromeTrace       | The events held, in the Chrome trace event format       |
+        | WriteChromeTrace    | Write them to a file, for chrome://tracing or Perfetto  |
+----------------------------------------------------------------------------------------|
+Notes   | Given to ExtendibleHashFile::SetTracer. The events are kept in a ring of a    |
+        | fixed number of slots, the oldest overwritten once it is full. A thread takes |
+        | the next slot with one atomic addition, and fills it in between two stores of |
+        | the slot's sequence number, so that recording takes no lock, and Events       |
+        | passes over a slot being filled in or overwritten as it reads it.             |
+        | A callback is called on the thread recording the event, with any latch that   |
+        | thread holds still held, so it must be quick and must not call back into the  |
+        | file. It must be set before the tracer is given to a file.                    |
+=========================================================================================
+*/
+#ifndef _EhFtRaCe__
+#define _EhFtRaCe__
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Events held, unless the tracer is told otherwise
+const int TRACECAPACITY = 1 << 16;
+
+// Event types, and what first and second hold for each
+const int EHF_TRACE_SPLITBEGIN = 0;           // Bucket split, its depth
+const int EHF_TRACE_SPLITEND = 1;             // New bucket, its depth
+const int EHF_TRACE_INDEXGROW = 2;            // Index values before, and after doubling
+const int EHF_TRACE_INDEXSHRINK = 3;          // Index values before, and after halving
+const int EHF_TRACE_BUCKETREAD = 4;           // Bucket, nanoseconds the read took
+const int EHF_TRACE_BUCKETWRITE = 5;          // Bucket, nanoseconds the write took
+const int EHF_TRACE_CACHEEVICT = 6;           // Page evicted, page taking its frame
+const int EHF_TRACETYPES = 7;
+
+struct EHFTraceEvent{
+  uint64_t nanoseconds;                       // When, on a monotonic clock
+  int type;                                   // EHF_TRACE_...
+  int thread;                                 // Small number for the recording thread
+  long first;
+  long second;
+};
+
+class EHFTracer{
+ public:
+  // capacity is rounded up to a power of two
+  explicit EHFTracer(int capacity = TRACECAPACITY
+		     );
+  ~EHFTracer();
+
+  EHFTracer(const EHFTracer&) = delete;
+  EHFTracer& operator=(const EHFTracer&) = delete;
+
+  void
+  Record(int type,
+	 long first,
+	 long second
+	 );
+
+  void
+  SetCallback(std::function<void(const EHFTraceEvent&)> callback
+	      );
+
+  std::vector<EHFTraceEvent>
+  Events() const;
+
+  uint64_t
+  Recorded() const;
+
+  std::string
+  ToChromeTrace() const;
+
+  bool                                        // False if the file could not be written
+  WriteChromeTrace(char* fileName
+		   ) const;
+
+ private:
+  struct Slot{
+    std::atomic<uint64_t> sequence;           // 2n+1 while event n is filled in, then 2n+2
+    EHFTraceEvent event;
+  };
+
+  Slot* _slots;
+  uint64_t _mask;                             // Slots less one
+  std::atomic<uint64_t> _next;                // Number of the next event
+  std::function<void(const EHFTraceEvent&)> _callback;
+};
+
+#endif
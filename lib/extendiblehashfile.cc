@@ -6,6 +6,10 @@ Purpose	 | Extendible Hashing File implementation
 */
 
 #include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <utility>
+#include <chrono>
 
 // Get extendible hash file header and constants
 #include "ehfconsts.h"
@@ -13,6 +17,13 @@ Purpose	 | Extendible Hashing File implementation
 
 // Get extendible hash file bucket class
 #include "ehfbucket.h"
+#include "bucketfile.h"
+#include "ehfrecordview.h"
+#include "memorybucketstore.h"
+
+// Get the index representations
+#include "indexholder.h"
+#include "compactindexholder.h"
 
 // Get the hash function
 #include "hash.h"
@@ -27,13 +38,13 @@ Purpose	 | Extendible Hashing File implementation
 // For FileSummary out put
 #include <iostream>
 
-// For power function calls
-#include <math.h>
+// Index slots filled in by each insert, after the index was doubled
+const int MIRRORSPERINSERT = 64;
 
 /*
 =========================================================================================
-Name	 | ExtendibleHashFile destructor
-Purpose	 | Destructor
+Name	 | ExtendibleHashFile constructors
+Purpose	 | Constructors, with the default options or with those given
 =========================================================================================
 */
 ExtendibleHashFile::
@@ -44,6 +55,36 @@ ExtendibleHashFile()
   _bucketCount = 0;
   _bucketFileFD = -1;
   _indexFileFD = -1;
+  _container = nullptr;
+  _bucketFile = nullptr;
+  _memory = nullptr;
+  _tracer = nullptr;
+  _indexDirty = false;
+  _writeCount = 0;
+  _durableWrites = 0;
+  _syncing = false;
+  _stopFlusher = false;
+}
+
+ExtendibleHashFile::
+ExtendibleHashFile(const EHFOptions& options
+		   )
+  : _options(options)
+{
+  // File is not open initially
+  _fileOpen = false;
+  _bucketCount = 0;
+  _bucketFileFD = -1;
+  _indexFileFD = -1;
+  _container = nullptr;
+  _bucketFile = nullptr;
+  _memory = nullptr;
+  _tracer = nullptr;
+  _indexDirty = false;
+  _writeCount = 0;
+  _durableWrites = 0;
+  _syncing = false;
+  _stopFlusher = false;
 }
 
 /*
@@ -80,21 +121,48 @@ Open(char* fileName,					// File to open
   if (_fileOpen){
     Close();
   }
+  _dirtyBuckets.clear();
+  _indexDirty = false;
+  _writeCount = 0;
+  _durableWrites = 0;
   // Create a file name
   int strLength = 5 + strlen(fileName);
   char indexFileName[strLength];			// Index file name
   char bucketFileName[strLength];			// Bucket file name
+  char containerFileName[strLength];			// Container file name
   memset(bucketFileName, '\0', strLength);
   memset(indexFileName, '\0', strLength);
+  memset(containerFileName, '\0', strLength);
   strcpy(bucketFileName, fileName);
   strcpy(indexFileName, fileName);
+  strcpy(containerFileName, fileName);
   strcat(bucketFileName, ".ehf");			// Append the extension
   strcat(indexFileName, ".ehd");			// Append the extension
+  strcat(containerFileName, ".eh");			// Append the extension
 
+  if (_options.inMemory){
+    _fileOpen = CreateInMemory();
+    return _fileOpen;
+  }
   if (openExisting){
-    _fileOpen = OpenExistingFile(indexFileName, bucketFileName);
-  } else {
+    // Should both layouts be present, the container is the one in use
+    if (access(containerFileName, F_OK) == 0){
+      _fileOpen = OpenExistingContainer(containerFileName);
+    } else {
+      _fileOpen = OpenExistingFile(indexFileName, bucketFileName);
+    }
+  } else if (_options.fileFormat == EHF_FORMAT_TWOFILES){
+    unlink(containerFileName);				// Replace a table of any layout
     _fileOpen = CreateNewFile(indexFileName, bucketFileName);
+  } else {
+    _fileOpen = CreateNewContainer(containerFileName);
+    if (_fileOpen){
+      unlink(indexFileName);				// Replace a table of any layout
+      unlink(bucketFileName);
+    }
+  }
+  if (_fileOpen && (_options.durability == EHF_DURABILITY_PERIODIC)){
+    _flusher = std::thread(&ExtendibleHashFile::Flusher, this);
   }
   return _fileOpen;
 }
@@ -118,6 +186,31 @@ Close()
   if (!_fileOpen){
     return;
   }
+  StopFlusher();
+  if (_memory != nullptr){
+    delete _index;
+    delete _memory;
+    _memory = nullptr;
+    _bucketCount = 0;
+    _fileOpen = false;
+    return;
+  }
+  if (_container != nullptr){
+    // Write the index and bucket count, and make the whole file durable
+    if (!_container->Commit(_index, _bucketCount)){
+      // std::cout error
+    }
+    delete _index;
+    delete _bucketFile;
+    _bucketFile = nullptr;
+    _container->Close();
+    delete _container;
+    _container = nullptr;
+    _bucketFileFD = -1;
+    _bucketCount = 0;
+    _fileOpen = false;
+    return;
+  }
   // Write the index
   _index->Write(_indexFileFD);
   // Deallocate index memory
@@ -126,6 +219,10 @@ Close()
   if (WriteBucketCount() != EHF_WROTEOK){
     // std::cout error
   }
+  if (_options.durability != EHF_DURABILITY_NONE){
+    fdatasync(_bucketFileFD);
+    fdatasync(_indexFileFD);
+  }
 
   // Close the files
   close(_indexFileFD);
@@ -165,8 +262,51 @@ InsertRecord(char* keyToAdd,				// Key value
   //strlcpy(key, keyToAdd, IDSIZE+1);			// 1 for the null character
   // Get 32 bit hash value
   int hashValue = Hash(key);
+  uint64_t start = _options.timeOperations ? EHFStatsCollector::Now() : 0;
+  int result;
+  uint64_t writeNumber = 0;
+  {
+    // Only one writer at a time
+    std::lock_guard<std::mutex> latch(_writeLatch);
+    result = InsertLocked(keyToAdd, recordToAdd, hashValue, writeNumber);
+  }
+  // Wait for a sync, once the latch is free for other writers to join it
+  result = AwaitDurable(result, writeNumber);
+  if (_options.timeOperations){
+    _stats.Time(EHF_LATENCY_INSERT, EHFStatsCollector::Now() - start);
+  }
+  return result;
+}
+
+/*
+=========================================================================================
+Name	 | InsertLocked
+Purpose	 | Insert a record, with the writer latch held, and number the insert
+Notes	 | writeNumber is the number to wait on for the insert to be durable. With
+	 | EHF_DURABILITY_PEROP the insert is durable already.
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+InsertLocked(char* keyToAdd,
+	     char* recordToAdd,
+	     int hashValue,
+	     uint64_t& writeNumber,
+	     bool replace
+	     )
+{
+  // Spread the copying left behind by doubling the index over the inserts that follow
+  _index->CopyMirrors(MIRRORSPERINSERT);
   // Attempt to insert the record
-  return InsertRecord(keyToAdd, recordToAdd, hashValue, 1);
+  _stats.Count(EHF_STAT_INSERTS);
+  int result = InsertRecord(keyToAdd, recordToAdd, hashValue, 1, replace);
+  if (result == EHF_POORHASHFUNCTION){
+    _stats.Count(EHF_STAT_POORHASHFUNCTION);
+  }
+  if ( (result != EHF_INSERTED) && (result != EHF_UPDATED) ){
+    return result;
+  }
+  return NumberWrite(writeNumber) ? result : EHF_WRITEERROR;
 }
 
 // The private method (recursive)
@@ -175,7 +315,8 @@ ExtendibleHashFile::
 InsertRecord(char* keyToAdd,				// Key value
 	     char* recordToAdd,				// Record to insert
 	     int   hashValue,				// keyToAdd's hash value
-	     int   callNumber				// For infinite recursion check
+	     int   callNumber,				// For infinite recursion check
+	     bool  replace				// Update the record if present
 	     )
 {
   if (callNumber > 5){
@@ -186,39 +327,56 @@ InsertRecord(char* keyToAdd,				// Key value
 
   // Determine the address from the 32 bit hash value
   int address = GetLowestBits( hashValue, _index->GetDepth() );
+  int bucketNumber = _index->GetAddress(address);
 
-  EHFBucket* bucket = new EHFBucket(_bucketFileFD, _index->GetAddress(address));
+  EHFBucket bucket(_bucketFileFD, bucketNumber, EHF_TOBEREAD);
+  PlaceBucket(bucket);
 
-  int readResult = bucket->Read();
+  _stats.Count(EHF_STAT_BUCKETREADS);
+  uint64_t begun = TraceBegin();
+  int readResult = bucket.Read();
+  TraceIO(EHF_TRACE_BUCKETREAD, bucketNumber, begun);
   if (readResult != EHF_READOK){
-    delete bucket;
     return readResult;
   }
 
-  int addResult = bucket->Add(keyToAdd, recordToAdd);	 // Attempt to add the record
-  int bucketDepth;
+  // An upsert of a key already present overwrites it, all but the key, even in a full
+  // bucket
+  if ( replace && (bucket.Replace(keyToAdd, IDSIZE, RECORDSIZE - IDSIZE,
+				  recordToAdd + IDSIZE) == EHF_UPDATED) ){
+    _stats.Count(EHF_STAT_UPDATES);
+    if (WriteBucket(bucket, bucketNumber) != EHF_WROTEOK){
+      return EHF_WRITEERROR;
+    }
+    return EHF_UPDATED;
+  }
+
+  int addResult = bucket.Add(keyToAdd, recordToAdd);	 // Attempt to add the record
   switch (addResult){
   case EHF_INSERTED:
       // Base case 1
-      // The record was inserted
-      bucket->Write();					 // Write bucket back to file
-      delete bucket;					 // Deallocate memory for bucket
+      // The record was inserted, so write the bucket back to the file
+      if (WriteBucket(bucket, bucketNumber) != EHF_WROTEOK){
+	return EHF_WRITEERROR;
+      }
       return addResult;					 // Return EHF_INSERTED
       break;
   case EHF_ALREADY_PRESENT:
       // Base case 2
       // Bucket already contained key, thus nothing was added - no need to rewrite it
-      delete bucket;					 // Deallocate memory for bucket
       return addResult;					 // Return EHF_ALREADY_PRESENT
       break;
   case EHF_FULLBUCKET:
       // Recursive case
       // Bucket was full so it must be split
-      bucketDepth = bucket->Depth();			 // For AccomodateRecord call
-      delete bucket;					 // Deallocate memory for bucket
-      AccomodateRecord(address, bucketDepth);		 // Make room for the record
+      {
+	int splitResult = AccomodateRecord(address, bucket.Depth()); // Make room
+	if (splitResult != EHF_WROTEOK){
+	  return splitResult;
+	}
+      }
       // Recursive call - attempt to insert the record again
-      return InsertRecord( keyToAdd, recordToAdd, hashValue, (callNumber+1) );
+      return InsertRecord( keyToAdd, recordToAdd, hashValue, (callNumber+1), replace );
       break;
   default:
       // This should never happen
@@ -227,6 +385,225 @@ InsertRecord(char* keyToAdd,				// Key value
   } // switch
 }
 
+/*
+=========================================================================================
+Name	 | UpdateRecord / UpsertRecord / UpdateField
+Purpose	 | Overwrite a record where it lies in its bucket
+Returns	 | EHF_UPDATED - The record was overwritten (or, for UpsertRecord, EHF_INSERTED,
+	 | of the same value, if it was inserted instead)
+	 | EHF_NOT_PRESENT - There is no record under the key to update
+	 | EHF_BADFIELD - The bytes to overwrite are not all in the record, past its key
+	 | Otherwise as InsertRecord
+Notes	 | The bucket holding the record is read once and written once, whatever the
+	 | durability option; only an upsert of a new key into a full bucket splits.
+	 | The key in the record written is always keyToUpdate's, so that the record is
+	 | still found under it. UpdateField copies no more than the length bytes given.
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+UpdateRecord(char* keyToUpdate,
+	     char* recordToWrite
+	     )
+{
+  return UpdateField(keyToUpdate, IDSIZE, RECORDSIZE - IDSIZE, recordToWrite + IDSIZE);
+}
+
+int
+ExtendibleHashFile::
+UpsertRecord(char* keyToAdd,
+	     char* recordToAdd
+	     )
+{
+  if (!_fileOpen){
+    return EHF_FILENOTOPEN;
+  }
+  char key[IDSIZE+1];
+  *((char *) mempcpy(key, keyToAdd, IDSIZE)) = '\0';
+  int hashValue = Hash(key);
+  int result;
+  uint64_t writeNumber = 0;
+  {
+    std::lock_guard<std::mutex> latch(_writeLatch);
+    result = InsertLocked(key, recordToAdd, hashValue, writeNumber, true);
+  }
+  return AwaitDurable(result, writeNumber);
+}
+
+int
+ExtendibleHashFile::
+UpdateField(char* keyToUpdate,
+	    int position,
+	    int length,
+	    char* value
+	    )
+{
+  if (!_fileOpen){
+    return EHF_FILENOTOPEN;
+  }
+  if ( (position < IDPOSITION + IDSIZE) || (length < 0) ||
+       (position + length > RECORDSIZE) ){
+    return EHF_BADFIELD;
+  }
+  char key[IDSIZE+1];
+  *((char *) mempcpy(key, keyToUpdate, IDSIZE)) = '\0';
+  int hashValue = Hash(key);
+  int result;
+  uint64_t writeNumber = 0;
+  {
+    std::lock_guard<std::mutex> latch(_writeLatch);
+    result = ModifyLocked(key, hashValue,
+			  [position, length, value](char* record){
+			    memcpy(record + position, value, length);
+			    return true;
+			  },
+			  writeNumber);
+  }
+  return AwaitDurable(result, writeNumber);
+}
+
+/*
+=========================================================================================
+Name	 | CompareAndSwap / Modify
+Purpose	 | Change a record atomically, given what it holds now
+Returns	 | EHF_UPDATED - The record was changed
+	 | EHF_MISMATCH - CompareAndSwap found something other than expected, which it
+	 | copies into expected, RECORDSIZE chars and a '\0'
+	 | EHF_UNCHANGED - modify returned false
+	 | EHF_NOT_PRESENT - There is no record under the key
+	 | Otherwise as InsertRecord
+Notes	 | The record is read, looked at and written back with the writer latch held
+	 | throughout, so no other write comes between, and readers see it either as it
+	 | was or as it becomes. The bucket is read once, and written once if the record
+	 | changes. A counter kept in a record is then bumped by Modify alone, with no
+	 | lock around a RetrieveRecord and an InsertRecord, and no retries.
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+CompareAndSwap(char* keyToUpdate,
+	       char* expected,
+	       char* desired
+	       )
+{
+  bool matched = false;
+  auto compare = [expected, desired, &matched](char* record){
+    matched = (memcmp(record + IDSIZE, expected + IDSIZE, RECORDSIZE - IDSIZE) == 0);
+    if (matched){
+      memcpy(record + IDSIZE, desired + IDSIZE, RECORDSIZE - IDSIZE);
+    } else {
+      memcpy(expected, record, RECORDSIZE);
+      expected[RECORDSIZE] = '\0';
+    }
+    return matched;
+  };
+  // Held by reference, which std::function keeps without allocating
+  int result = Modify(keyToUpdate, std::ref(compare));
+  return ( (result == EHF_UNCHANGED) && !matched ) ? EHF_MISMATCH : result;
+}
+
+int
+ExtendibleHashFile::
+Modify(char* keyToModify,
+       std::function<bool(char* record)> modify
+       )
+{
+  if (!_fileOpen){
+    return EHF_FILENOTOPEN;
+  }
+  char key[IDSIZE+1];
+  *((char *) mempcpy(key, keyToModify, IDSIZE)) = '\0';
+  int hashValue = Hash(key);
+  int result;
+  uint64_t writeNumber = 0;
+  {
+    std::lock_guard<std::mutex> latch(_writeLatch);
+    result = ModifyLocked(key, hashValue, modify, writeNumber);
+  }
+  return AwaitDurable(result, writeNumber);
+}
+
+int
+ExtendibleHashFile::
+ModifyLocked(char* keyToModify,
+	     int hashValue,
+	     const std::function<bool(char* record)>& modify,
+	     uint64_t& writeNumber
+	     )
+{
+  int bucketNumber = _index->GetAddress( GetLowestBits(hashValue, _index->GetDepth()) );
+  EHFBucket bucket(_bucketFileFD, bucketNumber, EHF_TOBEREAD);
+  PlaceBucket(bucket);
+  _stats.Count(EHF_STAT_BUCKETREADS);
+  uint64_t begun = TraceBegin();
+  int result = bucket.Read();
+  TraceIO(EHF_TRACE_BUCKETREAD, bucketNumber, begun);
+  if (result != EHF_READOK){
+    return result;
+  }
+  char record[RECORDSIZE+1];
+  result = bucket.Retrieve(keyToModify, record);
+  if (result != EHF_RETRIEVED){
+    return result;
+  }
+  if (!modify(record)){
+    return EHF_UNCHANGED;
+  }
+  bucket.Replace(keyToModify, IDSIZE, RECORDSIZE - IDSIZE, record + IDSIZE);
+  _stats.Count(EHF_STAT_UPDATES);
+  if ( (WriteBucket(bucket, bucketNumber) != EHF_WROTEOK) || !NumberWrite(writeNumber) ){
+    return EHF_WRITEERROR;
+  }
+  return EHF_UPDATED;
+}
+
+bool
+ExtendibleHashFile::
+NumberWrite(uint64_t& writeNumber
+	    )
+{
+  writeNumber = ++_writeCount;
+  return (_options.durability != EHF_DURABILITY_PEROP) || SyncLocked();
+}
+
+int
+ExtendibleHashFile::
+AwaitDurable(int result,
+	     uint64_t writeNumber
+	     )
+{
+  bool written = (result == EHF_INSERTED) || (result == EHF_UPDATED);
+  if ( written && (_options.durability == EHF_DURABILITY_COMMIT) &&
+       !WaitDurable(writeNumber) ){
+    return EHF_WRITEERROR;
+  }
+  return result;
+}
+
+/*
+=========================================================================================
+Name	 | WriteBucket
+Purpose	 | Write a bucket in place, keeping it first for any snapshot yet to read it, and
+	 | bumping its version around the write for lock-free readers
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+WriteBucket(EHFBucket& bucket,
+	    int bucketNumber
+	    )
+{
+  PreserveBucket(bucketNumber);
+  BucketVersion(bucketNumber).WriteBegin();
+  _stats.Count(EHF_STAT_BUCKETWRITES);
+  uint64_t begun = TraceBegin();
+  int result = bucket.Write();
+  TraceIO(EHF_TRACE_BUCKETWRITE, bucketNumber, begun);
+  BucketVersion(bucketNumber).WriteEnd();
+  MarkDirty(bucketNumber);
+  return result;
+}
+
 /*
 =========================================================================================
 Name	 | AccomodateRecord
@@ -235,6 +612,9 @@ Purpose	 | A helper for the InsertRecord methods. This method will split the add
 	 | space in the index for this increase of address depth, then the index space is
 	 | doubled by adding an extra bit. The index is updated so that the addresses
 	 | with the extra bit points at the new bucket which resulted from the split.
+Returns	 | EHF_WROTEOK - The bucket was split
+	 | EHF_MAXTABLEDEPTH - The bucket is as deep as the table allows
+	 | EHF_WRITEERROR - A shadow split could not be committed, so is not on disc
 Notes    | Updating the index after the split can be a complicated process. Consider an
          | index of depth 10, and an address in which a record must be accomodated, and a
          | bucketDepth of 6. Say we have the address as 200. The bucket will contain
@@ -271,12 +651,14 @@ Notes    | Updating the index after the split can be a complicated process. Cons
          | we say 2^(bucketDepth+1) (the old bucketDepth, not the new one).
          | The bit pattern above the newBucketDepth number of bits is 0, 1, 2, 3, up to
          | 2^unUsedBits.
-	 | The way the for loop works:
-         | Use i as a counter for the upper bits. Say i = 5 = 00000000 00000101
-         | Move it along to be    00000010 10000000
-	 | Or in another 1        00000010 11000000
-	 | Or in the bucketValue  00000010 11001000
-         | etc
+	 | Updating those addresses is left to the index (see SplitAddress), as an index
+	 | that does not keep one slot per address need not visit them one by one.
+	 | Shadow splits: with the shadowSplits option, both halves of the split are
+	 | written to pages not in use, and the index, with every address of the old
+	 | bucket now pointing at one half or the other, is committed straight after.
+	 | The superblock write is what switches from the old bucket to the new pair, so
+	 | a crash before it finds the old bucket, and one after it finds both halves.
+	 | Each split costs a commit of the whole index and two syncs.
 =========================================================================================
 */
 int                                                        // Return Code
@@ -291,31 +673,57 @@ AccomodateRecord(int address,				   // Address to expand
   }
 
   int bucketValue = GetLowestBits(address, bucketDepth);   // Bit pattern held by bucket 
-  int newBucketNumber = SplitBucket(address, bucketDepth);
+  int oldBucketNumber = _index->GetAddress(address);
+  // A shadow split leaves the old bucket alone, so its records survive a crash
+  bool shadow = (_container != nullptr) && _options.shadowSplits;
+  int oldHalfNumber = shadow ? _container->AllocatePage() : oldBucketNumber;
+
+  uint64_t start = _options.timeOperations ? EHFStatsCollector::Now() : 0;
+  _stats.Count(EHF_STAT_SPLITS);
+  if (_tracer != nullptr){
+    _tracer->Record(EHF_TRACE_SPLITBEGIN, oldBucketNumber, bucketDepth);
+  }
+  // Lock-free readers must not use the index while records move between buckets
+  _directoryVersion.WriteBegin();
 
-  //  int newAddress = GetLowestBits(address, bucketDepth);
-  // int newBucketNumber = SplitBucket(address, bucketDepth);
+  int newBucketNumber = SplitBucket(address, bucketDepth, oldHalfNumber);
 
   if ( bucketDepth == _index->GetDepth() ){
     // The case where the is only one address pointing at the bucket to split
     // Double the index - because we can't split one pointer into two
+    int oldSlots = _index->GetNumberOfAddresses();
     _index->IncreaseDepth();
+    _stats.Count(EHF_STAT_DOUBLINGS);
+    if (_tracer != nullptr){
+      _tracer->Record(EHF_TRACE_INDEXGROW, oldSlots, _index->GetNumberOfAddresses());
+    }
   }
   
-  // Determine the number of bits of the index address that are not required in 
-  // distinguishing between the new bucket and the old bucket
-  int unUsedBits = ( _index->GetDepth() - (bucketDepth + 1) );
-  
-  int loopLimit = int(pow(2, unUsedBits));                 // Get 2 ** unUsedBits
+  // Point the addresses with the extra one bit at the new bucket
+  if (oldHalfNumber != oldBucketNumber){
+    _index->MoveAddress(bucketValue, bucketDepth, oldHalfNumber);
+  }
+  _index->SplitAddress(bucketValue, bucketDepth, newBucketNumber);
+  _indexDirty = true;
 
-  for (int i = 0; i < loopLimit; ++i){
-    int tempAddress = i << (bucketDepth+1);                // Get the upper bit pattern
-    tempAddress |= (1 << bucketDepth);                     // Get the extra one
-    tempAddress |= bucketValue;                            // Or in the bucket Value
-    _index->SetAddress(tempAddress, newBucketNumber);
+  _directoryVersion.WriteEnd();
+  if (_tracer != nullptr){
+    _tracer->Record(EHF_TRACE_SPLITEND, newBucketNumber, bucketDepth + 1);
   }
-  //return somegoodcode;
-  return 1; // TODO
+  if (_options.timeOperations){
+    _stats.Time(EHF_LATENCY_SPLIT, EHFStatsCollector::Now() - start);
+  }
+
+  if (shadow){
+    // Publish both halves at once. Until then the superblock on disc still leads to
+    // the old bucket, which is only reused once that is no longer so.
+    _container->FreePage(oldBucketNumber);
+    if (!_container->Commit(_index, _bucketCount)){
+      return EHF_WRITEERROR;
+    }
+    _indexDirty = false;
+  }
+  return EHF_WROTEOK;
 }
 
 /*
@@ -342,7 +750,8 @@ Notes	 | 1) Splits the addressToSplit into two buckets.
 int						    // The number of the new bucket
 ExtendibleHashFile::
 SplitBucket(int addressToSplit,			    // The address to split
-	    int bucketDepth			    // Depth of bucket to split
+	    int bucketDepth,			    // Depth of bucket to split
+	    int oldHalfNumber			    // Where the old bit pattern's half goes
 	    )
 {
   int oldAddress = GetLowestBits(addressToSplit, bucketDepth); 
@@ -356,48 +765,51 @@ SplitBucket(int addressToSplit,			    // The address to split
 */
   BitSet(newAddress, bucketDepth);
 
-  // Split the existing bucket into a new pair of buckets
-  EHFBucket* existingBucket;			    // The existing bucket to be split
-  EHFBucket* oldBucket;				    // The bucket with an added '0'
-  EHFBucket* newBucket;				    // The bucket with an added '1'
-
   // Calculate the relative bucket positions of the two buckets in the file
-  int oldBucketPos = _index->GetAddress(oldAddress);// The same as existingBucket
-  int newBucketPos = _bucketCount;		    // Position at the end of the file
-  // Update the number of buckets
-  _bucketCount++;
+  int oldBucketPos = oldHalfNumber;		    // Usually the same as existingBucket
+  int newBucketPos = AllocateBucket();		    // Position of a bucket not in use
   // Calculate the new bucket depth
   int newBucketDepth = (bucketDepth+1);
 
-  existingBucket = new EHFBucket(_bucketFileFD,
-				 _index->GetAddress(oldAddress)
-				 );
-  if (existingBucket->Read() != EHF_READOK){
+  // Split the existing bucket into a new pair of buckets
+  EHFBucket existingBucket(_bucketFileFD,	    // The existing bucket to be split
+			   _index->GetAddress(oldAddress),
+			   EHF_TOBEREAD
+			   );
+  PlaceBucket(existingBucket);
+  _stats.Count(EHF_STAT_BUCKETREADS);
+  uint64_t begun = TraceBegin();
+  if (existingBucket.Read() != EHF_READOK){
     // std::cout error
   }
-
-  oldBucket = new EHFBucket(_bucketFileFD,
-			    oldBucketPos,	    // File position
-			    newBucketDepth
-			    );
-  newBucket = new EHFBucket(_bucketFileFD,
-			    newBucketPos,
-			    newBucketDepth
-			    );
+  TraceIO(EHF_TRACE_BUCKETREAD, _index->GetAddress(oldAddress), begun);
+
+  EHFBucket oldBucket(_bucketFileFD,		    // The bucket with an added '0'
+		      oldBucketPos,		    // File position
+		      newBucketDepth
+		      );
+  EHFBucket newBucket(_bucketFileFD,		    // The bucket with an added '1'
+		      newBucketPos,
+		      newBucketDepth
+		      );
+  PlaceBucket(oldBucket);
+  PlaceBucket(newBucket);
+  oldBucket.ChangePattern(oldAddress);
+  newBucket.ChangePattern(newAddress);
 
   // Redistribute the records from the existing bucket to the new buckets
   char keyValue[IDSIZE+1];
   char record[RECORDSIZE+1];
-  for (int i = 0; i < existingBucket->NumOfRecs(); i++){
-    existingBucket->RetrieveRecAtIndex(i, keyValue, record);
+  for (int i = 0; i < existingBucket.NumOfRecs(); i++){
+    existingBucket.RetrieveRecAtIndex(i, keyValue, record);
     // Get 32 bit hash value
     int hashValue = Hash(keyValue);
     // Determine the address from the 32 bit hash value
     int result = GetLowestBits( hashValue, newBucketDepth );
     if (result == oldAddress){
-      oldBucket->Add(keyValue, record);
+      oldBucket.Add(keyValue, record);
     } else if (result == newAddress){
-      newBucket->Add(keyValue, record);
+      newBucket.Add(keyValue, record);
     } else {
       // std::cout error - the address should match one of them!!!
       std::cout << "ERROR IN SPLIT BUCKET\n";
@@ -405,17 +817,13 @@ SplitBucket(int addressToSplit,			    // The address to split
     }
   }
 
-  delete existingBucket;			       // All done with existing bucket
-
   // Write the two new buckets
-  if (oldBucket->Write() != EHF_WROTEOK){
+  if (WriteBucket(oldBucket, oldBucketPos) != EHF_WROTEOK){
     // std::cout error
   }
-  delete oldBucket;
-  if (newBucket->Write() != EHF_WROTEOK){
+  if (WriteBucket(newBucket, newBucketPos) != EHF_WROTEOK){
     // std::cout error
   }
-  delete newBucket;
 
   return newBucketPos;
 }
@@ -430,6 +838,9 @@ Returns	 | EHF_RETRIEVED   - Record was retrieved successfully
 	 | EHF_READERROR   - The bucket was not read correctly
 Notes	 | The strings that are returned are null-terminated. Thus, the caller must
 	 | ensure there is enough room for both the key/record and a null terminator.
+	 | No lock is taken. The index and bucket versions are noted before the bucket
+	 | is read and checked afterwards, and if a writer changed either in between,
+	 | the lookup is simply done again.
 =========================================================================================
 */
 int
@@ -441,107 +852,622 @@ RetrieveRecord(char* keyToFind,				 //
   if (!_fileOpen){
     return EHF_FILENOTOPEN;
   }
-  char key[IDSIZE+1];
-  *((char *) mempcpy(key, keyToFind, IDSIZE)) = '\0';
-  //strlcpy(key, keyToFind, IDSIZE+1);
-  int hashValue = Hash(key);
-  // now have a 32 bit hash value, but only need so many bits
-  int address = GetLowestBits( hashValue, _index->GetDepth() );
-
-  EHFBucket bucket(_bucketFileFD, _index->GetAddress(address));
-
-  int readResult = bucket.Read();
-  if (readResult != EHF_READOK){
-    return readResult;
+  uint64_t start = _options.timeOperations ? EHFStatsCollector::Now() : 0;
+  _stats.Count(EHF_STAT_RETRIEVES);
+  EHFLookup lookup;
+  StartLookup(keyToFind, lookup);
+  int result;
+  for (;;){
+    BeginLookup(lookup);
+    ResolveLookup(lookup, false);
+    if (FinishLookup(lookup, returnRecord, result)){
+      break;
+    }
+    // A writer got in the way, so look again
+    _stats.Count(EHF_STAT_LOOKUPRETRIES);
   }
-
-  return ( bucket.Retrieve(keyToFind, returnRecord) );
-
+  if (_options.timeOperations){
+    _stats.Time(EHF_LATENCY_RETRIEVE, EHFStatsCollector::Now() - start);
+  }
+  return result;
 }
 
-
+/*
+=========================================================================================
+Name	 | RetrieveBatch
+Purpose	 | Retrieve a batch of records, with the lookups of a group interleaved
+Returns	 | The number of records retrieved. results[i] is what RetrieveRecord would
+	 | have returned for keysToFind[i].
+Notes	 | Each lookup is a chain of loads: the index slot, then the bucket, each
+	 | likely a cache miss in a large table. Taking a group of lookups through one
+	 | stage at a time, prefetching what the next stage reads, lets their misses
+	 | overlap rather than follow each other:
+	 |   1 hash each key, and prefetch its index slot (BeginLookup)
+	 |   2 read the slot, and prefetch the bucket (ResolveLookup)
+	 |   3 look for the key in the bucket, and validate (FinishLookup)
+	 | Buckets are only prefetched, and read where they lie, in memory (inMemory);
+	 | elsewhere stage 3 reads the bucket as RetrieveRecord does, and only the index
+	 | is prefetched. A lookup a writer got in the way of is done again on its own.
+=========================================================================================
+*/
 int
 ExtendibleHashFile::
-DeleteRecord(char* keyToDelete
-	     )
+RetrieveBatch(int count,
+	      char** keysToFind,
+	      char** returnRecords,
+	      int* results,
+	      int groupSize
+	      )
 {
-  return 1;
+  if (groupSize < 1){
+    groupSize = 1;
+  } else if (groupSize > MAXBATCHGROUP){
+    groupSize = MAXBATCHGROUP;
+  }
+  if (!_fileOpen){
+    for (int i = 0; i < count; i++){
+      results[i] = EHF_FILENOTOPEN;
+    }
+    return 0;
+  }
+  EHFLookup group[MAXBATCHGROUP];
+  int retrieved = 0;
+  int retried = 0;
+  for (int first = 0; first < count; first += groupSize){
+    int inGroup = std::min(groupSize, count - first);
+    for (int g = 0; g < inGroup; g++){
+      StartLookup(keysToFind[first + g], group[g]);
+      BeginLookup(group[g]);
+    }
+    for (int g = 0; g < inGroup; g++){
+      ResolveLookup(group[g], false);
+    }
+    for (int g = 0; g < inGroup; g++){
+      int i = first + g;
+      int result;
+      if (!FinishLookup(group[g], returnRecords[i], result)){
+	// RetrieveRecord counts the lookup once more
+	result = RetrieveRecord(keysToFind[i], returnRecords[i]);
+	retried++;
+      }
+      results[i] = result;
+      retrieved += (result == EHF_RETRIEVED) ? 1 : 0;
+    }
+  }
+  _stats.Count(EHF_STAT_RETRIEVES, count - retried);
+  _stats.Count(EHF_STAT_LOOKUPRETRIES, retried);
+  return retrieved;
 }
 
-bool
+/*
+=========================================================================================
+Name	 | StartLookup / BeginLookup / ResolveLookup / FinishLookup
+Purpose	 | The stages of a lookup, for RetrieveRecord to run straight through, and for
+	 | RetrieveBatch and EHFOperation to interleave with other lookups
+Notes	 | StartLookup copies and hashes the key. BeginLookup notes the index version and
+	 | prefetches the key's index slot. ResolveLookup reads the slot, notes the bucket
+	 | version, and gets the bucket on its way: prefetched in memory, or with
+	 | readAhead, read ahead into the page cache (not for direct I/O, where the read
+	 | would bypass it). FinishLookup looks for the key, and returns false if a
+	 | writer got in the way since BeginLookup, for the lookup to begin again.
+=========================================================================================
+*/
+void
 ExtendibleHashFile::
-OpenExistingFile(char* indexFileName,
-		 char* bucketFileName
-		 )
+StartLookup(char* keyToFind,
+	    EHFLookup& lookup
+	    )
 {
-  // Open existing files with read write privilages
-  _bucketFileFD = open(bucketFileName, O_RDWR);	      // Open bucket file
-  _indexFileFD = open(indexFileName, O_RDWR);	      // Open index file
-
-  if ( (_bucketFileFD >= 0) && (_indexFileFD >= 0) ){
-    // Set up the index
-    _index = new IndexHolder();
-    _index->Load(_indexFileFD);
-    if (ReadBucketCount() != EHF_READOK){
-      return false;
-    }
-    return true;
-  } else {
-    return false;
-  }
+  *((char *) mempcpy(lookup.key, keyToFind, IDSIZE)) = '\0';
+  lookup.hashValue = Hash(lookup.key);
 }
 
+void
+ExtendibleHashFile::
+BeginLookup(EHFLookup& lookup
+	    )
+{
+  lookup.directoryVersion = _directoryVersion.ReadBegin();
+  // now have a 32 bit hash value, but only need so many bits
+  lookup.address = GetLowestBits( lookup.hashValue, _index->GetDepth() );
+  _index->Prefetch(lookup.address);
+}
 
-
-bool
+void
 ExtendibleHashFile::
-CreateNewFile(char* indexFileName,
-	      char* bucketFileName
+ResolveLookup(EHFLookup& lookup,
+	      bool readAhead
 	      )
 {
-  // Create new files with read write privilages, and truncate any existing files
-  _bucketFileFD = open(bucketFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
-  _indexFileFD = open(indexFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
-
-  // Test if open was successful or not.
-  if ( (_bucketFileFD >= 0) && (_indexFileFD >= 0) ){
-
-    // Set up the index
-    _index = new IndexHolder(1);		      // Initial index has depth 1
-
-    _bucketCount = 2;				      // There are two buckets initially
-    if ( WriteBucketCount() != EHF_WROTEOK){
-      return false;
-    }
-
-    // Create an empty bucket. This dummy is use to setup the file
-    EHFBucket* bucket = new EHFBucket( _bucketFileFD, 0, _index->GetDepth() );
-
-    // Write bucket 0
-    if ( bucket->Write() != EHF_WROTEOK){
-      return false;
+  lookup.bucketNumber = _index->GetAddress(lookup.address);
+  lookup.version = BucketVersion(lookup.bucketNumber).ReadBegin();
+  lookup.image = nullptr;
+  if (_memory != nullptr){
+    lookup.image = _memory->InPlace(lookup.bucketNumber);
+    for (int line = 0; (lookup.image != nullptr) && (line < BUCKETSIZE); line += 64){
+      __builtin_prefetch(lookup.image + line);
     }
+  } else if (readAhead && (_bucketFile == nullptr)){
+    long fileHeaderSize = (_container != nullptr) ? SUPERBLOCKAREA : FILEHEADERSIZE;
+    long pageSize = (_container != nullptr) ? _container->PageSize() : BUCKETSIZE;
+    posix_fadvise(_bucketFileFD, fileHeaderSize + pageSize * lookup.bucketNumber,
+		  BUCKETSIZE, POSIX_FADV_WILLNEED);
+  }
+}
 
-    bucket->ChangeAddress(1);			      // Change address from 0 to 1
-    // Write bucket 1
-    if ( bucket->Write() != EHF_WROTEOK){
-      return false;
+bool
+ExtendibleHashFile::
+FinishLookup(EHFLookup& lookup,
+	     char* returnRecord,
+	     int& result
+	     )
+{
+  if (lookup.image != nullptr){
+    const char* record = EHFBucket::FindInImage(lookup.image, lookup.key);
+    result = EHF_NOT_PRESENT;
+    if (record != nullptr){
+      memcpy(returnRecord, record, RECORDSIZE);
+      returnRecord[RECORDSIZE] = '\0';
+      result = EHF_RETRIEVED;
     }
-
-    _index->SetAddress(0,0);			      // Address 0 points at bucket 0
-    _index->SetAddress(1,1);			      // Address 1 points at bucket 1
-
-    return true;
   } else {
-    return false;
+    EHFBucket bucket(_bucketFileFD, lookup.bucketNumber, EHF_TOBEREAD);
+    PlaceBucket(bucket);
+    uint64_t begun = TraceBegin();
+    result = bucket.Read();
+    TraceIO(EHF_TRACE_BUCKETREAD, lookup.bucketNumber, begun);
+    if (result == EHF_READOK){
+      result = bucket.Retrieve(lookup.key, returnRecord);
+    }
   }
+  _stats.Count(EHF_STAT_BUCKETREADS);
+  return ( BucketVersion(lookup.bucketNumber).ReadValidate(lookup.version) &&
+	   _directoryVersion.ReadValidate(lookup.directoryVersion) );
 }
 
 /*
 =========================================================================================
-Name	| ReadBucketCount
-Purpose | Read in the file information (how many buckets are there?)
-=========================================================================================
+Name	 | Get
+Purpose	 | Find a record, and leave it where it was found for view to look at
+Returns	 | EHF_RETRIEVED   - view holds the record
+	 | EHF_NOT_PRESENT - The record was not present, view is empty
+	 | EHF_FILENOTOPEN - The bucket file was not open
+	 | EHF_READERROR   - The bucket was not read correctly
+Notes	 | Validated as RetrieveRecord is. With direct I/O the page is pinned before the
+	 | record is looked for in it, so a writer changing the bucket after validation
+	 | writes another page; if validation fails the pin is let go, and the lookup done
+	 | again. Should every frame be pinned, or without direct I/O, the bucket is read
+	 | as RetrieveRecord reads it, and only the record is copied into the view.
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+Get(char* keyToFind,
+    EHFRecordView& view
+    )
+{
+  view.Release();
+  if (!_fileOpen){
+    return EHF_FILENOTOPEN;
+  }
+  char key[IDSIZE+1];
+  *((char *) mempcpy(key, keyToFind, IDSIZE)) = '\0';
+  int hashValue = Hash(key);
+  _stats.Count(EHF_STAT_RETRIEVES);
+
+  for (;;){
+    _stats.Count(EHF_STAT_BUCKETREADS);
+    unsigned directoryVersion = _directoryVersion.ReadBegin();
+    int address = GetLowestBits( hashValue, _index->GetDepth() );
+    int bucketNumber = _index->GetAddress(address);
+    VersionLatch& bucketVersion = BucketVersion(bucketNumber);
+    unsigned version = bucketVersion.ReadBegin();
+
+    int result = EHF_READOK;
+    const char* image = nullptr;
+    char bucketImage[BUCKETSIZE];
+    int pin = -1;
+    uint64_t begun = TraceBegin();
+    if (_bucketFile != nullptr){
+      image = _bucketFile->Pin(bucketNumber, pin, result);
+    }
+    if ( (image == nullptr) && (result == EHF_READOK) ){
+      EHFBucket bucket(_bucketFileFD, bucketNumber, EHF_TOBEREAD);
+      PlaceBucket(bucket);
+      result = bucket.ReadImage(bucketImage);
+      image = bucketImage;
+    }
+    TraceIO(EHF_TRACE_BUCKETREAD, bucketNumber, begun);
+    const char* record = nullptr;
+    if (result == EHF_READOK){
+      record = EHFBucket::FindInImage(image, key);
+      result = (record != nullptr) ? EHF_RETRIEVED : EHF_NOT_PRESENT;
+    }
+    if ( bucketVersion.ReadValidate(version) &&
+	 _directoryVersion.ReadValidate(directoryVersion) ){
+      if ( (record != nullptr) && (pin >= 0) ){
+	view._record = record;
+	view._file = _bucketFile;
+	view._pin = pin;
+      } else if (record != nullptr){
+	view.Keep(record);
+      } else if (pin >= 0){
+	_bucketFile->Unpin(pin);
+      }
+      return result;
+    }
+    if (pin >= 0){
+      _bucketFile->Unpin(pin);
+    }
+    // A writer got in the way, so look again
+    _stats.Count(EHF_STAT_LOOKUPRETRIES);
+  }
+}
+
+int
+ExtendibleHashFile::
+DeleteRecord(char* keyToDelete
+	     )
+{
+  return 1;
+}
+
+/*
+=========================================================================================
+Name	 | Sync
+Purpose	 | Make every record inserted so far durable, along with the index
+Returns	 | True if everything was synced
+Notes	 | Always runs a sync of its own, whatever the durability option
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+Sync()
+{
+  if (!_fileOpen){
+    return false;
+  }
+  return SyncNow();
+}
+
+/*
+=========================================================================================
+Name	 | Persist
+Purpose	 | Write a table kept in memory out as a container, for Open to open from disc
+Returns	 | False if the table is not in memory, or the container could not be written
+Notes	 | Bucket numbers are handed out in order in memory, so the buckets go to the
+	 | same pages of a new container, chunk by chunk, then a Commit adds the index.
+	 | As in ConvertToContainer, the container is written under a temporary name,
+	 | synced by the Commit, and renamed into place, so a table already on disc
+	 | under fileName is left as it was should any of it fail.
+	 | Writers are held off for the length of it; readers carry on.
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+Persist(char* fileName
+	)
+{
+  if ( !_fileOpen || (_memory == nullptr) ){
+    return false;
+  }
+  int strLength = 5 + strlen(fileName);
+  char indexFileName[strLength];
+  char bucketFileName[strLength];
+  char containerFileName[strLength];
+  char tempFileName[strLength];
+  snprintf(indexFileName, strLength, "%s.ehd", fileName);
+  snprintf(bucketFileName, strLength, "%s.ehf", fileName);
+  snprintf(containerFileName, strLength, "%s.eh", fileName);
+  snprintf(tempFileName, strLength, "%s.eh~", fileName);
+
+  std::lock_guard<std::mutex> latch(_writeLatch);
+  EHFContainer container;
+  if (!container.Create(tempFileName)){
+    return false;
+  }
+  for (int page = 0; page < _bucketCount; page++){
+    container.AllocatePage();
+  }
+  bool persisted =
+    _memory->WriteTo(container.FileDescriptor(), SUPERBLOCKAREA, _bucketCount) &&
+    container.Commit(_index, _bucketCount);
+  container.Close();
+  persisted = persisted && (rename(tempFileName, containerFileName) == 0);
+  if (persisted){
+    unlink(indexFileName);				// Replace a table of any layout
+    unlink(bucketFileName);
+  } else {
+    unlink(tempFileName);
+  }
+  return persisted;
+}
+
+/*
+=========================================================================================
+Name	 | GetStats
+Purpose	 | Gather the counts every thread has kept for this file
+Notes	 | Safe to call at any time, from any thread; counts being made meanwhile may be
+	 | in or out.
+=========================================================================================
+*/
+EHFStats
+ExtendibleHashFile::
+GetStats()
+{
+  return _stats.Gather();
+}
+
+void
+ExtendibleHashFile::
+SetTracer(EHFTracer* tracer
+	  )
+{
+  _tracer = tracer;
+  if (_bucketFile != nullptr){
+    _bucketFile->SetTracer(tracer);
+  }
+}
+
+bool
+ExtendibleHashFile::
+OpenExistingFile(char* indexFileName,
+		 char* bucketFileName
+		 )
+{
+  // Open existing files with read write privilages
+  _bucketFileFD = open(bucketFileName, O_RDWR);	      // Open bucket file
+  _indexFileFD = open(indexFileName, O_RDWR);	      // Open index file
+
+  if ( (_bucketFileFD >= 0) && (_indexFileFD >= 0) ){
+    // Set up the index
+    _index = NewIndex(0);
+    _index->Load(_indexFileFD);
+    if (ReadBucketCount() != EHF_READOK){
+      return false;
+    }
+    return true;
+  } else {
+    return false;
+  }
+}
+
+
+
+bool
+ExtendibleHashFile::
+CreateNewFile(char* indexFileName,
+	      char* bucketFileName
+	      )
+{
+  // Create new files with read write privilages, and truncate any existing files
+  _bucketFileFD = open(bucketFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  _indexFileFD = open(indexFileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+  // Test if open was successful or not.
+  if ( (_bucketFileFD >= 0) && (_indexFileFD >= 0) ){
+
+    // Set up the index
+    _index = NewIndex(1);			      // Initial index has depth 1
+
+    _bucketCount = 2;				      // There are two buckets initially
+    if ( WriteBucketCount() != EHF_WROTEOK){
+      return false;
+    }
+
+    // Create an empty bucket. This dummy is use to setup the file
+    EHFBucket bucket( _bucketFileFD, 0, _index->GetDepth() );
+    bucket.ChangePattern(0);
+
+    // Write bucket 0
+    if ( bucket.Write() != EHF_WROTEOK){
+      return false;
+    }
+
+    bucket.ChangeAddress(1);			      // Change address from 0 to 1
+    bucket.ChangePattern(1);
+    // Write bucket 1
+    if ( bucket.Write() != EHF_WROTEOK){
+      return false;
+    }
+
+    // Address 0 points at bucket 0, split off address 1 to point at bucket 1
+    _index->SplitAddress(0, 0, 1);
+    _indexDirty = true;				      // Not in the index file yet
+
+    return true;
+  } else {
+    return false;
+  }
+}
+
+/*
+=========================================================================================
+Name	| OpenExistingContainer
+Purpose | Open a container, reading its index and bucket count from the last commit
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+OpenExistingContainer(char* containerFileName
+		      )
+{
+  _container = new EHFContainer();
+  if (_container->Open(containerFileName)){
+    _bucketFileFD = _container->FileDescriptor();
+    _index = NewIndex(0);
+    if (_container->LoadIndex(_index, _options.indexOpen)){
+      _bucketCount = _container->BucketCount();
+      OpenBucketFile(containerFileName);
+      return true;
+    }
+    delete _index;
+  }
+  delete _container;
+  _container = nullptr;
+  _bucketFileFD = -1;
+  return false;
+}
+
+/*
+=========================================================================================
+Name	| CreateNewContainer
+Purpose | Create a container holding two empty buckets, as CreateNewFile does, and
+	| commit it straight away so that it can be opened even if never closed
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+CreateNewContainer(char* containerFileName
+		   )
+{
+  _container = new EHFContainer();
+  int pageSize = _options.directIO ? DIRECTALIGN : BUCKETSIZE;
+  if (_container->Create(containerFileName, pageSize)){
+    _bucketFileFD = _container->FileDescriptor();
+    _index = NewIndex(1);			      // Initial index has depth 1
+    _bucketCount = 0;
+    OpenBucketFile(containerFileName);
+    int firstBucket = AllocateBucket();
+    int secondBucket = AllocateBucket();
+    EHFBucket bucket(_bucketFileFD, firstBucket, _index->GetDepth());
+    PlaceBucket(bucket);
+    bucket.ChangePattern(0);
+    if (bucket.Write() == EHF_WROTEOK){
+      bucket.ChangeAddress(secondBucket);
+      bucket.ChangePattern(1);
+      if (bucket.Write() == EHF_WROTEOK){
+	// The new index points at firstBucket, the first page of a new container
+	_index->SplitAddress(0, 0, secondBucket);
+	if (_container->Commit(_index, _bucketCount)){
+	  return true;
+	}
+      }
+    }
+    delete _index;
+    delete _bucketFile;
+    _bucketFile = nullptr;
+  }
+  delete _container;
+  _container = nullptr;
+  _bucketFileFD = -1;
+  _bucketCount = 0;
+  return false;
+}
+
+/*
+=========================================================================================
+Name	| CreateInMemory
+Purpose | Set up a table of two empty buckets in memory, as CreateNewFile does on disc
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+CreateInMemory()
+{
+  _memory = new MemoryBucketStore();
+  _index = NewIndex(1);				      // Initial index has depth 1
+  _bucketCount = 0;
+  int firstBucket = AllocateBucket();
+  int secondBucket = AllocateBucket();
+  EHFBucket bucket(_bucketFileFD, firstBucket, _index->GetDepth());
+  PlaceBucket(bucket);
+  bucket.ChangePattern(0);
+  bucket.Write();
+  bucket.ChangeAddress(secondBucket);
+  bucket.ChangePattern(1);
+  bucket.Write();
+  _index->SplitAddress(0, 0, secondBucket);
+  return true;
+}
+
+/*
+=========================================================================================
+Name	| AllocateBucket
+Purpose | Return the relative number of a bucket not yet in use, and count it
+Notes	| The .ehf file only grows at the end, while a container reuses free pages
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+AllocateBucket()
+{
+  int bucketNumber = _bucketCount;
+  if (_container != nullptr){
+    bucketNumber = _container->AllocatePage();
+  }
+  _bucketCount++;
+  return bucketNumber;
+}
+
+void
+ExtendibleHashFile::
+PlaceBucket(EHFBucket& bucket
+	    )
+{
+  if (_memory != nullptr){
+    bucket.ChangeStore(_memory);
+  } else if (_container != nullptr){
+    bucket.ChangeFileHeaderSize(SUPERBLOCKAREA);
+    bucket.ChangePageSize(_container->PageSize());
+    bucket.ChangeStore(_bucketFile);
+  }
+}
+
+/*
+=========================================================================================
+Name	| OpenBucketFile
+Purpose | With the directIO option, open the container again for direct bucket I/O
+Notes	| A container whose pages are not aligned for it is used as usual
+=========================================================================================
+*/
+void
+ExtendibleHashFile::
+OpenBucketFile(char* containerFileName
+	       )
+{
+  if ( !_options.directIO || (_container->PageSize() % DIRECTALIGN != 0) ){
+    return;
+  }
+  _bucketFile = new BucketFile();
+  if (!_bucketFile->Open(containerFileName, SUPERBLOCKAREA, _container->PageSize(),
+			 _options.cachePages)){
+    delete _bucketFile;
+    _bucketFile = nullptr;
+    return;
+  }
+  _bucketFile->SetTracer(_tracer);
+}
+
+/*
+=========================================================================================
+Name	| NewIndex
+Purpose | Create an index of the type chosen by the options
+Params	| initialDepth - depth of a new index, or 0 for one about to be Loaded
+=========================================================================================
+*/
+ExtendibleIndex*
+ExtendibleHashFile::
+NewIndex(int initialDepth
+	 )
+{
+  if (_options.indexType == EHF_INDEX_COMPACT){
+    if (initialDepth == 0){
+      return new CompactIndexHolder();
+    }
+    return new CompactIndexHolder(initialDepth);
+  }
+  if (initialDepth == 0){
+    return new IndexHolder();
+  }
+  return new IndexHolder(initialDepth);
+}
+
+/*
+=========================================================================================
+Name	| ReadBucketCount
+Purpose | Read in the file information (how many buckets are there?)
+=========================================================================================
 */
 int
 ExtendibleHashFile::
@@ -581,6 +1507,439 @@ WriteBucketCount(){
   }
 }
 
+/*
+=========================================================================================
+Name	| DistinctBuckets
+Purpose | List the buckets the index points at, in file order
+Notes	| Every index value pointing at a bucket is passed over but the first
+=========================================================================================
+*/
+std::vector<int>
+ExtendibleHashFile::
+DistinctBuckets()
+{
+  std::vector<bool> seen;
+  std::vector<int> buckets;
+  long slots = _index->GetNumberOfAddresses();
+  for (long i = 0; i < slots; i++){
+    int bucketNumber = _index->GetAddress(i);
+    if (static_cast<size_t>(bucketNumber) >= seen.size()){
+      seen.resize(bucketNumber + 1, false);
+    }
+    if (!seen[bucketNumber]){
+      seen[bucketNumber] = true;
+      buckets.push_back(bucketNumber);
+    }
+  }
+  std::sort(buckets.begin(), buckets.end());
+  return buckets;
+}
+
+/*
+=========================================================================================
+Name	| BeginSnapshot / EndSnapshot
+Purpose | Take the buckets a scan is to read from the index, and have writers keep the
+	| image of any of them they change before the scan has read it, until the scan
+	| ends
+Notes	| The snapshot is of the moment the writer latch is held here. Each bucket is
+	| kept at most once, so a snapshot holds no more than its buckets, however much
+	| is written meanwhile, and much less for a scan keeping ahead of the writers.
+	| A bucket may also be freed, by a shadow split, and never written again; the
+	| container holds such pages until the scan ends, so that no Commit writes its
+	| index over them.
+=========================================================================================
+*/
+void
+ExtendibleHashFile::
+BeginSnapshot(EHFSnapshot* snapshot,
+	      int firstPage,
+	      int endPage
+	      )
+{
+  std::lock_guard<std::mutex> latch(_writeLatch);
+  std::vector<int> buckets = DistinctBuckets();
+  std::vector<int>::iterator first = std::lower_bound(buckets.begin(), buckets.end(),
+						       firstPage);
+  std::vector<int>::iterator end = std::lower_bound(first, buckets.end(), endPage);
+  snapshot->buckets.assign(first, end);
+  snapshot->pages = PageCount();
+  snapshot->read.assign(snapshot->buckets.size(), false);
+  snapshot->kept.clear();
+  _snapshots.push_back(snapshot);
+  if (_container != nullptr){
+    _container->HoldFreedPages();
+  }
+}
+
+void
+ExtendibleHashFile::
+EndSnapshot(EHFSnapshot* snapshot
+	    )
+{
+  std::lock_guard<std::mutex> latch(_writeLatch);
+  std::vector<EHFSnapshot*>::iterator found =
+    std::remove(_snapshots.begin(), _snapshots.end(), snapshot);
+  if ( (found != _snapshots.end()) && (_container != nullptr) ){
+    _container->EndHold();
+  }
+  _snapshots.erase(found, _snapshots.end());
+  snapshot->kept.clear();
+}
+
+/*
+=========================================================================================
+Name	| PreserveBucket
+Purpose | Before a bucket is written, copy it into every snapshot that holds it and has
+	| yet to read it, unless a copy was kept already
+Notes	| With the writer latch held the bucket cannot change as it is copied. A scan
+	| marks buckets read under the snapshot latch, once it has read them, so a bucket
+	| not kept here was read in full before this write began.
+=========================================================================================
+*/
+void
+ExtendibleHashFile::
+PreserveBucket(int bucketNumber
+	       )
+{
+  for (EHFSnapshot* snapshot : _snapshots){
+    std::lock_guard<std::mutex> latch(snapshot->latch);
+    std::vector<int>::iterator found = std::lower_bound(snapshot->buckets.begin(),
+							snapshot->buckets.end(),
+							bucketNumber);
+    if ( (found == snapshot->buckets.end()) || (*found != bucketNumber) ||
+	 snapshot->read[found - snapshot->buckets.begin()] ||
+	 (snapshot->kept.count(bucketNumber) > 0) ){
+      continue;
+    }
+    std::vector<char> image(BUCKETSIZE);
+    EHFBucket bucket(_bucketFileFD, bucketNumber, EHF_TOBEREAD);
+    PlaceBucket(bucket);
+    if (bucket.ReadImage(image.data()) == EHF_READOK){
+      snapshot->kept.emplace(bucketNumber, std::move(image));
+    }
+  }
+}
+
+long
+ExtendibleHashFile::
+PageCount()
+{
+  return (_container != nullptr) ? _container->PageCount() : _bucketCount;
+}
+
+/*
+=========================================================================================
+Name	| ReadBuckets
+Purpose | Read a run of buckets in file order, all of the pages from the first to the
+	| last in one read
+Notes	| In memory each bucket is copied out of the store instead. The read is counted
+	| as one bucket read a bucket, and traced as one, against the first bucket.
+=========================================================================================
+*/
+int
+ExtendibleHashFile::
+ReadBuckets(const int* buckets,
+	    size_t count,
+	    std::vector<char>& span,
+	    std::vector<const char*>& images
+	    )
+{
+  images.clear();
+  if (count == 0){
+    return EHF_READOK;
+  }
+  _stats.Count(EHF_STAT_BUCKETREADS, count);
+  uint64_t begun = TraceBegin();
+  if (_memory != nullptr){
+    span.resize(count * BUCKETSIZE);
+    for (size_t b = 0; b < count; b++){
+      EHFBucket bucket(_bucketFileFD, buckets[b], EHF_TOBEREAD);
+      PlaceBucket(bucket);
+      int result = bucket.ReadImage(&span[b * BUCKETSIZE]);
+      if (result != EHF_READOK){
+	return result;
+      }
+      images.push_back(&span[b * BUCKETSIZE]);
+    }
+  } else {
+    long fileHeaderSize = (_container != nullptr) ? SUPERBLOCKAREA : FILEHEADERSIZE;
+    long pageSize = (_container != nullptr) ? _container->PageSize() : BUCKETSIZE;
+    size_t bytes = (buckets[count - 1] - buckets[0] + 1) * pageSize;
+    span.resize(bytes);
+    ssize_t dataRead = pread(_bucketFileFD, span.data(), bytes,
+			     fileHeaderSize + pageSize * buckets[0]);
+    // The last page need only hold its bucket, where the file may end
+    if (dataRead < static_cast<ssize_t>(bytes - pageSize + BUCKETSIZE)){
+      return (_bucketFileFD < 0) ? EHF_FILENOTOPEN : EHF_READERROR;
+    }
+    for (size_t b = 0; b < count; b++){
+      images.push_back(&span[(buckets[b] - buckets[0]) * pageSize]);
+    }
+  }
+  TraceIO(EHF_TRACE_BUCKETREAD, buckets[0], begun);
+  return EHF_READOK;
+}
+
+void
+ExtendibleHashFile::
+ReadAhead(const int* buckets,
+	  size_t count
+	  )
+{
+  if ( (count == 0) || (_memory != nullptr) ){
+    return;
+  }
+  long fileHeaderSize = (_container != nullptr) ? SUPERBLOCKAREA : FILEHEADERSIZE;
+  long pageSize = (_container != nullptr) ? _container->PageSize() : BUCKETSIZE;
+  posix_fadvise(_bucketFileFD, fileHeaderSize + pageSize * buckets[0],
+		(buckets[count - 1] - buckets[0] + 1) * pageSize, POSIX_FADV_WILLNEED);
+}
+
+/*
+=========================================================================================
+Name	| TraceBegin / TraceIO
+Purpose | Time a bucket read or write for the tracer, if there is one, and record it
+=========================================================================================
+*/
+uint64_t
+ExtendibleHashFile::
+TraceBegin()
+{
+  return (_tracer != nullptr) ? EHFStatsCollector::Now() : 0;
+}
+
+void
+ExtendibleHashFile::
+TraceIO(int type,
+	int bucketNumber,
+	uint64_t begun
+	)
+{
+  if (_tracer != nullptr){
+    _tracer->Record(type, bucketNumber, EHFStatsCollector::Now() - begun);
+  }
+}
+
+/*
+=========================================================================================
+Name	| BucketVersion
+Purpose | Return the version latch guarding a bucket. Buckets share latches, so a write
+	| to one bucket may cause a needless retry for a reader of another.
+=========================================================================================
+*/
+VersionLatch&
+ExtendibleHashFile::
+BucketVersion(int bucketNumber
+	      )
+{
+  return _bucketVersions[ static_cast<unsigned>(bucketNumber) % BUCKETVERSIONSTRIPES ];
+}
+
+/*
+=========================================================================================
+Name	| MarkDirty
+Purpose | Note a bucket written since the last sync, so that the sync can start its
+	| writeback ahead of time. Not kept without a durability option, when syncs are
+	| rare and the list would only grow, nor in memory, where there is no writeback.
+=========================================================================================
+*/
+void
+ExtendibleHashFile::
+MarkDirty(int bucketNumber
+	  )
+{
+  if ( (_options.durability != EHF_DURABILITY_NONE) && (_memory == nullptr) ){
+    _dirtyBuckets.push_back(bucketNumber);
+  }
+}
+
+/*
+=========================================================================================
+Name	| WaitDurable
+Purpose | Wait until the insert numbered writeNumber, and every one before it, is durable
+Returns | False if the sync that was to cover it failed
+Notes	| Whoever finds no sync under way runs one, for every insert made by then. Those
+	| arriving meanwhile wait for it to end, and if it started too early for them,
+	| one of them runs the next, so a burst of writers shares a few syncs.
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+WaitDurable(uint64_t writeNumber
+	    )
+{
+  std::unique_lock<std::mutex> lock(_syncLatch);
+  while (_durableWrites < writeNumber){
+    if (_syncing){
+      _syncDone.wait(lock);
+      continue;
+    }
+    _syncing = true;
+    lock.unlock();
+    bool synced = SyncNow();
+    lock.lock();
+    _syncing = false;
+    _syncDone.notify_all();
+    if (!synced){
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+=========================================================================================
+Name	| PollDurable
+Purpose | Check on the insert numbered writeNumber becoming durable, without waiting on
+	| anyone else's sync
+Notes	| With no sync under way one is run, there and then, as WaitDurable would.
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+PollDurable(uint64_t writeNumber,
+	    bool& durable
+	    )
+{
+  std::unique_lock<std::mutex> lock(_syncLatch);
+  durable = true;
+  while (_durableWrites < writeNumber){
+    if (_syncing){
+      return false;
+    }
+    _syncing = true;
+    lock.unlock();
+    bool synced = SyncNow();
+    lock.lock();
+    _syncing = false;
+    _syncDone.notify_all();
+    if (!synced){
+      durable = false;
+      return true;
+    }
+  }
+  return true;
+}
+
+/*
+=========================================================================================
+Name	| SyncNow
+Purpose | Sync everything written so far
+Notes	| Writeback of the buckets written since the last sync is started first, range
+	| by range, without the writer latch, so that there is little left to write by
+	| the time SyncLocked syncs with writers held off.
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+SyncNow()
+{
+  std::vector<int> dirty;
+  {
+    std::lock_guard<std::mutex> latch(_writeLatch);
+    dirty.swap(_dirtyBuckets);
+  }
+  if ( (_bucketFile != nullptr) && _bucketFile->Direct() ){
+    dirty.clear();				      // Nothing in the page cache
+  }
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+  long fileHeaderSize = (_container != nullptr) ? SUPERBLOCKAREA : FILEHEADERSIZE;
+  long pageSize = (_container != nullptr) ? _container->PageSize() : BUCKETSIZE;
+  for (size_t first = 0; first < dirty.size(); ){
+    size_t last = first;
+    while ( (last + 1 < dirty.size()) && (dirty[last + 1] == dirty[last] + 1) ){
+      last++;
+    }
+    sync_file_range(_bucketFileFD, fileHeaderSize + pageSize * dirty[first],
+		    pageSize * (last - first + 1), SYNC_FILE_RANGE_WRITE);
+    first = last + 1;
+  }
+
+  std::lock_guard<std::mutex> latch(_writeLatch);
+  return SyncLocked();
+}
+
+/*
+=========================================================================================
+Name	| SyncLocked
+Purpose | Sync everything written so far, with the writer latch held
+Notes	| After a split the index goes too: a Commit for a container, and for two files
+	| the buckets are synced before the index that refers to them is written out.
+=========================================================================================
+*/
+bool
+ExtendibleHashFile::
+SyncLocked()
+{
+  uint64_t writeCount = _writeCount;
+  bool synced;
+  if (_memory != nullptr){
+    synced = true;				      // Nothing can be made durable
+  } else if (_container != nullptr){
+    if (_indexDirty){
+      synced = _container->Commit(_index, _bucketCount);
+    } else {
+      synced = (fdatasync(_bucketFileFD) == 0);
+    }
+  } else {
+    synced = (fdatasync(_bucketFileFD) == 0);
+    if (synced && _indexDirty){
+      synced = _index->Write(_indexFileFD) && (WriteBucketCount() == EHF_WROTEOK) &&
+	(fdatasync(_bucketFileFD) == 0) && (fdatasync(_indexFileFD) == 0);
+    }
+  }
+  if (synced){
+    if (_memory == nullptr){
+      _stats.Count(EHF_STAT_SYNCS);
+    }
+    _dirtyBuckets.clear();
+    _indexDirty = false;
+    std::lock_guard<std::mutex> lock(_syncLatch);
+    _durableWrites = std::max(_durableWrites, writeCount);
+  }
+  return synced;
+}
+
+/*
+=========================================================================================
+Name	| Flusher
+Purpose | Sync every syncInterval milliseconds, for EHF_DURABILITY_PERIODIC, until
+	| StopFlusher
+=========================================================================================
+*/
+void
+ExtendibleHashFile::
+Flusher()
+{
+  std::unique_lock<std::mutex> lock(_syncLatch);
+  while (!_stopFlusher){
+    _flusherWake.wait_for(lock, std::chrono::milliseconds(_options.syncInterval));
+    uint64_t writeCount = _writeCount;
+    if ( !_stopFlusher && (_durableWrites < writeCount) ){
+      lock.unlock();
+      WaitDurable(writeCount);
+      lock.lock();
+    }
+  }
+}
+
+void
+ExtendibleHashFile::
+StopFlusher()
+{
+  if (!_flusher.joinable()){
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_syncLatch);
+    _stopFlusher = true;
+  }
+  _flusherWake.notify_all();
+  _flusher.join();
+  _stopFlusher = false;
+}
+
 /*
 =========================================================================================
 Name	| FileSummary
@@ -608,28 +1967,107 @@ FileSummary(){
     std::cout << tempAdr;
 
     // Get the bucket with address i
-    EHFBucket* bucket = new EHFBucket(_bucketFileFD, _index->GetAddress(i));
-    int readResult = bucket->Read();
+    EHFBucket bucket(_bucketFileFD, _index->GetAddress(i), EHF_TOBEREAD);
+    PlaceBucket(bucket);
+    int readResult = bucket.Read();
     if (readResult != EHF_READOK){
-      delete bucket;
       std::cout << "Read bucket error in FileSummary();" << std::endl;
+      continue;
     }
-    int numRecs = bucket->NumOfRecs();
+    int numRecs = bucket.NumOfRecs();
     for (int x = 0; x < numRecs; x++){
-      bucket->RetrieveRecAtIndex(x, tempKey, tempRec);
+      bucket.RetrieveRecAtIndex(x, tempKey, tempRec);
       std::cout << " " << tempKey << std::endl;
       if (x != (numRecs-1)){
 	// print alignment spacing for the next one
 	std::cout << "				";
       }
     }
-    delete bucket;
     std::cout << "Records in bucket "<<i<<" : "<< numRecs<<std::endl;
     std::cout << "---------------------------------------\n";
     std::cout << std::endl;
   }
 }
 
+/*
+=========================================================================================
+Name	 | Analyse
+Purpose	 | Measure the occupancy of the file, visiting each bucket once
+Notes	 | Every index value pointing at a bucket is passed over but the first, so each
+	 | bucket is read once, however many index values share it. The buckets are read
+	 | in the order they lie in the file, shared out amongst the threads in runs, and
+	 | each thread counts apart until they are added up at the end. A bucket whose
+	 | record count or depth is out of range, as ReadFromBuffer judges them, counts
+	 | as unreadable rather than indexing the histograms with it.
+=========================================================================================
+*/
+EHFOccupancy
+ExtendibleHashFile::
+Analyse(int threads
+	)
+{
+  EHFOccupancy occupancy;
+  if (!_fileOpen){
+    return occupancy;
+  }
+  std::lock_guard<std::mutex> latch(_writeLatch);
+  occupancy.indexDepth = _index->GetDepth();
+  occupancy.indexSlots = _index->GetNumberOfAddresses();
+  if (_container != nullptr){
+    occupancy.pageSize = _container->PageSize();
+  }
+  std::vector<int> buckets = DistinctBuckets();
+
+  if (threads <= 0){
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max(1, std::min(threads, static_cast<int>(buckets.size())));
+  size_t each = (buckets.size() + threads - 1) / threads;
+  std::vector<EHFOccupancy> parts(threads);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < threads; t++){
+    readers.emplace_back([this, &buckets, &parts, t, each](){
+      EHFOccupancy& part = parts[t];
+      char key[IDSIZE+1];
+      char record[RECORDSIZE+1];
+      size_t end = std::min(buckets.size(), (t + 1) * each);
+      for (size_t b = t * each; b < end; b++){
+	EHFBucket bucket(_bucketFileFD, buckets[b], EHF_TOBEREAD);
+	PlaceBucket(bucket);
+	if (bucket.Read() != EHF_READOK){
+	  part.unreadable++;
+	  continue;
+	}
+	int depth = bucket.Depth();
+	int numRecs = bucket.NumOfRecs();
+	if ( (numRecs < 0) || (numRecs > FULLBUCKET) || (depth < 0) || (depth > NUMBITS - 2) ){
+	  part.unreadable++;
+	  continue;
+	}
+	if (static_cast<size_t>(depth) >= part.depthHistogram.size()){
+	  part.depthHistogram.resize(depth + 1, 0);
+	}
+	part.depthHistogram[depth]++;
+	part.fillHistogram[numRecs]++;
+	part.buckets++;
+	part.records += numRecs;
+	for (int r = 0; r < numRecs; r++){
+	  bucket.RetrieveRecAtIndex(r, key, record);
+	  part.patternRecords[GetLowestBits(Hash(key), HOTPATTERNBITS)]++;
+	}
+      }
+    });
+  }
+  for (std::thread& reader : readers){
+    reader.join();
+  }
+  for (EHFOccupancy& part : parts){
+    occupancy.Add(part);
+  }
+  occupancy.Summarise();
+  return occupancy;
+}
+
 /*
 These are the first 58 records contained in the CompBookData file
 Each has been given it's relative record number, from 0 - 57
@@ -13,17 +13,94 @@ Methods | Name                | Functionality
         | Close               | Close the file that was opened with the Open call       |
         | InsertRecord        | Insert a record into the file opened by the Open call   |
         | RetrieveRecord      | Retrieve record from the file matching the given key    |
+        | Get                 | Find a record, and view it where it lies in its bucket  |
+        | RetrieveBatch       | Retrieve many records, overlapping their cache misses   |
+        | UpdateRecord        | Overwrite the record matching the given key in place    |
+        | UpsertRecord        | Update the record if there is one, insert it otherwise  |
+        | UpdateField         | Overwrite part of a record, such as its call code       |
+        | CompareAndSwap      | Overwrite a record only if it holds what was expected   |
+        | Modify              | Change a record through a function, atomically          |
         | DeleteRecord        | Delete record from the file matching the given key      |
+        | Sync                | Make every change so far durable                        |
+        | Persist             | Write a table kept in memory out as a container         |
+        | GetStats            | Counts and latencies of what the file has done          |
+        | Analyse             | Occupancy of the buckets, each read once, in parallel   |
+        | SetTracer           | Record splits, index growth and bucket I/O as they occur|
 ----------------------------------------------------------------------------------------|
 Notes   | This is an extendible hash file, that is, it grows and shrinks as records are |
         | inserted and deleted. The retrieve function is purely that, the file is not   |
         | affected by any retrieve operations                                           |
+        | Once open, any number of threads may retrieve records while other threads     |
+        | insert. Writers are serialised by a latch, readers take no lock at all and    |
+        | instead validate version counters, retrying if a writer got in the way.       |
+        | Open and Close must not race with any other call.                             |
+        | A file is kept either in one container file, name.eh (see EHFContainer), or  |
+        | in the older pair of name.ehd (index) and name.ehf (buckets).                 |
+        | Writes go to the page cache, and are made durable as the durability option    |
+        | says (see ehfoptions.h). A sync starts writeback of just the buckets written  |
+        | since the last one, then, holding the writer latch, commits the index if a   |
+        | split changed it and syncs the files. Writers waiting on a sync share it: the |
+        | first to wait runs it for everything written by then, the others wait on it   |
+        | or on the one after. In the two file layout the index file is rewritten in    |
+        | place, so a crash during that write may need RebuildIndex (ehfrecovery.h).   |
+        | With the inMemory option there are no files: buckets live in a                |
+        | MemoryBucketStore, and inserts and lookups make no system calls, while the   |
+        | splits and the index work as they do on disc.                                |
 =========================================================================================
 */
 #ifndef _ExTENdiBLEhAsHFilE__
 #define _ExTENdiBLEhAsHFilE__ 
 
-#include "indexholder.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "extendibleindex.h"
+#include "ehfoptions.h"
+#include "ehfcontainer.h"
+#include "versionlatch.h"
+#include "records.h"
+#include "ehfstats.h"
+#include "ehfoccupancy.h"
+#include "ehftrace.h"
+
+class EHFBucket;
+class BucketFile;
+class MemoryBucketStore;
+class EHFRecordView;
+
+// Number of version latches shared out amongst the buckets of a file
+const int BUCKETVERSIONSTRIPES = 256;
+
+// Lookups RetrieveBatch keeps in flight at once, unless told otherwise, and at most
+const int BATCHGROUP = 16;
+const int MAXBATCHGROUP = 64;
+
+// A lookup part way through, as its stages are run by RetrieveRecord, RetrieveBatch
+// and EHFOperation
+struct EHFLookup{
+  char key[IDSIZE+1];                               // The key, cut to size
+  int hashValue;
+  int address;                                      // Index value of the key
+  int bucketNumber;                                 // Bucket it gives
+  unsigned directoryVersion;                        // Versions seen as the lookup began
+  unsigned version;
+  const char* image;                                // The bucket where it lies, if in memory
+};
+
+// What a scan sees: the buckets as they were when it began. A writer about to change a
+// bucket the scan has yet to read keeps a copy of it here first (see PreserveBucket).
+struct EHFSnapshot{
+  std::vector<int> buckets;                         // In file order
+  long pages;                                       // Pages in the file when it began
+  std::vector<bool> read;                           // Buckets the scan has read
+  std::unordered_map<int, std::vector<char> > kept; // Images from before a write
+  std::mutex latch;                                 // Guards read and kept
+};
 
 class ExtendibleHashFile{
   /*
@@ -35,6 +112,10 @@ class ExtendibleHashFile{
   // Constructor
   ExtendibleHashFile();
 
+  // Constructor, for a file other than the default options
+  ExtendibleHashFile(const EHFOptions& options       // See ehfoptions.h
+		     );
+
   // Destructor
   ~ExtendibleHashFile();
 
@@ -56,6 +137,12 @@ class ExtendibleHashFile{
   void
   FileSummary();
 
+  // Read every bucket once, with threads threads (0 for one per core), and measure
+  // how full they are, see ehfoccupancy.h. Writers wait until it is done.
+  EHFOccupancy
+  Analyse(int threads = 0
+	  );
+
   // Insert a record into the extendible hash file
   int                                                // Return code, see ehfconsts.h
   InsertRecord(char* keyToAdd,                       // Key of the record to add
@@ -68,24 +155,171 @@ class ExtendibleHashFile{
 		 char* returnRecord                  // Return the record if found
 		 );
   
+  // Retrieve count records, as RetrieveRecord would one by one, into returnRecords[i]
+  // with a return code in results[i]. Lookups go groupSize at a time, prefetching each
+  // stage of every lookup in the group before any of them waits on it.
+  int                                                // Number retrieved
+  RetrieveBatch(int count,                           // Number of keys
+		char** keysToFind,                   // Keys of the records to search for
+		char** returnRecords,                // Return the records found
+		int* results,                        // Return code for each key
+		int groupSize = BATCHGROUP           // Lookups in flight at once
+		);
+
+  // Find a record without copying it out of its bucket, see ehfrecordview.h
+  int                                                // Return code, see ehfconsts.h
+  Get(char* keyToFind,                               // Key of the record to search for
+      EHFRecordView& view                            // Views the record if found
+      );
+
+  // Overwrite the record held under keyToUpdate with recordToWrite, but for its key,
+  // in one bucket read and one write
+  int                                                // Return code, see ehfconsts.h
+  UpdateRecord(char* keyToUpdate,                    // Key of the record to update
+	       char* recordToWrite                   // Its new contents
+	       );
+
+  // Update the record held under keyToAdd if there is one, or insert recordToAdd
+  int                                                // Return code, see ehfconsts.h
+  UpsertRecord(char* keyToAdd,                       // Key of the record
+	       char* recordToAdd                     // The record to write
+	       );
+
+  // Overwrite length bytes of the record held under keyToUpdate from position on,
+  // such as CALLCODEPOSITION and CALLCODESIZE, leaving the rest of it as it is
+  int                                                // Return code, see ehfconsts.h
+  UpdateField(char* keyToUpdate,                     // Key of the record to update
+	      int position,                          // First byte, past the key
+	      int length,                            // Bytes to overwrite
+	      char* value                            // length bytes to write there
+	      );
+
+  // Overwrite the record held under keyToUpdate with desired, but for its key, if it
+  // still holds expected; if not, expected is given what it holds instead, RECORDSIZE
+  // chars and a '\0'. The RECORDSIZE - IDSIZE bytes past the key are compared as they
+  // are stored, a '\0' in one field not ending the comparison.
+  int                                                // Return code, see ehfconsts.h
+  CompareAndSwap(char* keyToUpdate,                  // Key of the record to update
+		 char* expected,                     // What the record should hold
+		 char* desired                       // What it is to hold
+		 );
+
+  // Call modify on a copy of the record held under keyToModify, RECORDSIZE chars and a
+  // '\0', and write it back, but for its key, if modify returns true. modify runs with
+  // the writer latch held, so must be quick and must not call into the table.
+  int                                                // Return code, see ehfconsts.h
+  Modify(char* keyToModify,                          // Key of the record to change
+	 std::function<bool(char* record)> modify    // Changes the record, or says not to
+	 );
+
   // Delete a record from the extendible hash file
   int                                                // Return code, see ehfconsts.h 
   DeleteRecord(char* keyToDelete                     // Key of the record to delete
 	       );
 
+  // Make every change made so far durable, whatever the durability option
+  bool                                               // True if all was synced
+  Sync();
+
+  // Write a table kept in memory to fileName.eh, replacing any table there, in one
+  // pass. The table stays open, in memory.
+  bool                                               // True if all was written
+  Persist(char* fileName                             // As would be given to Open
+	  );
+
+  // What has been done since construction, see ehfstats.h
+  EHFStats
+  GetStats();
+
+  // Record splits, index doubling, bucket reads and writes and, with direct I/O, cache
+  // evictions on tracer, see ehftrace.h; nullptr to stop. Must not race with any other
+  // call, and the tracer must outlive the file or be taken off it first.
+  void
+  SetTracer(EHFTracer* tracer
+	    );
+
   /*
   =======================================================================================
    IMPLEMENTATION METHODS
   =======================================================================================
    */
  private:
+  // EHFOperation runs the stages of lookups and inserts itself
+  friend class EHFOperation;
+  // EHFCursor reads the buckets a span at a time
+  friend class EHFCursor;
+  friend int ScanPartitions(ExtendibleHashFile*, int,
+			    std::function<void(int, const char*, const char*)>,
+			    std::function<void(int)>);
+
+  // The stages of a lookup, in order: FinishLookup returns false if the lookup must
+  // begin again
+  void
+  StartLookup(char* keyToFind,
+	      EHFLookup& lookup
+	      );
+
+  void
+  BeginLookup(EHFLookup& lookup
+	      );
+
+  void
+  ResolveLookup(EHFLookup& lookup,
+		bool readAhead                       // Start reading the bucket from disc
+		);
+
+  bool
+  FinishLookup(EHFLookup& lookup,
+	       char* returnRecord,
+	       int& result
+	       );
+
+  // Insert with the writer latch held, numbering the insert for WaitDurable. With
+  // replace, a record already under the key is updated instead.
+  int
+  InsertLocked(char* keyToAdd,
+	       char* recordToAdd,
+	       int hashValue,
+	       uint64_t& writeNumber,
+	       bool replace = false
+	       );
+
   int 
   InsertRecord(char* keyToAdd,                       // Key for the record to be added
 	       char* recordToAdd,                    // Record to be added
 	       int hashValue,                        // 
-	       int callNumber
+	       int callNumber,
+	       bool replace                          // Update the record if present
+	       );
+
+  // Change a record through modify with the writer latch held, numbering the write
+  int
+  ModifyLocked(char* keyToModify,
+	       int hashValue,
+	       const std::function<bool(char* record)>& modify,
+	       uint64_t& writeNumber
 	       );
 
+  // Number a write done with the writer latch held, and sync it with
+  // EHF_DURABILITY_PEROP
+  bool                                               // False if the sync failed
+  NumberWrite(uint64_t& writeNumber
+	      );
+
+  // With EHF_DURABILITY_COMMIT, wait for a write that gave result to be durable,
+  // once the writer latch has been let go
+  int                                                // result, or EHF_WRITEERROR
+  AwaitDurable(int result,
+	       uint64_t writeNumber
+	       );
+
+  // Write a bucket back where it came from, as readers and scans expect: kept for
+  // snapshots, under its version latch, and noted for the next sync
+  int
+  WriteBucket(EHFBucket& bucket,
+	      int bucketNumber
+	      );
+
   int 
   AccomodateRecord(int address, 
 		   int bucketDepth
@@ -93,7 +327,8 @@ class ExtendibleHashFile{
 
   int 
   SplitBucket(int addressToSplit, 
-	      int bucketDepth
+	      int bucketDepth,
+	      int oldHalfNumber
 	      );
 
   bool 
@@ -106,18 +341,160 @@ class ExtendibleHashFile{
 		char* bucketFileName
 		);
 
+  bool
+  OpenExistingContainer(char* containerFileName
+			);
+
+  bool
+  CreateNewContainer(char* containerFileName
+		     );
+
+  bool
+  CreateInMemory();
+
+  // The relative bucket number of a bucket not yet in use
+  int
+  AllocateBucket();
+
+  // Set up bucket to find its place in whichever layout the file has
+  void
+  PlaceBucket(EHFBucket& bucket
+	      );
+
   int
   ReadBucketCount();
  
   int
   WriteBucketCount();
+
+  // Set up _bucketFile for the container, if the options ask for direct I/O
+  void
+  OpenBucketFile(char* containerFileName
+		 );
+
+  // A new, empty index of the type chosen by the options
+  ExtendibleIndex*
+  NewIndex(int initialDepth
+	   );
+
+  // Note a bucket written, to be flushed by the next sync
+  void
+  MarkDirty(int bucketNumber
+	    );
+
+  // Wait until every change up to writeNumber is durable, running a sync if none is
+  bool
+  WaitDurable(uint64_t writeNumber
+	      );
+
+  // As WaitDurable, but false rather than waiting while another sync is under way
+  bool                                               // True once there is no more to do
+  PollDurable(uint64_t writeNumber,
+	      bool& durable                          // False if the sync failed
+	      );
+
+  // Start writeback of the dirty buckets, then sync under the writer latch
+  bool
+  SyncNow();
+
+  // With the writer latch held: commit the index if need be, and sync the files
+  bool
+  SyncLocked();
+
+  // The background thread of EHF_DURABILITY_PERIODIC
+  void
+  Flusher();
+
+  void
+  StopFlusher();
+
+  // Every bucket the index points at, once each, in file order. The writer latch must
+  // be held.
+  std::vector<int>
+  DistinctBuckets();
+
+  // Take a snapshot of the buckets on pages [firstPage, endPage), and keep it up to
+  // date until EndSnapshot
+  void
+  BeginSnapshot(EHFSnapshot* snapshot,
+		int firstPage,
+		int endPage
+		);
+
+  void
+  EndSnapshot(EHFSnapshot* snapshot
+	      );
+
+  // Keep the image of a bucket about to be written, for every snapshot yet to read it.
+  // The writer latch must be held.
+  void
+  PreserveBucket(int bucketNumber
+		 );
+
+  // Pages buckets may lie on, those of the container if there is one. The writer latch
+  // must be held.
+  long
+  PageCount();
+
+  // Read the count buckets given, in file order, with one read from the file, leaving
+  // the image of each amongst the pages read into span
+  int                                                // EHF_READOK, or the read's error
+  ReadBuckets(const int* buckets,
+	      size_t count,
+	      std::vector<char>& span,
+	      std::vector<const char*>& images
+	      );
+
+  // Ask for the buckets ReadBuckets is to be given next to be read ahead
+  void
+  ReadAhead(const int* buckets,
+	    size_t count
+	    );
+
+  // The time a bucket read or write begins, if there is a tracer to record it on
+  uint64_t
+  TraceBegin();
+
+  // Record a bucket read or write, begun at TraceBegin
+  void
+  TraceIO(int type,
+	  int bucketNumber,
+	  uint64_t begun
+	  );
+
+  // The version latch guarding the given bucket
+  VersionLatch&
+  BucketVersion(int bucketNumber
+		);
   
   // Members
   bool _fileOpen;                                       // True if the file is open
   int _indexFileFD;                                     // File descriptor of directory
   int _bucketFileFD;                                    // File descriptor of bucket file
   int _bucketCount;                                     // Number of buckets in the file
-  IndexHolder* _index;                                  // Pointer to the index
+  EHFContainer* _container;                             // The container, if there is one
+  BucketFile* _bucketFile;                              // Direct bucket I/O, if asked for
+  MemoryBucketStore* _memory;                           // The buckets, if in memory
+  EHFOptions _options;                                  // Options given at construction
+  ExtendibleIndex* _index;                              // Pointer to the index
+  std::mutex _writeLatch;                               // Serialises writers
+  VersionLatch _directoryVersion;                       // Bumped around index changes
+  VersionLatch _bucketVersions[BUCKETVERSIONSTRIPES];   // Bumped around bucket writes
+  // Under _writeLatch
+  std::vector<int> _dirtyBuckets;                       // Written since the last sync
+  std::vector<EHFSnapshot*> _snapshots;                 // Of scans under way
+  bool _indexDirty;                                     // Split since the last sync
+  std::atomic<uint64_t> _writeCount;                    // Inserts, read without the latch
+  // Under _syncLatch
+  uint64_t _durableWrites;                              // Inserts known to be durable
+  bool _syncing;                                        // A sync is under way
+  bool _stopFlusher;                                    // Close wants the Flusher to end
+  std::mutex _syncLatch;
+  std::condition_variable _syncDone;                    // Signalled as a sync ends
+  std::condition_variable _flusherWake;                 // Signalled to stop the Flusher
+  std::thread _flusher;                                 // Runs Flusher, if periodic
+  EHFStatsCollector _stats;                             // Counted by every thread
+  EHFTracer* _tracer;                                   // Events recorded, if set
 };
 
 #endif
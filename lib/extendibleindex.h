@@ -0,0 +1,65 @@
+/*
+=========================================================================================
+Name    | ExtendibleIndex                                                               |
+Purpose | What an extendible hash file needs from its index (directory)                 |
+----------------------------------------------------------------------------------------|
+Notes   | An index maps the lowest GetDepth() bits of a hash value (the index, or slot) |
+        | to the relative number of the bucket holding it (the address). IndexHolder    |
+        | keeps one slot per index value. CompactIndexHolder keeps one leaf per bucket, |
+        | which is far smaller when many slots share a shallow bucket. Both read and    |
+        | write the same .ehd layout: the depth followed by every slot's address.       |
+=========================================================================================
+*/
+#ifndef _ExTeNdIbLeInDeX__
+#define _ExTeNdIbLeInDeX__
+
+class ExtendibleIndex
+{
+public:
+virtual ~ExtendibleIndex() {}
+
+// The index is read from, or written to, the file at position (in bytes)
+virtual bool Load(int fileDescriptor, long position = 0) = 0;
+virtual bool Write(int fileDescriptor, long position = 0) = 0;
+
+/*
+Set the index up from slots, the address plus one of every index value in order, for an
+index of depth. With inPlace the index may go on using slots, writing to them too,
+rather than copying them, and slots must then outlast the index.
+*/
+virtual bool Attach(int* slots, int depth, bool inPlace) = 0;
+
+// Add another bit to the index depth, every new index value taking its buddy's address
+virtual void IncreaseDepth() = 0;
+
+virtual int GetDepth() = 0;
+
+virtual int GetNumberOfAddresses() = 0;
+
+virtual int GetAddress(int index) = 0;
+
+// Start bringing what GetAddress(index) will read into the cache. A hint only, which
+// an index whose lookups are a chain of loads may ignore.
+virtual void Prefetch(int index) { (void) index; }
+
+/*
+The bucket holding the index values ending in the bucketDepth bits of bucketValue has
+been split. Those also ending in a 1 bit above bucketValue now go to newAddress, the
+others stay where they were. bucketDepth must be less than the index depth.
+*/
+virtual void SplitAddress(int bucketValue, int bucketDepth, int newAddress) = 0;
+
+/*
+The bucket holding the index values ending in the bucketDepth bits of bucketValue has
+moved to newAddress. bucketDepth must not be more than the index depth.
+*/
+virtual void MoveAddress(int bucketValue, int bucketDepth, int newAddress) = 0;
+
+// Do up to count steps of deferred work, returning the number done (0 if none is left)
+virtual int CopyMirrors(int count) { (void) count; return 0; }
+
+// Bytes of memory held by the index
+virtual long MemoryUsage() = 0;
+};
+
+#endif
@@ -7,14 +7,20 @@ Author   | David Stevenson
 =========================================================================================
 */
 #include <iostream>
+#include <new>
+#include <cstdlib>
+#include <cstring>
 
-// For file system methods and constants 
+// For file system methods and constants
 #include <unistd.h>
-#include <fcntl.h> 
+#include <fcntl.h>
 
 #include "indexholder.h"
 #include "bit_op_lib.h"
 
+// Number of slots gathered up before Write writes them out
+const int WRITECHUNK = 1024;
+
 /*
 =========================================================================================
 Name     | Constructors
@@ -23,7 +29,13 @@ Name     | Constructors
 IndexHolder::IndexHolder()
 {
   _indexDepth = 1;
-  _indexPointer = nullptr;
+  _attachedBegin = nullptr;
+  _attachedEnd = nullptr;
+  for (int level = 0; level <= NUMBITS; level++){
+    _levels[level] = nullptr;
+  }
+  _fillLevel = 2;
+  _fillOffset = 0;
 }
 
 IndexHolder::IndexHolder(int initialDepth)
@@ -32,10 +44,19 @@ IndexHolder::IndexHolder(int initialDepth)
   if ( !( (initialDepth >= 1) && (initialDepth <= 32) ) ){
     initialDepth = 1;
   }
+  for (int level = 0; level <= NUMBITS; level++){
+    _levels[level] = (level <= initialDepth) ? CreateLevel(level) : nullptr;
+  }
+  // Point each element to the zeroth address. Slot 0 does so explicitly, and every
+  // other slot defers to it, until CopyMirrors gets around to filling it in.
+  _levels[0][0] = 0 + 1;
+  _attachedBegin = nullptr;
+  _attachedEnd = nullptr;
+  _fillLevel = 1;
+  _fillOffset = 0;
   _indexDepth = initialDepth;
-  _indexPointer = CreateIndex( GetNumberOfAddresses() ); 
 }
-  
+
 /*
 =========================================================================================
 Name     | Destructors
@@ -44,101 +65,166 @@ Name     | Destructors
 IndexHolder::
 ~IndexHolder()
 {
-  if (_indexPointer != nullptr) {
-    delete[] _indexPointer;
-    _indexPointer = nullptr;
-  }
+  FreeLevels();
 }
 
 bool
 IndexHolder::
-Load(int fileDescriptor
+Load(int fileDescriptor,
+     long position
      )
 {
   if (fileDescriptor < 0){
     return false;
   }
 
-  if (_indexPointer != nullptr) {
-    delete[] _indexPointer;
-    _indexPointer = nullptr;
-  }
-  
+  FreeLevels();
+
   // Seek to the start of the index
-  lseek(fileDescriptor, 0, SEEK_SET);
+  lseek(fileDescriptor, position, SEEK_SET);
 
   // Read the index depth
-  int dataRead = read(fileDescriptor, 
-		      &_indexDepth, 
-		      sizeof(_indexDepth)
+  int depth;
+  int dataRead = read(fileDescriptor,
+		      &depth,
+		      sizeof(depth)
 		      );
-  if ( dataRead != sizeof(_indexDepth) ){
+  if ( (dataRead != sizeof(depth)) || (depth < 1) || (depth > NUMBITS) ){
     return false;
   }
 
-  // Create space for the index
-  _indexPointer = CreateIndex( GetNumberOfAddresses() );
-
-  // Read the index  
-  dataRead = read(fileDescriptor,                        // file to read from 
-		  &*_indexPointer,                       // buffer to read to
-		  (sizeof(int) * GetNumberOfAddresses()) // size of data to read
-		  );
-  if ( static_cast<size_t>(dataRead) != (sizeof(int) * GetNumberOfAddresses()) ){
-    return false;
+  // The file holds the slots in order, which is also the order of the levels
+  for (int level = 0; level <= depth; level++){
+    int* slots = CreateLevel(level);
+    _levels[level] = slots;
+    int size = (level == 0) ? 1 : LevelStart(level);
+    dataRead = read(fileDescriptor,                      // file to read from
+		    slots,                               // buffer to read to
+		    (sizeof(int) * size)                 // size of data to read
+		    );
+    if ( static_cast<size_t>(dataRead) != (sizeof(int) * size) ){
+      return false;
+    }
+    // Every slot is filled in
+    for (int i = 0; i < size; i++){
+      slots[i]++;
+    }
   }
+  _fillLevel = depth + 1;
+  _fillOffset = 0;
+  _indexDepth = depth;
   return true;
 }
 
-bool 
+bool
 IndexHolder::
-Write(int fileDescriptor
+Write(int fileDescriptor,
+      long position
       )
 {
   if (fileDescriptor < 0){
     return false;
   }
-  if (_indexPointer == nullptr){
+  if (_levels[0] == nullptr){
     return false;
   }
-  
+
   // Seek to the start of the index
-  lseek(fileDescriptor, 0, SEEK_SET);
+  lseek(fileDescriptor, position, SEEK_SET);
 
   // Write the index depth
-  int dataWrote = write(fileDescriptor, 
-			&_indexDepth, 
-			sizeof(_indexDepth));
-  if ( dataWrote != sizeof(_indexDepth) ){
+  int depth = _indexDepth;
+  int dataWrote = write(fileDescriptor,
+			&depth,
+			sizeof(depth));
+  if ( dataWrote != sizeof(depth) ){
     return false;
   }
 
-  // Write the index
-  dataWrote = write(fileDescriptor, 
-		    _indexPointer, 
-		    (sizeof(int) * GetNumberOfAddresses()) 
-		    );
-  if ( static_cast<size_t>(dataWrote) != (sizeof(int) * GetNumberOfAddresses()) ){
-    return false;
+  // Write the index, with every slot's address, whether it is filled in or not
+  int chunk[WRITECHUNK];
+  int numOfAddresses = GetNumberOfAddresses();
+  for (int start = 0; start < numOfAddresses; start += WRITECHUNK){
+    int count = numOfAddresses - start;
+    if (count > WRITECHUNK){
+      count = WRITECHUNK;
+    }
+    for (int i = 0; i < count; i++){
+      chunk[i] = GetAddress(start + i);
+    }
+    dataWrote = write(fileDescriptor, chunk, (sizeof(int) * count));
+    if ( static_cast<size_t>(dataWrote) != (sizeof(int) * count) ){
+      return false;
+    }
   }
   return true;
 
 }
 
+/*
+=========================================================================================
+Name     | Attach
+Purpose  | Set the index up from an array of slots, as a loaded index would be
+Notes    | The slots are stored level after level already, so when inPlace each level
+         | simply points into the array, and nothing is read until a lookup needs it.
+         | Attached levels are never freed, the caller unmaps or frees them after the
+         | holder is gone. Slots written by SetAddress are written into the array, so it
+         | must be writable, if only as a private mapping.
+=========================================================================================
+*/
+bool
+IndexHolder::
+Attach(int* slots,
+       int depth,
+       bool inPlace
+       )
+{
+  if ( (slots == nullptr) || (depth < 1) || (depth > NUMBITS - 2) ){
+    return false;
+  }
+  FreeLevels();
+  if (inPlace){
+    _attachedBegin = slots;
+    _attachedEnd = slots + (1 << depth);
+  }
+  for (int level = 0; level <= depth; level++){
+    int size = (level == 0) ? 1 : LevelStart(level);
+    int* levelSlots = slots + LevelStart(level);
+    if (!inPlace){
+      int* copy = CreateLevel(level);
+      memcpy(copy, levelSlots, sizeof(int) * size);
+      levelSlots = copy;
+    }
+    _levels[level] = levelSlots;
+  }
+  // Every slot is filled in
+  _fillLevel = depth + 1;
+  _fillOffset = 0;
+  _indexDepth = depth;
+  return true;
+}
+
 /*
 =========================================================================================
 Name     | IncreaseDepth
-Purpose  | Increase the bit depth of the index by 1, and copy all the old pointer values
-         | into the new index.
+Purpose  | Increase the bit depth of the index by 1. The new slots all defer to the old
+         | ones until they are filled in.
 Notes    | Assuming the original index has a pointer at the index xxx. In the new index
          | both indexes 0xxx and 1xxx get assigned with the same pointer as xxx.
+         | Rather than copying every pointer now, a new level is added for the 1xxx
+         | slots, all of them zero, which GetAddress takes to mean "use 0xxx". Nothing
+         | is copied, and calloc hands large levels out as untouched zero pages, so the
+         | cost does not grow with the size of the index. CopyMirrors fills the slots
+         | in later, a few at a time.
+         | The new level is published before the new depth, so a reader that sees the
+         | new depth also finds the level.
 =========================================================================================
 */
-void 
+void
 IndexHolder::
 IncreaseDepth()
 {
-  if (_indexPointer == nullptr){
+  if (_levels[0] == nullptr){
     return;
   }
 
@@ -146,63 +232,39 @@ IncreaseDepth()
 
   // Calculate new depth
   int newDepth = _indexDepth + 1;
-  // New number of addresses is 2 times the old number
-  int oldNumOfAddresses = GetNumberOfAddresses();
-  int newNumOfAddresses = 2 * oldNumOfAddresses;
 
-  // Allocate memory for new index
-  int* tempIndex = CreateIndex(newNumOfAddresses);
-  int extraBit = 1 << _indexDepth;
-  // Copy old pointer values into the new index
-  for (int i = 0; i < oldNumOfAddresses; i++){
-    // Assign the 0xxx pointer
-    tempIndex[i] = _indexPointer[i];
-    // Assign the 1xxx pointer                          
-    tempIndex[extraBit | i] = _indexPointer[i];            
-  }
+  // A level left behind by DecreaseDepth is out of date, and a reader may still use it
+  RetireIndex(_levels[newDepth]);
+  _levels[newDepth] = CreateLevel(newDepth);
 
   // Update depth
   _indexDepth = newDepth;
-  // The new index is assigned
-  delete[] _indexPointer;
-  _indexPointer = tempIndex;
 }
 
 /*
 =========================================================================================
 Name     | DecreaseDepth
-Purpose  | Decrease the bit depth of the index by 1, and copy all the old pointer values
-         | into the new index.
+Purpose  | Decrease the bit depth of the index by 1, if every pair of buddies agree.
 Notes    | If a decrease is possible then it must hold that the values in the first half
          | of the index match those values in the second half of the index (in the exact
-         | same order). Thus when the index size is decreased we have to simply copy one
-         | half of the old index into the new one.
+         | same order). Thus the levels below the top one already are the smaller index,
+         | and only the depth needs to change. The top level is kept until the next
+         | IncreaseDepth, so a lock-free reader that read the old depth still finds it.
 =========================================================================================
 */
-bool 
+bool
 IndexHolder::
 DecreaseDepth()
 {
   if ( DepthDecreasePossible() ){
-    // Calculate new depth
-    int newDepth = _indexDepth - 1 ;
-    // New number of addresses is half of the old number
-    int oldNumOfAddresses = GetNumberOfAddresses();
-    int newNumOfAddresses = oldNumOfAddresses / 2;
-    // And allocate memory for new index
-    int* tempIndex = CreateIndex(newNumOfAddresses);
-    
-    // Copy the old pointer values back into the smaller index
-    for (int i = 0; i < newNumOfAddresses; i++){
-      // Assign the xxx pointer
-      tempIndex[i] = _indexPointer[i];
-    }
+    int oldDepth = _indexDepth;
     // Update depth
-    _indexDepth = newDepth;
-    // The new index is assigned
-    delete[] _indexPointer;
-    _indexPointer = tempIndex;
-    
+    _indexDepth = oldDepth - 1;
+    // Any filling in still to do was in the level that has gone
+    if (_fillLevel >= oldDepth){
+      _fillLevel = oldDepth;
+      _fillOffset = 0;
+    }
     return true;
   } else {
     // Depth decrease not possible
@@ -214,67 +276,227 @@ DecreaseDepth()
 =========================================================================================
 Name     | SetAddress
 Purpose  | Set an address of an index value
+Notes    | Slots above this one which still defer to it must keep the address they see
+         | now, so they are filled in with it first. Those are the slots that differ
+         | from this one by a single higher bit, in a level not yet filled in, so at
+         | most one per level is touched.
 =========================================================================================
 */
-void 
+void
 IndexHolder::
-SetAddress(int index,                                   // Index whose address to set 
+SetAddress(int index,                                   // Index whose address to set
 	   int address                                  // The address value to be given
 	   )
 {
-  if (_indexPointer == nullptr){
+  if (_levels[0] == nullptr){
     return;
   }
 
   if ( (index >= 0) && (index < GetNumberOfAddresses()) ){
-    _indexPointer[index] = address;
-  } 
+    int depth = _indexDepth;
+    int firstBit = LevelOf(index);
+    if (firstBit < _fillLevel - 1){
+      firstBit = _fillLevel - 1;
+    }
+    if (firstBit < depth){
+      int current = GetAddress(index) + 1;
+      for (int bit = firstBit; bit < depth; bit++){
+	int child = index | (1 << bit);
+	int* childSlot = &_levels[bit + 1].load(std::memory_order_relaxed)[child - (1 << bit)];
+	if (*childSlot == 0){
+	  *childSlot = current;
+	}
+      }
+    }
+    int level = LevelOf(index);
+    _levels[level].load(std::memory_order_relaxed)[index - LevelStart(level)] = address + 1;
+  }
+}
+
+/*
+=========================================================================================
+Name     | SplitAddress
+Purpose  | Point the index values of the "new" half of a split bucket at the new bucket
+Notes    | See ExtendibleHashFile::AccomodateRecord for how the index values are found.
+         | Use i as a counter for the upper bits. Say i = 5 = 00000000 00000101
+         | Move it along to be    00000010 10000000
+         | Or in another 1        00000010 11000000
+         | Or in the bucketValue  00000010 11001000
+=========================================================================================
+*/
+void
+IndexHolder::
+SplitAddress(int bucketValue,                           // Bit pattern held by the bucket
+	     int bucketDepth,                           // Depth of the bucket before split
+	     int newAddress                             // Address of the new bucket
+	     )
+{
+  // Determine the number of bits of the index address that are not required in
+  // distinguishing between the new bucket and the old bucket
+  int unUsedBits = ( GetDepth() - (bucketDepth + 1) );
+  int loopLimit = 1 << unUsedBits;                      // Get 2 ** unUsedBits
+
+  for (int i = 0; i < loopLimit; ++i){
+    int tempAddress = i << (bucketDepth+1);             // Get the upper bit pattern
+    tempAddress |= (1 << bucketDepth);                  // Get the extra one
+    tempAddress |= bucketValue;                         // Or in the bucket Value
+    SetAddress(tempAddress, newAddress);
+  }
+}
+
+/*
+=========================================================================================
+Name     | MoveAddress
+Purpose  | Point every index value ending in the bucketDepth bits of bucketValue at
+         | newAddress, there being 2^(depth - bucketDepth) of them
+=========================================================================================
+*/
+void
+IndexHolder::
+MoveAddress(int bucketValue,                            // Bit pattern held by the bucket
+	    int bucketDepth,                            // Depth of the bucket
+	    int newAddress                              // Where the bucket is now
+	    )
+{
+  int loopLimit = 1 << ( GetDepth() - bucketDepth );
+  for (int i = 0; i < loopLimit; ++i){
+    SetAddress((i << bucketDepth) | bucketValue, newAddress);
+  }
 }
 
 /*
 =========================================================================================
 Name     | GetAddress
 Purpose  | Return the address for a given index
-Returns  | The address for the given index, 
+Returns  | The address for the given index,
          | or -1 if the index value is out of range, or doesn't even exist
+Notes    | A slot not yet filled in holds zero, and the slot's buddy is used instead,
+         | repeatedly if need be. Slot 0 is always filled in.
 =========================================================================================
 */
 int                                                     // The address at the index
-IndexHolder:: 
+IndexHolder::
 GetAddress(int index                                    // Index whose address to return
 	   )
 {
+  // The depth is read before the levels, see IncreaseDepth
   if ( (index >= 0) && (index < GetNumberOfAddresses()) ){
-    if (_indexPointer != nullptr) {
-      return _indexPointer[index];
+    if (_levels[0].load(std::memory_order_relaxed) == nullptr){
+      return -1;
+    }
+    for (;;){
+      int level = LevelOf(index);
+      int start = LevelStart(level);
+      int slot = _levels[level].load(std::memory_order_relaxed)[index - start];
+      if ( (slot != 0) || (level == 0) ){
+	return slot - 1;
+      }
+      index -= start;
     }
   }
   return -1;
 }
 
+void
+IndexHolder::
+Prefetch(int index
+	 )
+{
+  if ( (index >= 0) && (index < GetNumberOfAddresses()) ){
+    int level = LevelOf(index);
+    int* slots = _levels[level].load(std::memory_order_relaxed);
+    if (slots != nullptr){
+      __builtin_prefetch(&slots[index - LevelStart(level)]);
+    }
+  }
+}
+
+/*
+=========================================================================================
+Name     | CopyMirrors
+Purpose  | Fill in up to count slots that still defer to their buddy
+Returns  | The number of slots visited, 0 once everything is filled in
+Notes    | Slots are filled in level by level, oldest doubling first, so the buddy of
+         | the slot being filled in is always filled in already. The address a slot
+         | resolves to never changes here, so lock-free readers need not be told.
+=========================================================================================
+*/
+int
+IndexHolder::
+CopyMirrors(int count
+	    )
+{
+  int depth = _indexDepth;
+  int visited = 0;
+  while ( (visited < count) && (_fillLevel <= depth) ){
+    int* slots = _levels[_fillLevel].load(std::memory_order_relaxed);
+    if (slots[_fillOffset] == 0){
+      slots[_fillOffset] = GetAddress(_fillOffset) + 1;
+    }
+    visited++;
+    _fillOffset++;
+    if (_fillOffset == LevelStart(_fillLevel)){
+      _fillLevel++;
+      _fillOffset = 0;
+    }
+  }
+  return visited;
+}
+
+int
+IndexHolder::
+MirrorsPending()
+{
+  int depth = _indexDepth;
+  int pending = 0;
+  for (int level = _fillLevel; level <= depth; level++){
+    pending += LevelStart(level);
+  }
+  if (_fillLevel <= depth){
+    pending -= _fillOffset;
+  }
+  return pending;
+}
+
+long
+IndexHolder::
+MemoryUsage()
+{
+  long bytes = sizeof(*this);
+  int depth = _indexDepth;
+  for (int level = 0; level <= depth; level++){
+    if (_levels[level] != nullptr){
+      bytes += sizeof(int) * ((level == 0) ? 1 : static_cast<long>(LevelStart(level)));
+    }
+  }
+  return bytes;
+}
+
 void
 IndexHolder::
 Print()
 {
-  if (_indexPointer == nullptr){
+  if (_levels[0] == nullptr){
     return;
   }
-  char posString[_indexDepth + 1];                      // Get integers in binary string
+  int depth = _indexDepth;
+  char posString[depth + 1];                            // Get integers in binary string
   for (int i = 0; i < GetNumberOfAddresses(); i++){
-    if (IntInBinary(i, _indexDepth, posString)){
-      std::cout << posString << "->" << _indexPointer[i] << std::endl << std::flush;
+    if (IntInBinary(i, depth, posString)){
+      std::cout << posString << "->" << GetAddress(i) << std::endl << std::flush;
     } else {
       std::cout << "IntInBinary error..." << std::endl << std::flush;
     }
   }
 }
 
-int 
+int
 IndexHolder::
 GetNumberOfAddresses()
 {
   int result = 1;
-  for (int i = 0; i < _indexDepth; i++){
+  int depth = _indexDepth;
+  for (int i = 0; i < depth; i++){
     result = result * 2;
   }
   return result;
@@ -293,25 +515,96 @@ GetDepth()
 
 /*
 =========================================================================================
-Name    | CreateIndex
-Purpose | Creates an index with the specified number of addresses
-Returns | A pointer to the new index
+Name     | LevelOf / LevelStart
+Purpose  | The level holding a slot (one more than its highest set bit, 0 for slot 0),
+         | and the first slot held by a level. A level L above 0 holds LevelStart(L)
+         | slots.
+=========================================================================================
+*/
+int
+IndexHolder::
+LevelOf(int index
+	)
+{
+  return (index == 0) ? 0 : (NUMBITS - __builtin_clz(static_cast<unsigned>(index)));
+}
+
+int
+IndexHolder::
+LevelStart(int level
+	   )
+{
+  return (level == 0) ? 0 : (1 << (level - 1));
+}
+
+/*
+=========================================================================================
+Name     | RetireIndex
+Purpose  | Keep a replaced level alive until the holder is destroyed or reloaded
+=========================================================================================
+*/
+void
+IndexHolder::
+RetireIndex(int* oldIndex
+	    )
+{
+  if (oldIndex != nullptr){
+    _retiredIndexes.push_back(oldIndex);
+  }
+}
+
+/*
+=========================================================================================
+Name     | FreeLevels
+Purpose  | Free every level, current or retired, apart from attached ones
+=========================================================================================
+*/
+void
+IndexHolder::
+FreeLevels()
+{
+  for (int level = 0; level <= NUMBITS; level++){
+    if (!IsAttached(_levels[level])){
+      free(_levels[level]);
+    }
+    _levels[level] = nullptr;
+  }
+  for (int* retired : _retiredIndexes) {
+    if (!IsAttached(retired)){
+      free(retired);
+    }
+  }
+  _retiredIndexes.clear();
+  _attachedBegin = nullptr;
+  _attachedEnd = nullptr;
+}
+
+bool
+IndexHolder::
+IsAttached(int* level
+	   )
+{
+  return (level >= _attachedBegin) && (level < _attachedEnd);
+}
+
+/*
+=========================================================================================
+Name    | CreateLevel
+Purpose | Creates the slots of one level of the index, none of them filled in
+Returns | A pointer to the new level
 =========================================================================================
 */
 int*
 IndexHolder::
-CreateIndex(int numOfAddresses
+CreateLevel(int level
 	    )
 {
-  // BUGGY here (std:bad_alloc)
-  // Allocate memory for new addresses
-  int* tempIndex = new int[numOfAddresses];
-  
-  // Point each element to the zeroth address
-  for (int i = 0; i < numOfAddresses; i++){
-    tempIndex[i] = 0;
-  }
-  return tempIndex;
+  size_t size = (level == 0) ? 1 : (static_cast<size_t>(1) << (level - 1));
+  int* slots = static_cast<int*>( calloc(size, sizeof(int)) );
+  if (slots == nullptr){
+    throw std::bad_alloc();
+  }
+  return slots;
 }
 
 /*
@@ -324,22 +617,24 @@ Notes    | The index size can be decreased iff each pair of buddies has the same
          | 00 & 10, 01 & 11
          | This is because other than their leftmost bit, the bit patterns are the
          | same. (ie, 00 & 10 both end in 0, and 01 & 11 both end in 1)
+         | A slot not yet filled in has its buddy's value by definition.
 =========================================================================================
 */
 bool
 IndexHolder::
 DepthDecreasePossible()
 {
-  if ( !(_indexDepth > 1) ){
+  int depth = _indexDepth;
+  if ( !(depth > 1) ){
     return false;
   }
   int halfway = GetNumberOfAddresses() / 2;
-  int topBit = 1 << (_indexDepth - 1);
+  int* topLevel = _levels[depth];
   // Check that all the buddies are pointing at the same thing
   for (int i = 0; i < halfway; i++){
-    if (_indexPointer[topBit | i] != _indexPointer[i]){
+    if ( (topLevel[i] != 0) && (topLevel[i] - 1 != GetAddress(i)) ){
       return false;
-    } 
+    }
   }
   return true;
 }
@@ -2,7 +2,16 @@
 =========================================================================================
 =========================================================================================
 */
-class IndexHolder
+#ifndef _InDeXhOlDeR__
+#define _InDeXhOlDeR__
+
+#include <atomic>
+#include <vector>
+
+#include "bit_op_lib.h"
+#include "extendibleindex.h"
+
+class IndexHolder : public ExtendibleIndex
 {
 public:
 /*
@@ -17,17 +26,20 @@ IndexHolder(int initialDepth);
 /*
 Destructor
 */
-~IndexHolder();
+~IndexHolder() override;
 
-bool Load(int fileDescriptor);
-bool Write(int fileDescriptor);
+bool Load(int fileDescriptor, long position = 0) override;
+bool Write(int fileDescriptor, long position = 0) override;
+bool Attach(int* slots, int depth, bool inPlace) override;
 
 /*
 Add another bit to the index depth. This effectively doubles the size of the index.
 The bit is added on the left. The values stored in the index correspond to the old
 values, if the new bit were to be ignored.
+The new upper half starts out empty, every slot in it deferring to its buddy in the
+lower half, so doubling costs the same at any depth. CopyMirrors fills it in later.
 */
-void IncreaseDepth();
+void IncreaseDepth() override;
 
 /*
 Tests to see if the index can be shrunk. The index can be shrunk iff for all the 
@@ -36,23 +48,73 @@ is removed from the left, effectively halfing the index size
 */
 bool DecreaseDepth();
 
-int GetDepth();
+int GetDepth() override;
 
-int GetNumberOfAddresses();
+int GetNumberOfAddresses() override;
 
 void Print();
 
 void SetAddress(int index, int address);
 
-int GetAddress(int index);
+int GetAddress(int index) override;
+
+// Prefetch the slot of index. A slot that defers to its buddy still costs a miss.
+void Prefetch(int index) override;
+
+/*
+Point every index value ending in a 1 bit followed by the bucketDepth bits of
+bucketValue at newAddress. There are 2^(depth - bucketDepth - 1) of them.
+*/
+void SplitAddress(int bucketValue, int bucketDepth, int newAddress) override;
+
+void MoveAddress(int bucketValue, int bucketDepth, int newAddress) override;
+
+/*
+Copy up to count buddy values into slots that still defer to their buddy, oldest
+doubling first. Returns how many slots were visited. This is the deferred part of
+IncreaseDepth, meant to be called a little at a time.
+*/
+int CopyMirrors(int count) override;
+
+/*
+The number of slots that may still defer to their buddy
+*/
+int MirrorsPending();
+
+long MemoryUsage() override;
 
 private:
 
 bool DepthDecreasePossible();
-int* CreateIndex(int numOfAddresses);    
+int* CreateLevel(int level);
+
+int LevelOf(int index);
+int LevelStart(int level);
+
+void RetireIndex(int* oldIndex);
+void FreeLevels();
+bool IsAttached(int* level);
 
 // data members
-int  _indexDepth;
-int* _indexPointer;
+// The index is kept as one array per level. Level 0 holds slot 0, and level L holds
+// the slots whose highest set bit is bit L-1, so doubling the index just adds a level
+// and no slot ever moves. A slot holds its address plus one. Zero means the slot has
+// not been filled in since the doubling that created it, and its buddy (the slot with
+// the highest bit cleared) is to be used instead.
+// The depth is atomic and stored after the level it brings in, so that lock-free
+// readers always find every level the depth they read calls for.
+std::atomic<int>  _indexDepth;
+std::atomic<int*> _levels[NUMBITS + 1];
+// Every slot below this level/offset has been filled in by CopyMirrors
+int _fillLevel;
+int _fillOffset;
+// Levels dropped by DecreaseDepth. They are kept until the holder is destroyed or
+// reloaded, because an optimistic reader may still be using one.
+std::vector<int*> _retiredIndexes;
+// The array given to Attach when used in place, whose levels are not ours to free
+int* _attachedBegin;
+int* _attachedEnd;
 
 };
+
+#endif
@@ -0,0 +1,167 @@
+/*
+=========================================================================================
+Name	 | MemoryBucketStore
+Purpose	 | Buckets kept in an arena in memory, see memorybucketstore.h
+=========================================================================================
+*/
+
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+// For file system methods and constants
+#include <unistd.h>
+
+#include "memorybucketstore.h"
+#include "bit_op_lib.h"
+#include "ehfconsts.h"
+#include "records.h"
+
+/*
+=========================================================================================
+Name	 | MemoryBucketStore constructor / destructor
+=========================================================================================
+*/
+MemoryBucketStore::
+MemoryBucketStore()
+{
+  for (std::atomic<char*>& chunk : _chunks){
+    chunk.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+MemoryBucketStore::
+~MemoryBucketStore()
+{
+  for (std::atomic<char*>& chunk : _chunks){
+    delete[] chunk.load(std::memory_order_relaxed);
+  }
+}
+
+int
+MemoryBucketStore::
+Read(int page,
+     void* bucket,
+     int bytes
+     )
+{
+  char* memory = PageMemory(page, false);
+  if (memory == nullptr){
+    return EHF_READERROR;
+  }
+  std::memcpy(bucket, memory, bytes);
+  return EHF_READOK;
+}
+
+int
+MemoryBucketStore::
+Write(int page,
+      const void* bucket,
+      int bytes
+      )
+{
+  char* memory = PageMemory(page, true);
+  if ( (memory == nullptr) || (bytes > BUCKETSIZE) ){
+    return EHF_WRITEERROR;
+  }
+  std::memcpy(memory, bucket, bytes);
+  std::memset(memory + bytes, 0, BUCKETSIZE - bytes);
+  return EHF_WROTEOK;
+}
+
+/*
+=========================================================================================
+Name	 | WriteTo
+Purpose	 | Write the first pages pages out to a file, a chunk at a time
+=========================================================================================
+*/
+bool
+MemoryBucketStore::
+WriteTo(int fileDescriptor,
+	long firstPosition,
+	int pages
+	)
+{
+  std::vector<char> zeroes;
+  int first = 0;
+  for (int k = 0; (k < MEMORYCHUNKS) && (first < pages); k++){
+    int chunkPages = MEMORYFIRSTCHUNK << k;
+    int count = std::min(chunkPages, pages - first);
+    size_t bytes = static_cast<size_t>(count) * BUCKETSIZE;
+    const char* chunk = _chunks[k].load(std::memory_order_acquire);
+    if (chunk == nullptr){
+      zeroes.resize(bytes);
+      chunk = zeroes.data();
+    }
+    long position = firstPosition + static_cast<long>(first) * BUCKETSIZE;
+    size_t written = 0;
+    while (written < bytes){
+      ssize_t wrote = pwrite(fileDescriptor, chunk + written, bytes - written,
+			     position + written);
+      if (wrote <= 0){
+	return false;
+      }
+      written += wrote;
+    }
+    first += chunkPages;
+  }
+  return true;
+}
+
+const char*
+MemoryBucketStore::
+InPlace(int page
+	)
+{
+  return PageMemory(page, false);
+}
+
+int
+MemoryBucketStore::
+Pages()
+{
+  for (int k = MEMORYCHUNKS - 1; k >= 0; k--){
+    if (_chunks[k].load(std::memory_order_acquire) != nullptr){
+      // Pages before chunk k, then those in it, without overflowing for the last one
+      return (MEMORYFIRSTCHUNK << k) - MEMORYFIRSTCHUNK + (MEMORYFIRSTCHUNK << k);
+    }
+  }
+  return 0;
+}
+
+/*
+=========================================================================================
+Name	 | PageMemory
+Purpose	 | Find the memory of a page
+Notes	 | Counting from MEMORYFIRSTCHUNK, the pages before chunk k number
+	 | (MEMORYFIRSTCHUNK << k) - MEMORYFIRSTCHUNK, so the highest set bit of
+	 | page + MEMORYFIRSTCHUNK gives the chunk, and the bits below it the page within.
+=========================================================================================
+*/
+char*
+MemoryBucketStore::
+PageMemory(int page,
+	   bool allocate
+	   )
+{
+  if (page < 0){
+    return nullptr;
+  }
+  unsigned position = static_cast<unsigned>(page) + MEMORYFIRSTCHUNK;
+  int highBit = (NUMBITS - 1) - __builtin_clz(position);
+  int k = highBit - MEMORYFIRSTCHUNKBITS;
+  if (k >= MEMORYCHUNKS){
+    return nullptr;
+  }
+  size_t withinChunk = position - (1u << highBit);
+  char* chunk = _chunks[k].load(std::memory_order_acquire);
+  if ( (chunk == nullptr) && allocate ){
+    chunk = new char[static_cast<size_t>(MEMORYFIRSTCHUNK << k) * BUCKETSIZE]();
+    _chunks[k].store(chunk, std::memory_order_release);
+  }
+  if (chunk == nullptr){
+    return nullptr;
+  }
+  return chunk + withinChunk * BUCKETSIZE;
+}
@@ -0,0 +1,87 @@
+/*
+=========================================================================================
+Name    | MemoryBucketStore                                                             |
+Purpose | Keep the buckets of a table in memory, with no file behind them               |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | Read                | Copy a bucket out of its page                           |
+        | Write               | Copy a bucket into its page, making room if need be     |
+        | WriteTo             | Write pages out to a file, in as few writes as can be   |
+        | InPlace             | The memory of a page, to read without copying it        |
+        | Pages               | Pages up to the end of the last chunk allocated         |
+----------------------------------------------------------------------------------------|
+Notes   | Pages are BUCKETSIZE bytes, held in an arena of chunks that double in size:   |
+        | chunk k holds MEMORYFIRSTCHUNK << k pages, so that a small table takes little |
+        | memory and a large one few chunks. A chunk is never moved or freed while the  |
+        | store is in use, and chunk pointers are published with release ordering, so  |
+        | readers need no latch while the single writer adds chunks.                    |
+        | Pages are contiguous within a chunk, laid out just as they are in a container |
+        | of BUCKETSIZE pages, so a chunk goes to the file in one write.                |
+=========================================================================================
+*/
+#ifndef _MeMoRyBuCkEtStOrE__
+#define _MeMoRyBuCkEtStOrE__
+
+#include <atomic>
+
+#include "bucketstore.h"
+
+// Pages in the first chunk of the arena, as a power of two
+const int MEMORYFIRSTCHUNKBITS = 6;
+const int MEMORYFIRSTCHUNK = 1 << MEMORYFIRSTCHUNKBITS;
+// Chunks in the arena, enough for all but the last MEMORYFIRSTCHUNK page numbers an
+// int can hold
+const int MEMORYCHUNKS = 31 - MEMORYFIRSTCHUNKBITS;
+
+class MemoryBucketStore : public BucketStore{
+ public:
+  MemoryBucketStore();
+  ~MemoryBucketStore();
+
+  int
+  Read(int page,
+       void* bucket,
+       int bytes
+       ) override;
+
+  int
+  Write(int page,
+	const void* bucket,
+	int bytes
+	) override;
+
+  // Write pages [0, pages) to fileDescriptor, page n at firstPosition + n * BUCKETSIZE.
+  // Pages never written go out as zeroes. False if a write failed.
+  bool
+  WriteTo(int fileDescriptor,
+	  long firstPosition,
+	  int pages
+	  );
+
+  // The BUCKETSIZE bytes of page where they lie, or nullptr if it has never been
+  // written. A write to the page may change them at any time.
+  const char*
+  InPlace(int page
+	  );
+
+  // Pages up to the end of the last chunk allocated so far, whether or not the chunks
+  // before it are
+  int
+  Pages();
+
+ private:
+  MemoryBucketStore(const MemoryBucketStore&) = delete;
+  MemoryBucketStore& operator=(const MemoryBucketStore&) = delete;
+
+  // Memory of page, or nullptr if its chunk has not been allocated. With allocate,
+  // the chunk is allocated if need be; only the writer may ask for that.
+  char*
+  PageMemory(int page,
+	     bool allocate
+	     );
+
+  std::atomic<char*> _chunks[MEMORYCHUNKS];
+};
+
+#endif
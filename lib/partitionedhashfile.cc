@@ -0,0 +1,291 @@
+/*
+=========================================================================================
+Name	 | PartitionedHashFile
+Purpose	 | Shared-nothing, thread per core table built from ExtendibleHashFiles
+=========================================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "hash.h"
+#include "partitionedhashfile.h"
+
+// Empty polls of its queues before a worker gives up the rest of its time slice
+const int WORKERSPINS = 64;
+
+/*
+=========================================================================================
+Name	 | PartitionedHashFile constructor
+Purpose	 | Set up the partitions and the request queues. Nothing is opened until Open.
+=========================================================================================
+*/
+PartitionedHashFile::
+PartitionedHashFile(int partitions,
+		    int clients
+		    )
+{
+  _partitions = (partitions >= 1) ? partitions : 1;
+  _clients = (clients >= 1) ? clients : 1;
+  _open = false;
+  _running = false;
+  _files = new ExtendibleHashFile[_partitions];
+  _queues = new SPSCQueue<PartitionRequest*>[_partitions * _clients];
+  _workers = new std::thread[_partitions];
+}
+
+/*
+=========================================================================================
+Name	 | PartitionedHashFile destructor
+=========================================================================================
+*/
+PartitionedHashFile::
+~PartitionedHashFile()
+{
+  Close();
+  delete[] _workers;
+  delete[] _queues;
+  delete[] _files;
+}
+
+/*
+=========================================================================================
+Name	 | Open
+Purpose	 | Open (or create) the file of every partition, and start one worker per
+	 | partition, each pinned to its own core where the system allows it.
+Returns	 | True if every partition was opened
+=========================================================================================
+*/
+bool
+PartitionedHashFile::
+Open(char* fileName,
+     bool openExisting
+     )
+{
+  Close();
+
+  int strLength = strlen(fileName) + 16;
+  char partitionFileName[strLength];
+  for (int p = 0; p < _partitions; p++){
+    snprintf(partitionFileName, strLength, "%s.p%d", fileName, p);
+    if (!_files[p].Open(partitionFileName, openExisting)){
+      for (int opened = 0; opened < p; opened++){
+	_files[opened].Close();
+      }
+      return false;
+    }
+  }
+
+  _running = true;
+  unsigned cores = std::thread::hardware_concurrency();
+  for (int p = 0; p < _partitions; p++){
+    _workers[p] = std::thread(&PartitionedHashFile::Worker, this, p);
+    if (cores > 0){
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(p % cores, &cpus);
+      // Not being pinned costs locality only, so a failure here is ignored
+      pthread_setaffinity_np(_workers[p].native_handle(), sizeof(cpus), &cpus);
+    }
+  }
+  _open = true;
+  return true;
+}
+
+bool
+PartitionedHashFile::
+IsOpen()
+{
+  return _open;
+}
+
+/*
+=========================================================================================
+Name	 | Close
+Purpose	 | Stop the workers, once they have finished any queued requests, and close the
+	 | partitions.
+=========================================================================================
+*/
+void
+PartitionedHashFile::
+Close()
+{
+  if (!_open){
+    return;
+  }
+  _running = false;
+  for (int p = 0; p < _partitions; p++){
+    _workers[p].join();
+    _files[p].Close();
+  }
+  _open = false;
+}
+
+/*
+=========================================================================================
+Name	 | Submit
+Purpose	 | Hand a request over to the worker of the partition owning its key. The caller
+	 | then polls request->done, or calls one of the waiting methods instead.
+Returns	 | True if queued, false if the queue is full (or the table is not open)
+=========================================================================================
+*/
+bool
+PartitionedHashFile::
+Submit(int client,
+       PartitionRequest* request
+       )
+{
+  if (!_open || (client < 0) || (client >= _clients)){
+    return false;
+  }
+  request->done.store(false, std::memory_order_relaxed);
+  return Queue(client, Partition(request->key)).Push(request);
+}
+
+int
+PartitionedHashFile::
+InsertRecord(int client,
+	     char* keyToAdd,
+	     char* recordToAdd
+	     )
+{
+  PartitionRequest request;
+  request.op = PARTITION_INSERT;
+  request.key = keyToAdd;
+  request.record = recordToAdd;
+  return Wait(client, &request);
+}
+
+int
+PartitionedHashFile::
+RetrieveRecord(int client,
+	       char* keyToFind,
+	       char* returnRecord
+	       )
+{
+  PartitionRequest request;
+  request.op = PARTITION_RETRIEVE;
+  request.key = keyToFind;
+  request.record = returnRecord;
+  return Wait(client, &request);
+}
+
+/*
+=========================================================================================
+Name	 | Partition
+Purpose	 | Return the partition owning a key
+Notes	 | Each partition's index already uses the low bits of the hash value, so the
+	 | hash is scrambled by a multiplicative (Fibonacci) hash and its high bits are
+	 | scaled onto the partitions. That keeps both choices independent of each other.
+=========================================================================================
+*/
+int
+PartitionedHashFile::
+Partition(char* key
+	  )
+{
+  char hashKey[IDSIZE+1];
+  *((char *) mempcpy(hashKey, key, IDSIZE)) = '\0';
+  unsigned int mixed = static_cast<unsigned int>(Hash(hashKey)) * 2654435761u;
+  return static_cast<int>( (static_cast<unsigned long long>(mixed) * _partitions) >> 32 );
+}
+
+int
+PartitionedHashFile::
+NumberOfPartitions()
+{
+  return _partitions;
+}
+
+/*
+  Private member functions
+*/
+
+/*
+=========================================================================================
+Name	 | Worker
+Purpose	 | The loop run by the thread owning a partition. It polls the queue of every
+	 | client, and yields only after finding them all empty many times in a row.
+=========================================================================================
+*/
+void
+PartitionedHashFile::
+Worker(int partition
+       )
+{
+  int idlePolls = 0;
+  bool running = true;
+  while (running){
+    // Read the flag before polling, so requests queued before Close are still served
+    running = _running.load(std::memory_order_acquire);
+    bool served = false;
+    for (int client = 0; client < _clients; client++){
+      PartitionRequest* request;
+      while (Queue(client, partition).Pop(request)){
+	request->result = Execute(partition, request);
+	request->done.store(true, std::memory_order_release);
+	served = true;
+      }
+    }
+    if (served){
+      idlePolls = 0;
+    } else if (++idlePolls >= WORKERSPINS){
+      std::this_thread::yield();
+      idlePolls = 0;
+    }
+  }
+}
+
+int
+PartitionedHashFile::
+Execute(int partition,
+	PartitionRequest* request
+	)
+{
+  switch (request->op){
+  case PARTITION_INSERT:
+    return _files[partition].InsertRecord(request->key, request->record);
+  case PARTITION_RETRIEVE:
+    return _files[partition].RetrieveRecord(request->key, request->record);
+  default:
+    return -1;
+  }
+}
+
+/*
+=========================================================================================
+Name	 | Wait
+Purpose	 | Submit a request as client and wait for its result
+=========================================================================================
+*/
+int
+PartitionedHashFile::
+Wait(int client,
+     PartitionRequest* request
+     )
+{
+  if (!_open){
+    return EHF_FILENOTOPEN;
+  }
+  while (!Submit(client, request)){
+    std::this_thread::yield();
+  }
+  while (!request->done.load(std::memory_order_acquire)){
+    std::this_thread::yield();
+  }
+  return request->result;
+}
+
+SPSCQueue<PartitionRequest*>&
+PartitionedHashFile::
+Queue(int client,
+      int partition
+      )
+{
+  return _queues[partition * _clients + client];
+}
@@ -0,0 +1,122 @@
+/*
+=========================================================================================
+Name    | Partitioned Hash File                                                         |
+Purpose | Shared-nothing table made of one ExtendibleHashFile per core                  |
+----------------------------------------------------------------------------------------|
+Methods | Name                | Functionality                                           |
+----------------------------------------------------------------------------------------|
+        | PartitionedHashFile | Constructor, given the partition and client counts      |
+        | Open                | Open or create every partition and start their workers  |
+        | Close               | Stop the workers and close every partition              |
+        | Submit              | Queue a request to the partition that owns its key      |
+        | InsertRecord        | Insert a record and wait for the result                 |
+        | RetrieveRecord      | Retrieve a record and wait for the result               |
+        | Partition           | Return the partition that owns a key                    |
+----------------------------------------------------------------------------------------|
+Notes   | Each partition owns the keys whose hash maps onto it, and has its own files,  |
+        | index and a worker thread pinned to one core. Only that worker ever touches   |
+        | the partition. Clients hand requests over through one lock-free single        |
+        | producer / single consumer queue per (client, partition) pair, so on the hot  |
+        | path no two cores write the same cache line except to pass a request over and |
+        | to complete it. Each client number must be used by one thread at a time.      |
+        | Partition p of table "name" is kept as the file name.p<p>.eh, so a table must |
+        | always be opened with the partition count it was created with.                |
+=========================================================================================
+*/
+#ifndef _PaRtItIoNeDhAsHfIlE__
+#define _PaRtItIoNeDhAsHfIlE__
+
+#include <atomic>
+#include <thread>
+
+#include "extendiblehashfile.h"
+#include "spscqueue.h"
+
+// Request operations
+const int PARTITION_INSERT = 1;
+const int PARTITION_RETRIEVE = 2;
+
+// A request handed to a partition worker. The caller owns it, and must keep the key
+// and record alive until done is set. result then holds the ehfconsts.h return code.
+struct PartitionRequest{
+  int op;                                            // PARTITION_INSERT or _RETRIEVE
+  char* key;                                         // Key of the record
+  char* record;                                      // Record to insert, or to fill
+  int result;                                        // Return code of the operation
+  std::atomic<bool> done;                            // Set once result is valid
+};
+
+class PartitionedHashFile{
+ public:
+  PartitionedHashFile(int partitions,                // Number of partitions (cores)
+		      int clients                    // Number of client threads
+		      );
+
+  ~PartitionedHashFile();
+
+  bool                                               // True if every partition opened
+  Open(char* fileName,                               // Filename of the table
+       bool openExisting = true                      // If the table exists
+       );
+
+  bool
+  IsOpen();
+
+  void
+  Close();
+
+  // Queue request to its partition. False if that queue is full, try again later
+  bool
+  Submit(int client,                                 // Client number of the caller
+	 PartitionRequest* request                   // Request to queue
+	 );
+
+  int                                                // Return code, see ehfconsts.h
+  InsertRecord(int client,                           // Client number of the caller
+	       char* keyToAdd,                       // Key of the record to add
+	       char* recordToAdd                     // The record to add
+	       );
+
+  int                                                // Return code, see ehfconsts.h
+  RetrieveRecord(int client,                         // Client number of the caller
+		 char* keyToFind,                    // Key of the record to search for
+		 char* returnRecord                  // Return the record if found
+		 );
+
+  int                                                // Partition owning the key
+  Partition(char* key
+	    );
+
+  int
+  NumberOfPartitions();
+
+ private:
+  void
+  Worker(int partition
+	 );
+
+  int
+  Execute(int partition,
+	  PartitionRequest* request
+	  );
+
+  int
+  Wait(int client,
+       PartitionRequest* request
+       );
+
+  SPSCQueue<PartitionRequest*>&
+  Queue(int client,
+	int partition
+	);
+
+  int _partitions;                                   // Number of partitions
+  int _clients;                                      // Number of clients
+  bool _open;                                        // True if the table is open
+  std::atomic<bool> _running;                        // Cleared to stop the workers
+  ExtendibleHashFile* _files;                        // One file per partition
+  SPSCQueue<PartitionRequest*>* _queues;             // One queue per client/partition
+  std::thread* _workers;                             // One worker per partition
+};
+
+#endif
@@ -8,6 +8,10 @@ const int TITLESIZE = 30;
 const int AUTHORSIZE = 15;
 const int CALLCODESIZE = 12;
 const int RECORDSIZE = IDSIZE + TITLESIZE + AUTHORSIZE + CALLCODESIZE;
+// where each field starts within a record, following on from IDPOSITION
+const int TITLEPOSITION = IDPOSITION + IDSIZE;
+const int AUTHORPOSITION = TITLEPOSITION + TITLESIZE;
+const int CALLCODEPOSITION = AUTHORPOSITION + AUTHORSIZE;
 
 // the number of bytes that can be read in one disk access
 const int SECTORSIZE = 1024;
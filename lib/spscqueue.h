@@ -0,0 +1,89 @@
+/*
+=========================================================================================
+Name    | SPSCQueue                                                                     |
+Purpose | Bounded lock-free queue for exactly one producer thread and one consumer      |
+----------------------------------------------------------------------------------------|
+Notes   | The producer only ever writes _tail and the consumer only ever writes _head,  |
+        | and the two live on separate cache lines, so neither side spins on a line the |
+        | other keeps dirtying. Each side keeps a private copy of the other's index and |
+        | only rereads the shared one when its copy says the queue is full or empty.    |
+=========================================================================================
+*/
+#ifndef _SpScQuEuE__
+#define _SpScQuEuE__
+
+#include <atomic>
+#include <cstddef>
+
+const int CACHELINESIZE = 64;
+
+template <typename T>
+class SPSCQueue{
+ public:
+  // capacity is rounded up to a power of two
+  explicit SPSCQueue(int capacity = 1024)
+  {
+    _capacity = 1;
+    while (_capacity < capacity){
+      _capacity *= 2;
+    }
+    _slots = new T[_capacity];
+    _head = 0;
+    _tail = 0;
+    _cachedHead = 0;
+    _cachedTail = 0;
+  }
+
+  ~SPSCQueue()
+  {
+    delete[] _slots;
+  }
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  // Producer only. False if the queue is full
+  bool
+  Push(const T& item)
+  {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cachedHead == static_cast<size_t>(_capacity)){
+      _cachedHead = _head.load(std::memory_order_acquire);
+      if (tail - _cachedHead == static_cast<size_t>(_capacity)){
+	return false;
+      }
+    }
+    _slots[tail & (_capacity - 1)] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. False if the queue is empty
+  bool
+  Pop(T& item)
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _cachedTail){
+      _cachedTail = _tail.load(std::memory_order_acquire);
+      if (head == _cachedTail){
+	return false;
+      }
+    }
+    item = _slots[head & (_capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  T* _slots;
+  int _capacity;
+  char _padding1[CACHELINESIZE];
+  std::atomic<size_t> _head;                            // Written by the consumer
+  size_t _cachedTail;                                   // Consumer's copy of _tail
+  char _padding2[CACHELINESIZE];
+  std::atomic<size_t> _tail;                            // Written by the producer
+  size_t _cachedHead;                                   // Producer's copy of _head
+  char _padding3[CACHELINESIZE];
+};
+
+#endif
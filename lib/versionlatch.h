@@ -0,0 +1,63 @@
+/*
+=========================================================================================
+Name    | VersionLatch                                                                  |
+Purpose | Version counter for optimistic (lock-free) readers                            |
+----------------------------------------------------------------------------------------|
+Notes   | A writer makes the version odd for the duration of a change, and even again   |
+        | when it is done. A reader notes the version before looking at the protected   |
+        | data, and afterwards checks that it has not moved. If it has, the reader may  |
+        | have seen a half made change and must look again. Writers must already be     |
+        | serialised amongst themselves, the latch does not exclude one writer from     |
+        | another.                                                                      |
+=========================================================================================
+*/
+#ifndef _VeRsIoNlAtCh__
+#define _VeRsIoNlAtCh__
+
+#include <atomic>
+#include <thread>
+
+class VersionLatch{
+ public:
+  VersionLatch() : _version(0) {}
+
+  // Wait for any change in progress to finish, and return the version to validate
+  unsigned
+  ReadBegin() const
+  {
+    unsigned version = _version.load(std::memory_order_acquire);
+    while (version & 1){
+      std::this_thread::yield();
+      version = _version.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+
+  // True if no change was made since ReadBegin returned version
+  bool
+  ReadValidate(unsigned version) const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ( _version.load(std::memory_order_relaxed) == version );
+  }
+
+  // Mark the start of a change
+  void
+  WriteBegin()
+  {
+    _version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  // Mark the end of a change
+  void
+  WriteEnd()
+  {
+    _version.fetch_add(1, std::memory_order_release);
+  }
+
+ private:
+  std::atomic<unsigned> _version;
+};
+
+#endif
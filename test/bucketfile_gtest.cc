@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "bucketfile.h"
+
+static const long FIRSTPOSITION = 4096;
+
+// A file of pages pages, page n filled with the byte n
+static void MakePages(char* filename, int pages) {
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ASSERT_GE(fd, 0);
+  std::vector<char> page(DIRECTALIGN);
+  for (int n = 0; n < pages; n++) {
+    memset(page.data(), n, page.size());
+    ASSERT_EQ(pwrite(fd, page.data(), page.size(), FIRSTPOSITION + n * DIRECTALIGN),
+              DIRECTALIGN);
+  }
+  close(fd);
+}
+
+TEST(BucketFileOpen, RefusesUnalignedPages) {
+  char filename[] = "bucketfile.gtest";
+  MakePages(filename, 1);
+  BucketFile file;
+  ASSERT_FALSE(file.Open(filename, FIRSTPOSITION, BUCKETSIZE, 16));
+  ASSERT_FALSE(file.Open(filename, 4, DIRECTALIGN, 16));
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 16));
+  file.Close();
+}
+
+TEST(BucketFileRead, SmallCacheKeepsAnswersRight) {
+  char filename[] = "bucketfile.gtest";
+  MakePages(filename, 100);
+  BucketFile file;
+  // One frame per shard, so most reads miss
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 1));
+  char bucket[BUCKETSIZE];
+  for (int round = 0; round < 2; round++) {
+    for (int n = 0; n < 100; n++) {
+      ASSERT_EQ(file.Read(n, bucket, BUCKETSIZE), EHF_READOK);
+      ASSERT_EQ(bucket[0], static_cast<char>(n));
+      ASSERT_EQ(bucket[BUCKETSIZE - 1], static_cast<char>(n));
+    }
+  }
+  ASSERT_EQ(file.CacheHits() + file.CacheMisses(), 200);
+  ASSERT_GE(file.CacheMisses(), 100);
+
+  // Reading the same page again hits
+  long hits = file.CacheHits();
+  ASSERT_EQ(file.Read(99, bucket, BUCKETSIZE), EHF_READOK);
+  ASSERT_EQ(file.CacheHits(), hits + 1);
+  file.Close();
+}
+
+TEST(BucketFileWrite, WritesWholePagesThrough) {
+  char filename[] = "bucketfile.gtest";
+  MakePages(filename, 8);
+  BucketFile file;
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 64));
+  char bucket[BUCKETSIZE];
+  ASSERT_EQ(file.Read(3, bucket, BUCKETSIZE), EHF_READOK);
+  memset(bucket, 'b', sizeof(bucket));
+  ASSERT_EQ(file.Write(3, bucket, BUCKETSIZE), EHF_WROTEOK);
+  // Past the end of the file is fine, it grows by a page
+  ASSERT_EQ(file.Write(8, bucket, BUCKETSIZE), EHF_WROTEOK);
+  file.Close();
+
+  // The rest of the page is zeroed, not left as it was
+  int fd = open(filename, O_RDONLY);
+  ASSERT_GE(fd, 0);
+  std::vector<char> page(DIRECTALIGN);
+  for (int n : { 3, 8 }) {
+    ASSERT_EQ(pread(fd, page.data(), page.size(), FIRSTPOSITION + n * DIRECTALIGN),
+              DIRECTALIGN);
+    ASSERT_EQ(page[0], 'b');
+    ASSERT_EQ(page[BUCKETSIZE - 1], 'b');
+    ASSERT_EQ(page[BUCKETSIZE], 0);
+    ASSERT_EQ(page[DIRECTALIGN - 1], 0);
+  }
+  close(fd);
+
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 64));
+  ASSERT_EQ(file.Read(8, bucket, BUCKETSIZE), EHF_READOK);
+  ASSERT_EQ(bucket[10], 'b');
+  file.Close();
+}
+
+TEST(BucketFilePin, WritesLeaveAPinnedPageAlone) {
+  char filename[] = "bucketfile.gtest";
+  MakePages(filename, 4);
+  BucketFile file;
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 64));
+  int pin;
+  int result;
+  const char* pinned = file.Pin(2, pin, result);
+  ASSERT_NE(pinned, nullptr);
+  ASSERT_EQ(result, EHF_READOK);
+  ASSERT_EQ(pinned[0], 2);
+
+  char bucket[BUCKETSIZE];
+  memset(bucket, 'w', sizeof(bucket));
+  ASSERT_EQ(file.Write(2, bucket, BUCKETSIZE), EHF_WROTEOK);
+  ASSERT_EQ(pinned[0], 2);
+  ASSERT_EQ(file.Read(2, bucket, BUCKETSIZE), EHF_READOK);
+  ASSERT_EQ(bucket[0], 'w');
+  file.Unpin(pin);
+  file.Close();
+}
+
+TEST(BucketFilePin, EveryFramePinned) {
+  char filename[] = "bucketfile.gtest";
+  MakePages(filename, 3 * CACHESHARDS);
+  BucketFile file;
+  // One frame per shard: pages 0 and CACHESHARDS share it
+  ASSERT_TRUE(file.Open(filename, FIRSTPOSITION, DIRECTALIGN, 1));
+  int pin;
+  int result;
+  ASSERT_NE(file.Pin(0, pin, result), nullptr);
+  int other;
+  ASSERT_EQ(file.Pin(CACHESHARDS, other, result), nullptr);
+  ASSERT_EQ(result, EHF_READOK);
+
+  // Reads and writes of the shard go round the cache
+  char bucket[BUCKETSIZE];
+  ASSERT_EQ(file.Read(CACHESHARDS, bucket, BUCKETSIZE), EHF_READOK);
+  ASSERT_EQ(bucket[0], CACHESHARDS);
+  memset(bucket, 'w', sizeof(bucket));
+  ASSERT_EQ(file.Write(2 * CACHESHARDS, bucket, BUCKETSIZE), EHF_WROTEOK);
+
+  file.Unpin(pin);
+  const char* page = file.Pin(2 * CACHESHARDS, pin, result);
+  ASSERT_NE(page, nullptr);
+  ASSERT_EQ(page[0], 'w');
+  file.Unpin(pin);
+  file.Close();
+}
@@ -0,0 +1,126 @@
+#include "gtest/gtest.h"
+
+#include "indexholder.h"
+#include "compactindexholder.h"
+
+#include <stdlib.h>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Split buckets the way ExtendibleHashFile does, on both indexes alike. Slots are
+// picked by pick, and no bucket goes deeper than maxDepth.
+template <typename Picker>
+static void SplitBoth(ExtendibleIndex& a, ExtendibleIndex& b, int splits,
+		      int maxDepth, Picker pick) {
+  std::vector<int> bucketDepths(1, 0);
+  for (int s = 0; s < splits; s++) {
+    int slot = pick(a.GetNumberOfAddresses());
+    int address = a.GetAddress(slot);
+    int bucketDepth = bucketDepths[address];
+    if (bucketDepth >= maxDepth) {
+      continue;
+    }
+    if (bucketDepth == a.GetDepth()) {
+      a.IncreaseDepth();
+      b.IncreaseDepth();
+    }
+    int bucketValue = slot & ((1 << bucketDepth) - 1);
+    int newAddress = bucketDepths.size();
+    a.SplitAddress(bucketValue, bucketDepth, newAddress);
+    b.SplitAddress(bucketValue, bucketDepth, newAddress);
+    bucketDepths[address] = bucketDepth + 1;
+    bucketDepths.push_back(bucketDepth + 1);
+  }
+}
+
+static void ExpectSameAddresses(ExtendibleIndex& a, ExtendibleIndex& b) {
+  ASSERT_EQ(a.GetDepth(), b.GetDepth());
+  for (int slot = 0; slot < a.GetNumberOfAddresses(); slot++) {
+    ASSERT_EQ(a.GetAddress(slot), b.GetAddress(slot)) << "slot " << slot;
+  }
+}
+
+TEST(CompactIndexHolderConstruction, DepthOfOne) {
+  CompactIndexHolder cih(1);
+  ASSERT_EQ(cih.GetDepth(), 1);
+  ASSERT_EQ(cih.GetNumberOfAddresses(), 2);
+  ASSERT_EQ(cih.GetAddress(0), 0);
+  ASSERT_EQ(cih.GetAddress(1), 0);
+  ASSERT_EQ(cih.GetAddress(2), -1);
+  ASSERT_EQ(cih.GetNumberOfNodes(), 0);
+}
+
+TEST(CompactIndexHolderSplits, FirstSplit) {
+  CompactIndexHolder cih(1);
+  cih.SplitAddress(0, 0, 1);
+  ASSERT_EQ(cih.GetAddress(0), 0);
+  ASSERT_EQ(cih.GetAddress(1), 1);
+  cih.IncreaseDepth();
+  ASSERT_EQ(cih.GetAddress(2), 0);
+  ASSERT_EQ(cih.GetAddress(3), 1);
+  ASSERT_EQ(cih.GetNumberOfNodes(), 1);
+}
+
+TEST(CompactIndexHolderSplits, MatchesIndexHolderOnRandomSplits) {
+  IndexHolder ih(1);
+  CompactIndexHolder cih(1);
+  srand(1);
+  SplitBoth(ih, cih, 3000, 14, [](int slots) { return rand() % slots; });
+  ExpectSameAddresses(ih, cih);
+}
+
+TEST(CompactIndexHolderSplits, SmallerThanIndexHolderWhenSkewed) {
+  IndexHolder ih(1);
+  CompactIndexHolder cih(1);
+  // Always split the bucket holding slot 0, as a hot spot in the hash values would
+  SplitBoth(ih, cih, 20, 20, [](int) { return 0; });
+  ExpectSameAddresses(ih, cih);
+  ASSERT_EQ(cih.GetDepth(), 20);
+  ASSERT_EQ(cih.GetNumberOfNodes(), 20);
+  ih.CopyMirrors(1 << 21);
+  ASSERT_LT(cih.MemoryUsage() * 100, ih.MemoryUsage());
+}
+
+TEST(CompactIndexHolderFile, WriteAndLoadBothWays) {
+  IndexHolder ih(1);
+  CompactIndexHolder cih(1);
+  srand(2);
+  SplitBoth(ih, cih, 500, 12, [](int slots) { return rand() % slots; });
+
+  int fd = open("compactindexholder.gtest", O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(cih.Write(fd));
+  IndexHolder loadedArray;
+  ASSERT_TRUE(loadedArray.Load(fd));
+  ExpectSameAddresses(ih, loadedArray);
+
+  ASSERT_TRUE(ih.Write(fd));
+  CompactIndexHolder loadedCompact;
+  ASSERT_TRUE(loadedCompact.Load(fd));
+  ExpectSameAddresses(ih, loadedCompact);
+  ASSERT_EQ(loadedCompact.GetNumberOfNodes(), cih.GetNumberOfNodes());
+  close(fd);
+}
+
+TEST(CompactIndexHolderSplits, MoveAddressMatchesIndexHolder) {
+  IndexHolder ih(1);
+  CompactIndexHolder cih(1);
+  srand(3);
+  SplitBoth(ih, cih, 200, 10, [](int slots) { return rand() % slots; });
+  // Move the buckets of slots 0 and 5 to new addresses, at the depth they have
+  int moves[] = { 0, 5 };
+  for (int slot : moves) {
+    int address = ih.GetAddress(slot);
+    int bucketDepth = 0;
+    while (bucketDepth < ih.GetDepth() &&
+           ih.GetAddress(slot ^ (1 << bucketDepth)) != address) {
+      bucketDepth++;
+    }
+    int bucketValue = slot & ((1 << bucketDepth) - 1);
+    ih.MoveAddress(bucketValue, bucketDepth, 1000 + slot);
+    cih.MoveAddress(bucketValue, bucketDepth, 1000 + slot);
+    ASSERT_EQ(ih.GetAddress(slot), 1000 + slot);
+  }
+  ExpectSameAddresses(ih, cih);
+}
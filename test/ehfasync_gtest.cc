@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfoptions.h"
+#include "ehfasync.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+TEST(EHFAsync, MatchesTheSynchronousCallsInEveryMode) {
+  EHFOptions onDisc;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions direct;
+  direct.directIO = true;
+  direct.cachePages = 64;
+  EHFOptions commit;
+  commit.durability = EHF_DURABILITY_COMMIT;
+  EHFOptions modes[] = { onDisc, inMemory, direct, commit };
+  char filename[] = "ehf-async.gtest";
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+
+    // All the inserts in flight at once, splitting buckets under each other
+    const int count = 1000;
+    std::vector<EHFOperation> inserts(count + 1);
+    EHFScheduler scheduler;
+    char key[7];
+    char record[1024];
+    for (int i = 0; i < count; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      inserts[i].Insert(&ehf, key, record);
+      scheduler.Submit(&inserts[i]);
+    }
+    sprintf(key, "%06d", 7);
+    inserts[count].Insert(&ehf, key, record);
+    scheduler.Submit(&inserts[count]);
+    ASSERT_EQ(scheduler.Pending(), count + 1);
+    scheduler.Run();
+    ASSERT_EQ(scheduler.Pending(), 0);
+    for (int i = 0; i < count; i++) {
+      ASSERT_TRUE(inserts[i].Done());
+      ASSERT_EQ(inserts[i].Result(), EHF_INSERTED);
+    }
+    ASSERT_EQ(inserts[count].Result(), EHF_ALREADY_PRESENT);
+
+    // Every other key is missing
+    std::vector<EHFOperation> retrieves(count);
+    std::vector<std::string> keys(count);
+    std::vector<std::vector<char>> records(count, std::vector<char>(RECORDSIZE + 1));
+    for (int i = 0; i < count; i++) {
+      sprintf(key, "%06d", (i % 2 == 0) ? i : 5000 + i);
+      keys[i] = key;
+      retrieves[i].Retrieve(&ehf, &keys[i][0], records[i].data());
+      scheduler.Submit(&retrieves[i]);
+    }
+    scheduler.Run();
+    for (int i = 0; i < count; i++) {
+      ASSERT_EQ(retrieves[i].Result(), ehf.RetrieveRecord(&keys[i][0], record));
+      ASSERT_EQ(retrieves[i].Result(), (i % 2 == 0) ? EHF_RETRIEVED : EHF_NOT_PRESENT);
+      if (i % 2 == 0) {
+        ASSERT_EQ(strcmp(records[i].data(), record), 0);
+      }
+    }
+    ehf.Close();
+  }
+}
+
+TEST(EHFAsync, WhenDoneKeepsOperationsInFlight) {
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "unused";
+  ASSERT_TRUE(ehf.Open(filename, false));
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 500; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  // A few operations, each set up again for the next key as it finishes
+  const int inFlight = 8;
+  EHFOperation operations[inFlight];
+  char records[inFlight][RECORDSIZE + 1];
+  EHFScheduler scheduler;
+  int next = 0;
+  int retrieved = 0;
+  std::function<void(EHFOperation*)> whenDone = [&](EHFOperation* done) {
+    retrieved += (done->Result() == EHF_RETRIEVED) ? 1 : 0;
+    if (next < 500) {
+      int slot = done - operations;
+      sprintf(key, "%06d", next++);
+      done->Retrieve(&ehf, key, records[slot]);
+    }
+  };
+  for (int slot = 0; slot < inFlight; slot++) {
+    sprintf(key, "%06d", next++);
+    operations[slot].Retrieve(&ehf, key, records[slot]);
+    scheduler.Submit(&operations[slot], whenDone);
+  }
+  while (scheduler.Poll() > 0) {
+    ASSERT_LE(scheduler.Pending(), inFlight);
+  }
+  ASSERT_EQ(retrieved, 500);
+  ehf.Close();
+}
+
+// What the whenDone of WhenDoneSubmitsOthers needs, behind one reference, so that the
+// std::function holds it in place rather than on the heap
+struct FanOut{
+  static const int width = 8;
+  ExtendibleHashFile* ehf;
+  EHFScheduler scheduler;
+  EHFOperation operations[width * width];
+  char keys[width * width][IDSIZE + 1];
+  char records[width * width][RECORDSIZE + 1];
+  int submitted = 0;
+  int retrieved = 0;
+  int fannedOut = 0;
+
+  void Done(EHFOperation* done) {
+    retrieved += (done->Result() == EHF_RETRIEVED) ? 1 : 0;
+    if (submitted + width > width * width) {
+      return;
+    }
+    for (int f = 0; f < width; f++) {
+      int slot = submitted++;
+      NumberedKey(slot, keys[slot]);
+      operations[slot].Retrieve(ehf, keys[slot], records[slot]);
+      scheduler.Submit(&operations[slot],
+                       [this](EHFOperation* next) { Done(next); });
+    }
+  }
+};
+
+TEST(EHFAsync, WhenDoneSubmitsOthers) {
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "unused";
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 100);
+
+  // Each finished operation fans out into more, moving every entry as it submits them,
+  // and its whenDone still has its state to count with afterwards
+  std::unique_ptr<FanOut> fanOut(new FanOut());
+  fanOut->ehf = &ehf;
+  FanOut& state = *fanOut;
+  EHFOperation first;
+  char firstKey[IDSIZE + 1];
+  char firstRecord[RECORDSIZE + 1];
+  NumberedKey(99, firstKey);
+  first.Retrieve(&ehf, firstKey, firstRecord);
+  fanOut->scheduler.Submit(&first, [&state](EHFOperation* done) {
+    state.Done(done);
+    state.fannedOut++;
+  });
+  fanOut->scheduler.Run();
+  ASSERT_EQ(fanOut->submitted, FanOut::width * FanOut::width);
+  ASSERT_EQ(fanOut->fannedOut, 1);
+  ASSERT_EQ(fanOut->retrieved, FanOut::width * FanOut::width + 1);
+  ehf.Close();
+}
+
+TEST(EHFAsync, FileNotOpen) {
+  ExtendibleHashFile ehf;
+  char key[] = "000001";
+  char record[RECORDSIZE + 1] = "000001Record";
+  EHFOperation retrieve;
+  EHFOperation insert;
+  retrieve.Retrieve(&ehf, key, record);
+  insert.Insert(&ehf, key, record);
+  ASSERT_FALSE(retrieve.Done());
+  ASSERT_EQ(retrieve.Resume(), EHF_FILENOTOPEN);
+  ASSERT_EQ(insert.Resume(), EHF_FILENOTOPEN);
+  ASSERT_TRUE(retrieve.Done());
+  ASSERT_EQ(retrieve.Resume(), EHF_FILENOTOPEN);
+}
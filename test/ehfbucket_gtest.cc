@@ -88,6 +88,55 @@ TEST(EHFBucketUsage, AddToEmptyBucketRetrieveThenDelete) {
   }
 }
 
+TEST(EHFBucketConstruction, ToBeReadSkipsClearing) {
+  int fd = open("ehfbucket.gtest", O_CREAT | O_TRUNC | O_RDWR, 0600);
+  EHFBucket written(fd, 0, 3);
+  char key[IDSIZE+1];
+  strcpy(key, "148000");
+  char record_in[RECORDSIZE+1];
+  strcpy(record_in, "148000A primer in data reduction : aEhrenberg, A. SQA276.12 E33");
+  ASSERT_EQ(written.Add(key, record_in), EHF_INSERTED);
+  ASSERT_EQ(written.Write(), EHF_WROTEOK);
+
+  EHFBucket b(fd, 0, EHF_TOBEREAD);
+  ASSERT_EQ(b.NumOfRecs(), 0);
+  ASSERT_EQ(b.Read(), EHF_READOK);
+  ASSERT_EQ(b.NumOfRecs(), 1);
+  ASSERT_EQ(b.Depth(), 3);
+  char record_out[RECORDSIZE+1];
+  ASSERT_EQ(b.Retrieve(key, record_out), EHF_RETRIEVED);
+  ASSERT_EQ(strncmp(record_in, record_out, RECORDSIZE+1), 0);
+
+  // Past the end of the file, so the read fails and leaves no records behind
+  b.ChangeAddress(5);
+  ASSERT_EQ(b.Read(), EHF_READERROR);
+  ASSERT_EQ(b.NumOfRecs(), 0);
+  close(fd);
+}
+
 // TODO tests to max out a bucket
 // TODO test writing / reading a maxed out bucket from disk
 
+
+TEST(EHFBucketUsage, ReplaceOverwritesInPlace) {
+  int fd = open("ehfbucket.gtest", O_CREAT | O_TRUNC | O_RDWR, 0600);
+  EHFBucket b(fd, 0, 1);
+  char key[IDSIZE+1];
+  strcpy(key, "148000");
+  char record_in[RECORDSIZE+1];
+  strcpy(record_in, "148000A primer in data reduction : aEhrenberg, A. SQA276.12 E33");
+  ASSERT_EQ(b.Add(key, record_in), EHF_INSERTED);
+
+  char callCode[] = "QA999.99 Z99";
+  ASSERT_EQ(b.Replace(key, CALLCODEPOSITION, CALLCODESIZE, callCode), EHF_UPDATED);
+  char record_out[RECORDSIZE+1];
+  ASSERT_EQ(b.Retrieve(key, record_out), EHF_RETRIEVED);
+  ASSERT_EQ(strncmp(record_out, record_in, CALLCODEPOSITION), 0);
+  ASSERT_EQ(strncmp(record_out + CALLCODEPOSITION, callCode, CALLCODESIZE), 0);
+  ASSERT_EQ(b.NumOfRecs(), 1);
+
+  char missing[IDSIZE+1];
+  strcpy(missing, "148001");
+  ASSERT_EQ(b.Replace(missing, CALLCODEPOSITION, CALLCODESIZE, callCode), EHF_NOT_PRESENT);
+  close(fd);
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "checksum.h"
+#include "indexholder.h"
+#include "ehfoptions.h"
+#include "ehfcontainer.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+TEST(Checksum, KnownValue) {
+  ASSERT_EQ(Crc32("123456789", 9), 0xCBF43926u);
+  // In pieces
+  ASSERT_EQ(Crc32("6789", 4, Crc32("12345", 5)), 0xCBF43926u);
+}
+
+TEST(EHFContainerCommit, CommitAndReopen) {
+  char filename[] = "ehfcontainer.gtest.eh";
+  EHFContainer container;
+  ASSERT_TRUE(container.Create(filename));
+  IndexHolder index(1);
+  ASSERT_EQ(container.AllocatePage(), 0);
+  ASSERT_EQ(container.AllocatePage(), 1);
+  index.SplitAddress(0, 0, 1);
+  ASSERT_TRUE(container.Commit(&index, 2));
+  container.Close();
+
+  int indexOpens[] = { EHF_OPEN_READINDEX, EHF_OPEN_MAPINDEX, EHF_OPEN_PREFETCHINDEX };
+  for (int indexOpen : indexOpens) {
+    ASSERT_TRUE(container.Open(filename));
+    IndexHolder loaded;
+    ASSERT_TRUE(container.LoadIndex(&loaded, indexOpen));
+    ASSERT_EQ(container.BucketCount(), 2);
+    ASSERT_EQ(loaded.GetDepth(), 1);
+    ASSERT_EQ(loaded.GetAddress(0), 0);
+    ASSERT_EQ(loaded.GetAddress(1), 1);
+    // The index went into page 2, the first page after the buckets
+    ASSERT_EQ(container.PageCount(), 3);
+    container.Close();
+  }
+}
+
+TEST(EHFContainerCommit, IndexPagesAreReused) {
+  char filename[] = "ehfcontainer.gtest.eh";
+  EHFContainer container;
+  ASSERT_TRUE(container.Create(filename));
+  IndexHolder index(1);
+  container.AllocatePage();
+  container.AllocatePage();
+  index.SplitAddress(0, 0, 1);
+  for (int commit = 0; commit < 10; commit++) {
+    ASSERT_TRUE(container.Commit(&index, 2));
+  }
+  // The pages of each index are freed by the next commit, and reused by the one after
+  ASSERT_LE(container.PageCount(), 4);
+  int freed = container.AllocatePage();
+  ASSERT_LT(freed, 4);
+  container.Close();
+}
+
+TEST(EHFContainerCommit, TornSuperblockFallsBack) {
+  char filename[] = "ehfcontainer.gtest.eh";
+  EHFContainer container;
+  ASSERT_TRUE(container.Create(filename));
+  IndexHolder index(1);
+  container.AllocatePage();
+  container.AllocatePage();
+  ASSERT_TRUE(container.Commit(&index, 2));
+  index.SplitAddress(0, 0, 1);
+  ASSERT_TRUE(container.Commit(&index, 3));
+  container.Close();
+
+  // Damage the newest copy, generation 2 in slot 0
+  int fd = open(filename, O_RDWR);
+  ASSERT_GE(fd, 0);
+  char garbage[16];
+  memset(garbage, 0x5A, sizeof(garbage));
+  ASSERT_EQ(pwrite(fd, garbage, sizeof(garbage), 24), (ssize_t) sizeof(garbage));
+  close(fd);
+
+  ASSERT_TRUE(container.Open(filename));
+  IndexHolder loaded;
+  ASSERT_TRUE(container.LoadIndex(&loaded, EHF_OPEN_READINDEX));
+  ASSERT_EQ(container.BucketCount(), 2);
+  ASSERT_EQ(loaded.GetAddress(1), 0);
+  container.Close();
+}
+
+TEST(EHFContainerCommit, NotAContainer) {
+  char filename[] = "ehfcontainer.gtest.eh";
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  char zeros[4096];
+  memset(zeros, 0, sizeof(zeros));
+  ASSERT_EQ(write(fd, zeros, sizeof(zeros)), (ssize_t) sizeof(zeros));
+  close(fd);
+  EHFContainer container;
+  ASSERT_FALSE(container.Open(filename));
+}
+
+TEST(EHFContainerFile, InsertReopenRetrieve) {
+  char filename[] = "ehfcontainer.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 300);
+  ehf.Close();
+  ASSERT_EQ(access("ehfcontainer.gtest.eh", F_OK), 0);
+  ASSERT_NE(access("ehfcontainer.gtest.ehd", F_OK), 0);
+
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 300);
+  InsertNumbered(ehf, 300, 400);
+  ehf.Close();
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 400);
+  ehf.Close();
+}
+
+TEST(EHFContainerConvert, TwoFilesToContainer) {
+  char filename[] = "ehfconvert.gtest";
+  EHFOptions options;
+  options.fileFormat = EHF_FORMAT_TWOFILES;
+  ExtendibleHashFile twoFiles(options);
+  ASSERT_TRUE(twoFiles.Open(filename, false));
+  InsertNumbered(twoFiles, 0, 300);
+  twoFiles.Close();
+  ASSERT_EQ(access("ehfconvert.gtest.ehd", F_OK), 0);
+
+  ASSERT_TRUE(ConvertToContainer(filename));
+  ASSERT_EQ(access("ehfconvert.gtest.eh", F_OK), 0);
+  ASSERT_NE(access("ehfconvert.gtest.ehd", F_OK), 0);
+  ASSERT_NE(access("ehfconvert.gtest.ehf", F_OK), 0);
+
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 300);
+  InsertNumbered(ehf, 300, 400);
+  ehf.Close();
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 400);
+  ehf.Close();
+
+  // Nothing left to convert
+  ASSERT_FALSE(ConvertToContainer(filename));
+}
+
+TEST(EHFContainerMapping, MappedIndexStaysPrivate) {
+  char filename[] = "ehfcontainer.gtest.eh";
+  EHFContainer container;
+  ASSERT_TRUE(container.Create(filename));
+  IndexHolder index(1);
+  for (int i = 0; i < 4; i++) {
+    container.AllocatePage();
+  }
+  index.SplitAddress(0, 0, 1);
+  ASSERT_TRUE(container.Commit(&index, 4));
+  container.Close();
+
+  ASSERT_TRUE(container.Open(filename));
+  IndexHolder mapped;
+  ASSERT_TRUE(container.LoadIndex(&mapped, EHF_OPEN_MAPINDEX));
+  // Changed in memory, and committed twice, so the mapped run is freed by the first
+  // commit but must not be written over by the second
+  mapped.IncreaseDepth();
+  mapped.SplitAddress(1, 1, 2);
+  mapped.SplitAddress(0, 1, 3);
+  ASSERT_TRUE(container.Commit(&mapped, 4));
+  ASSERT_TRUE(container.Commit(&mapped, 4));
+  ASSERT_EQ(mapped.GetAddress(0), 0);
+  ASSERT_EQ(mapped.GetAddress(1), 1);
+  ASSERT_EQ(mapped.GetAddress(2), 3);
+  ASSERT_EQ(mapped.GetAddress(3), 2);
+  container.Close();
+
+  ASSERT_TRUE(container.Open(filename));
+  IndexHolder loaded;
+  ASSERT_TRUE(container.LoadIndex(&loaded, EHF_OPEN_READINDEX));
+  ASSERT_EQ(loaded.GetDepth(), 2);
+  ASSERT_EQ(loaded.GetAddress(2), 3);
+  ASSERT_EQ(loaded.GetAddress(3), 2);
+  container.Close();
+}
+
+TEST(EHFContainerMapping, EveryIndexOpenFindsTheRecords) {
+  char filename[] = "ehfcontainer.gtest";
+  ExtendibleHashFile created;
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 300);
+  created.Close();
+
+  int indexOpens[] = { EHF_OPEN_READINDEX, EHF_OPEN_MAPINDEX, EHF_OPEN_PREFETCHINDEX };
+  int last = 300;
+  for (int indexOpen : indexOpens) {
+    EHFOptions options;
+    options.indexOpen = indexOpen;
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename));
+    RetrieveNumbered(ehf, 0, last);
+    InsertNumbered(ehf, last, last + 100);
+    last += 100;
+    RetrieveNumbered(ehf, 0, last);
+    ehf.Close();
+  }
+}
+
+// Read a whole file into memory
+static std::vector<char> ReadFile(const char* fileName) {
+  std::vector<char> contents;
+  int fd = open(fileName, O_RDONLY);
+  if (fd >= 0) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    contents.resize(size);
+    if (pread(fd, contents.data(), size, 0) != size) {
+      contents.clear();
+    }
+    close(fd);
+  }
+  return contents;
+}
+
+static void WriteFile(const char* fileName, const std::vector<char>& contents) {
+  int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, contents.data(), contents.size()), (ssize_t) contents.size());
+  close(fd);
+}
+
+TEST(EHFContainerShadowSplits, CrashBeforeSuperblockKeepsOldRecords) {
+  char filename[] = "ehfshadow.gtest";
+  char crashFilename[] = "ehfshadow-crash.gtest";
+  EHFOptions options;
+  options.shadowSplits = true;
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename, false));
+
+  char key[7];
+  char record[1024];
+  int splitsChecked = 0;
+  for (int i = 0; i < 300; i++) {
+    std::vector<char> before = ReadFile("ehfshadow.gtest.eh");
+    NumberedKey(i, key);
+    NumberedRecord(key, record);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    std::vector<char> after = ReadFile("ehfshadow.gtest.eh");
+    if (memcmp(before.data(), after.data(), SUPERBLOCKAREA) == 0) {
+      continue;
+    }
+    // That insert split a bucket. Crash it just before the superblock was written,
+    // with every page the split wrote, but the superblocks as they were before.
+    memcpy(after.data(), before.data(), SUPERBLOCKAREA);
+    WriteFile("ehfshadow-crash.gtest.eh", after);
+    ExtendibleHashFile crashed;
+    ASSERT_TRUE(crashed.Open(crashFilename));
+    RetrieveNumbered(crashed, 0, i);
+    crashed.Close();
+    splitsChecked++;
+  }
+  ASSERT_GT(splitsChecked, 0);
+
+  // Without a Close, every split is on disc already
+  WriteFile("ehfshadow-crash.gtest.eh", ReadFile("ehfshadow.gtest.eh"));
+  ExtendibleHashFile crashed;
+  ASSERT_TRUE(crashed.Open(crashFilename));
+  RetrieveNumbered(crashed, 0, 300);
+  crashed.Close();
+
+  ehf.Close();
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 300);
+  ehf.Close();
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfoptions.h"
+#include "ehfcursor.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+// Scan the table, checking every record, and count how often each key comes out
+static void ScanNumbered(ExtendibleHashFile& ehf, std::vector<int>& seen) {
+  EHFCursor cursor;
+  ASSERT_TRUE(cursor.Open(&ehf));
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  char expected[RECORDSIZE+1];
+  while (cursor.Next(key, record)) {
+    int i = atoi(key);
+    ASSERT_GE(i, 0);
+    ASSERT_LT(static_cast<size_t>(i), seen.size());
+    NumberedRecord(key, expected);
+    ASSERT_EQ(strcmp(expected, record), 0);
+    seen[i]++;
+  }
+  ASSERT_EQ(cursor.Result(), EHF_READOK);
+  ASSERT_FALSE(cursor.Next(key, record));
+}
+
+TEST(EHFCursor, VisitsEveryRecordOnce) {
+  EHFOptions container;
+  EHFOptions twoFiles;
+  twoFiles.fileFormat = EHF_FORMAT_TWOFILES;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions direct;
+  direct.directIO = true;
+  EHFOptions modes[] = { container, twoFiles, inMemory, direct };
+  char filename[] = "ehf-cursor.gtest";
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+    InsertNumbered(ehf, 0, 1500);
+    std::vector<int> seen(1500, 0);
+    ScanNumbered(ehf, seen);
+    for (int i = 0; i < 1500; i++) {
+      ASSERT_EQ(seen[i], 1) << "key " << i;
+    }
+    ehf.Close();
+  }
+}
+
+TEST(EHFCursor, ReadsEachBucketOnce) {
+  char filename[] = "ehf-cursor.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 1000);
+  EHFOccupancy occupancy = ehf.Analyse(1);
+  ASSERT_LT(occupancy.buckets, occupancy.indexSlots);
+
+  uint64_t before = ehf.GetStats().bucketReads;
+  std::vector<int> seen(1000, 0);
+  ScanNumbered(ehf, seen);
+  ASSERT_EQ(ehf.GetStats().bucketReads - before,
+            static_cast<uint64_t>(occupancy.buckets));
+  ehf.Close();
+
+  // Still there once reopened, as read from the file
+  ASSERT_TRUE(ehf.Open(filename));
+  seen.assign(1000, 0);
+  ScanNumbered(ehf, seen);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(seen[i], 1);
+  }
+  ehf.Close();
+}
+
+TEST(EHFCursor, EmptyAndClosedTables) {
+  char filename[] = "ehf-cursor.gtest";
+  ExtendibleHashFile ehf;
+  EHFCursor cursor;
+  ASSERT_FALSE(cursor.Open(&ehf));
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  ASSERT_FALSE(cursor.Next(key, record));
+  ASSERT_EQ(cursor.Result(), EHF_FILENOTOPEN);
+
+  ASSERT_TRUE(ehf.Open(filename, false));
+  ASSERT_TRUE(cursor.Open(&ehf));
+  ASSERT_FALSE(cursor.Next(key, record));
+  ASSERT_EQ(cursor.Result(), EHF_READOK);
+  cursor.Close();
+  ehf.Close();
+}
+
+TEST(EHFCursor, PageRangesSplitTheTable) {
+  char filename[] = "ehf-cursor.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 1500);
+  std::vector<int> seen(1500, 0);
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int firstPage = 0; firstPage < 1000; firstPage += 7) {
+    EHFCursor cursor;
+    ASSERT_TRUE(cursor.Open(&ehf, firstPage, firstPage + 7));
+    while (cursor.Next(key, record)) {
+      seen[atoi(key)]++;
+    }
+    ASSERT_EQ(cursor.Result(), EHF_READOK);
+  }
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_EQ(seen[i], 1);
+  }
+  ehf.Close();
+}
+
+TEST(EHFCursor, ScanPartitionsGathersEveryRecord) {
+  EHFOptions container;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions modes[] = { container, inMemory };
+  char filename[] = "ehf-cursor.gtest";
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+    InsertNumbered(ehf, 0, 1500);
+    for (int partitions : { 1, 3, 8 }) {
+      // Each partition counts apart, and the sink adds them up
+      std::vector< std::vector<int> > found(partitions, std::vector<int>(1500, 0));
+      std::vector<int> seen(1500, 0);
+      int gathered = 0;
+      int result = ScanPartitions(&ehf, partitions,
+          [&found](int partition, const char* key, const char* record) {
+            int i = atoi(key);
+            if (strncmp(record, key, IDSIZE) == 0) {
+              found[partition][i]++;
+            }
+          },
+          [&found, &seen, &gathered](int partition) {
+            for (size_t i = 0; i < seen.size(); i++) {
+              seen[i] += found[partition][i];
+            }
+            gathered++;
+          });
+      ASSERT_EQ(result, EHF_READOK);
+      ASSERT_EQ(gathered, partitions);
+      for (int i = 0; i < 1500; i++) {
+        ASSERT_EQ(seen[i], 1) << partitions << " partitions, key " << i;
+      }
+    }
+    ehf.Close();
+  }
+
+  ExtendibleHashFile closed;
+  int result = ScanPartitions(&closed, 2, [](int, const char*, const char*) {});
+  ASSERT_EQ(result, EHF_FILENOTOPEN);
+}
+
+TEST(EHFCursor, SeesTheTableAsItWasWhenOpened) {
+  EHFOptions container;
+  EHFOptions twoFiles;
+  twoFiles.fileFormat = EHF_FORMAT_TWOFILES;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions direct;
+  direct.directIO = true;
+  EHFOptions shadow;
+  shadow.shadowSplits = true;
+  EHFOptions modes[] = { container, twoFiles, inMemory, direct, shadow };
+  char filename[] = "ehf-cursor.gtest";
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+    InsertNumbered(ehf, 0, 700);
+    EHFCursor cursor;
+    ASSERT_TRUE(cursor.Open(&ehf));
+    // Every bucket is split at least once, before the cursor has read any of them
+    InsertNumbered(ehf, 700, 1500);
+
+    std::vector<int> seen(1500, 0);
+    char key[IDSIZE+1];
+    char record[RECORDSIZE+1];
+    char expected[1024];
+    while (cursor.Next(key, record)) {
+      NumberedRecord(key, expected);
+      ASSERT_EQ(strcmp(expected, record), 0);
+      seen[atoi(key)]++;
+    }
+    ASSERT_EQ(cursor.Result(), EHF_READOK);
+    cursor.Close();
+    for (int i = 0; i < 1500; i++) {
+      ASSERT_EQ(seen[i], (i < 700) ? 1 : 0) << "key " << i;
+    }
+
+    // A cursor opened now sees all of them
+    seen.assign(1500, 0);
+    ScanNumbered(ehf, seen);
+    for (int i = 0; i < 1500; i++) {
+      ASSERT_EQ(seen[i], 1);
+    }
+    ehf.Close();
+  }
+}
+
+TEST(EHFCursor, ScanPartitionsAlongsideAWriter) {
+  char filename[] = "ehf-cursor.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 700);
+
+  std::vector< std::vector<int> > found(4, std::vector<int>(1500, 0));
+  std::vector<int> seen(1500, 0);
+  std::atomic<bool> started(false);
+  std::thread writer;
+  int result = ScanPartitions(&ehf, 4,
+      [&](int partition, const char* key, const char*) {
+        if (!started.exchange(true)) {
+          writer = std::thread([&ehf]() { InsertNumbered(ehf, 700, 1500); });
+        }
+        found[partition][atoi(key)]++;
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      },
+      [&found, &seen](int partition) {
+        for (size_t i = 0; i < seen.size(); i++) {
+          seen[i] += found[partition][i];
+        }
+      });
+  writer.join();
+  ASSERT_EQ(result, EHF_READOK);
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_EQ(seen[i], (i < 700) ? 1 : 0) << "key " << i;
+  }
+  ehf.Close();
+}
+
+TEST(EHFCursor, SnapshotOutlastsCommitsOfShadowSplits) {
+  EHFOptions options;
+  options.shadowSplits = true;
+  char filename[] = "ehf-cursor.gtest";
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 1000);
+  ASSERT_TRUE(ehf.Sync());
+  EHFCursor cursor;
+  ASSERT_TRUE(cursor.Open(&ehf));
+  // Shadow splits free the buckets the cursor is yet to read, and each Sync commits,
+  // which would let the next one write its index over them
+  for (int from = 1000; from < 1500; from += 25) {
+    InsertNumbered(ehf, from, from + 25);
+    ASSERT_TRUE(ehf.Sync());
+  }
+
+  std::vector<int> seen(1500, 0);
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  char expected[1024];
+  while (cursor.Next(key, record)) {
+    int i = atoi(key);
+    ASSERT_GE(i, 0);
+    ASSERT_LT(i, 1500);
+    NumberedRecord(key, expected);
+    ASSERT_EQ(strcmp(expected, record), 0);
+    seen[i]++;
+  }
+  ASSERT_EQ(cursor.Result(), EHF_READOK);
+  cursor.Close();
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_EQ(seen[i], (i < 1000) ? 1 : 0) << "key " << i;
+  }
+
+  // Once the cursor is done with them the pages are free again
+  ASSERT_TRUE(ehf.Sync());
+  seen.assign(1500, 0);
+  ScanNumbered(ehf, seen);
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_EQ(seen[i], 1);
+  }
+  ehf.Close();
+}
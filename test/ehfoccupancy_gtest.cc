@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfoptions.h"
+#include "ehfoccupancy.h"
+#include "ehfcontainer.h"
+#include "indexholder.h"
+#include "bit_op_lib.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+TEST(EHFOccupancy, CountsEveryBucketOnce) {
+  EHFOptions onDisc;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions direct;
+  direct.directIO = true;
+  EHFOptions modes[] = { onDisc, inMemory, direct };
+  char filename[] = "ehf-occupancy.gtest";
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+    InsertNumbered(ehf, 0, 1000);
+
+    EHFOccupancy occupancy = ehf.Analyse(4);
+    ASSERT_EQ(occupancy.records, 1000);
+    ASSERT_EQ(occupancy.indexSlots, 1L << occupancy.indexDepth);
+    ASSERT_GT(occupancy.buckets, 1000 / FULLBUCKET);
+    ASSERT_LE(occupancy.buckets, occupancy.indexSlots);
+    ASSERT_DOUBLE_EQ(occupancy.loadFactor, 1000.0 / (occupancy.buckets * FULLBUCKET));
+    ASSERT_DOUBLE_EQ(occupancy.slotsPerBucket,
+                     static_cast<double>(occupancy.indexSlots) / occupancy.buckets);
+    ASSERT_EQ(occupancy.wastedBytes,
+              occupancy.buckets * occupancy.pageSize - 1000L * RECORDSIZE);
+
+    long buckets = 0;
+    long deepest = 0;
+    for (size_t d = 0; d < occupancy.depthHistogram.size(); d++) {
+      buckets += occupancy.depthHistogram[d];
+      deepest = (occupancy.depthHistogram[d] > 0) ? d : deepest;
+    }
+    ASSERT_EQ(buckets, occupancy.buckets);
+    ASSERT_EQ(deepest, occupancy.indexDepth);
+    long records = 0;
+    buckets = 0;
+    for (int n = 0; n <= FULLBUCKET; n++) {
+      buckets += occupancy.fillHistogram[n];
+      records += n * occupancy.fillHistogram[n];
+    }
+    ASSERT_EQ(buckets, occupancy.buckets);
+    ASSERT_EQ(records, 1000);
+
+    ASSERT_EQ(static_cast<int>(occupancy.hottest.size()), HOTPATTERNS);
+    for (int i = 1; i < HOTPATTERNS; i++) {
+      ASSERT_GE(occupancy.hottest[i - 1].records, occupancy.hottest[i].records);
+    }
+    ASSERT_EQ(occupancy.hottest[0].records,
+              occupancy.patternRecords[occupancy.hottest[0].pattern]);
+
+    // However many threads read them
+    EHFOccupancy alone = ehf.Analyse(1);
+    ASSERT_EQ(alone.ToJSON(), occupancy.ToJSON());
+    ASSERT_EQ(alone.patternRecords, occupancy.patternRecords);
+    ehf.Close();
+  }
+}
+
+TEST(EHFOccupancy, SkipsBucketsOutOfRange) {
+  char filename[] = "ehf-occupancy.gtest";
+  char containerFilename[] = "ehf-occupancy.gtest.eh";
+  EHFOptions options;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  long buckets = created.Analyse().buckets;
+  created.Close();
+
+  // One bucket claims more records than fit, another a depth no index reaches
+  EHFContainer container;
+  ASSERT_TRUE(container.Open(containerFilename));
+  IndexHolder index;
+  ASSERT_TRUE(container.LoadIndex(&index, EHF_OPEN_READINDEX));
+  int pageSize = container.PageSize();
+  container.Close();
+  int fd = open(containerFilename, O_RDWR);
+  ASSERT_GE(fd, 0);
+  int numOfRecs = FULLBUCKET + 1000;
+  int depth = NUMBITS + 1000;
+  ASSERT_EQ(pwrite(fd, &numOfRecs, sizeof(numOfRecs),
+                   SUPERBLOCKAREA + static_cast<long>(index.GetAddress(0)) * pageSize),
+            static_cast<ssize_t>(sizeof(numOfRecs)));
+  ASSERT_EQ(pwrite(fd, &depth, sizeof(depth),
+                   SUPERBLOCKAREA + static_cast<long>(index.GetAddress(1)) * pageSize +
+                   sizeof(int)),
+            static_cast<ssize_t>(sizeof(depth)));
+  close(fd);
+
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename));
+  EHFOccupancy occupancy = ehf.Analyse(2);
+  ASSERT_EQ(occupancy.unreadable, 2);
+  ASSERT_EQ(occupancy.buckets, buckets - 2);
+  ASSERT_EQ(occupancy.depthHistogram.size(),
+            static_cast<size_t>(occupancy.indexDepth) + 1);
+  ASSERT_NE(occupancy.ToJSON().find("\"unreadable\":2"), std::string::npos);
+  ehf.Close();
+}
+
+TEST(EHFOccupancy, ToJSON) {
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "unused";
+  ASSERT_TRUE(ehf.Analyse().buckets == 0);
+  ASSERT_TRUE(ehf.Open(filename, false));
+  InsertNumbered(ehf, 0, 10);
+  EHFOccupancy occupancy = ehf.Analyse();
+  ASSERT_EQ(occupancy.buckets, 2);
+  std::string json = occupancy.ToJSON();
+  ASSERT_EQ(json.front(), '{');
+  ASSERT_EQ(json.back(), '}');
+  ASSERT_NE(json.find("\"indexDepth\":1,\"indexSlots\":2,\"buckets\":2,\"records\":10,"),
+            std::string::npos);
+  ASSERT_NE(json.find("\"depthHistogram\":[0,2]"), std::string::npos);
+  ASSERT_NE(json.find("\"hottestPatterns\":[{\"pattern\":"), std::string::npos);
+  ehf.Close();
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "indexholder.h"
+#include "ehfoptions.h"
+#include "ehfcontainer.h"
+#include "ehfbucket.h"
+#include "ehfrecovery.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+static int CountRetrievable(ExtendibleHashFile& ehf, int from, int to) {
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  int found = 0;
+  for (int i = from; i < to; i++) {
+    NumberedKey(i, key);
+    if (ehf.RetrieveRecord(key, record) == EHF_RETRIEVED) {
+      found++;
+    }
+  }
+  return found;
+}
+
+TEST(EHFRecoveryTwoFiles, LostIndexFile) {
+  char filename[] = "ehfrecovery.gtest";
+  EHFOptions options;
+  options.fileFormat = EHF_FORMAT_TWOFILES;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  created.Close();
+
+  ASSERT_EQ(unlink("ehfrecovery.gtest.ehd"), 0);
+  ASSERT_TRUE(RebuildIndex(filename, 4));
+
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1000);
+  InsertNumbered(ehf, 1000, 1500);
+  ehf.Close();
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1500);
+  ehf.Close();
+}
+
+TEST(EHFRecoveryTwoFiles, StaleIndexFile) {
+  char filename[] = "ehfrecovery.gtest";
+  EHFOptions options;
+  options.fileFormat = EHF_FORMAT_TWOFILES;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  created.Close();
+
+  // The index as it was when the table was new
+  IndexHolder stale(1);
+  stale.SplitAddress(0, 0, 1);
+  int indexFD = open("ehfrecovery.gtest.ehd", O_RDWR | O_TRUNC);
+  ASSERT_GE(indexFD, 0);
+  ASSERT_TRUE(stale.Write(indexFD));
+  close(indexFD);
+
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename));
+  ASSERT_LT(CountRetrievable(ehf, 0, 1000), 1000);
+  ehf.Close();
+
+  ASSERT_TRUE(RebuildIndex(filename));
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1000);
+  ehf.Close();
+}
+
+TEST(EHFRecoveryTwoFiles, BucketsWithoutPatterns) {
+  char filename[] = "ehfrecovery.gtest";
+  EHFOptions options;
+  options.fileFormat = EHF_FORMAT_TWOFILES;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  created.Close();
+
+  // Wipe out the patterns, as in a file written before they were kept
+  int bucketFD = open("ehfrecovery.gtest.ehf", O_RDWR);
+  ASSERT_GE(bucketFD, 0);
+  struct stat status;
+  ASSERT_EQ(fstat(bucketFD, &status), 0);
+  long buckets = (status.st_size - FILEHEADERSIZE) / BUCKETSIZE;
+  char zeroes[2 * sizeof(int)] = { 0 };
+  for (long b = 0; b < buckets; b++) {
+    long position = FILEHEADERSIZE + (b + 1) * BUCKETSIZE - sizeof(zeroes);
+    ASSERT_EQ(pwrite(bucketFD, zeroes, sizeof(zeroes), position),
+              static_cast<ssize_t>(sizeof(zeroes)));
+  }
+  close(bucketFD);
+  ASSERT_EQ(unlink("ehfrecovery.gtest.ehd"), 0);
+
+  ASSERT_TRUE(RebuildIndex(filename, 1));
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1000);
+  InsertNumbered(ehf, 1000, 1500);
+  RetrieveNumbered(ehf, 0, 1500);
+  ehf.Close();
+}
+
+TEST(EHFRecoveryContainer, StaleCommittedIndex) {
+  char filename[] = "ehfrecovery.gtest";
+  char containerFilename[] = "ehfrecovery.gtest.eh";
+  // Shadow splits leave the old buckets on free pages, which must not come back
+  EHFOptions options;
+  options.shadowSplits = true;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  created.Close();
+
+  // Commit the index of a new table over the real one
+  EHFContainer container;
+  ASSERT_TRUE(container.Open(containerFilename));
+  IndexHolder real;
+  ASSERT_TRUE(container.LoadIndex(&real, EHF_OPEN_READINDEX));
+  int bucketCount = container.BucketCount();
+  int pageCount = container.PageCount();
+  IndexHolder stale(1);
+  stale.SplitAddress(0, 0, real.GetAddress(1));
+  ASSERT_TRUE(container.Commit(&stale, 2));
+  container.Close();
+
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename));
+  ASSERT_LT(CountRetrievable(ehf, 0, 1000), 1000);
+  ehf.Close();
+
+  ASSERT_TRUE(RebuildIndex(filename, 2));
+  ASSERT_TRUE(container.Open(containerFilename));
+  IndexHolder rebuilt;
+  ASSERT_TRUE(container.LoadIndex(&rebuilt, EHF_OPEN_READINDEX));
+  ASSERT_EQ(container.BucketCount(), bucketCount);
+  ASSERT_EQ(container.PageCount(), pageCount);
+  for (int i = 0; i < real.GetNumberOfAddresses(); i++) {
+    ASSERT_EQ(rebuilt.GetAddress(i % rebuilt.GetNumberOfAddresses()),
+              real.GetAddress(i));
+  }
+  container.Close();
+
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1000);
+  InsertNumbered(ehf, 1000, 1500);
+  ehf.Close();
+  ASSERT_TRUE(ehf.Open(filename));
+  RetrieveNumbered(ehf, 0, 1500);
+  ehf.Close();
+}
+
+TEST(EHFRecoveryContainer, IndexOverOldBuckets) {
+  char filename[] = "ehfrecovery.gtest";
+  char containerFilename[] = "ehfrecovery.gtest.eh";
+  EHFOptions options;
+  options.shadowSplits = true;
+  ExtendibleHashFile created(options);
+  ASSERT_TRUE(created.Open(filename, false));
+  InsertNumbered(created, 0, 1000);
+  created.Close();
+
+  // Every page out of use looks like a deep bucket, whose mark lies past the end of
+  // an index shorter than a page
+  EHFContainer container;
+  ASSERT_TRUE(container.Open(containerFilename));
+  IndexHolder index;
+  ASSERT_TRUE(container.LoadIndex(&index, EHF_OPEN_READINDEX));
+  std::vector<bool> used(container.PageCount(), false);
+  for (int i = 0; i < index.GetNumberOfAddresses(); i++) {
+    used[index.GetAddress(i)] = true;
+  }
+  for (int page = 0; page < container.PageCount(); page++) {
+    if (!used[page]) {
+      EHFBucket stale(container.FileDescriptor(), page, 20);
+      stale.ChangeFileHeaderSize(SUPERBLOCKAREA);
+      stale.ChangePageSize(container.PageSize());
+      stale.ChangePattern(0);
+      ASSERT_EQ(stale.Write(), EHF_WROTEOK);
+    }
+  }
+  ASSERT_TRUE(container.Commit(&index, container.BucketCount()));
+  int pageSize = container.PageSize();
+  container.Close();
+
+  // The rest of the run's last page holds nothing
+  int fd = open(containerFilename, O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EHFSuperblock superblocks[2];
+  for (int slot = 0; slot < 2; slot++) {
+    ASSERT_EQ(pread(fd, &superblocks[slot], sizeof(EHFSuperblock), slot * SUPERBLOCKSLOT),
+              static_cast<ssize_t>(sizeof(EHFSuperblock)));
+  }
+  EHFSuperblock& last = (superblocks[0].generation > superblocks[1].generation) ?
+    superblocks[0] : superblocks[1];
+  ASSERT_GT(last.metaBytes % pageSize, 0u);
+  std::vector<char> tail(pageSize - last.metaBytes % pageSize);
+  ASSERT_EQ(pread(fd, tail.data(), tail.size(),
+                  SUPERBLOCKAREA + static_cast<long>(last.metaPage) * pageSize +
+                  last.metaBytes),
+            static_cast<ssize_t>(tail.size()));
+  close(fd);
+  for (char byte : tail) {
+    ASSERT_EQ(byte, 0);
+  }
+}
+
+TEST(EHFRecovery, NoTable) {
+  char filename[] = "ehfrecovery.gtest.none";
+  ASSERT_FALSE(RebuildIndex(filename));
+}
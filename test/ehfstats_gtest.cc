@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfoptions.h"
+#include "ehfstats.h"
+#include "extendiblehashfile.h"
+
+TEST(EHFHistogram, BucketsHoldTheirValues) {
+  for (uint64_t value = 0; value < 100000; value = value * 3 / 2 + 1) {
+    int bucket = EHFHistogram::BucketOf(value);
+    ASSERT_GE(EHFHistogram::HighestIn(bucket), value);
+    if (bucket > 0) {
+      ASSERT_LT(EHFHistogram::HighestIn(bucket - 1), value);
+    }
+  }
+  ASSERT_EQ(EHFHistogram::BucketOf(~0ULL), HISTOGRAMBUCKETS - 1);
+  ASSERT_EQ(EHFHistogram::HighestIn(HISTOGRAMBUCKETS - 1), ~0ULL);
+}
+
+TEST(EHFHistogram, PercentilesWithinABucket) {
+  EHFHistogram histogram;
+  ASSERT_EQ(histogram.Percentile(0.5), 0u);
+  for (uint64_t value = 1; value <= 10000; value++) {
+    histogram.Record(value);
+  }
+  ASSERT_EQ(histogram.count, 10000u);
+  ASSERT_EQ(histogram.max, 10000u);
+  ASSERT_DOUBLE_EQ(histogram.Mean(), 5000.5);
+  ASSERT_GE(histogram.Percentile(0.5), 5000u);
+  ASSERT_LE(histogram.Percentile(0.5), 5000u + 5000u / HISTOGRAMSUBBUCKETS);
+  ASSERT_GE(histogram.Percentile(0.99), 9900u);
+  ASSERT_EQ(histogram.Percentile(1.0), 10000u);
+
+  EHFHistogram more;
+  more.Record(20000);
+  histogram.Add(more);
+  ASSERT_EQ(histogram.count, 10001u);
+  ASSERT_EQ(histogram.Percentile(1.0), 20000u);
+}
+
+TEST(EHFStats, CountsWhatTheFileDid) {
+  EHFOptions options;
+  options.timeOperations = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "ehf-stats.gtest";
+  ASSERT_TRUE(ehf.Open(filename, false));
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  sprintf(key, "%06d", 1);
+  ASSERT_EQ(ehf.InsertRecord(key, record), EHF_ALREADY_PRESENT);
+  for (int i = 0; i < 500; i++) {
+    sprintf(key, "%06d", i * 2);
+    ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  }
+
+  EHFStats stats = ehf.GetStats();
+  ASSERT_EQ(stats.inserts, 1001u);
+  ASSERT_EQ(stats.retrieves, 500u);
+  ASSERT_EQ(stats.lookupRetries, 0u);
+  ASSERT_GT(stats.splits, 1000u / FULLBUCKET / 2);
+  ASSERT_GT(stats.directoryDoublings, 0u);
+  ASSERT_LE(stats.directoryDoublings, stats.splits);
+  // Every insert writes its bucket, and every split two
+  ASSERT_EQ(stats.bucketWrites, 1000u + 2 * stats.splits);
+  // Every insert reads its bucket, again after a split, and every split reads one
+  ASSERT_EQ(stats.bucketReads, 1001u + 2 * stats.splits + 500u);
+  ASSERT_EQ(stats.poorHashFunction, 0u);
+  ASSERT_EQ(stats.insertLatency.count, 1001u);
+  ASSERT_EQ(stats.retrieveLatency.count, 500u);
+  ASSERT_EQ(stats.splitLatency.count, stats.splits);
+  ASSERT_GT(stats.insertLatency.Percentile(0.5), 0u);
+  ASSERT_GE(stats.insertLatency.max, stats.splitLatency.Percentile(0.5));
+
+  std::string json = stats.ToJSON();
+  ASSERT_EQ(json.front(), '{');
+  ASSERT_EQ(json.back(), '}');
+  ASSERT_NE(json.find("\"inserts\":1001,"), std::string::npos);
+  ASSERT_NE(json.find("\"retrieveLatencyNs\":{\"count\":500,"), std::string::npos);
+  ehf.Close();
+}
+
+TEST(EHFStats, ThreadsCountApart) {
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "unused";
+  ASSERT_TRUE(ehf.Open(filename, false));
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 200; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&ehf]() {
+      char readerKey[7];
+      char readerRecord[RECORDSIZE + 1];
+      for (int i = 0; i < 1000; i++) {
+        sprintf(readerKey, "%06d", i % 200);
+        ehf.RetrieveRecord(readerKey, readerRecord);
+      }
+    });
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  EHFStats stats = ehf.GetStats();
+  ASSERT_EQ(stats.inserts, 200u);
+  ASSERT_EQ(stats.retrieves, 4000u);
+  // Latencies are only kept when asked for
+  ASSERT_EQ(stats.retrieveLatency.count, 0u);
+  ASSERT_EQ(stats.insertLatency.count, 0u);
+
+  // Each file counts for itself
+  ExtendibleHashFile other(options);
+  ASSERT_TRUE(other.Open(filename, false));
+  ASSERT_EQ(other.GetStats().inserts, 0u);
+  other.Close();
+  ehf.Close();
+}
+
+TEST(EHFStats, ThreadsForgetFilesThatAreGone) {
+  EHFOptions options;
+  options.inMemory = true;
+  char filename[] = "unused";
+  char key[IDSIZE + 1] = "000001";
+  char record[RECORDSIZE + 1];
+  size_t before = EHFStatsCollector::CachedShards();
+  ExtendibleHashFile kept(options);
+  ASSERT_TRUE(kept.Open(filename, false));
+  kept.RetrieveRecord(key, record);
+  for (int i = 0; i < 1000; i++) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_TRUE(ehf.Open(filename, false));
+    ehf.RetrieveRecord(key, record);
+    // Back and forth, past the last shard kept apart
+    kept.RetrieveRecord(key, record);
+    ehf.RetrieveRecord(key, record);
+    ASSERT_EQ(ehf.GetStats().retrieves, 2u);
+    ehf.Close();
+  }
+  ASSERT_EQ(EHFStatsCollector::CachedShards(), before + 1);
+  ASSERT_EQ(kept.GetStats().retrieves, 1001u);
+
+  // Nor does another thread keep what it counted for a file gone
+  std::unique_ptr<ExtendibleHashFile> other(new ExtendibleHashFile(options));
+  ASSERT_TRUE(other->Open(filename, false));
+  size_t during = 0;
+  size_t after = 0;
+  std::mutex step;
+  std::condition_variable stepped;
+  int stage = 0;
+  std::thread counter([&]() {
+    char counterRecord[RECORDSIZE + 1];
+    other->RetrieveRecord(key, counterRecord);
+    kept.RetrieveRecord(key, counterRecord);
+    during = EHFStatsCollector::CachedShards();
+    std::unique_lock<std::mutex> lock(step);
+    stage = 1;
+    stepped.notify_all();
+    stepped.wait(lock, [&]() { return stage == 2; });
+    after = EHFStatsCollector::CachedShards();
+  });
+  {
+    std::unique_lock<std::mutex> lock(step);
+    stepped.wait(lock, [&]() { return stage == 1; });
+  }
+  other->Close();
+  other.reset();
+  {
+    std::lock_guard<std::mutex> lock(step);
+    stage = 2;
+  }
+  stepped.notify_all();
+  counter.join();
+  ASSERT_EQ(during, 2u);
+  ASSERT_EQ(after, 1u);
+  kept.Close();
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "ehfoptions.h"
+#include "ehftrace.h"
+#include "bucketfile.h"
+#include "extendiblehashfile.h"
+#include "numberedrecords.h"
+
+static long CountOf(const std::vector<EHFTraceEvent>& events, int type) {
+  long count = 0;
+  for (const EHFTraceEvent& event : events) {
+    count += (event.type == type) ? 1 : 0;
+  }
+  return count;
+}
+
+TEST(EHFTracer, KeepsTheNewestEventsInOrder) {
+  EHFTracer tracer(10);                       // Rounded up to 16
+  for (int i = 0; i < 5; i++) {
+    tracer.Record(EHF_TRACE_BUCKETREAD, i, 0);
+  }
+  std::vector<EHFTraceEvent> events = tracer.Events();
+  ASSERT_EQ(events.size(), 5u);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(events[i].first, i);
+    ASSERT_EQ(events[i].type, EHF_TRACE_BUCKETREAD);
+    ASSERT_GE(events[i].nanoseconds, events[0].nanoseconds);
+  }
+
+  for (int i = 5; i < 40; i++) {
+    tracer.Record(EHF_TRACE_BUCKETWRITE, i, 0);
+  }
+  events = tracer.Events();
+  ASSERT_EQ(tracer.Recorded(), 40u);
+  ASSERT_EQ(events.size(), 16u);
+  for (int i = 0; i < 16; i++) {
+    ASSERT_EQ(events[i].first, 24 + i);
+  }
+}
+
+TEST(EHFTracer, RecordsFromManyThreads) {
+  EHFTracer tracer(4096);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&tracer, t]() {
+      for (int i = 0; i < 1000; i++) {
+        tracer.Record(EHF_TRACE_BUCKETREAD, t, i);
+      }
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::vector<EHFTraceEvent> events = tracer.Events();
+  ASSERT_EQ(events.size(), 4000u);
+  // Each thread's events are in the order it recorded them, under a number of its own
+  std::vector<long> next(4, 0);
+  std::vector<int> threadOf(4, -1);
+  for (const EHFTraceEvent& event : events) {
+    ASSERT_EQ(event.second, next[event.first]++);
+    if (threadOf[event.first] < 0) {
+      threadOf[event.first] = event.thread;
+    }
+    ASSERT_EQ(event.thread, threadOf[event.first]);
+  }
+}
+
+TEST(EHFTracer, TracesSplitsAndIndexGrowth) {
+  EHFTracer tracer;
+  long callbacks = 0;
+  tracer.SetCallback([&callbacks](const EHFTraceEvent&) { callbacks++; });
+  char filename[] = "ehf-trace.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_TRUE(ehf.Open(filename, false));
+  ehf.SetTracer(&tracer);
+  InsertNumbered(ehf, 0, 1000);
+  char key[7] = "000123";
+  char record[RECORDSIZE+1];
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ehf.SetTracer(nullptr);
+  InsertNumbered(ehf, 1000, 1100);
+  ehf.Close();
+
+  std::vector<EHFTraceEvent> events = tracer.Events();
+  ASSERT_EQ(static_cast<long>(events.size()), callbacks);
+  long splits = CountOf(events, EHF_TRACE_SPLITBEGIN);
+  ASSERT_GT(splits, 1000 / FULLBUCKET);
+  ASSERT_EQ(CountOf(events, EHF_TRACE_SPLITEND), splits);
+  // Every insert reads its bucket, and writes it or splits it
+  ASSERT_EQ(CountOf(events, EHF_TRACE_BUCKETREAD), 1000 + 2 * splits + 1);
+  ASSERT_EQ(CountOf(events, EHF_TRACE_BUCKETWRITE), 1000 + 2 * splits);
+
+  long doublings = 0;
+  bool inSplit = false;
+  for (const EHFTraceEvent& event : events) {
+    if (event.type == EHF_TRACE_SPLITBEGIN) {
+      ASSERT_FALSE(inSplit);
+      inSplit = true;
+    } else if (event.type == EHF_TRACE_SPLITEND) {
+      ASSERT_TRUE(inSplit);
+      inSplit = false;
+    } else if (event.type == EHF_TRACE_INDEXGROW) {
+      ASSERT_TRUE(inSplit);
+      ASSERT_EQ(event.second, 2 * event.first);
+      doublings++;
+    }
+  }
+  ASSERT_GT(doublings, 0);
+  ASSERT_EQ(CountOf(events, EHF_TRACE_CACHEEVICT), 0);
+
+  std::string json = tracer.ToChromeTrace();
+  ASSERT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[{"), 0u);
+  ASSERT_EQ(json.substr(json.size() - 2), "]}");
+  ASSERT_NE(json.find("\"ph\":\"B\""), std::string::npos);
+  ASSERT_NE(json.find("\"name\":\"index doubled\""), std::string::npos);
+  ASSERT_NE(json.find("\"name\":\"bucket write\",\"ph\":\"X\""), std::string::npos);
+
+  char traceFilename[] = "ehf-trace.gtest.json";
+  ASSERT_TRUE(tracer.WriteChromeTrace(traceFilename));
+  FILE* file = fopen(traceFilename, "r");
+  ASSERT_NE(file, nullptr);
+  fseek(file, 0, SEEK_END);
+  ASSERT_EQ(ftell(file), static_cast<long>(json.size()));
+  fclose(file);
+}
+
+TEST(EHFTracer, TracesCacheEvictions) {
+  EHFOptions options;
+  options.directIO = true;
+  options.cachePages = CACHESHARDS;           // A frame a shard
+  EHFTracer tracer;
+  char filename[] = "ehf-trace.gtest";
+  ExtendibleHashFile ehf(options);
+  ASSERT_TRUE(ehf.Open(filename, false));
+  ehf.SetTracer(&tracer);
+  InsertNumbered(ehf, 0, 1000);
+  ehf.Close();
+  ASSERT_GT(CountOf(tracer.Events(), EHF_TRACE_CACHEEVICT), 0);
+  ASSERT_NE(tracer.ToChromeTrace().find("\"name\":\"cache eviction\""), std::string::npos);
+}
@@ -1,8 +1,22 @@
+#include <atomic>
+#include <chrono>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "gtest/gtest.h"
 
 #include "ehfconsts.h"
+#include "indexholder.h"
+#include "ehfcontainer.h"
+#include "ehfrecovery.h"
+#include "bucketfile.h"
+#include "ehfrecordview.h"
 #include "extendiblehashfile.h"
 
 TEST(EHFConstruction, SimpleOpenNewClose) {
@@ -123,3 +137,942 @@ TEST(EHFRetrieveForty, RetrieveFortyFromExpandedFile) {
   ehf = nullptr;
 }
 
+
+TEST(EHFConcurrency, ReadersDuringSplits) {
+  ExtendibleHashFile* ehf = new ExtendibleHashFile();
+  char filename[30];
+  strcpy(filename, "ehf-concurrent.gtest");
+  ASSERT_EQ(ehf->Open(filename, false), true);
+
+  // Records 0..99 are present before the readers start
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 100; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf->InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  std::atomic<bool> writing(true);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([ehf, &writing, &failures, t]() {
+      char readerKey[7];
+      char readerRecord[1024];
+      char expected[1024];
+      int i = t;
+      do {
+        sprintf(readerKey, "%06d", i % 100);
+        sprintf(expected, "%sRecord for %s", readerKey, readerKey);
+        if (ehf->RetrieveRecord(readerKey, readerRecord) != EHF_RETRIEVED ||
+            strcmp(expected, readerRecord) != 0) {
+          failures++;
+        }
+        i++;
+      } while (writing);
+    });
+  }
+
+  // Records 100..399 cause many splits and index doublings under the readers
+  for (int i = 100; i < 400; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf->InsertRecord(key, record), EHF_INSERTED);
+  }
+  writing = false;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(failures, 0);
+
+  ehf->Close();
+  delete ehf;
+  ehf = nullptr;
+}
+
+TEST(EHFCompactIndex, InsertWithCompactReopenWithArray) {
+  EHFOptions options;
+  options.indexType = EHF_INDEX_COMPACT;
+  ExtendibleHashFile* ehf = new ExtendibleHashFile(options);
+  char filename[30];
+  strcpy(filename, "ehf-compact.gtest");
+  ASSERT_EQ(ehf->Open(filename, false), true);
+
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf->InsertRecord(key, record), EHF_INSERTED);
+  }
+  ehf->Close();
+  delete ehf;
+
+  // The index files are the same either way, so the other index type can read it
+  ehf = new ExtendibleHashFile();
+  ASSERT_EQ(ehf->Open(filename), true);
+  char expected[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(expected, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf->RetrieveRecord(key, record), EHF_RETRIEVED);
+    ASSERT_EQ(strcmp(expected, record), 0);
+  }
+  ehf->Close();
+  delete ehf;
+
+  ehf = new ExtendibleHashFile(options);
+  ASSERT_EQ(ehf->Open(filename), true);
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    ASSERT_EQ(ehf->RetrieveRecord(key, record), EHF_RETRIEVED);
+  }
+  ehf->Close();
+  delete ehf;
+  ehf = nullptr;
+}
+
+TEST(EHFDurability, EveryModeKeepsRecords) {
+  int durabilities[] = { EHF_DURABILITY_NONE, EHF_DURABILITY_PERIODIC,
+                         EHF_DURABILITY_COMMIT, EHF_DURABILITY_PEROP };
+  int formats[] = { EHF_FORMAT_CONTAINER, EHF_FORMAT_TWOFILES };
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  char key[7];
+  char record[1024];
+  char expected[1024];
+  for (int format : formats) {
+    for (int durability : durabilities) {
+      EHFOptions options;
+      options.fileFormat = format;
+      options.durability = durability;
+      options.syncInterval = 5;
+      ExtendibleHashFile ehf(options);
+      ASSERT_EQ(ehf.Open(filename, false), true);
+      for (int i = 0; i < 300; i++) {
+        sprintf(key, "%06d", i);
+        sprintf(record, "%sRecord for %s", key, key);
+        ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+      }
+      ASSERT_EQ(ehf.Sync(), true);
+      ehf.Close();
+
+      ASSERT_EQ(ehf.Open(filename), true);
+      for (int i = 0; i < 300; i++) {
+        sprintf(key, "%06d", i);
+        sprintf(expected, "%sRecord for %s", key, key);
+        ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+        ASSERT_EQ(strcmp(expected, record), 0);
+      }
+      ehf.Close();
+    }
+  }
+}
+
+// The bucket count of the last commit of a container
+static int CommittedBuckets(char* containerFilename) {
+  EHFContainer container;
+  IndexHolder index;
+  if (!container.Open(containerFilename) ||
+      !container.LoadIndex(&index, EHF_OPEN_READINDEX)) {
+    return -1;
+  }
+  return container.BucketCount();
+}
+
+TEST(EHFDurability, SyncCommitsTheIndex) {
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  char containerFilename[30];
+  strcpy(containerFilename, "ehf-durability.gtest.eh");
+  ExtendibleHashFile ehf;
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  // Without a durability option, nothing is committed until asked
+  ASSERT_EQ(CommittedBuckets(containerFilename), 2);
+  ASSERT_EQ(ehf.Sync(), true);
+  ASSERT_GT(CommittedBuckets(containerFilename), 2);
+  ehf.Close();
+}
+
+TEST(EHFDurability, PeriodicCommitsTheIndex) {
+  EHFOptions options;
+  options.durability = EHF_DURABILITY_PERIODIC;
+  options.syncInterval = 5;
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  char containerFilename[30];
+  strcpy(containerFilename, "ehf-durability.gtest.eh");
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  int committed = 2;
+  for (int wait = 0; wait < 200 && committed <= 2; wait++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    committed = CommittedBuckets(containerFilename);
+  }
+  ASSERT_GT(committed, 2);
+  ehf.Close();
+}
+
+TEST(EHFDurability, SyncWritesTheIndexFile) {
+  EHFOptions options;
+  options.fileFormat = EHF_FORMAT_TWOFILES;
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ASSERT_EQ(ehf.Sync(), true);
+
+  // A second handle finds every record from the files alone
+  ExtendibleHashFile reader(options);
+  ASSERT_EQ(reader.Open(filename), true);
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    ASSERT_EQ(reader.RetrieveRecord(key, record), EHF_RETRIEVED);
+  }
+  reader.Close();
+  ehf.Close();
+}
+
+TEST(EHFDurability, CommitWritersShareSyncs) {
+  EHFOptions options;
+  options.durability = EHF_DURABILITY_COMMIT;
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename, false), true);
+
+  std::atomic<int> failures(0);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&ehf, &failures, t]() {
+      char writerKey[12];                     // Room for any int, as the compiler sees it
+      char writerRecord[1024];
+      for (int i = t * 100; i < (t + 1) * 100; i++) {
+        sprintf(writerKey, "%06d", i);
+        sprintf(writerRecord, "%sRecord for %s", writerKey, writerKey);
+        if (ehf.InsertRecord(writerKey, writerRecord) != EHF_INSERTED) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  ASSERT_EQ(failures, 0);
+
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 400; i++) {
+    sprintf(key, "%06d", i);
+    ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  }
+  ehf.Close();
+}
+
+// Each update, swap and modify is synced before it returns, under the options that
+// promise that
+TEST(EHFDurability, UpdatesAreDurableOnReturn) {
+  int durabilities[] = { EHF_DURABILITY_NONE, EHF_DURABILITY_COMMIT,
+                         EHF_DURABILITY_PEROP };
+  char filename[30];
+  strcpy(filename, "ehf-durability.gtest");
+  char key[7];
+  char record[1024];
+  char callCode[] = "QA999.99 Z99";
+  for (int durability : durabilities) {
+    EHFOptions options;
+    options.durability = durability;
+    ExtendibleHashFile ehf(options);
+    ASSERT_EQ(ehf.Open(filename, false), true);
+    for (int i = 0; i < 300; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    }
+    uint64_t expectedSyncs = (durability == EHF_DURABILITY_NONE) ? 0 : 1;
+    for (int i = 0; i < 300; i += 3) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sUpdated %s", key, key);
+      uint64_t syncs = ehf.GetStats().syncs;
+      ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_UPDATED);
+      ASSERT_EQ(ehf.GetStats().syncs - syncs, expectedSyncs);
+      syncs = ehf.GetStats().syncs;
+      ASSERT_EQ(ehf.UpdateField(key, CALLCODEPOSITION, CALLCODESIZE, callCode),
+                EHF_UPDATED);
+      ASSERT_EQ(ehf.GetStats().syncs - syncs, expectedSyncs);
+      syncs = ehf.GetStats().syncs;
+      ASSERT_EQ(ehf.UpsertRecord(key, record), EHF_UPDATED);
+      ASSERT_EQ(ehf.GetStats().syncs - syncs, expectedSyncs);
+      char expected[1024];
+      char desired[1024];
+      ASSERT_EQ(ehf.RetrieveRecord(key, expected), EHF_RETRIEVED);
+      sprintf(desired, "%sSwapped %s", key, key);
+      syncs = ehf.GetStats().syncs;
+      ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_UPDATED);
+      ASSERT_EQ(ehf.GetStats().syncs - syncs, expectedSyncs);
+      syncs = ehf.GetStats().syncs;
+      int result = ehf.Modify(key, [](char* r) { r[IDSIZE] = 'M'; return true; });
+      ASSERT_EQ(result, EHF_UPDATED);
+      ASSERT_EQ(ehf.GetStats().syncs - syncs, expectedSyncs);
+      // Nothing written, nothing to wait for
+      syncs = ehf.GetStats().syncs;
+      result = ehf.Modify(key, [](char*) { return false; });
+      ASSERT_EQ(result, EHF_UNCHANGED);
+      ASSERT_EQ(ehf.GetStats().syncs, syncs);
+    }
+    ehf.Close();
+  }
+}
+
+TEST(EHFDirectIO, InsertReopenRetrieveWithSmallCache) {
+  EHFOptions options;
+  options.directIO = true;
+  options.cachePages = 16;
+  char filename[30];
+  strcpy(filename, "ehf-direct.gtest");
+  char containerFilename[30];
+  strcpy(containerFilename, "ehf-direct.gtest.eh");
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  char expected[1024];
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ehf.Close();
+
+  // Every page is aligned for direct I/O
+  EHFContainer container;
+  ASSERT_TRUE(container.Open(containerFilename));
+  ASSERT_EQ(container.PageSize(), DIRECTALIGN);
+  container.Close();
+
+  // Without directIO, the same file opens as usual
+  EHFOptions buffered;
+  int reopens[] = { 0, 1, 2 };
+  for (int reopen : reopens) {
+    ExtendibleHashFile table((reopen == 1) ? buffered : options);
+    if (reopen == 2) {
+      ASSERT_TRUE(RebuildIndex(filename));
+    }
+    ASSERT_EQ(table.Open(filename), true);
+    for (int i = 0; i < 1000; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(expected, "%sRecord for %s", key, key);
+      ASSERT_EQ(table.RetrieveRecord(key, record), EHF_RETRIEVED);
+      ASSERT_EQ(strcmp(expected, record), 0);
+    }
+    table.Close();
+  }
+}
+
+TEST(EHFGet, ViewsRecordsInEveryMode) {
+  // A handle, not a buffer: a copied record lives apart from the view
+  ASSERT_LT(sizeof(EHFRecordView), 64u);
+  EHFOptions buffered;
+  EHFOptions direct;
+  direct.directIO = true;
+  EHFOptions smallCache(direct);
+  smallCache.cachePages = 16;
+  EHFOptions modes[] = { buffered, direct, smallCache };
+  char filename[30];
+  strcpy(filename, "ehf-get.gtest");
+  char key[7];
+  char record[1024];
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_EQ(ehf.Open(filename, false), true);
+    for (int i = 0; i < 500; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    }
+
+    EHFRecordView view;
+    for (int i = 0; i < 500; i++) {
+      sprintf(key, "%06d", i);
+      ASSERT_EQ(ehf.Get(key, view), EHF_RETRIEVED);
+      ASSERT_EQ(view.Size(), RECORDSIZE);
+      ASSERT_EQ(memcmp(view.Data(), key, IDSIZE), 0);
+      ASSERT_EQ(memcmp(view.Data() + TITLEPOSITION, "Record for ", 11), 0);
+    }
+    strcpy(key, "999999");
+    ASSERT_EQ(ehf.Get(key, view), EHF_NOT_PRESENT);
+    ASSERT_EQ(view.Data(), nullptr);
+    ASSERT_EQ(view.Size(), 0);
+
+    // A view outlasts splits of its bucket, and moves with its record
+    strcpy(key, "000007");
+    ASSERT_EQ(ehf.Get(key, view), EHF_RETRIEVED);
+    for (int i = 500; i < 1000; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    }
+    EHFRecordView moved(std::move(view));
+    ASSERT_EQ(view.Data(), nullptr);
+    ASSERT_EQ(memcmp(moved.Data(), "000007Record for 000007", 23), 0);
+    view = std::move(moved);
+    ASSERT_EQ(memcmp(view.Data(), "000007Record for 000007", 23), 0);
+    view.Release();
+    ASSERT_EQ(view.Data(), nullptr);
+
+    sprintf(key, "%06d", 999);
+    ASSERT_EQ(ehf.Get(key, view), EHF_RETRIEVED);
+    view.Release();
+    ehf.Close();
+  }
+}
+
+TEST(EHFInMemory, NoFilesUntilPersisted) {
+  char filename[30];
+  strcpy(filename, "ehf-memory.gtest");
+  unlink("ehf-memory.gtest.eh");
+  EHFOptions options;
+  options.inMemory = true;
+  options.durability = EHF_DURABILITY_PEROP;
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename), true);
+  char key[7];
+  char record[1024];
+  char expected[1024];
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ASSERT_EQ(ehf.InsertRecord(key, record), EHF_ALREADY_PRESENT);
+  ASSERT_TRUE(ehf.Sync());
+  EHFRecordView view;
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(expected, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+    ASSERT_EQ(strcmp(expected, record), 0);
+    ASSERT_EQ(ehf.Get(key, view), EHF_RETRIEVED);
+    ASSERT_EQ(memcmp(view.Data(), expected, strlen(expected)), 0);
+  }
+  view.Release();
+  ASSERT_NE(access("ehf-memory.gtest.eh", F_OK), 0);
+  ASSERT_NE(access("ehf-memory.gtest.ehf", F_OK), 0);
+
+  // Persisted, the table opens from disc, and carries on in memory
+  ASSERT_TRUE(ehf.Persist(filename));
+  for (int i = 1000; i < 1200; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ehf.Close();
+
+  ExtendibleHashFile onDisc;
+  ASSERT_EQ(onDisc.Open(filename), true);
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(expected, "%sRecord for %s", key, key);
+    ASSERT_EQ(onDisc.RetrieveRecord(key, record), EHF_RETRIEVED);
+    ASSERT_EQ(strcmp(expected, record), 0);
+  }
+  strcpy(key, "001100");
+  ASSERT_EQ(onDisc.RetrieveRecord(key, record), EHF_NOT_PRESENT);
+  ASSERT_FALSE(onDisc.Persist(filename));
+  onDisc.Close();
+
+  // Persisting writes every bucket's pattern too, so the index can be rebuilt
+  ASSERT_TRUE(RebuildIndex(filename));
+  ASSERT_EQ(onDisc.Open(filename), true);
+  strcpy(key, "000999");
+  ASSERT_EQ(onDisc.RetrieveRecord(key, record), EHF_RETRIEVED);
+  onDisc.Close();
+}
+
+TEST(EHFInMemory, FailedPersistKeepsTheTableOnDisc) {
+  char filename[30];
+  strcpy(filename, "ehf-persist.gtest");
+  unlink("ehf-persist.gtest.eh");
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename), true);
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ASSERT_TRUE(ehf.Persist(filename));
+  for (int i = 300; i < 600; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  // The new container cannot be written, so the one there stays
+  rmdir("ehf-persist.gtest.eh~");
+  ASSERT_EQ(mkdir("ehf-persist.gtest.eh~", 0700), 0);
+  ASSERT_FALSE(ehf.Persist(filename));
+  ASSERT_EQ(rmdir("ehf-persist.gtest.eh~"), 0);
+  ehf.Close();
+
+  ExtendibleHashFile onDisc;
+  ASSERT_EQ(onDisc.Open(filename), true);
+  for (int i = 0; i < 600; i++) {
+    sprintf(key, "%06d", i);
+    ASSERT_EQ(onDisc.RetrieveRecord(key, record),
+              (i < 300) ? EHF_RETRIEVED : EHF_NOT_PRESENT);
+  }
+  onDisc.Close();
+}
+
+TEST(EHFInMemory, ReadersDuringSplits) {
+  EHFOptions options;
+  options.inMemory = true;
+  ExtendibleHashFile ehf(options);
+  char filename[] = "unused";
+  ASSERT_EQ(ehf.Open(filename, false), true);
+
+  // Records 0..99 are present before the readers start
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 100; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  std::atomic<bool> writing(true);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&ehf, &writing, &failures, t]() {
+      char readerKey[7];
+      char readerRecord[1024];
+      char expected[1024];
+      int i = t;
+      do {
+        sprintf(readerKey, "%06d", i % 100);
+        sprintf(expected, "%sRecord for %s", readerKey, readerKey);
+        if (ehf.RetrieveRecord(readerKey, readerRecord) != EHF_RETRIEVED ||
+            strcmp(expected, readerRecord) != 0) {
+          failures++;
+        }
+        i++;
+      } while (writing);
+    });
+  }
+
+  // New chunks of the arena are added under the readers as well
+  for (int i = 100; i < 1500; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  writing = false;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(failures, 0);
+  ehf.Close();
+}
+
+TEST(EHFRetrieveBatch, MatchesRetrieveRecord) {
+  EHFOptions onDisc;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions compact;
+  compact.indexType = EHF_INDEX_COMPACT;
+  EHFOptions modes[] = { onDisc, inMemory, compact };
+  char filename[30];
+  strcpy(filename, "ehf-batch.gtest");
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_EQ(ehf.Open(filename, false), true);
+    char key[7];
+    char record[1024];
+    for (int i = 0; i < 1000; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    }
+
+    // Every other key is missing
+    const int count = 300;
+    std::vector<std::string> keys(count);
+    std::vector<char*> keyPointers(count);
+    std::vector<std::vector<char>> records(count, std::vector<char>(RECORDSIZE + 1));
+    std::vector<char*> recordPointers(count);
+    std::vector<int> results(count);
+    for (int i = 0; i < count; i++) {
+      sprintf(key, "%06d", (i % 2 == 0) ? i * 3 : 5000 + i);
+      keys[i] = key;
+      keyPointers[i] = &keys[i][0];
+      recordPointers[i] = records[i].data();
+    }
+    for (int groupSize : { 1, 7, BATCHGROUP, MAXBATCHGROUP + 10 }) {
+      ASSERT_EQ(ehf.RetrieveBatch(count, keyPointers.data(), recordPointers.data(),
+                                  results.data(), groupSize), count / 2);
+      for (int i = 0; i < count; i++) {
+        ASSERT_EQ(results[i], ehf.RetrieveRecord(keyPointers[i], record));
+        if (results[i] == EHF_RETRIEVED) {
+          ASSERT_EQ(strcmp(recordPointers[i], record), 0);
+        }
+      }
+    }
+    ehf.Close();
+    ASSERT_EQ(ehf.RetrieveBatch(1, keyPointers.data(), recordPointers.data(),
+                                results.data()), 0);
+    ASSERT_EQ(results[0], EHF_FILENOTOPEN);
+  }
+}
+
+TEST(EHFUpdate, UpdateUpsertAndUpdateFieldInEveryMode) {
+  EHFOptions container;
+  EHFOptions twoFiles;
+  twoFiles.fileFormat = EHF_FORMAT_TWOFILES;
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  EHFOptions direct;
+  direct.directIO = true;
+  EHFOptions modes[] = { container, twoFiles, inMemory, direct };
+  char filename[30];
+  strcpy(filename, "ehf-update.gtest");
+  for (EHFOptions& options : modes) {
+    ExtendibleHashFile ehf(options);
+    ASSERT_EQ(ehf.Open(filename, false), true);
+    char key[7];
+    char record[1024];
+    char expected[1024];
+    for (int i = 0; i < 500; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+    }
+
+    // One bucket read and one write each, and the key is kept whatever the record says
+    EHFStats before = ehf.GetStats();
+    for (int i = 0; i < 500; i += 2) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "XXXXXXUpdated %s", key);
+      ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_UPDATED);
+    }
+    EHFStats after = ehf.GetStats();
+    ASSERT_EQ(after.bucketReads - before.bucketReads, 250u);
+    ASSERT_EQ(after.bucketWrites - before.bucketWrites, 250u);
+    ASSERT_EQ(after.updates - before.updates, 250u);
+    sprintf(key, "%06d", 700);
+    ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_NOT_PRESENT);
+
+    // Present keys are updated, new ones inserted, splitting as need be
+    for (int i = 400; i < 800; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sUpserted %s", key, key);
+      ASSERT_EQ(ehf.UpsertRecord(key, record), EHF_UPDATED);
+    }
+    ASSERT_EQ(ehf.GetStats().updates - after.updates, 100u);
+
+    char callCode[] = "QA999.99 Z99";
+    sprintf(key, "%06d", 11);
+    ASSERT_EQ(ehf.UpdateField(key, CALLCODEPOSITION, CALLCODESIZE, callCode), EHF_UPDATED);
+    ASSERT_EQ(ehf.UpdateField(key, IDPOSITION, IDSIZE, callCode), EHF_BADFIELD);
+    ASSERT_EQ(ehf.UpdateField(key, CALLCODEPOSITION, CALLCODESIZE + 1, callCode),
+              EHF_BADFIELD);
+
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < 800; i++) {
+        sprintf(key, "%06d", i);
+        if (i >= 400) {
+          sprintf(expected, "%sUpserted %s", key, key);
+        } else if (i % 2 == 0) {
+          sprintf(expected, "%sUpdated %s", key, key);
+        } else {
+          sprintf(expected, "%sRecord for %s", key, key);
+        }
+        if (i == 11) {
+          memcpy(expected + CALLCODEPOSITION, callCode, CALLCODESIZE);
+        }
+        ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+        ASSERT_EQ(strncmp(expected, record, RECORDSIZE), 0) << "key " << i;
+      }
+      if (options.inMemory) {
+        break;
+      }
+      ehf.Close();
+      ASSERT_EQ(ehf.Open(filename), true);
+    }
+    ehf.Close();
+    ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_FILENOTOPEN);
+  }
+}
+
+TEST(EHFModify, CompareAndSwapAndModify) {
+  char filename[30];
+  strcpy(filename, "ehf-modify.gtest");
+  ExtendibleHashFile ehf;
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  // Whole records are compared, past any '\0', so the buffers start out clear
+  char record[1024] = {};
+  for (int i = 0; i < 300; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  char expected[1024] = {};
+  char desired[1024] = {};
+  sprintf(key, "%06d", 42);
+  sprintf(expected, "%sRecord for %s", key, key);
+  sprintf(desired, "%sSwapped %s", key, key);
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_UPDATED);
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ASSERT_STREQ(record, desired);
+
+  // A stale expectation fails, and is given the record as it now is to retry with
+  sprintf(desired, "%sSwapped again %s", key, key);
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_MISMATCH);
+  ASSERT_EQ(memcmp(expected, record, RECORDSIZE), 0);
+  ASSERT_EQ(expected[RECORDSIZE], '\0');
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_UPDATED);
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ASSERT_STREQ(record, desired);
+
+  // The key stays whatever the function does to it, and declining writes nothing
+  sprintf(key, "%06d", 7);
+  int result = ehf.Modify(key, [](char* r) { memset(r, 'X', RECORDSIZE); return true; });
+  ASSERT_EQ(result, EHF_UPDATED);
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ASSERT_EQ(strncmp(record, "000007XXXX", 10), 0);
+  EHFStats before = ehf.GetStats();
+  result = ehf.Modify(key, [](char* r) { r[IDSIZE] = 'Y'; return false; });
+  ASSERT_EQ(result, EHF_UNCHANGED);
+  EHFStats after = ehf.GetStats();
+  ASSERT_EQ(after.bucketReads - before.bucketReads, 1u);
+  ASSERT_EQ(after.bucketWrites, before.bucketWrites);
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ASSERT_EQ(record[IDSIZE], 'X');
+
+  // A '\0' ending an earlier field does not hide a change to a later one
+  sprintf(key, "%06d", 43);
+  memset(record, ' ', RECORDSIZE);
+  memcpy(record, key, IDSIZE);
+  record[IDSIZE + 5] = '\0';
+  record[RECORDSIZE] = '\0';
+  ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_UPDATED);
+  ASSERT_EQ(ehf.RetrieveRecord(key, expected), EHF_RETRIEVED);
+  char callCode[] = "QA999.99 Z99";
+  ASSERT_EQ(ehf.UpdateField(key, CALLCODEPOSITION, CALLCODESIZE, callCode), EHF_UPDATED);
+  memcpy(desired, expected, RECORDSIZE + 1);
+  desired[IDSIZE] = 'D';
+  memset(expected + RECORDSIZE, 'Z', 8);
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_MISMATCH);
+  ASSERT_EQ(memcmp(expected + CALLCODEPOSITION, callCode, CALLCODESIZE), 0);
+  ASSERT_EQ(expected[RECORDSIZE], '\0');
+  memcpy(desired + CALLCODEPOSITION, callCode, CALLCODESIZE);
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_UPDATED);
+  ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+  ASSERT_EQ(memcmp(record, desired, RECORDSIZE), 0);
+
+  sprintf(key, "%06d", 500);
+  result = ehf.Modify(key, [](char*) { return true; });
+  ASSERT_EQ(result, EHF_NOT_PRESENT);
+  ASSERT_EQ(ehf.CompareAndSwap(key, expected, desired), EHF_NOT_PRESENT);
+  ehf.Close();
+  result = ehf.Modify(key, [](char*) { return true; });
+  ASSERT_EQ(result, EHF_FILENOTOPEN);
+}
+
+TEST(EHFModify, ContendedCounters) {
+  char filename[30];
+  strcpy(filename, "ehf-modify.gtest");
+  ExtendibleHashFile ehf;
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  const int counters = 8;
+  const int bumps = 400;
+  char key[7];
+  char record[1024];
+  for (int c = 0; c < counters; c++) {
+    sprintf(key, "%06d", c);
+    sprintf(record, "%s%010d", key, 0);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  // Two threads bump every counter with Modify, two with CompareAndSwap loops, while
+  // another inserts, splitting the buckets the counters are in
+  std::vector<std::thread> threads;
+  std::atomic<int> failures(0);
+  for (int t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&ehf, &failures, t, counters, bumps]() {
+      char key[7];
+      for (int b = 0; b < bumps; b++) {
+        sprintf(key, "%06d", (b + t) % counters);
+        if (t % 2 == 0) {
+          int result = ehf.Modify(key, [](char* r) {
+            sprintf(r + IDSIZE, "%010d", atoi(r + IDSIZE) + 1);
+            return true;
+          });
+          failures += (result != EHF_UPDATED);
+          continue;
+        }
+        char expected[RECORDSIZE+1];
+        char desired[RECORDSIZE+1];
+        if (ehf.RetrieveRecord(key, expected) != EHF_RETRIEVED) {
+          failures++;
+          continue;
+        }
+        int result;
+        do {
+          memset(desired, '\0', sizeof(desired));
+          sprintf(desired, "%s%010d", key, atoi(expected + IDSIZE) + 1);
+          result = ehf.CompareAndSwap(key, expected, desired);
+        } while (result == EHF_MISMATCH);
+        failures += (result != EHF_UPDATED);
+      }
+    }));
+  }
+  threads.push_back(std::thread([&ehf, &failures, counters]() {
+    char key[7];
+    char record[1024];
+    for (int i = counters; i < 1200; i++) {
+      sprintf(key, "%06d", i);
+      sprintf(record, "%sRecord for %s", key, key);
+      failures += (ehf.InsertRecord(key, record) != EHF_INSERTED);
+    }
+  }));
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(failures.load(), 0);
+
+  int total = 0;
+  for (int c = 0; c < counters; c++) {
+    sprintf(key, "%06d", c);
+    ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+    total += atoi(record + IDSIZE);
+  }
+  ASSERT_EQ(total, 4 * bumps);
+  ehf.Close();
+}
+
+// Make writes to path fail by putting a read only descriptor in place of every one open
+// on it. Returns each descriptor with a copy of what it was, for RestoreWrites.
+static std::vector< std::pair<int, int> > BreakWrites(const char* path) {
+  std::vector< std::pair<int, int> > broken;
+  struct stat wanted;
+  if (stat(path, &wanted) != 0) {
+    return broken;
+  }
+  std::vector<int> open;
+  for (int fd = 3; fd < 1024; fd++) {
+    struct stat status;
+    if ( (fstat(fd, &status) == 0) && (status.st_dev == wanted.st_dev) &&
+         (status.st_ino == wanted.st_ino) ) {
+      open.push_back(fd);
+    }
+  }
+  for (int fd : open) {
+    int readOnly = ::open(path, O_RDONLY);
+    broken.push_back( std::make_pair(fd, dup(fd)) );
+    dup2(readOnly, fd);
+    close(readOnly);
+  }
+  return broken;
+}
+
+static void RestoreWrites(std::vector< std::pair<int, int> >& broken) {
+  for (std::pair<int, int>& fd : broken) {
+    dup2(fd.second, fd.first);
+    close(fd.second);
+  }
+  broken.clear();
+}
+
+TEST(EHFWriteErrors, EveryWritePathReportsAFailedWrite) {
+  char filename[] = "ehf-writeerror.gtest";
+  ExtendibleHashFile ehf;
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  // Too few records to fill a bucket
+  for (int i = 0; i < 4; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+
+  std::vector< std::pair<int, int> > broken = BreakWrites("ehf-writeerror.gtest.eh");
+  ASSERT_FALSE(broken.empty());
+  sprintf(key, "%06d", 1);
+  sprintf(record, "%sUpdated %s", key, key);
+  ASSERT_EQ(ehf.UpdateRecord(key, record), EHF_WRITEERROR);
+  ASSERT_EQ(ehf.UpsertRecord(key, record), EHF_WRITEERROR);
+  sprintf(key, "%06d", 4);
+  sprintf(record, "%sRecord for %s", key, key);
+  ASSERT_EQ(ehf.InsertRecord(key, record), EHF_WRITEERROR);
+  ASSERT_EQ(ehf.UpsertRecord(key, record), EHF_WRITEERROR);
+  RestoreWrites(broken);
+  ehf.Close();
+}
+
+TEST(EHFWriteErrors, FailedShadowSplitIsReported) {
+  char filename[] = "ehf-writeerror.gtest";
+  EHFOptions options;
+  options.shadowSplits = true;
+  ExtendibleHashFile ehf(options);
+  ASSERT_EQ(ehf.Open(filename, false), true);
+  // A table in memory, filled the same way, finds the first key to split a bucket
+  EHFOptions inMemory;
+  inMemory.inMemory = true;
+  ExtendibleHashFile twin(inMemory);
+  ASSERT_EQ(twin.Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  int i = 0;
+  for ( ; i < 1000; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    uint64_t splits = twin.GetStats().splits;
+    ASSERT_EQ(twin.InsertRecord(key, record), EHF_INSERTED);
+    if (twin.GetStats().splits != splits) {
+      break;
+    }
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+  ASSERT_LT(i, 1000);
+  twin.Close();
+
+  // The split cannot be committed, so the insert must not go on as if it had been
+  std::vector< std::pair<int, int> > broken = BreakWrites("ehf-writeerror.gtest.eh");
+  ASSERT_FALSE(broken.empty());
+  uint64_t splits = ehf.GetStats().splits;
+  ASSERT_EQ(ehf.InsertRecord(key, record), EHF_WRITEERROR);
+  ASSERT_EQ(ehf.GetStats().splits, splits + 1);
+  RestoreWrites(broken);
+  ehf.Close();
+}
@@ -2,6 +2,9 @@
 
 #include "indexholder.h"
 
+#include <unistd.h>
+#include <fcntl.h>
+
 TEST(IndexHolderConstruction, DepthOfOne) {
   int depth = 1;
   IndexHolder ih(depth);
@@ -95,3 +98,67 @@ TEST(IndexholderDynamism, DecreaseDepthFrom3to2heap) {
   delete ih;
   ih = nullptr;
 }
+
+TEST(IndexholderLazyDoubling, IncreaseDepthDefersToBuddies) {
+  IndexHolder ih(1);
+  ih.SetAddress(0, 3);
+  ih.SetAddress(1, 7);
+  ih.CopyMirrors(100);
+  ASSERT_EQ(ih.MirrorsPending(), 0);
+  ih.IncreaseDepth();
+  ih.IncreaseDepth();
+  // Nothing has been copied, yet every slot reports its buddy's address
+  ASSERT_EQ(ih.MirrorsPending(), 6);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(ih.GetAddress(i), (i % 2 == 0) ? 3 : 7);
+  }
+  ASSERT_EQ(ih.CopyMirrors(4), 4);
+  ASSERT_EQ(ih.MirrorsPending(), 2);
+  ASSERT_EQ(ih.CopyMirrors(100), 2);
+  ASSERT_EQ(ih.CopyMirrors(100), 0);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(ih.GetAddress(i), (i % 2 == 0) ? 3 : 7);
+  }
+}
+
+TEST(IndexholderLazyDoubling, SetAddressKeepsDeferringSlots) {
+  IndexHolder ih(1);
+  ih.SetAddress(0, 3);
+  ih.SetAddress(1, 7);
+  ih.IncreaseDepth();
+  ih.IncreaseDepth();
+  // Slots 2, 4 and 6 defer (directly or not) to slot 0, and must not follow it
+  ih.SetAddress(0, 9);
+  ih.SetAddress(5, 11);
+  int expected[] = {9, 7, 3, 7, 3, 11, 3, 7};
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(ih.GetAddress(i), expected[i]);
+  }
+  ih.CopyMirrors(100);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(ih.GetAddress(i), expected[i]);
+  }
+  ASSERT_EQ(ih.DecreaseDepth(), false);
+}
+
+TEST(IndexholderLazyDoubling, WriteAndLoadUnfilledIndex) {
+  IndexHolder* ih = new IndexHolder(1);
+  ih->SetAddress(1, 5);
+  ih->IncreaseDepth();
+  ih->IncreaseDepth();
+  ih->SetAddress(6, 2);
+  int fd = open("indexholder.gtest", O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ASSERT_TRUE(ih->Write(fd));
+  delete ih;
+  ih = new IndexHolder();
+  ASSERT_TRUE(ih->Load(fd));
+  ASSERT_EQ(ih->GetDepth(), 3);
+  ASSERT_EQ(ih->MirrorsPending(), 0);
+  int expected[] = {0, 5, 0, 5, 0, 5, 2, 5};
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(ih->GetAddress(i), expected[i]);
+  }
+  delete ih;
+  ih = nullptr;
+  close(fd);
+}
@@ -0,0 +1,58 @@
+#include <string.h>
+
+#include <vector>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "memorybucketstore.h"
+
+TEST(MemoryBucketStore, ReadsWhatWasWritten) {
+  MemoryBucketStore store;
+  char bucket[BUCKETSIZE];
+  ASSERT_EQ(store.Read(0, bucket, BUCKETSIZE), EHF_READERROR);
+  ASSERT_EQ(store.Pages(), 0);
+
+  // Pages either side of each chunk boundary
+  std::vector<int> pages = { 0, 1, MEMORYFIRSTCHUNK - 1, MEMORYFIRSTCHUNK,
+                             3 * MEMORYFIRSTCHUNK - 1, 3 * MEMORYFIRSTCHUNK, 5000 };
+  for (int page : pages) {
+    memset(bucket, page % 251, sizeof(bucket));
+    ASSERT_EQ(store.Write(page, bucket, BUCKETSIZE), EHF_WROTEOK);
+  }
+  for (int page : pages) {
+    ASSERT_EQ(store.Read(page, bucket, BUCKETSIZE), EHF_READOK);
+    ASSERT_EQ(bucket[0], static_cast<char>(page % 251));
+    ASSERT_EQ(bucket[BUCKETSIZE - 1], static_cast<char>(page % 251));
+  }
+  // Pages in an allocated chunk read as zeroes until written
+  ASSERT_EQ(store.Read(2, bucket, BUCKETSIZE), EHF_READOK);
+  ASSERT_EQ(bucket[0], 0);
+  ASSERT_GE(store.Pages(), 5001);
+  ASSERT_EQ(store.Read(-1, bucket, BUCKETSIZE), EHF_READERROR);
+}
+
+TEST(MemoryBucketStore, WriteToLaysPagesOutInOrder) {
+  MemoryBucketStore store;
+  char bucket[BUCKETSIZE];
+  int pages = 4 * MEMORYFIRSTCHUNK;
+  for (int page = 0; page < pages; page++) {
+    memset(bucket, 'a' + page % 26, sizeof(bucket));
+    ASSERT_EQ(store.Write(page, bucket, BUCKETSIZE), EHF_WROTEOK);
+  }
+  int fd = open("memorybucketstore.gtest", O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(store.WriteTo(fd, 100, pages));
+  ASSERT_EQ(lseek(fd, 0, SEEK_END), 100 + pages * BUCKETSIZE);
+  for (int page = 0; page < pages; page++) {
+    ASSERT_EQ(pread(fd, bucket, BUCKETSIZE, 100 + page * BUCKETSIZE), BUCKETSIZE);
+    ASSERT_EQ(bucket[0], 'a' + page % 26);
+    ASSERT_EQ(bucket[BUCKETSIZE - 1], 'a' + page % 26);
+  }
+  close(fd);
+  unlink("memorybucketstore.gtest");
+}
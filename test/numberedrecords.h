@@ -0,0 +1,52 @@
+/*
+=========================================================================================
+Name    | Numbered records                                                              |
+Purpose | The table most tests fill: key i is i in IDSIZE digits, and its record is the |
+        | key, then "Record for " and the key again                                     |
+=========================================================================================
+*/
+#ifndef _NuMbErEdReCoRdS__
+#define _NuMbErEdReCoRdS__
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "records.h"
+#include "extendiblehashfile.h"
+
+// key has room for IDSIZE+1 chars
+inline void NumberedKey(int i, char* key) {
+  snprintf(key, IDSIZE + 1, "%06d", i);
+}
+
+// record has room for RECORDSIZE+1 chars
+inline void NumberedRecord(const char* key, char* record) {
+  snprintf(record, RECORDSIZE + 1, "%sRecord for %s", key, key);
+}
+
+inline void InsertNumbered(ExtendibleHashFile& ehf, int from, int to) {
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  for (int i = from; i < to; i++) {
+    NumberedKey(i, key);
+    NumberedRecord(key, record);
+    ASSERT_EQ(ehf.InsertRecord(key, record), EHF_INSERTED);
+  }
+}
+
+inline void RetrieveNumbered(ExtendibleHashFile& ehf, int from, int to) {
+  char key[IDSIZE+1];
+  char record[RECORDSIZE+1];
+  char expected[RECORDSIZE+1];
+  for (int i = from; i < to; i++) {
+    NumberedKey(i, key);
+    NumberedRecord(key, expected);
+    ASSERT_EQ(ehf.RetrieveRecord(key, record), EHF_RETRIEVED);
+    ASSERT_EQ(strcmp(expected, record), 0);
+  }
+}
+
+#endif
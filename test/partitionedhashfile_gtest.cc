@@ -0,0 +1,68 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "ehfconsts.h"
+#include "partitionedhashfile.h"
+
+TEST(PartitionedConstruction, OpenNewCloseReopen) {
+  PartitionedHashFile* phf = new PartitionedHashFile(4, 1);
+  ASSERT_EQ(phf->IsOpen(), false);
+  char filename[30];
+  strcpy(filename, "phf.gtest");
+  ASSERT_EQ(phf->Open(filename, false), true);
+  ASSERT_EQ(phf->IsOpen(), true);
+  phf->Close();
+  ASSERT_EQ(phf->IsOpen(), false);
+  ASSERT_EQ(phf->Open(filename), true);
+  phf->Close();
+  strcpy(filename, "phf.gtest-fail");
+  ASSERT_EQ(phf->Open(filename), false);
+  delete phf;
+  phf = nullptr;
+}
+
+TEST(PartitionedRouting, KeysSpreadOverAllPartitions) {
+  PartitionedHashFile phf(4, 1);
+  int counts[4] = {0, 0, 0, 0};
+  char key[7];
+  for (int i = 0; i < 400; i++) {
+    sprintf(key, "%06d", i);
+    int partition = phf.Partition(key);
+    ASSERT_GE(partition, 0);
+    ASSERT_LT(partition, 4);
+    counts[partition]++;
+  }
+  for (int p = 0; p < 4; p++) {
+    ASSERT_GT(counts[p], 0);
+  }
+}
+
+TEST(PartitionedInsertAndRetrieve, InsertReopenRetrieve) {
+  PartitionedHashFile* phf = new PartitionedHashFile(4, 2);
+  char filename[30];
+  strcpy(filename, "phf.gtest");
+  ASSERT_EQ(phf->Open(filename, false), true);
+  char key[7];
+  char record[1024];
+  for (int i = 0; i < 200; i++) {
+    sprintf(key, "%06d", i);
+    sprintf(record, "%sRecord for %s", key, key);
+    ASSERT_EQ(phf->InsertRecord(i % 2, key, record), EHF_INSERTED);
+  }
+  ASSERT_EQ(phf->InsertRecord(0, key, record), EHF_ALREADY_PRESENT);
+  phf->Close();
+
+  ASSERT_EQ(phf->Open(filename), true);
+  for (int i = 0; i < 200; i++) {
+    sprintf(key, "%06d", i);
+    std::string expected = std::string(key) + "Record for " + key;
+    ASSERT_EQ(phf->RetrieveRecord(i % 2, key, record), EHF_RETRIEVED);
+    ASSERT_EQ(strcmp(expected.data(), record), 0);
+  }
+  strcpy(key, "999999");
+  ASSERT_EQ(phf->RetrieveRecord(0, key, record), EHF_NOT_PRESENT);
+  phf->Close();
+  delete phf;
+  phf = nullptr;
+}